@@ -30,7 +30,10 @@ GeneRaxArguments::GeneRaxArguments(int iargc, char * iargv[]):
   reconcile(true),
   buildSuperMatrix(false),
   reconciliationSamples(0),
+  reconciliationArchive(false),
   maxSPRRadius(5),
+  residentGeneTrees(false),
+  measuredCostBalancing(false),
   recWeight(1.0), 
   seed(123),
   filterFamilies(true),
@@ -41,6 +44,7 @@ GeneRaxArguments::GeneRaxArguments(int iargc, char * iargv[]):
   speciesSPRRadius(DEFAULT_SPECIES_SPR_RADIUS),
   speciesSmallRootRadius(DEFAULT_SPECIES_SMALL_ROOT_RADIUS),
   speciesBigRootRadius(DEFAULT_SPECIES_BIG_ROOT_RADIUS),
+  speciesThreads(1),
   minGeneBranchLength(0.000001),
   quartetSupport(false),
   quartetSupportAllQuartets(false),
@@ -114,6 +118,8 @@ void GeneRaxArguments::init() {
       recWeight = atof(argv[++i]);
     } else if (arg == "--reconciliation-samples") {
       reconciliationSamples = static_cast<unsigned int>(atoi(argv[++i]));
+    } else if (arg == "--reconciliation-archive") {
+      reconciliationArchive = true;
     /**
      * Gene tree correction
      */
@@ -130,6 +136,10 @@ void GeneRaxArguments::init() {
       supportThreshold = static_cast<double>(atof(argv[++i]));
     } else if (arg == "--max-spr-radius") {
       maxSPRRadius = static_cast<unsigned int>(atoi(argv[++i]));
+    } else if (arg == "--resident-gene-trees") {
+      residentGeneTrees = true;
+    } else if (arg == "--measured-cost-balancing") {
+      measuredCostBalancing = true;
     /**
      *  Species tree inference
      */
@@ -141,6 +151,8 @@ void GeneRaxArguments::init() {
       speciesSmallRootRadius = static_cast<unsigned int>(atoi(argv[++i]));
     } else if (arg == "--si-big-root-radius") {
       speciesBigRootRadius = static_cast<unsigned int>(atoi(argv[++i]));
+    } else if (arg == "--si-threads") {
+      speciesThreads = static_cast<unsigned int>(atoi(argv[++i]));
     } else if (arg == "--si-constrained-search") {
       constrainSpeciesSearch = true;
     } else if (arg == "--si-estimate-bl") {
@@ -206,10 +218,18 @@ void GeneRaxArguments::checkInputs() {
     Logger::info << "[Error] You cannot use per-family and per-species rates at the same time" << std::endl;
     ok = false;
   }
+  if (speciesThreads < 1) {
+    Logger::info << "[Error] The number of species tree search threads should be at least 1" << std::endl;
+    ok = false;
+  }
   if (!ArgumentsHelper::isValidRecModel(reconciliationModelStr)) {
     Logger::info << "[Error] Invalid reconciliation model string " << reconciliationModelStr << std::endl;
     ok = false;
   }
+  if (reconciliationArchive && buildSuperMatrix) {
+    Logger::info << "[Error] The supermatrix cannot be built from archived reconciliations" << std::endl;
+    ok = false;
+  }
   if (!ok) {
     Logger::info << "Aborting." << std::endl;
     ParallelContext::abort(1);
@@ -221,7 +241,7 @@ void GeneRaxArguments::checkInputs() {
 
 void GeneRaxArguments::printHelp() {
   Logger::info << "-h, --help" << std::endl;
-  Logger::info << "-f, --families <FAMILIES_INFORMATION>" << std::endl;
+  Logger::info << "-f, --families <FAMILIES_INFORMATION> (families file, or family bundle built with familybundle)" << std::endl;
   Logger::info << "-s, --species-tree <SPECIES TREE>" << std::endl;
   Logger::info << "--strategy <STRATEGY>  {EVAL, SPR}" << std::endl;
   Logger::info << "-r --rec-model <reconciliationModel>  {UndatedDL, UndatedDTL, Auto}" << std::endl;
@@ -234,10 +254,14 @@ void GeneRaxArguments::printHelp() {
   Logger::info << "--loss-rate <loss rate>" << std::endl;
   Logger::info << "--transfer-rate <transfer rate>" << std::endl;
   Logger::info << "--max-spr-radius <max SPR radius>" << std::endl;
+  Logger::info << "--resident-gene-trees" << std::endl;
+  Logger::info << "--measured-cost-balancing" << std::endl;
   Logger::info << "--rec-weight <reconciliation likelihood weight>" << std::endl;
   Logger::info << "--do-not-reconcile" << std::endl;
   Logger::info << "--reconciliation-samples <number of samples>" << std::endl;
+  Logger::info << "--reconciliation-archive" << std::endl;
   Logger::info << "--seed <seed>" << std::endl;
+  Logger::info << "--si-threads <threads per rank> (species tree search, initial species tree inference and reconciliation)" << std::endl;
   Logger::info << "Please find more information on the GeneRax github wiki" << std::endl;
   Logger::info << std::endl;
 
@@ -263,10 +287,14 @@ void GeneRaxArguments::printSummary() {
   Logger::info << "- You are running GeneRax without MPI (no parallelization)" << std::endl;
 #endif
   Logger::info << "- Random seed: " << seed << std::endl;
+  Logger::info << "- Threads per rank (species tree inference and reconciliation): " <<  speciesThreads << std::endl;
   Logger::info << "- Reconciliation model: " << reconciliationModelStr << std::endl;
   if (reconciliationSamples) {
     Logger::info << "- Reconciliation samples: " << reconciliationSamples << std::endl;
   }
+  if (reconciliationArchive) {
+    Logger::info << "- Reconciliation files written to per-rank archives" << std::endl;
+  }
   Logger::info << "- DTL rates: "; 
   if (perSpeciesDTLRates) {
     Logger::info << "per species rates" << std::endl;
@@ -293,6 +321,8 @@ void GeneRaxArguments::printSummary() {
     Logger::info << "Gene tree correction information:" << std::endl;  
     Logger::info << "- Gene tree strategy: " << ArgumentsHelper::strategyToStr(strategy) << std::endl;
     Logger::info << "- Max gene SPR radius: " << maxSPRRadius << std::endl;
+    Logger::info << "- Resident gene trees: " << boolStr[residentGeneTrees] << std::endl;
+    Logger::info << "- Measured cost balancing: " << boolStr[measuredCostBalancing] << std::endl;
     Logger::info << std::endl;
   }
 }
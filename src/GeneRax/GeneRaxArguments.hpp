@@ -41,7 +41,10 @@ public:
    bool reconcile;
    bool buildSuperMatrix;
    unsigned int reconciliationSamples;
+   bool reconciliationArchive;
    unsigned int maxSPRRadius;
+   bool residentGeneTrees;
+   bool measuredCostBalancing;
    double recWeight;
    int seed;
    bool filterFamilies;
@@ -56,6 +59,9 @@ public:
    unsigned int speciesSPRRadius;
    unsigned int speciesSmallRootRadius;
    unsigned int speciesBigRootRadius;
+   // threads per rank for the species tree search, the initial
+   // species tree inference and the reconciliation (--si-threads)
+   unsigned int speciesThreads;
    double minGeneBranchLength;
    bool quartetSupport;
    bool quartetSupportAllQuartets;
@@ -19,6 +19,7 @@
 #include <NJ/Cherry.hpp>
 #include <NJ/CherryPro.hpp>
 #include <parallelization/Scheduler.hpp>
+#include <routines/GeneTreeWorkerPool.hpp>
 #include <routines/Routines.hpp>
 #include <optimizers/SpeciesTreeOptimizer.hpp>
 #include <trees/SpeciesTree.hpp>
@@ -51,7 +52,8 @@ static void initStartingSpeciesTree(GeneRaxInstance &instance)
   } else {
     Routines::computeInitialSpeciesTree(instance.currentFamilies,
         instance.args.output,
-        instance.args.speciesTreeAlgorithm)->save(instance.speciesTree);
+        instance.args.speciesTreeAlgorithm,
+        instance.args.speciesThreads)->save(instance.speciesTree);
 
   }
   ParallelContext::barrier();
@@ -143,7 +145,10 @@ void GeneRaxCore::generateFakeAlignments(GeneRaxInstance &instance)
     family.libpllModel = "GTR";
     if (coreFamilies.find(family.name) != coreFamilies.end()) {
       // generate the MSA
-      PLLUnrootedTree tree(family.startingGeneTree);
+      std::vector<pll_utree_t *> trees;
+      Family::readStartingGeneTrees(family, trees, 1);
+      assert(trees.size());
+      PLLUnrootedTree tree(trees[0]);
       std::ofstream os(family.alignmentFile);
       for (auto leaf: tree.getLeaves()) {
         os << ">" << leaf->label << std::endl << "ACGT" << std::endl;
@@ -168,6 +173,16 @@ void GeneRaxCore::printStats(GeneRaxInstance &instance)
 }
 
 
+/**
+ *  The measured family costs, or null if the families should be
+ *  distributed according to their sizes
+ */
+static FamilyCosts *getFamilyCosts(GeneRaxInstance &instance)
+{
+  return instance.args.measuredCostBalancing ? 
+    &instance.familyCosts : nullptr;
+}
+
 static void speciesTreeSearchAux(GeneRaxInstance &instance, int samples)
 {
   Families saveFamilies = instance.currentFamilies;
@@ -183,13 +198,15 @@ static void speciesTreeSearchAux(GeneRaxInstance &instance, int samples)
   searchParams.sprRadius = instance.args.speciesSPRRadius;
   searchParams.rootSmallRadius = instance.args.speciesSmallRootRadius;
   searchParams.rootBigRadius = instance.args.speciesBigRootRadius;
+  searchParams.threads = instance.args.speciesThreads;
   SpeciesTreeOptimizer speciesTreeOptimizer(instance.speciesTree, 
       instance.currentFamilies, 
       instance.getRecModelInfo(), 
       startingRates, 
       instance.args.userDTLRates, 
       instance.args.output, 
-      searchParams);
+      searchParams,
+      getFamilyCosts(instance));
   if (instance.args.speciesSPRRadius > 0) {
     Logger::info << std::endl;
     Logger::timed << "Start optimizing the species tree with fixed gene trees (on " 
@@ -225,15 +242,24 @@ void GeneRaxCore::geneTreeJointSearch(GeneRaxInstance &instance)
       instance.args.strategy == GeneSearchStrategy::RECONCILE) {
     return;
   }
+  std::unique_ptr<GeneTreeWorkerPool> workers;
+  if (instance.args.residentGeneTrees) {
+    workers = std::make_unique<GeneTreeWorkerPool>(instance.speciesTree,
+        instance.recModelInfo,
+        RecOpt::Grid,
+        instance.args.madRooting,
+        instance.args.supportThreshold,
+        instance.args.recWeight);
+  }
   for (unsigned int i = 1; i <= instance.args.recRadius; ++i) { 
     bool enableLibpll = false;
     bool perSpeciesDTLRates = false;
-    optimizeRatesAndGeneTrees(instance, perSpeciesDTLRates, enableLibpll, i);
+    optimizeRatesAndGeneTrees(instance, perSpeciesDTLRates, enableLibpll, i, workers.get());
   }
   for (unsigned int i = 1; i <= instance.args.maxSPRRadius; ++i) {
     bool enableLibpll = true;
     bool perSpeciesDTLRates = instance.args.perSpeciesDTLRates && (i >= instance.args.maxSPRRadius - 1); // only apply per-species optimization at the two last rounds
-    optimizeRatesAndGeneTrees(instance, perSpeciesDTLRates, enableLibpll, i);
+    optimizeRatesAndGeneTrees(instance, perSpeciesDTLRates, enableLibpll, i, workers.get());
   }
   ModelParameters modelRates(instance.rates,
       1,
@@ -291,7 +317,10 @@ void GeneRaxCore::reconcile(GeneRaxInstance &instance)
         instance.args.output, 
         instance.args.reconcile,
         instance.args.reconciliationSamples, 
-        optimizeRates);
+        optimizeRates,
+        instance.args.reconciliationArchive,
+        instance.args.speciesThreads,
+        getFamilyCosts(instance));
     if (instance.args.buildSuperMatrix) {
       std::string outputSuperMatrixAll = FileSystem::joinPaths(
           instance.args.output, "superMatrixAll.fasta");
@@ -371,7 +400,8 @@ void GeneRaxCore::initialGeneTreeSearch(GeneRaxInstance &instance)
 void GeneRaxCore::optimizeRatesAndGeneTrees(GeneRaxInstance &instance,
     bool perSpeciesDTLRates,
     bool enableLibpll,
-    unsigned int sprRadius)
+    unsigned int sprRadius,
+    GeneTreeWorkerPool *workers)
 {
   assert(ParallelContext::isRandConsistent());
   long elapsed = 0;
@@ -383,7 +413,8 @@ void GeneRaxCore::optimizeRatesAndGeneTrees(GeneRaxInstance &instance,
         instance.currentFamilies, 
         perSpeciesDTLRates, 
         instance.rates, 
-        instance.elapsedRates);
+        instance.elapsedRates,
+        getFamilyCosts(instance));
     if (!instance.args.perFamilyDTLRates && !instance.args.perSpeciesDTLRates) {
       auto paramNames = Enums::parameterNames(instance.recModelInfo.model);
       Logger::info << "\t";
@@ -402,25 +433,41 @@ void GeneRaxCore::optimizeRatesAndGeneTrees(GeneRaxInstance &instance,
   }
   Logger::timed << "Optimizing " + additionalMsg + "gene trees with radius=" << sprRadius << "... " << std::endl; 
   const bool enableRecLL = true;
-  Routines::optimizeGeneTrees(instance.currentFamilies, 
-      instance.recModelInfo, 
-      instance.rates, 
-      instance.args.output, 
-      "results", 
-      instance.args.execPath, 
-      instance.speciesTree, 
-      RecOpt::Grid, 
-      instance.args.madRooting,
-      instance.args.supportThreshold, 
-      instance.args.recWeight, 
-      enableRecLL, 
-      enableLibpll, 
-      sprRadius, 
-      instance.currentIteration++, 
-      ParallelContext::allowSchedulerSplitImplementation(), 
-      elapsed);
+  if (workers) {
+    workers->optimizeGeneTrees(instance.currentFamilies,
+        instance.rates,
+        instance.args.output,
+        "results",
+        enableRecLL,
+        enableLibpll,
+        sprRadius,
+        elapsed);
+    instance.currentIteration++;
+  } else {
+    Routines::optimizeGeneTrees(instance.currentFamilies, 
+        instance.recModelInfo, 
+        instance.rates, 
+        instance.args.output, 
+        "results", 
+        instance.args.execPath, 
+        instance.speciesTree, 
+        RecOpt::Grid, 
+        instance.args.madRooting,
+        instance.args.supportThreshold, 
+        instance.args.recWeight, 
+        enableRecLL, 
+        enableLibpll, 
+        sprRadius, 
+        instance.currentIteration++, 
+        ParallelContext::allowSchedulerSplitImplementation(), 
+        elapsed);
+  }
   instance.elapsedSPR += elapsed;
-  Routines::gatherLikelihoods(instance.currentFamilies, instance.totalLibpllLL, instance.totalRecLL);
+  if (workers) {
+    workers->gatherLikelihoods(instance.totalLibpllLL, instance.totalRecLL);
+  } else {
+    Routines::gatherLikelihoods(instance.currentFamilies, instance.totalLibpllLL, instance.totalRecLL);
+  }
   Logger::info << "\tJointLL=" << instance.totalLibpllLL + instance.totalRecLL 
     << " RecLL=" << instance.totalRecLL << " LibpllLL=" << instance.totalLibpllLL << std::endl;
   Logger::info << std::endl;
@@ -435,7 +482,8 @@ void GeneRaxCore::speciesTreeBLEstimation(GeneRaxInstance &instance)
   ReconciliationBLEstimator::estimate(
       instance.speciesTree,
       instance.currentFamilies,
-      instance.modelParameters);
+      instance.modelParameters,
+      getFamilyCosts(instance));
   ParallelContext::barrier();
 }
 
@@ -1,5 +1,6 @@
 
 class GeneRaxInstance;
+class GeneTreeWorkerPool;
 
 
 /**
@@ -77,10 +78,13 @@ private:
 
   /*
    *  Generic gene tree search  
+   *  If workers is not null, the gene trees are optimized by
+   *  the resident workers instead of the scheduler
    */
   static void optimizeRatesAndGeneTrees(GeneRaxInstance &instance,
     bool perSpeciesDTLRates,
     bool enableLibpll,
-    unsigned int sprRadius);
+    unsigned int sprRadius,
+    GeneTreeWorkerPool *workers);
 
 };
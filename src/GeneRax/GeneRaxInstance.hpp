@@ -15,6 +15,9 @@ struct GeneRaxInstance {
   Families currentFamilies;
   RecModelInfo recModelInfo;
   Parameters rates;
+  // measured reconciliation evaluation cost of each family, 
+  // only filled with --measured-cost-balancing
+  FamilyCosts familyCosts;
   ModelParameters modelParameters;
   double totalLibpllLL;
   double totalRecLL;
@@ -0,0 +1,53 @@
+#include <iostream>
+#include <string>
+
+#include <IO/FileArchive.hpp>
+#include <routines/SlavesMain.hpp>
+
+/**
+ *  Hack for fix a link error
+ */
+int unused(int argc, char** argv)
+{
+  return static_scheduled_main(argc, argv, 0);
+}
+
+static void printSyntax()
+{
+  std::cerr << "Error: syntax is one of" << std::endl;
+  std::cerr << "./extractarchive list archive" << std::endl;
+  std::cerr << "./extractarchive cat archive file_name" << std::endl;
+  std::cerr << "./extractarchive extract archive output_dir" << std::endl;
+}
+
+/**
+ *  Read the archives written by GeneRax with --reconciliation-archive
+ */
+int main(int argc, char** argv)
+{
+  if (argc < 3) {
+    printSyntax();
+    return 1;
+  }
+  std::string command(argv[1]);
+  std::string archive(argv[2]);
+  if (command == "list" && argc == 3) {
+    for (auto &name: FileArchive::list(archive)) {
+      std::cout << name << std::endl;
+    }
+  } else if (command == "cat" && argc == 4) {
+    std::string content;
+    if (!FileArchive::readFile(archive, argv[3], content)) {
+      std::cerr << "Error: cannot find " << argv[3] << " in " << archive << std::endl;
+      return 1;
+    }
+    std::cout << content;
+  } else if (command == "extract" && argc == 4) {
+    auto entries = FileArchive::extract(archive, argv[3]);
+    std::cerr << "Extracted " << entries << " entries" << std::endl;
+  } else {
+    printSyntax();
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,45 @@
+#include <iostream>
+#include <string>
+
+#include <IO/FamiliesFileParser.hpp>
+#include <IO/FamilyBundle.hpp>
+#include <IO/Logger.hpp>
+#include <parallelization/ParallelContext.hpp>
+#include <routines/SlavesMain.hpp>
+
+/**
+ *  Hack for fix a link error
+ */
+int unused(int argc, char** argv)
+{
+  return static_scheduled_main(argc, argv, 0);
+}
+
+/**
+ *  Convert a GeneRax families file into a family bundle,
+ *  that can be passed to GeneRax with --families
+ */
+int main(int argc, char** argv)
+{
+  if (argc != 3) {
+    std::cerr << "Error: syntax is ./familybundle families_file output_bundle" << std::endl;
+    return 1;
+  }
+  std::string familiesFile(argv[1]);
+  std::string bundleFile(argv[2]);
+#ifdef WITH_MPI
+  ParallelContext::init(0);
+#else
+  int noMPIComm = -1;
+  ParallelContext::init(&noMPIComm);
+#endif
+  Logger::init();
+  auto families = FamiliesFileParser::parseFamiliesFile(familiesFile);
+  Logger::timed << "Building a bundle from " << families.size() 
+    << " families..." << std::endl;
+  FamilyBundle::write(families, bundleFile);
+  Logger::timed << "End of the bundle construction" << std::endl;
+  Logger::close();
+  ParallelContext::finalize();
+  return 0;
+}
@@ -21,8 +21,8 @@ int unused(int argc, char** argv)
 int main(int argc, char** argv)
 {
 
-  if (argc != 5) {
-    std::cerr << "Error: syntax is ./njrax algorithm input_gene_trees mapping_file output_species_tree " << std::endl;
+  if (argc != 5 && argc != 6) {
+    std::cerr << "Error: syntax is ./njrax algorithm input_gene_trees mapping_file output_species_tree [threads]" << std::endl;
     std::cerr << "Possible algorithms are [MiniNJ, Cherry, NJst]" << std::endl;
     std::cerr << "The mapping file should have one of the two following syntaxes:" << std::endl;
    std::cerr << std::endl;
@@ -41,6 +41,8 @@ int main(int argc, char** argv)
   std::string inputGeneTrees(argv[a++]);
   std::string inputMappingFile(argv[a++]);
   std::string outputSpeciesTree(argv[a++]);
+  unsigned int threads = (argc == 6) ?
+    static_cast<unsigned int>(atoi(argv[a++])) : 1;
 
   // let's hack to use GeneRax core interface
   Families families;
@@ -52,7 +54,8 @@ int main(int argc, char** argv)
   std::string fakeOutputDir = "njrax_output";
   auto speciesTree(Routines::computeInitialSpeciesTree(families, 
         fakeOutputDir,
-        speciesTreeAlgorithm));
+        speciesTreeAlgorithm,
+        threads));
   speciesTree->save(outputSpeciesTree);
   return 0;
 }
@@ -4,6 +4,7 @@
 #include <IO/ParallelOfstream.hpp>
 #include <IO/FileSystem.hpp>
 #include <IO/GeneSpeciesMapping.hpp>
+#include <IO/LibpllParsers.hpp>
 #include <algorithm>
 #include <trees/PLLRootedTree.hpp>
 #include <parallelization/PerCoreGeneTrees.hpp>
@@ -136,6 +137,26 @@ static FamilyErrorCode filterFamily(const FamilyInfo &family, const std::unorder
   return ERROR_OK;
 }
 
+/**
+ *  Only the species tree dependent checks of filterFamily, 
+ *  for families that were already validated when building
+ *  a family bundle
+ */
+static FamilyErrorCode filterValidatedFamily(const FamilyInfo &family, 
+    const std::unordered_set<std::string> &speciesTreeLabels)
+{
+  if (!speciesTreeLabels.size()) {
+    return ERROR_OK;
+  }
+  for (auto &species: family.coveredSpecies) {
+    if (speciesTreeLabels.find(species) == speciesTreeLabels.end()) {
+      std::cerr << "[Error] Invalid mapping: can't find the species " << species << " in the species tree" << std::endl;
+      return ERROR_MAPPING_MISMATCH;
+    }
+  }
+  return ERROR_OK;
+}
+
 void Family::filterFamilies(Families &families, const std::string &speciesTreeFile, bool checkAlignments, bool checkSpeciesTree)
 {
   ParallelContext::barrier();
@@ -166,7 +187,11 @@ void Family::filterFamilies(Families &families, const std::string &speciesTreeFi
   std::vector<unsigned int> errors;
   for (auto i = ParallelContext::getBegin(initialFamilySize); i < ParallelContext::getEnd(initialFamilySize); i ++) {
     auto &family = copy[i];
-    localErrors[i - ParallelContext::getBegin(initialFamilySize)]  = filterFamily(family, speciesTreeLabels, checkAlignments); 
+    bool validated = family.validated 
+      && (family.alignmentValidated || !checkAlignments);
+    localErrors[i - ParallelContext::getBegin(initialFamilySize)]  = validated ?
+      filterValidatedFamily(family, speciesTreeLabels) :
+      filterFamily(family, speciesTreeLabels, checkAlignments); 
   }
   ParallelContext::concatenateUIntVectors(localErrors, errors);
   errors.erase(remove(errors.begin(), errors.end(), 99999999), errors.end());
@@ -193,6 +218,56 @@ void Family::filterFamilies(Families &families, const std::string &speciesTreeFi
   Random::setSeed(consistentSeed);
 }
 
+void Family::readStartingGeneTrees(const FamilyInfo &family,
+    std::vector<pll_utree_t *> &trees,
+    unsigned int maxTrees)
+{
+  auto &packed = family.packedGeneTree;
+  if (packed.packs(family.startingGeneTree)) {
+    LibpllParsers::readNewicksFromBuffer(packed.data.get(), packed.size,
+        family.startingGeneTree, trees, maxTrees);
+  } else {
+    LibpllParsers::readNewicksFromFile(family.startingGeneTree,
+        trees, maxTrees);
+  }
+}
+
+void Family::getStartingGeneTreeContent(const FamilyInfo &family,
+    std::string &content)
+{
+  auto &packed = family.packedGeneTree;
+  if (packed.packs(family.startingGeneTree)) {
+    content.assign(packed.data.get(), packed.size);
+  } else {
+    FileSystem::getFileContent(family.startingGeneTree, content);
+  }
+}
+
+void Family::fillMapping(const FamilyInfo &family,
+    GeneSpeciesMapping &mapping)
+{
+  if (family.mappingFile.size()) {
+    auto &packed = family.packedMapping;
+    if (packed.packs(family.mappingFile)) {
+      mapping.fillFromMappingBuffer(packed.data.get(), packed.size);
+    } else {
+      mapping.fill(family.mappingFile, "");
+    }
+  } else if (family.packedGeneTree.packs(family.startingGeneTree)) {
+    // the mapping is deduced from the labels of the first tree
+    std::vector<pll_utree_t *> trees;
+    readStartingGeneTrees(family, trees, 1);
+    if (trees.empty()) {
+      throw LibpllException("Error while reading tree (file is empty) from file: ",
+          family.startingGeneTree);
+    }
+    PLLUnrootedTree geneTree(trees[0]);
+    mapping.fillFromGeneLabels(geneTree.getLabels());
+  } else {
+    mapping.fill("", family.startingGeneTree);
+  }
+}
+
 
 
   
@@ -234,11 +309,19 @@ void Family::printStats(Families &families,
 
 
   // gather parallel values
-  ParallelContext::sumUInt(totalGeneNumber);
   ParallelContext::maxUInt(maxGeneNumber);
+  std::vector<unsigned int> counts;
+  for (const auto &species: speciesLabels) {
+    counts.push_back(perSpeciesCoveringFamilies[species]);
+    counts.push_back(perSpeciesGenes[species]);
+  }
+  counts.push_back(totalGeneNumber);
+  ParallelContext::sumVectorUInt(counts);
+  totalGeneNumber = counts.back();
+  auto it = counts.begin();
   for (const auto &species: speciesLabels) {
-    ParallelContext::sumUInt(perSpeciesCoveringFamilies[species]);
-    ParallelContext::sumUInt(perSpeciesGenes[species]);
+    perSpeciesCoveringFamilies[species] = *it++;
+    perSpeciesGenes[species] = *it++;
     totalSpeciesCoverage += perSpeciesCoveringFamilies[species];
     if (minSpeciesCoverage > perSpeciesCoveringFamilies[species]) {
       minSpeciesCoverage = perSpeciesCoveringFamilies[species];
@@ -1,9 +1,30 @@
 #pragma once
 
+#include <cstddef>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+typedef struct pll_utree_s pll_utree_t;
+class GeneSpeciesMapping;
 
+/**
+ *  Content of a family file packed in a family bundle
+ *  (see IO/FamilyBundle.hpp). data points into the bundle,
+ *  which stays mapped as long as it is referenced.
+ */
+struct PackedFile {
+  // the path of the packed file: the content is only used
+  // while the family still references this path
+  std::string path;
+  std::shared_ptr<const char> data;
+  size_t size;
+  PackedFile(): size(0) {}
+  bool packs(const std::string &filePath) const {
+    return data && filePath == path;
+  }
+};
 
 struct FamilyInfo {
   std::string name;
@@ -13,6 +34,25 @@ struct FamilyInfo {
   std::string libpllModel;
   std::string statsFile;
   unsigned int color;
+  // metadata precomputed in a family bundle (see IO/FamilyBundle.hpp)
+  // number of genes (0 if unknown)
+  unsigned int geneNumber;
+  // alignment dimensions: number of sites, of taxa and of
+  // non-gap characters (0 if unknown)
+  unsigned int alignmentSites;
+  unsigned int alignmentTaxa;
+  unsigned int alignmentCharacters;
+  // the family passed the species tree independent checks
+  // of Family::filterFamilies (alignmentValidated: including
+  // the alignment checks)
+  bool validated;
+  bool alignmentValidated;
+  // the species covered by the genes of a validated family
+  std::vector<std::string> coveredSpecies;
+  // the starting gene tree and mapping files, if packed
+  // in the family bundle
+  PackedFile packedGeneTree;
+  PackedFile packedMapping;
   FamilyInfo() {
     reset();
   }
@@ -24,15 +64,51 @@ struct FamilyInfo {
     libpllModel = "GTR";
     statsFile = "";
     color = 0;
+    geneNumber = 0;
+    alignmentSites = 0;
+    alignmentTaxa = 0;
+    alignmentCharacters = 0;
+    validated = false;
+    alignmentValidated = false;
+    coveredSpecies.clear();
+    packedGeneTree = PackedFile();
+    packedMapping = PackedFile();
   }
 };
 
 typedef std::vector<FamilyInfo> Families;
 
+/**
+ *  Measured cost of each family, indexed with the family names
+ *  (see PerCoreGeneTrees)
+ */
+typedef std::unordered_map<std::string, double> FamilyCosts;
+
 class Family {
 public:
   Family() = delete;
   static void filterFamilies(Families &families, const std::string &speciesTreeFile, bool checkAlignments, bool checkSpeciesTree);
+  /**
+   *  Append the first maxTrees starting gene trees of a family
+   *  (all of them if maxTrees is 0) to trees. They are parsed in
+   *  place if the starting gene tree file is packed in the family
+   *  bundle, and read from the file otherwise.
+   */
+  static void readStartingGeneTrees(const FamilyInfo &family,
+      std::vector<pll_utree_t *> &trees,
+      unsigned int maxTrees = 0);
+  /**
+   *  Fill content with the starting gene tree file of a family
+   *  (from the family bundle if it is packed)
+   */
+  static void getStartingGeneTreeContent(const FamilyInfo &family,
+      std::string &content);
+  /**
+   *  Same as mapping.fill(family.mappingFile, family.startingGeneTree),
+   *  reading the files packed in the family bundle if any
+   */
+  static void fillMapping(const FamilyInfo &family,
+      GeneSpeciesMapping &mapping);
   static void printStats(Families &families, const std::string &speciesTreeFile, const std::string &coverageFile, const std::string &fractionMissingFile);
 };
 
@@ -2,6 +2,7 @@
 #include <fstream>
 #include <algorithm>
 #include <IO/Logger.hpp>
+#include <IO/FamilyBundle.hpp>
 #include <parallelization/ParallelContext.hpp>
 
 enum FFPStep {
@@ -42,6 +43,9 @@ static bool update_family(const std::string &line,
 
 Families FamiliesFileParser::parseFamiliesFile(const std::string &familiesFile)
 {
+  if (FamilyBundle::isBundle(familiesFile)) {
+    return FamilyBundle::read(familiesFile);
+  }
   Families families;
   std::ifstream reader(familiesFile);
   std::string line;
@@ -9,5 +9,9 @@
 class FamiliesFileParser {
 public:
   FamiliesFileParser() = delete;
+  /**
+   *  Parse a families file, or a family bundle 
+   *  (see IO/FamilyBundle.hpp)
+   */
   static Families parseFamiliesFile(const std::string &familiesFile);
 };
@@ -0,0 +1,544 @@
+#include "FamilyBundle.hpp"
+
+#include <IO/FileSystem.hpp>
+#include <IO/GeneSpeciesMapping.hpp>
+#include <IO/LibpllParsers.hpp>
+#include <IO/Logger.hpp>
+#include <parallelization/ParallelContext.hpp>
+#include <trees/PLLUnrootedTree.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char BUNDLE_MAGIC[8] = {'G', 'R', 'X', 'B', 'U', 'N', 'D', 'L'};
+static const uint32_t BUNDLE_VERSION = 2;
+
+static const uint32_t FAMILY_VALIDATED = 1;
+static const uint32_t FAMILY_ALIGNMENT_VALIDATED = 2;
+static const uint32_t FAMILY_GENE_TREE_PACKED = 4;
+static const uint32_t FAMILY_MAPPING_PACKED = 8;
+
+struct BundleHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t familiesNumber;
+  uint32_t speciesNumber;
+  uint32_t coveredSpeciesNumber;
+  uint64_t familiesOffset;
+  uint64_t speciesOffset;
+  uint64_t coveredSpeciesOffset;
+  uint64_t stringsOffset;
+  uint64_t size;
+};
+
+// offset relative to the strings section
+struct BundleString {
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct BundleFamily {
+  BundleString name;
+  BundleString startingGeneTree;
+  BundleString alignmentFile;
+  BundleString mappingFile;
+  BundleString libpllModel;
+  // the content of the starting gene tree and mapping files
+  BundleString geneTreePayload;
+  BundleString mappingPayload;
+  uint32_t geneNumber;
+  uint32_t alignmentSites;
+  uint32_t alignmentTaxa;
+  uint32_t alignmentCharacters;
+  uint32_t flags;
+  uint32_t coveredSpeciesBegin;
+  uint32_t coveredSpeciesNumber;
+};
+
+static_assert(sizeof(BundleHeader) == 64, "Unexpected bundle header padding");
+static_assert(sizeof(BundleFamily) == 144, "Unexpected bundle family padding");
+
+static void bundleError(const std::string &bundlePath,
+    const std::string &message)
+{
+  Logger::error << "Error when reading the family bundle " << bundlePath
+    << ": " << message << std::endl;
+  ParallelContext::abort(1);
+}
+
+bool FamilyBundle::isBundle(const std::string &path)
+{
+  std::ifstream is(path, std::ios::binary);
+  char magic[sizeof(BUNDLE_MAGIC)];
+  if (!is.read(magic, sizeof(magic))) {
+    return false;
+  }
+  return !memcmp(magic, BUNDLE_MAGIC, sizeof(magic));
+}
+
+Families FamilyBundle::read(const std::string &bundlePath)
+{
+  Families families;
+  int fd = open(bundlePath.c_str(), O_RDONLY);
+  if (fd < 0) {
+    bundleError(bundlePath, "cannot open the file");
+    return families;
+  }
+  struct stat st;
+  if (fstat(fd, &st) || static_cast<size_t>(st.st_size) < sizeof(BundleHeader)) {
+    close(fd);
+    bundleError(bundlePath, "the file is too small");
+    return families;
+  }
+  auto fileSize = static_cast<size_t>(st.st_size);
+  void *data = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    bundleError(bundlePath, "cannot map the file");
+    return families;
+  }
+  auto base = static_cast<const char *>(data);
+  // the packed files reference the mapping, which is released
+  // with the last of them
+  std::shared_ptr<const char> bundleData(base, [fileSize](const char *p) {
+      munmap(const_cast<char *>(p), fileSize);
+  });
+  BundleHeader header;
+  memcpy(&header, base, sizeof(header));
+  bool ok = !memcmp(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC))
+    && header.version == BUNDLE_VERSION
+    && header.size == fileSize
+    && header.familiesOffset + header.familiesNumber * sizeof(BundleFamily)
+      <= header.speciesOffset
+    && header.speciesOffset + header.speciesNumber * sizeof(BundleString)
+      <= header.coveredSpeciesOffset
+    && header.coveredSpeciesOffset + header.coveredSpeciesNumber * sizeof(uint32_t)
+      <= header.stringsOffset
+    && header.stringsOffset <= fileSize;
+  auto stringsSize = fileSize - header.stringsOffset;
+  auto getString = [&](const BundleString &str) {
+    if (str.offset > stringsSize || str.size > stringsSize - str.offset) {
+      ok = false;
+      return std::string();
+    }
+    return std::string(base + header.stringsOffset + str.offset, str.size);
+  };
+  auto getPackedFile = [&](const std::string &path, const BundleString &str) {
+    PackedFile packed;
+    if (str.offset > stringsSize || str.size > stringsSize - str.offset) {
+      ok = false;
+      return packed;
+    }
+    packed.path = path;
+    packed.data = std::shared_ptr<const char>(bundleData,
+        base + header.stringsOffset + str.offset);
+    packed.size = static_cast<size_t>(str.size);
+    return packed;
+  };
+  std::vector<std::string> species;
+  if (ok) {
+    auto speciesStrings = reinterpret_cast<const BundleString *>(
+        base + header.speciesOffset);
+    for (uint32_t i = 0; i < header.speciesNumber; ++i) {
+      species.push_back(getString(speciesStrings[i]));
+    }
+  }
+  if (ok) {
+    auto records = reinterpret_cast<const BundleFamily *>(
+        base + header.familiesOffset);
+    auto coveredSpecies = reinterpret_cast<const uint32_t *>(
+        base + header.coveredSpeciesOffset);
+    families.resize(header.familiesNumber);
+    for (uint32_t i = 0; i < header.familiesNumber && ok; ++i) {
+      auto &record = records[i];
+      auto &family = families[i];
+      family.name = getString(record.name);
+      family.startingGeneTree = getString(record.startingGeneTree);
+      family.alignmentFile = getString(record.alignmentFile);
+      family.mappingFile = getString(record.mappingFile);
+      family.libpllModel = getString(record.libpllModel);
+      family.geneNumber = record.geneNumber;
+      family.alignmentSites = record.alignmentSites;
+      family.alignmentTaxa = record.alignmentTaxa;
+      family.alignmentCharacters = record.alignmentCharacters;
+      if (record.flags & FAMILY_GENE_TREE_PACKED) {
+        family.packedGeneTree = getPackedFile(family.startingGeneTree,
+            record.geneTreePayload);
+      }
+      if (record.flags & FAMILY_MAPPING_PACKED) {
+        family.packedMapping = getPackedFile(family.mappingFile,
+            record.mappingPayload);
+      }
+      family.validated = record.flags & FAMILY_VALIDATED;
+      family.alignmentValidated = record.flags & FAMILY_ALIGNMENT_VALIDATED;
+      if (record.coveredSpeciesBegin > header.coveredSpeciesNumber ||
+          record.coveredSpeciesNumber >
+          header.coveredSpeciesNumber - record.coveredSpeciesBegin) {
+        ok = false;
+        break;
+      }
+      for (uint32_t j = 0; j < record.coveredSpeciesNumber; ++j) {
+        auto speciesIndex = coveredSpecies[record.coveredSpeciesBegin + j];
+        if (speciesIndex >= species.size()) {
+          ok = false;
+          break;
+        }
+        family.coveredSpecies.push_back(species[speciesIndex]);
+      }
+    }
+  }
+  if (!ok) {
+    bundleError(bundlePath, "the file is corrupted");
+    families.clear();
+  }
+  return families;
+}
+
+/**
+ *  Metadata computed by one rank for one family
+ */
+struct FamilyMetadata {
+  bool validated;
+  unsigned int geneNumber;
+  unsigned int alignmentSites;
+  unsigned int alignmentTaxa;
+  unsigned int alignmentCharacters;
+  std::vector<std::string> coveredSpecies;
+  // the starting gene tree and mapping files of a validated
+  // family are packed in the bundle: the master rank reads
+  // them again when writing the bundle, and checks their sizes
+  bool geneTreePacked;
+  bool mappingPacked;
+  unsigned int geneTreeSize;
+  unsigned int mappingSize;
+  FamilyMetadata():
+    validated(false),
+    geneNumber(0),
+    alignmentSites(0),
+    alignmentTaxa(0),
+    alignmentCharacters(0),
+    geneTreePacked(false),
+    mappingPacked(false),
+    geneTreeSize(0),
+    mappingSize(0)
+  {}
+};
+
+// flags gathered for each family
+static const unsigned int METADATA_VALIDATED = 1;
+static const unsigned int METADATA_GENE_TREE_PACKED = 2;
+static const unsigned int METADATA_MAPPING_PACKED = 4;
+
+/**
+ *  Pack a file if its size can be
+ *  gathered as an unsigned int
+ */
+static bool canPack(const std::string &content, unsigned int &size)
+{
+  if (content.size() > std::numeric_limits<unsigned int>::max()) {
+    return false;
+  }
+  size = static_cast<unsigned int>(content.size());
+  return true;
+}
+
+static bool isGeneTreeProvided(const FamilyInfo &family)
+{
+  return family.startingGeneTree != "__random__"
+    && family.startingGeneTree.size();
+}
+
+static FamilyMetadata computeMetadata(const FamilyInfo &family)
+{
+  FamilyMetadata metadata;
+  std::unordered_set<std::string> labels;
+  bool geneTreeProvided = isGeneTreeProvided(family);
+  std::string geneTreeContent;
+  std::string mappingContent;
+  try {
+    if (family.alignmentFile.size()) {
+      LibpllParsers::getMSADimensions(family.alignmentFile,
+          family.libpllModel,
+          metadata.alignmentSites,
+          metadata.alignmentTaxa,
+          metadata.alignmentCharacters);
+    }
+    if (geneTreeProvided) {
+      // the gene tree is validated from the content that is packed
+      FileSystem::getFileContent(family.startingGeneTree, geneTreeContent);
+      std::vector<pll_utree_t *> trees;
+      LibpllParsers::readNewicksFromBuffer(geneTreeContent.data(),
+          geneTreeContent.size(), family.startingGeneTree, trees, 1);
+      if (trees.empty()) {
+        return metadata;
+      }
+      PLLUnrootedTree geneTree(trees[0]);
+      labels = geneTree.getLabels();
+    } else if (family.alignmentFile.size()) {
+      LibpllParsers::fillLabelsFromAlignment(family.alignmentFile,
+          family.libpllModel, labels);
+    }
+  } catch (...) {
+    return metadata;
+  }
+  if (labels.size() < 3) {
+    return metadata;
+  }
+  GeneSpeciesMapping mapping;
+  if (family.mappingFile.size()) {
+    FileSystem::getFileContent(family.mappingFile, mappingContent);
+    mapping.fillFromMappingBuffer(mappingContent.data(),
+        mappingContent.size());
+  } else {
+    mapping.fillFromGeneLabels(labels);
+  }
+  // the gene side of GeneSpeciesMapping::check: if it fails, the
+  // family is not flagged as validated, and GeneRax will run all
+  // the checks (and report the error) by itself
+  if (mapping.getMap().size() != labels.size()) {
+    return metadata;
+  }
+  for (auto &geneSpecies: mapping.getMap()) {
+    if (labels.find(geneSpecies.first) == labels.end()) {
+      return metadata;
+    }
+  }
+  auto coveredSpecies = mapping.getCoveredSpecies();
+  metadata.coveredSpecies.assign(coveredSpecies.begin(), coveredSpecies.end());
+  std::sort(metadata.coveredSpecies.begin(), metadata.coveredSpecies.end());
+  metadata.geneNumber = static_cast<unsigned int>(labels.size());
+  if (geneTreeProvided) {
+    metadata.geneTreePacked = canPack(geneTreeContent, metadata.geneTreeSize);
+  }
+  if (family.mappingFile.size()) {
+    metadata.mappingPacked = canPack(mappingContent, metadata.mappingSize);
+  }
+  metadata.validated = true;
+  return metadata;
+}
+
+static BundleString addString(const std::string &str, std::string &strings)
+{
+  BundleString res;
+  res.offset = strings.size();
+  res.size = str.size();
+  strings += str;
+  return res;
+}
+
+static void writeBundle(const Families &families,
+    const std::vector<FamilyMetadata> &metadata,
+    const std::string &bundlePath)
+{
+  std::string strings;
+  std::vector<BundleFamily> records(families.size());
+  std::vector<BundleString> species;
+  std::unordered_map<std::string, uint32_t> speciesIndices;
+  std::vector<uint32_t> coveredSpecies;
+  for (size_t i = 0; i < families.size(); ++i) {
+    auto &family = families[i];
+    auto &record = records[i];
+    memset(&record, 0, sizeof(record));
+    record.name = addString(family.name, strings);
+    record.startingGeneTree = addString(family.startingGeneTree, strings);
+    record.alignmentFile = addString(family.alignmentFile, strings);
+    record.mappingFile = addString(family.mappingFile, strings);
+    record.libpllModel = addString(family.libpllModel, strings);
+    record.geneNumber = metadata[i].geneNumber;
+    record.alignmentSites = metadata[i].alignmentSites;
+    record.alignmentTaxa = metadata[i].alignmentTaxa;
+    record.alignmentCharacters = metadata[i].alignmentCharacters;
+    if (metadata[i].validated) {
+      record.flags |= FAMILY_VALIDATED;
+      if (family.alignmentValidated) {
+        record.flags |= FAMILY_ALIGNMENT_VALIDATED;
+      }
+    }
+    record.coveredSpeciesBegin = static_cast<uint32_t>(coveredSpecies.size());
+    record.coveredSpeciesNumber = static_cast<uint32_t>(
+        metadata[i].coveredSpecies.size());
+    for (auto &label: metadata[i].coveredSpecies) {
+      auto it = speciesIndices.find(label);
+      if (it == speciesIndices.end()) {
+        auto index = static_cast<uint32_t>(species.size());
+        it = speciesIndices.insert({label, index}).first;
+        species.push_back(addString(label, strings));
+      }
+      coveredSpecies.push_back(it->second);
+    }
+  }
+  // the packed files follow the other strings, and are only
+  // read from their files when they are written
+  uint64_t payloadsSize = 0;
+  auto addPayload = [&](unsigned int size) {
+    BundleString res;
+    res.offset = strings.size() + payloadsSize;
+    res.size = size;
+    payloadsSize += size;
+    return res;
+  };
+  for (size_t i = 0; i < families.size(); ++i) {
+    auto &record = records[i];
+    if (metadata[i].geneTreePacked) {
+      record.flags |= FAMILY_GENE_TREE_PACKED;
+      record.geneTreePayload = addPayload(metadata[i].geneTreeSize);
+    }
+    if (metadata[i].mappingPacked) {
+      record.flags |= FAMILY_MAPPING_PACKED;
+      record.mappingPayload = addPayload(metadata[i].mappingSize);
+    }
+  }
+  BundleHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+  header.version = BUNDLE_VERSION;
+  header.familiesNumber = static_cast<uint32_t>(records.size());
+  header.speciesNumber = static_cast<uint32_t>(species.size());
+  header.coveredSpeciesNumber = static_cast<uint32_t>(coveredSpecies.size());
+  header.familiesOffset = sizeof(BundleHeader);
+  header.speciesOffset = header.familiesOffset
+    + records.size() * sizeof(BundleFamily);
+  header.coveredSpeciesOffset = header.speciesOffset
+    + species.size() * sizeof(BundleString);
+  header.stringsOffset = header.coveredSpeciesOffset
+    + coveredSpecies.size() * sizeof(uint32_t);
+  header.size = header.stringsOffset + strings.size() + payloadsSize;
+  std::ofstream os(bundlePath, std::ios::binary);
+  os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  os.write(reinterpret_cast<const char *>(records.data()),
+      static_cast<std::streamsize>(records.size() * sizeof(BundleFamily)));
+  os.write(reinterpret_cast<const char *>(species.data()),
+      static_cast<std::streamsize>(species.size() * sizeof(BundleString)));
+  os.write(reinterpret_cast<const char *>(coveredSpecies.data()),
+      static_cast<std::streamsize>(coveredSpecies.size() * sizeof(uint32_t)));
+  os.write(strings.data(), static_cast<std::streamsize>(strings.size()));
+  auto writePayload = [&](const std::string &path, const BundleString &str) {
+    std::string content;
+    FileSystem::getFileContent(path, content);
+    if (content.size() != str.size) {
+      Logger::error << "Error when writing the family bundle " << bundlePath
+        << ": the file " << path << " changed while building the bundle"
+        << std::endl;
+      ParallelContext::abort(1);
+    }
+    os.write(content.data(), static_cast<std::streamsize>(content.size()));
+  };
+  for (size_t i = 0; i < families.size(); ++i) {
+    if (records[i].flags & FAMILY_GENE_TREE_PACKED) {
+      writePayload(families[i].startingGeneTree, records[i].geneTreePayload);
+    }
+    if (records[i].flags & FAMILY_MAPPING_PACKED) {
+      writePayload(families[i].mappingFile, records[i].mappingPayload);
+    }
+  }
+  if (!os) {
+    Logger::error << "Error when writing the family bundle " << bundlePath << std::endl;
+    ParallelContext::abort(1);
+  }
+}
+
+void FamilyBundle::write(const Families &inputFamilies,
+    const std::string &bundlePath)
+{
+  Families families = inputFamilies;
+  Family::filterFamilies(families, "", false, false);
+  // the alignment checks are only a flag in the bundle: the
+  // families with an invalid alignment are kept, because they can
+  // still be used without alignment, and we do not want
+  // filterFamilies to report them as discarded
+  Families alignedFamilies;
+  for (auto &family: families) {
+    if (family.alignmentFile.size()) {
+      alignedFamilies.push_back(family);
+    }
+  }
+  if (alignedFamilies.size()) {
+    Logger::mute();
+    Family::filterFamilies(alignedFamilies, "", true, false);
+    Logger::unmute();
+  }
+  std::unordered_set<std::string> validAlignments;
+  for (auto &family: alignedFamilies) {
+    validAlignments.insert(family.name);
+  }
+  for (auto &family: families) {
+    family.alignmentValidated = validAlignments.count(family.name) > 0;
+  }
+  // each rank computes the metadata of its families, and the
+  // master rank gathers them (the ranks hold contiguous ranges
+  // of families, in the rank order). For each family: the
+  // flags, the gene number, the alignment dimensions, the number
+  // of covered species, which are gathered separately, and the
+  // sizes of the packed files. The packed files themselves are
+  // not gathered: the master rank copies them into the bundle.
+  const size_t numbersPerFamily = 8;
+  auto familiesNumber = static_cast<unsigned int>(families.size());
+  std::vector<unsigned int> localNumbers;
+  std::vector<std::string> localSpecies;
+  for (auto i = ParallelContext::getBegin(familiesNumber);
+      i < ParallelContext::getEnd(familiesNumber); ++i) {
+    auto metadata = computeMetadata(families[i]);
+    unsigned int flags = 0;
+    if (metadata.validated) {
+      flags |= METADATA_VALIDATED;
+    }
+    if (metadata.geneTreePacked) {
+      flags |= METADATA_GENE_TREE_PACKED;
+    }
+    if (metadata.mappingPacked) {
+      flags |= METADATA_MAPPING_PACKED;
+    }
+    localNumbers.push_back(flags);
+    localNumbers.push_back(metadata.geneNumber);
+    localNumbers.push_back(metadata.alignmentSites);
+    localNumbers.push_back(metadata.alignmentTaxa);
+    localNumbers.push_back(metadata.alignmentCharacters);
+    localNumbers.push_back(static_cast<unsigned int>(
+          metadata.coveredSpecies.size()));
+    localNumbers.push_back(metadata.geneTreeSize);
+    localNumbers.push_back(metadata.mappingSize);
+    localSpecies.insert(localSpecies.end(),
+        metadata.coveredSpecies.begin(), metadata.coveredSpecies.end());
+  }
+  std::vector<unsigned int> numbers;
+  std::vector<std::string> species;
+  ParallelContext::gatherUIntVectors(localNumbers, numbers);
+  ParallelContext::gatherStrings(localSpecies, species);
+  if (ParallelContext::getRank() == 0) {
+    assert(numbers.size() == numbersPerFamily * families.size());
+    std::vector<FamilyMetadata> metadata(families.size());
+    auto speciesIt = species.begin();
+    for (size_t i = 0; i < families.size(); ++i) {
+      auto &m = metadata[i];
+      auto familyNumbers = &numbers[numbersPerFamily * i];
+      m.validated = familyNumbers[0] & METADATA_VALIDATED;
+      m.geneTreePacked = familyNumbers[0] & METADATA_GENE_TREE_PACKED;
+      m.mappingPacked = familyNumbers[0] & METADATA_MAPPING_PACKED;
+      m.geneNumber = familyNumbers[1];
+      m.alignmentSites = familyNumbers[2];
+      m.alignmentTaxa = familyNumbers[3];
+      m.alignmentCharacters = familyNumbers[4];
+      auto coveredSpeciesNumber = familyNumbers[5];
+      m.coveredSpecies.assign(speciesIt, speciesIt + coveredSpeciesNumber);
+      speciesIt += coveredSpeciesNumber;
+      m.geneTreeSize = familyNumbers[6];
+      m.mappingSize = familyNumbers[7];
+    }
+    assert(speciesIt == species.end());
+    writeBundle(families, metadata, bundlePath);
+    Logger::info << "Wrote " << families.size() << " families to "
+      << bundlePath << std::endl;
+  }
+  ParallelContext::barrier();
+}
+
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <IO/Families.hpp>
+
+/**
+ *  Binary alternative to the families file, for datasets with
+ *  many families: reading a bundle is a single memory-mapped
+ *  file access, and it stores the per-family metadata that
+ *  Family::filterFamilies and LibpllParsers::parallelGetTreeSizes
+ *  would otherwise recompute from the family files at startup.
+ *
+ *  Layout (native endianness, offsets relative to the file start):
+ *  - a header with the magic string, the format version, the
+ *    number of families and species and the offsets of the
+ *    following sections
+ *  - one fixed-size record per family (string references, gene
+ *    number, alignment dimensions, validation flags, covered
+ *    species range)
+ *  - the interned species labels (string references)
+ *  - the covered species of all families, as species indices
+ *  - the characters of all the strings (not null-terminated),
+ *    including the packed files
+ *
+ *  The starting gene tree and mapping files of the validated
+ *  families are packed in the bundle: the bundle stays mapped
+ *  and they are parsed in place (see FamilyInfo::packedGeneTree
+ *  and Family::readStartingGeneTrees). The alignments stay in
+ *  their files.
+ */
+class FamilyBundle {
+public:
+  FamilyBundle() = delete;
+
+  /**
+   *  @return true if path is a readable family bundle
+   *  (only the magic string is checked)
+   */
+  static bool isBundle(const std::string &path);
+
+  /**
+   *  Read the families from a bundle. Aborts if the bundle
+   *  is corrupted. The packed files of the families keep
+   *  the bundle mapped.
+   */
+  static Families read(const std::string &bundlePath);
+
+  /**
+   *  Run the species tree independent checks of
+   *  Family::filterFamilies, compute the family metadata and
+   *  write the bundle from the master rank. Invalid families
+   *  are discarded. Only the metadata is gathered: the master
+   *  rank copies the packed files one at a time when writing.
+   *  Must be called by all ranks.
+   */
+  static void write(const Families &families,
+      const std::string &bundlePath);
+};
+
@@ -0,0 +1,141 @@
+#include "FileArchive.hpp"
+
+#include <IO/FileSystem.hpp>
+#include <sstream>
+#include <unordered_set>
+
+static const std::string ENTRY_TAG("GRXA");
+
+FileArchiveWriter::FileArchiveWriter(const std::string &archivePath):
+  _os(archivePath, std::ios::binary | std::ios::trunc),
+  _indexOs(archivePath + ".index", std::ios::trunc),
+  _offset(0)
+{
+}
+
+void FileArchiveWriter::addFile(const std::string &name,
+    const std::string &content)
+{
+  std::string header = ENTRY_TAG + " " + std::to_string(name.size())
+    + " " + std::to_string(content.size()) + "\n";
+  _os << header << name << content;
+  // flush so that the archive can be read while being written
+  _os.flush();
+  _offset += header.size() + name.size();
+  _indexOs << _offset << " " << content.size() << " " << name << "\n";
+  _indexOs.flush();
+  _offset += content.size();
+}
+
+/**
+ *  Read the next entry of the archive. If content is null,
+ *  the content is skipped.
+ *  @return false at the end of the archive (or if it is corrupted)
+ */
+static bool readEntry(std::ifstream &is,
+    std::string &name,
+    std::string *content)
+{
+  std::string header;
+  if (!std::getline(is, header)) {
+    return false;
+  }
+  std::istringstream iss(header);
+  std::string tag;
+  size_t nameSize = 0;
+  size_t contentSize = 0;
+  if (!(iss >> tag >> nameSize >> contentSize) || tag != ENTRY_TAG) {
+    return false;
+  }
+  name.resize(nameSize);
+  if (!is.read(&name[0], static_cast<std::streamsize>(nameSize))) {
+    return false;
+  }
+  if (content) {
+    content->resize(contentSize);
+    is.read(&(*content)[0], static_cast<std::streamsize>(contentSize));
+  } else {
+    is.seekg(static_cast<std::streamoff>(contentSize), std::ios::cur);
+  }
+  return static_cast<bool>(is);
+}
+
+std::vector<std::string> FileArchive::list(const std::string &archivePath)
+{
+  std::vector<std::string> names;
+  std::unordered_set<std::string> seen;
+  std::ifstream is(archivePath, std::ios::binary);
+  std::string name;
+  while (readEntry(is, name, nullptr)) {
+    if (seen.insert(name).second) {
+      names.push_back(name);
+    }
+  }
+  return names;
+}
+
+bool FileArchive::readFile(const std::string &archivePath,
+    const std::string &name,
+    std::string &content)
+{
+  std::ifstream indexIs(archivePath + ".index");
+  if (indexIs) {
+    size_t offset = 0;
+    size_t size = 0;
+    bool found = false;
+    std::string line;
+    while (std::getline(indexIs, line)) {
+      std::istringstream iss(line);
+      size_t currentOffset;
+      size_t currentSize;
+      iss >> currentOffset >> currentSize;
+      iss.get(); // the space before the name
+      std::string currentName;
+      std::getline(iss, currentName);
+      if (currentName == name) {
+        offset = currentOffset;
+        size = currentSize;
+        found = true;
+      }
+    }
+    if (!found) {
+      return false;
+    }
+    std::ifstream is(archivePath, std::ios::binary);
+    is.seekg(static_cast<std::streamoff>(offset));
+    content.resize(size);
+    is.read(&content[0], static_cast<std::streamsize>(size));
+    return static_cast<bool>(is);
+  }
+  // no index: scan the archive
+  bool found = false;
+  std::ifstream is(archivePath, std::ios::binary);
+  std::string currentName;
+  std::string currentContent;
+  while (readEntry(is, currentName, &currentContent)) {
+    if (currentName == name) {
+      content = currentContent;
+      found = true;
+    }
+  }
+  return found;
+}
+
+unsigned int FileArchive::extract(const std::string &archivePath,
+    const std::string &outputDir)
+{
+  unsigned int entries = 0;
+  std::ifstream is(archivePath, std::ios::binary);
+  std::string name;
+  std::string content;
+  while (readEntry(is, name, &content)) {
+    // later entries override the previous ones, as
+    // when writing the same file twice
+    std::ofstream os(FileSystem::joinPaths(outputDir, name),
+        std::ios::binary | std::ios::trunc);
+    os << content;
+    entries++;
+  }
+  return entries;
+}
+
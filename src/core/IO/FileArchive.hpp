@@ -0,0 +1,69 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+/**
+ *  Append-only archive of small output files, to avoid creating
+ *  one file per family and per output type on shared filesystems.
+ *
+ *  The archive is a sequence of entries, each made of the header
+ *  line "GRXA <name size> <content size>\n", followed by the name
+ *  and the content. It can thus be read sequentially while it is
+ *  being written. An entry overrides the previous entries with
+ *  the same name.
+ *
+ *  Each entry is also indexed in <archive>.index, with one
+ *  "<content offset> <content size> <name>" line per entry, to
+ *  access a single file without scanning the whole archive.
+ *
+ *  The archive is not thread-safe, and each rank should write
+ *  its own archive.
+ */
+class FileArchiveWriter {
+public:
+  /**
+   *  Create (or truncate) the archive and its index
+   */
+  FileArchiveWriter(const std::string &archivePath);
+  FileArchiveWriter(const FileArchiveWriter &) = delete;
+  FileArchiveWriter & operator = (const FileArchiveWriter &) = delete;
+  FileArchiveWriter(FileArchiveWriter &&) = delete;
+  FileArchiveWriter & operator = (FileArchiveWriter &&) = delete;
+
+  void addFile(const std::string &name, const std::string &content);
+private:
+  std::ofstream _os;
+  std::ofstream _indexOs;
+  size_t _offset;
+};
+
+class FileArchive {
+public:
+  FileArchive() = delete;
+
+  /**
+   *  Names of the files of the archive, in writing order
+   *  (without duplicates)
+   */
+  static std::vector<std::string> list(const std::string &archivePath);
+
+  /**
+   *  Fill content with the last version of the file name.
+   *  Uses the index if it exists.
+   *  @return false if the file is not in the archive
+   */
+  static bool readFile(const std::string &archivePath,
+      const std::string &name,
+      std::string &content);
+
+  /**
+   *  Write all the files of the archive into outputDir, with
+   *  the same content as if they had been written directly
+   *  @return the number of extracted entries
+   */
+  static unsigned int extract(const std::string &archivePath,
+      const std::string &outputDir);
+};
+
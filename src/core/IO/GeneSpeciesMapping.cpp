@@ -67,9 +67,20 @@ bool GeneSpeciesMapping::check(const std::unordered_set<std::string> &geneLeaves
 }
 
 
+void GeneSpeciesMapping::fillFromMappingBuffer(const char *data, size_t size)
+{
+  std::istringstream is(std::string(data, size));
+  buildFromMappingStream(is);
+}
+
 void GeneSpeciesMapping::buildFromMappingFile(const std::string &mappingFile)
 {
   std::ifstream f(mappingFile);
+  buildFromMappingStream(f);
+}
+
+void GeneSpeciesMapping::buildFromMappingStream(std::istream &f)
+{
   std::string line;
   getline(f, line);
   f.seekg(0, std::ios::beg);
@@ -90,7 +101,7 @@ static bool isBlanck(const std::string &s)
 
   
 
-void GeneSpeciesMapping::buildFromPhyldogMapping(std::ifstream &f)
+void GeneSpeciesMapping::buildFromPhyldogMapping(std::istream &f)
 {
   /*
     species1:gene1;gene2;gene3
@@ -111,7 +122,7 @@ void GeneSpeciesMapping::buildFromPhyldogMapping(std::ifstream &f)
   }
 }
 
-void GeneSpeciesMapping::buildFromTreerecsMapping(std::ifstream &f)
+void GeneSpeciesMapping::buildFromTreerecsMapping(std::istream &f)
 {
   /*
     gene1 species1
@@ -26,6 +26,10 @@ public:
   
   void fill(const std::string &mappingFile, const std::string &geneTreeStrOrFile); 
   void fillFromGeneLabels(const std::unordered_set<std::string> &labels); 
+  /**
+   *  Fill from the content [data, data + size) of a mapping file
+   */
+  void fillFromMappingBuffer(const char *data, size_t size);
   bool check(pll_utree_t *geneTree, pll_rtree_t *speciesTree);
   bool check(const std::unordered_set<std::string> &genes, const std::unordered_set<std::string> &species);
   void fill(const GeneSpeciesMapping &mapping);
@@ -44,9 +48,10 @@ public:
   std::unordered_set<std::string> getCoveredSpecies() const;
 private:
   std::map<std::string, std::string> _map; // <gene,species>
-  void buildFromPhyldogMapping(std::ifstream &f);
-  void buildFromTreerecsMapping(std::ifstream &f);
+  void buildFromPhyldogMapping(std::istream &f);
+  void buildFromTreerecsMapping(std::istream &f);
   void buildFromMappingFile(const std::string &mappingFile); 
+  void buildFromMappingStream(std::istream &f);
   void buildFromTrees(const std::string &geneTreeStrOrFile); 
 };
 
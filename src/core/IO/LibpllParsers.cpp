@@ -9,6 +9,7 @@
 #include <array>
 #include <IO/Logger.hpp>
 #include <IO/RootedNewickParser.hpp>
+#include <IO/UnrootedNewickParser.hpp>
 
 extern "C" {
 #include <pll.h>
@@ -48,31 +49,70 @@ void LibpllParsers::labelRootedTree(const std::string &unlabelledNewickFile, con
   pll_rtree_destroy(tree, free);
 }
 
-pll_utree_t *LibpllParsers::readNewickFromFile(const std::string &newickFilename)
+static std::string getParsingErrorMessage(const ParsingError &error)
 {
-  std::ifstream is(newickFilename);
-  if (!is)
-    throw LibpllException("Could not load open newick file ", newickFilename);
+  std::string errorMessage;
+  errorMessage += "Error name: ";
+  errorMessage += std::string(get_parsing_error_name(error.type));
+  errorMessage += ".\n";
+  errorMessage += "Error help message: ";
+  errorMessage += std::string(get_parsing_error_diagnostic(error.type));
+  errorMessage += ".\n";
+  errorMessage += "The parsing error was detected at character ";
+  errorMessage += std::to_string(error.offset) + ".";
+  return errorMessage;
+}
 
-  std::string line;
-  if (!std::getline(is, line)) {
+pll_utree_t *LibpllParsers::readNewickFromFile(const std::string &newickFilename)
+{
+  std::vector<pll_utree_t *> trees;
+  readNewicksFromFile(newickFilename, trees, 1);
+  if (trees.empty()) {
     throw LibpllException("Error while reading tree (file is empty) from file: ", newickFilename); 
   }
-  pll_utree_t *res = nullptr;
-  try {
-    res = readNewickFromStr(line);
-  } catch (...) {
-    throw LibpllException("Error while reading tree from file: ", newickFilename);
+  return trees[0];
+}
+
+void LibpllParsers::readNewicksFromFile(const std::string &newickFilename,
+    std::vector<pll_utree_t *> &trees,
+    unsigned int maxTrees)
+{
+  ParsingError error;
+  if (!custom_utree_parse_newick_file(newickFilename.c_str(), 
+        maxTrees,
+        trees,
+        &error)) {
+    if (error.type == PET_FILE_DOES_NOT_EXISTS) {
+      // the file could not be opened or mapped
+      throw LibpllException("Could not load open newick file ", newickFilename);
+    }
+    throw LibpllException("Error while reading tree from file: " 
+        + newickFilename + ".\n", getParsingErrorMessage(error));
   }
-  return res;
 }
 
+void LibpllParsers::readNewicksFromBuffer(const char *data,
+    size_t size,
+    const std::string &source,
+    std::vector<pll_utree_t *> &trees,
+    unsigned int maxTrees)
+{
+  ParsingError error;
+  if (!custom_utree_parse_newicks(data, size, maxTrees, trees, &error)) {
+    throw LibpllException("Error while reading tree from " 
+        + source + ".\n", getParsingErrorMessage(error));
+  }
+}
 
 pll_utree_t *LibpllParsers::readNewickFromStr(const std::string &newickString)
 {
-  auto utree =  pll_utree_parse_newick_string_unroot(newickString.c_str());
+  ParsingError error;
+  auto utree = custom_utree_parse_newick(newickString.c_str(), 
+      false,
+      &error);
   if (!utree) 
-    throw LibpllException("Error while reading tree from std::string: ", newickString);
+    throw LibpllException("Error while reading tree from std::string: " 
+        + newickString + ".\n", getParsingErrorMessage(error));
   return utree;
 }
 
@@ -92,14 +132,7 @@ static pll_rtree_t *readRooted(const std::string &newick, bool isFile)
     } else {
       errorMessage = "Error while reading rooted tree from string " + newick + ".\n";
     }
-    errorMessage += "Error name: ";
-    errorMessage += std::string(get_parsing_error_name(error.type));
-    errorMessage += ".\n";
-    errorMessage += "Error help message: ";
-    errorMessage += std::string(get_parsing_error_diagnostic(error.type));
-    errorMessage += ".\n";
-    errorMessage += "The parsing error was detected at character ";
-    errorMessage += std::to_string(error.offset) + ".";
+    errorMessage += getParsingErrorMessage(error);
     throw LibpllException(errorMessage); 
   }
 }
@@ -189,14 +222,27 @@ void LibpllParsers::getRtreeHierarchicalString(const pll_rtree_t *rtree, std::st
 std::vector<unsigned int> LibpllParsers::parallelGetTreeSizes(const Families &families) 
 {
   unsigned int treesNumber = static_cast<unsigned int>(families.size());
+  // all ranks have the same families, and thus take the same branch
+  std::vector<unsigned int> treeSizes;
+  for (auto &family: families) {
+    treeSizes.push_back(family.geneNumber);
+  }
+  if (std::find(treeSizes.begin(), treeSizes.end(), 0) == treeSizes.end()) {
+    return treeSizes;
+  }
+  treeSizes.clear();
   std::vector<unsigned int> localTreeSizes((treesNumber - 1 ) / ParallelContext::getSize() + 1, 0);
   for (auto i = ParallelContext::getBegin(treesNumber); i < ParallelContext::getEnd(treesNumber); i ++) {
-    pll_utree_t *tree = LibpllParsers::readNewickFromFile(families[i].startingGeneTree);
-    unsigned int taxa = tree->tip_count;
+    std::vector<pll_utree_t *> trees;
+    Family::readStartingGeneTrees(families[i], trees, 1);
+    if (trees.empty()) {
+      throw LibpllException("Error while reading tree (file is empty) from file: ", 
+          families[i].startingGeneTree); 
+    }
+    unsigned int taxa = trees[0]->tip_count;
     localTreeSizes[i - ParallelContext::getBegin(treesNumber)] = taxa;
-    pll_utree_destroy(tree, 0);
+    pll_utree_destroy(trees[0], 0);
   }
-  std::vector<unsigned int> treeSizes;
   ParallelContext::concatenateUIntVectors(localTreeSizes, treeSizes);
   treeSizes.erase(remove(treeSizes.begin(), treeSizes.end(), 0), treeSizes.end());
   assert(treeSizes.size() == families.size());
@@ -372,28 +418,50 @@ unsigned int LibpllParsers::getMSALength(const std::string &alignmentFilename,
 double LibpllParsers::getMSAEntropy(const std::string &alignmentFilename,
       const std::string &modelStrOrFilename)
 {
+  unsigned int sites = 0;
+  unsigned int taxa = 0;
+  unsigned int characters = 0;
+  if (!getMSADimensions(alignmentFilename, modelStrOrFilename,
+        sites, taxa, characters)) {
+    return 0;
+  }
+  return double(characters) / double(taxa);
+}
+
+bool LibpllParsers::getMSADimensions(const std::string &alignmentFilename,
+    const std::string &modelStrOrFilename,
+    unsigned int &sites,
+    unsigned int &taxa,
+    unsigned int &characters)
+{
+  sites = 0;
+  taxa = 0;
+  characters = 0;
   auto model = getModel(modelStrOrFilename);
   PLLSequencePtrs sequences;
   unsigned int *patternWeights = nullptr;
   try { 
     LibpllParsers::parseMSA(alignmentFilename, model->charmap(), sequences, patternWeights);
   } catch (...) {
-    return 0;
+    return false;
   }
   if (sequences.size() == 0) {
-    return 0;
+    free(patternWeights);
+    return false;
+  }
+  taxa = static_cast<unsigned int>(sequences.size());
+  for (unsigned int i = 0; i < sequences[0]->len; ++i) {
+    sites += patternWeights[i];
   }
-  unsigned int nonGaps = 0;
   for (auto &sequence: sequences) {
     for (unsigned int i = 0; i < sequence->len; ++i) {
       if (sequence->seq[i] != '-') {
-        nonGaps += patternWeights[i];
+        characters += patternWeights[i];
       }
     }
   }
   free(patternWeights);
-  return double(nonGaps) / double(sequences.size());
-
+  return true;
 }
   
 bool LibpllParsers::areLabelsValid(std::unordered_set<std::string> &leaves)
@@ -52,6 +52,22 @@ public:
   static void labelRootedTree(const std::string &unlabelledNewickFile, const std::string &labelledNewickFile);
   static pll_utree_t *readNewickFromFile(const std::string &newickFile);
   static pll_utree_t *readNewickFromStr(const std::string &newickSTring);
+  /**
+   *  Append the first maxTrees trees (all of them if maxTrees is 0)
+   *  of a newick file to trees. The trees can span several lines.
+   */
+  static void readNewicksFromFile(const std::string &newickFile,
+      std::vector<pll_utree_t *> &trees,
+      unsigned int maxTrees = 0);
+  /**
+   *  Same as readNewicksFromFile, from the newick buffer
+   *  [data, data + size). source names the buffer in the errors.
+   */
+  static void readNewicksFromBuffer(const char *data,
+      size_t size,
+      const std::string &source,
+      std::vector<pll_utree_t *> &trees,
+      unsigned int maxTrees = 0);
   static pll_rtree_t *readRootedFromFile(const std::string &newickFile);
   static pll_rtree_t *readRootedFromStr(const std::string &newickFile);
   static void parseMSA(const std::string &alignmentFilename, 
@@ -66,6 +82,15 @@ public:
    */
   static double getMSAEntropy(const std::string &alignmentFilename,
       const std::string &modelStrOrFilename);
+  /**
+   *  Fill the number of sites, of taxa and of non-gap characters
+   *  of an MSA. Return false if the MSA could not be parsed
+   */
+  static bool getMSADimensions(const std::string &alignmentFilename,
+      const std::string &modelStrOrFilename,
+      unsigned int &sites,
+      unsigned int &taxa,
+      unsigned int &characters);
   static void fillLeavesFromUtree(pll_utree_t *utree, std::unordered_set<std::string> &leaves);
   static void fillLeavesFromRtree(pll_rtree_t *rtree, std::unordered_set<std::string> &leaves);
   
@@ -23,7 +23,8 @@ const char *error_type_name[PET_LAST] = {
   "UNROOTED",
   "EMPTY_NODE",
   "ONLY_ONE_CHILD",
-  "TOKEN_AFTER_SEMICOLON"
+  "TOKEN_AFTER_SEMICOLON",
+  "TOO_FEW_TAXA"
 };
 
 
@@ -40,7 +41,8 @@ const char *error_type_diagnostic[PET_LAST] = {
   "The tree is unrooted: its top node has strictly more than two children",
   "A node has no label nor children",
   "A node has only one child",
-  "Some text follows the ending semicolon"
+  "Some text follows the ending semicolon",
+  "An unrooted tree should have at least three leaves"
 };
 
 
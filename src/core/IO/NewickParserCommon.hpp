@@ -21,6 +21,7 @@ enum ParsingErrorType {
   PET_EMPTY_NODE,
   PET_ONLY_ONE_CHILD,
   PET_TOKEN_AFTER_SEMICOLON,
+  PET_TOO_FEW_TAXA,
   PET_LAST
 };
 
@@ -1,9 +1,20 @@
 #include <IO/ParallelOfstream.hpp>
+#include <IO/FileArchive.hpp>
+#include <sstream>
+
+FileArchiveWriter *ParallelOfstream::_archive = nullptr;
+std::string ParallelOfstream::_archiveDirectory;
   
 ParallelOfstream::ParallelOfstream(const std::string &fileName, bool masterRankOnly): _os(nullptr)
 {
   if (!ParallelContext::getRank() || !masterRankOnly) {
-    _os = std::make_unique<std::ofstream>(fileName);
+    auto prefix = _archiveDirectory + "/";
+    if (_archive && fileName.compare(0, prefix.size(), prefix) == 0) {
+      _archiveName = fileName.substr(prefix.size());
+      _os = std::make_unique<std::ostringstream>();
+    } else {
+      _os = std::make_unique<std::ofstream>(fileName);
+    }
   } else {
     _os = std::make_unique<std::ostream>(nullptr);
   }
@@ -11,6 +22,11 @@ ParallelOfstream::ParallelOfstream(const std::string &fileName, bool masterRankO
   
 void ParallelOfstream::close()
 {
+  if (_archiveName.size()) {
+    auto content = static_cast<std::ostringstream *>(_os.get())->str();
+    _archive->addFile(_archiveName, content);
+    _archiveName.clear();
+  }
   // force the _os destruction if it holds an ofstream
   _os = std::make_unique<std::ostream>(nullptr);
 }
@@ -19,3 +35,16 @@ ParallelOfstream::~ParallelOfstream()
 {
   close();
 }
+
+void ParallelOfstream::startArchiving(FileArchiveWriter &archive,
+    const std::string &directory)
+{
+  _archive = &archive;
+  _archiveDirectory = directory;
+}
+
+void ParallelOfstream::stopArchiving()
+{
+  _archive = nullptr;
+  _archiveDirectory.clear();
+}
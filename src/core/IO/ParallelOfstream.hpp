@@ -5,15 +5,29 @@
 #include <string>
 #include <memory>
 
+class FileArchiveWriter;
 
 class ParallelOfstream {
 public:
   ParallelOfstream(const std::string &fileName, bool masterRankOnly = true);
   void close();
   ~ParallelOfstream();
+
+  /**
+   *  Until stopArchiving is called, the files that this rank
+   *  writes in directory are added to archive instead of
+   *  being created (see IO/FileArchive.hpp)
+   */
+  static void startArchiving(FileArchiveWriter &archive,
+      const std::string &directory);
+  static void stopArchiving();
 private:
   template<typename T> friend std::ostream& operator<<(ParallelOfstream&, T);
   std::unique_ptr<std::ostream> _os;
+  // name of the file in the archive, empty if not archived
+  std::string _archiveName;
+  static FileArchiveWriter *_archive;
+  static std::string _archiveDirectory;
 };
 
 template<typename T> 
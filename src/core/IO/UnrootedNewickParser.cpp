@@ -0,0 +1,505 @@
+#include "UnrootedNewickParser.hpp"
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+/*
+ *  Node of the intermediate tree built while reading the
+ *  newick buffer. The labels point to the buffer, and are
+ *  only copied when building the final tree
+ */
+struct ParsedNode {
+  // index of the parent node, -1 for the top node
+  int parent;
+  // first and last children indices, -1 if none
+  int first_child;
+  int last_child;
+  // index of the next sibling, -1 if none
+  int next_sibling;
+  unsigned int children_number;
+  const char *label;
+  unsigned int label_size;
+  double length;
+  bool has_length;
+};
+
+/*
+ *  Structure holding the current context of the parsing
+ */
+struct UTreeParser {
+  // Pointer to the start of the newick buffer
+  const char *input;
+  // Pointer to the current offset in the newick buffer
+  const char *input_current;
+  // Pointer to the end of the newick buffer
+  const char *input_end;
+  // all nodes parsed so far, the first one is the top node
+  std::vector<ParsedNode> nodes;
+  // index of the node currently being parsed
+  int current_node;
+  // object to fill if parsing fails
+  ParsingError *error;
+};
+
+static bool utree_has_errored(const UTreeParser *p)
+{
+  return p->error->type != PET_NOERROR;
+}
+
+static void utree_set_error(UTreeParser *p, ParsingErrorType type)
+{
+  if (!utree_has_errored(p)) {
+    p->error->type = type;
+    p->error->offset = static_cast<unsigned int>(p->input_current - p->input);
+  }
+}
+
+static bool utree_is_separator(char c)
+{
+  return is_separator[static_cast<unsigned char>(c)];
+}
+
+static void utree_skip_spaces(UTreeParser *p)
+{
+  while (p->input_current != p->input_end &&
+      to_trim[static_cast<unsigned char>(*p->input_current)]) {
+    p->input_current++;
+  }
+}
+
+/**
+ *  Return the size of the next token (number of characters
+ *  before the next separator or the end of the buffer)
+ */
+static unsigned int utree_get_token_size(const UTreeParser *p)
+{
+  const char *curr = p->input_current;
+  while (curr != p->input_end && !utree_is_separator(*curr)) {
+    curr++;
+  }
+  return static_cast<unsigned int>(curr - p->input_current);
+}
+
+/**
+ *  Create a new node under parent (-1 for the top node)
+ */
+static int utree_add_node(UTreeParser *p, int parent)
+{
+  ParsedNode node;
+  node.parent = parent;
+  node.first_child = -1;
+  node.last_child = -1;
+  node.next_sibling = -1;
+  node.children_number = 0;
+  node.label = NULL;
+  node.label_size = 0;
+  node.length = 0.0;
+  node.has_length = false;
+  int index = static_cast<int>(p->nodes.size());
+  if (parent >= 0) {
+    ParsedNode &parent_node = p->nodes[parent];
+    // the top node can have three children
+    unsigned int max_children = parent_node.parent < 0 ? 3 : 2;
+    if (parent_node.children_number == max_children) {
+      utree_set_error(p, PET_POLYTOMY);
+      return parent;
+    }
+    if (parent_node.last_child >= 0) {
+      p->nodes[parent_node.last_child].next_sibling = index;
+    } else {
+      parent_node.first_child = index;
+    }
+    parent_node.last_child = index;
+    parent_node.children_number++;
+  }
+  p->nodes.push_back(node);
+  return index;
+}
+
+/**
+ *  Called before leaving the current node (after a comma
+ *  or a right parenthesis)
+ */
+static void utree_terminate_node(UTreeParser *p)
+{
+  const ParsedNode &node = p->nodes[p->current_node];
+  if (!node.label && !node.children_number) {
+    utree_set_error(p, PET_EMPTY_NODE);
+  }
+}
+
+static void utree_read_label(UTreeParser *p)
+{
+  unsigned int size = utree_get_token_size(p);
+  ParsedNode &node = p->nodes[p->current_node];
+  if (!size || node.label) {
+    utree_set_error(p, PET_INVALID_LABEL);
+    return;
+  }
+  if (node.has_length) {
+    utree_set_error(p, PET_INVALID_BRANCH_LENGTH);
+    return;
+  }
+  node.label = p->input_current;
+  node.label_size = size;
+  p->input_current += size;
+}
+
+static void utree_read_length(UTreeParser *p)
+{
+  utree_skip_spaces(p);
+  unsigned int size = utree_get_token_size(p);
+  // strtod needs a null-terminated string
+  char buffer[64];
+  if (!size || size >= sizeof(buffer)) {
+    utree_set_error(p, PET_INVALID_BRANCH_LENGTH);
+    return;
+  }
+  memcpy(buffer, p->input_current, size);
+  buffer[size] = '\0';
+  double length = 0.0;
+  if (!is_numeric(buffer, &length)) {
+    utree_set_error(p, PET_INVALID_BRANCH_LENGTH);
+    return;
+  }
+  ParsedNode &node = p->nodes[p->current_node];
+  if (node.has_length) {
+    utree_set_error(p, PET_DOUBLE_BRANCH_LENGTH);
+    return;
+  }
+  node.length = length;
+  node.has_length = true;
+  p->input_current += size;
+}
+
+/**
+ *  Read the newick buffer until the first semicolon, and
+ *  build the intermediate tree in p
+ */
+static void utree_parse(UTreeParser *p)
+{
+  bool end = false;
+  p->current_node = utree_add_node(p, -1); // add top node
+  while (!end && !utree_has_errored(p)) {
+    utree_skip_spaces(p);
+    if (p->input_current == p->input_end) {
+      break;
+    }
+    int parent = p->nodes[p->current_node].parent;
+    switch (*p->input_current) {
+    case ';':
+      p->input_current++;
+      end = true;
+      break;
+    case '(':
+      // go down in the tree
+      p->input_current++;
+      p->current_node = utree_add_node(p, p->current_node);
+      break;
+    case ',':
+      p->input_current++;
+      if (parent < 0) {
+        utree_set_error(p, PET_INVALID_PARENTHESES);
+      } else {
+        utree_terminate_node(p);
+        p->current_node = utree_add_node(p, parent);
+      }
+      break;
+    case ')':
+      p->input_current++;
+      if (parent < 0) {
+        // at this point, we have more right than
+        // left parenthesis
+        utree_set_error(p, PET_INVALID_PARENTHESES);
+      } else {
+        utree_terminate_node(p);
+        p->current_node = parent;
+        if (p->nodes[parent].children_number == 1) {
+          utree_set_error(p, PET_ONLY_ONE_CHILD);
+        }
+      }
+      break;
+    case ':':
+      p->input_current++;
+      utree_read_length(p);
+      break;
+    default:
+      utree_read_label(p);
+      break;
+    }
+  }
+  if (utree_has_errored(p)) {
+    return;
+  }
+  if (p->nodes[p->current_node].parent >= 0) {
+    // we have more left than right parenthesis
+    utree_set_error(p, PET_INVALID_PARENTHESES);
+  } else if (!end) {
+    utree_set_error(p, PET_NOSEMICOLON);
+  }
+}
+
+static char *utree_copy_label(const ParsedNode &node)
+{
+  if (!node.label) {
+    return NULL;
+  }
+  char *label = (char *)malloc(node.label_size + 1);
+  memcpy(label, node.label, node.label_size);
+  label[node.label_size] = '\0';
+  return label;
+}
+
+static void utree_connect(pll_unode_t *n1, pll_unode_t *n2, double length)
+{
+  n1->back = n2;
+  n2->back = n1;
+  n1->length = n2->length = length;
+}
+
+/**
+ *  Build the pll_utree_t from the intermediate tree.
+ *  The indices follow the libpll conventions (tips first,
+ *  one clv and scaler index per inner node, one node index
+ *  per directed inner node, one pmatrix index per branch)
+ */
+static pll_utree_t *utree_build(UTreeParser *p)
+{
+  std::vector<ParsedNode> &nodes = p->nodes;
+  unsigned int tip_count = 0;
+  for (const ParsedNode &node: nodes) {
+    tip_count += (node.children_number == 0);
+  }
+  if (tip_count < 3) {
+    utree_set_error(p, PET_TOO_FEW_TAXA);
+    return NULL;
+  }
+  const ParsedNode &top = nodes[0];
+  // a rooted tree is unrooted by removing the top node
+  bool remove_top = (top.children_number == 2);
+  unsigned int inner_count = static_cast<unsigned int>(nodes.size())
+    - tip_count - (remove_top ? 1 : 0);
+  // for each parsed node, the directed node pointing to its parent
+  std::vector<pll_unode_t *> unodes(nodes.size(), NULL);
+  // for each parsed node, the directed node to connect to its next child
+  std::vector<pll_unode_t *> free_slots(nodes.size(), NULL);
+  for (unsigned int i = (remove_top ? 1 : 0); i < nodes.size(); ++i) {
+    char *label = utree_copy_label(nodes[i]);
+    pll_unode_t *unode = (pll_unode_t *)calloc(1, sizeof(pll_unode_t));
+    unode->label = label;
+    if (nodes[i].children_number) {
+      unode->next = (pll_unode_t *)calloc(1, sizeof(pll_unode_t));
+      unode->next->next = (pll_unode_t *)calloc(1, sizeof(pll_unode_t));
+      unode->next->next->next = unode;
+      // the label is shared, and only freed once
+      unode->next->label = unode->next->next->label = label;
+      free_slots[i] = (i == 0) ? unode : unode->next;
+    }
+    unodes[i] = unode;
+  }
+  for (unsigned int i = 1; i < nodes.size(); ++i) {
+    int parent = nodes[i].parent;
+    if (parent == 0 && remove_top) {
+      continue;
+    }
+    pll_unode_t *slot = free_slots[parent];
+    free_slots[parent] = slot->next;
+    utree_connect(unodes[i], slot, nodes[i].length);
+  }
+  pll_unode_t *root = unodes[0];
+  if (remove_top) {
+    // the first child becomes the root if it is not a tip
+    int child1 = top.first_child;
+    int child2 = nodes[child1].next_sibling;
+    if (!nodes[child1].children_number) {
+      std::swap(child1, child2);
+    }
+    utree_connect(unodes[child1], unodes[child2],
+        nodes[child1].length + nodes[child2].length);
+    root = unodes[child1];
+  }
+  pll_utree_t *tree = (pll_utree_t *)malloc(sizeof(pll_utree_t));
+  tree->tip_count = tip_count;
+  tree->inner_count = inner_count;
+  tree->edge_count = tip_count + inner_count - 1;
+  tree->binary = 1;
+  tree->nodes = (pll_unode_t **)malloc(
+      (tip_count + inner_count) * sizeof(pll_unode_t *));
+  tree->vroot = root;
+  // depth-first traversal from the root: the tips are indexed
+  // in traversal order, and the inner nodes in post-order (the
+  // root is the last node). This is iterative, because
+  // caterpillar trees can be very deep
+  unsigned int tip_index = 0;
+  unsigned int inner_index = 0;
+  unsigned int pmatrix_index = 0;
+  // (inner node, next directed node to visit)
+  std::vector<std::pair<pll_unode_t *, pll_unode_t *> > stack;
+  stack.push_back(std::make_pair(root, root));
+  while (!stack.empty()) {
+    pll_unode_t *node = stack.back().first;
+    pll_unode_t *slot = stack.back().second;
+    if (!slot) {
+      // all children were visited
+      stack.pop_back();
+      unsigned int index = tip_count + inner_index;
+      tree->nodes[index] = node;
+      node->clv_index = node->next->clv_index
+        = node->next->next->clv_index = index;
+      node->scaler_index = node->next->scaler_index
+        = node->next->next->scaler_index = static_cast<int>(inner_index);
+      node->node_index = tip_count + 3 * inner_index;
+      node->next->node_index = node->node_index + 1;
+      node->next->next->node_index = node->node_index + 2;
+      inner_index++;
+      if (node != root) {
+        node->pmatrix_index = node->back->pmatrix_index = pmatrix_index++;
+      }
+      continue;
+    }
+    pll_unode_t *next_slot = slot->next;
+    stack.back().second = (next_slot == node) ? NULL : next_slot;
+    pll_unode_t *child = slot->back;
+    if (child->next) {
+      stack.push_back(std::make_pair(child, child->next));
+    } else {
+      tree->nodes[tip_index] = child;
+      child->node_index = child->clv_index = tip_index++;
+      child->scaler_index = PLL_SCALE_BUFFER_NONE;
+      child->pmatrix_index = child->back->pmatrix_index = pmatrix_index++;
+    }
+  }
+  assert(tip_index == tip_count);
+  assert(inner_index == inner_count);
+  assert(pmatrix_index == tree->edge_count);
+  return tree;
+}
+
+pll_utree_t * custom_utree_parse_newick(const char *input,
+    size_t input_size,
+    const char **next,
+    ParsingError *error)
+{
+  UTreeParser p;
+  p.error = error;
+  error->type = PET_NOERROR;
+  error->offset = 0;
+  p.input = input;
+  p.input_current = input;
+  p.input_end = input + input_size;
+  p.current_node = -1;
+  utree_parse(&p);
+  if (next) {
+    *next = p.input_current;
+  } else {
+    utree_skip_spaces(&p);
+    if (p.input_current != p.input_end) {
+      utree_set_error(&p, PET_TOKEN_AFTER_SEMICOLON);
+    }
+  }
+  if (utree_has_errored(&p)) {
+    return NULL;
+  }
+  return utree_build(&p);
+}
+
+pll_utree_t * custom_utree_parse_newick(const char *s,
+    bool is_file,
+    ParsingError *error)
+{
+  if (!is_file) {
+    return custom_utree_parse_newick(s, strlen(s), NULL, error);
+  }
+  std::vector<pll_utree_t *> trees;
+  if (!custom_utree_parse_newick_file(s, 1, trees, error)) {
+    return NULL;
+  }
+  if (trees.empty()) {
+    error->type = PET_NOSEMICOLON;
+    error->offset = 0;
+    return NULL;
+  }
+  return trees[0];
+}
+
+bool custom_utree_parse_newicks(const char *input,
+    size_t input_size,
+    unsigned int max_trees,
+    std::vector<pll_utree_t *> &trees,
+    ParsingError *error)
+{
+  error->type = PET_NOERROR;
+  error->offset = 0;
+  const char *end = input + input_size;
+  const char *current = input;
+  std::vector<pll_utree_t *> parsed;
+  while (!max_trees || parsed.size() < max_trees) {
+    while (current != end && to_trim[static_cast<unsigned char>(*current)]) {
+      current++;
+    }
+    if (current == end) {
+      break;
+    }
+    const char *next = NULL;
+    pll_utree_t *tree = custom_utree_parse_newick(current,
+        static_cast<size_t>(end - current),
+        &next,
+        error);
+    if (!tree) {
+      error->offset += static_cast<unsigned int>(current - input);
+      for (auto parsedTree: parsed) {
+        pll_utree_destroy(parsedTree, NULL);
+      }
+      return false;
+    }
+    parsed.push_back(tree);
+    current = next;
+  }
+  trees.insert(trees.end(), parsed.begin(), parsed.end());
+  return true;
+}
+
+bool custom_utree_parse_newick_file(const char *filename,
+    unsigned int max_trees,
+    std::vector<pll_utree_t *> &trees,
+    ParsingError *error)
+{
+  error->type = PET_NOERROR;
+  error->offset = 0;
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    error->type = PET_FILE_DOES_NOT_EXISTS;
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    close(fd);
+    error->type = PET_FILE_DOES_NOT_EXISTS;
+    return false;
+  }
+  size_t size = static_cast<size_t>(file_stat.st_size);
+  void *mapping = NULL;
+  if (size) {
+    mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    error->type = PET_FILE_DOES_NOT_EXISTS;
+    return false;
+  }
+  bool ok = custom_utree_parse_newicks(static_cast<const char *>(mapping),
+      size,
+      max_trees,
+      trees,
+      error);
+  if (size) {
+    munmap(mapping, size);
+  }
+  return ok;
+}
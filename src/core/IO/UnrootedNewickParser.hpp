@@ -0,0 +1,55 @@
+#pragma once
+
+#include <IO/NewickParserCommon.hpp>
+#include <cstddef>
+#include <vector>
+
+/**
+ *  Parse the first unrooted tree from the newick buffer
+ *  [input, input + input_size). The buffer does not need to be
+ *  null-terminated. If the top node has two children, the tree
+ *  is unrooted.
+ *  If next is not NULL, it is set to the character following
+ *  the semicolon, and the text after the semicolon is not checked.
+ *  If an error occures, returns NULL and fills the
+ *  error object.
+ */
+pll_utree_t * custom_utree_parse_newick(const char *input,
+    size_t input_size,
+    const char **next,
+    ParsingError *error);
+
+/**
+ *  Parse an unrooted tree from a newick string or file
+ *  If an error occures, returns NULL and fills the
+ *  error object.
+ */
+pll_utree_t * custom_utree_parse_newick(const char *s,
+    bool is_file,
+    ParsingError *error);
+
+/**
+ *  Parse the first max_trees trees of the newick buffer
+ *  [input, input + input_size) (all of them if max_trees is 0)
+ *  and append them to trees. The trees are separated by their
+ *  semicolons, and the buffer does not need to be null-terminated.
+ *  Returns false and fills the error object if an error occures
+ *  (in this case, no tree is appended).
+ */
+bool custom_utree_parse_newicks(const char *input,
+    size_t input_size,
+    unsigned int max_trees,
+    std::vector<pll_utree_t *> &trees,
+    ParsingError *error);
+
+/**
+ *  Parse the first max_trees trees of a newick file (all of them
+ *  if max_trees is 0) and append them to trees. The file is
+ *  memory-mapped and parsed with custom_utree_parse_newicks. If it
+ *  cannot be opened or mapped, the error type is PET_FILE_DOES_NOT_EXISTS.
+ */
+bool custom_utree_parse_newick_file(const char *filename,
+    unsigned int max_trees,
+    std::vector<pll_utree_t *> &trees,
+    ParsingError *error);
+
@@ -2,9 +2,12 @@
 
 #include <vector>
 #include <memory>
+#include <sstream>
 #include "MiniNJ.hpp"
+#include "SpeciesMatrices.hpp"
 #include <IO/Logger.hpp>
 #include <IO/GeneSpeciesMapping.hpp>
+#include <parallelization/ParallelContext.hpp>
 #include <trees/PLLUnrootedTree.hpp>
 #include <unordered_map>
 #include<set>
@@ -55,9 +58,39 @@ public:
   void relabelNodesWithSpeciesId(unsigned int speciesId, 
     unsigned int newSpeciesId);
 
-  void updateNeigborMatrix(MatrixDouble &neighborMatrix,
-      MatrixDouble &denominatorMatrix);
+  /**
+   *  Recompute the contribution of this tree to the neighbor and
+   *  denominator matrices. Must be called after the tree changed.
+   */
+  void updateContribution();
+  /**
+   *  Add the last computed contribution of this tree to the
+   *  local matrices
+   */
+  void addContribution(LocalSpeciesMatrices &localMatrices) const;
+  /**
+   *  Remove the last computed contribution of this tree from 
+   *  the local matrices
+   */
+  void removeContribution(LocalSpeciesMatrices &localMatrices) const;
+  /**
+   *  Append the linear indices of the entries of the last 
+   *  computed contribution of this tree
+   */
+  void getContributionIndices(unsigned int speciesNumber,
+      std::vector<unsigned long> &indices) const;
   int coveredSpeciesNumber();
+  bool coversSpecies(int speciesId) const {
+    return _speciesIdToGeneIds.find(speciesId) != _speciesIdToGeneIds.end();
+  }
+  /**
+   *  Append the IDs of the species covered by this tree
+   */
+  void getCoveredSpecies(std::vector<int> &species) const {
+    for (auto &p: _speciesIdToGeneIds) {
+      species.push_back(p.first);
+    }
+  }
   std::string toString();
   void printInternalState();
   unsigned int getLeavesNumber() {
@@ -65,10 +98,12 @@ public:
   }
 
   std::pair<int, int> getChildren(int geneId, int parentId);
-  void updateMiniNJMatrix(MatrixDouble &distanceMatrixToUpdate,
-      MatrixDouble &denominatorMatrixToUpdate);
   int _hackIndex;
 private:
+  void updateNeigborMatrix(SparseMatrix &neighborMatrix,
+      SparseMatrix &denominatorMatrix);
+  void updateMiniNJMatrix(SparseMatrix &distanceMatrix,
+      SparseMatrix &denominatorMatrix);
   // return child geneId or -1 if not exists
   int getChildIdWithSpecies(int geneId, int speciesId);
   int mergeNeighbors(int geneId1, int geneId2);
@@ -93,6 +128,8 @@ private:
   std::vector<CherryNode> _nodes;
   SpeciesIdToGeneIds _speciesIdToGeneIds;
   unsigned int _leavesNumber;
+  SparseMatrix _neighborContribution;
+  SparseMatrix _denominatorContribution;
   static int hackCounter;
 };
 
@@ -113,11 +150,11 @@ void CherryTree::printInternalState()
   Logger::info << "Covered species " << coveredSpeciesNumber() << std::endl;
 }
 
-static void printMatrix(const MatrixDouble m) 
+static void printMatrix(const MatrixDouble &m) 
 {
-  for (auto &v: m) {
-    for (auto e: v) {
-      Logger::info << e << " ";
+  for (unsigned int i = 0; i < m.rows(); ++i) {
+    for (unsigned int j = 0; j < m.columns(); ++j) {
+      Logger::info << m[i][j] << " ";
     }
     Logger::info << std::endl;
   }
@@ -127,7 +164,7 @@ static void printMatrix(const MatrixDouble m)
 static void divideMatrix(MatrixDouble &m, const MatrixDouble &denom)
 {
   assert(m.size() == denom.size());
-  assert(m[0].size() == denom[0].size());
+  assert(m.columns() == denom.columns());
   for (unsigned int i = 0; i < m.size(); ++i) {
     for (unsigned int j = 0; j < m.size(); ++j) {
       if (denom[i][j] != 0.0) {
@@ -171,11 +208,15 @@ void CherryTree::relabelNodesWithSpeciesId(unsigned int speciesId,
     unsigned int newSpeciesId
     )
 {
-  for (auto geneId: _speciesIdToGeneIds[speciesId]) {
-    _nodes[geneId].height++;
-  }
-  for (auto geneId: _speciesIdToGeneIds[newSpeciesId]) {
-    _nodes[geneId].height++;
+  // only look the species up: a tree that does not cover
+  // them must not get an empty species
+  for (auto id: {speciesId, newSpeciesId}) {
+    auto it = _speciesIdToGeneIds.find(id);
+    if (it != _speciesIdToGeneIds.end()) {
+      for (auto geneId: it->second) {
+        _nodes[geneId].height++;
+      }
+    }
   }
   if (_speciesIdToGeneIds.find(speciesId) == _speciesIdToGeneIds.end()) {
     return;
@@ -230,15 +271,17 @@ void CherryTree::updateInternodeDistance(int geneId,
   updateInternodeDistance(children.second, geneId, sourceSpeciesId, currentDistance + 1.0, speciesDistances, denominator, count);
 }
 
-void CherryTree::updateMiniNJMatrix(MatrixDouble &distanceMatrixToUpdate,
-      MatrixDouble &denominatorMatrixToUpdate)
+void CherryTree::updateMiniNJMatrix(SparseMatrix &distanceMatrixToUpdate,
+      SparseMatrix &denominatorMatrixToUpdate)
 {
-  int speciesNumber = distanceMatrixToUpdate.size(); 
+  int speciesNumber = 0;
+  for (auto &p: _speciesIdToGeneIds) {
+    speciesNumber = std::max(speciesNumber, p.first + 1);
+  }
   double zero = 0.0;
-  VectorDouble zeros(speciesNumber, zero);
-  MatrixDouble speciesDistance(speciesNumber, zeros);
-  MatrixDouble denominator(speciesNumber, zeros);
-  MatrixDouble count(speciesNumber, zeros);
+  MatrixDouble speciesDistance(speciesNumber, speciesNumber, zero);
+  MatrixDouble denominator(speciesNumber, speciesNumber, zero);
+  MatrixDouble count(speciesNumber, speciesNumber, zero);
   for (auto &p: _speciesIdToGeneIds) {
     auto speciesId = p.first;
     const auto &geneIdSet = p.second;
@@ -250,8 +293,8 @@ void CherryTree::updateMiniNJMatrix(MatrixDouble &distanceMatrixToUpdate,
   for (int i = 0; i < speciesNumber; ++i) {
     for (int j = 0; j < speciesNumber; ++j) {
       if (i != j && speciesDistance[i][j] != zero) { 
-        distanceMatrixToUpdate[i][j] += count[i][j] * speciesDistance[i][j];
-        denominatorMatrixToUpdate[i][j] += count[i][j] * denominator[i][j];
+        distanceMatrixToUpdate.add(i, j, count[i][j] * speciesDistance[i][j]);
+        denominatorMatrixToUpdate.add(i, j, count[i][j] * denominator[i][j]);
       }
     }
   }  
@@ -274,11 +317,40 @@ std::pair<int, int> CherryTree::getChildren(int geneId, int parentId)
 
 
 
-void CherryTree::updateNeigborMatrix(MatrixDouble &neighborMatrixToUpdate,
-      MatrixDouble &denominatorMatrixToUpdate)
+void CherryTree::updateContribution()
 {
-  MatrixDouble *neighborMatrix = &neighborMatrixToUpdate;
-  MatrixDouble *denominatorMatrix = &denominatorMatrixToUpdate;
+  _neighborContribution.clear();
+  _denominatorContribution.clear();
+  if (MININJ) {
+    updateMiniNJMatrix(_neighborContribution, _denominatorContribution);
+  } else {
+    updateNeigborMatrix(_neighborContribution, _denominatorContribution);
+  }
+}
+
+void CherryTree::addContribution(LocalSpeciesMatrices &localMatrices) const
+{
+  localMatrices.add(_neighborContribution, _denominatorContribution);
+}
+
+void CherryTree::removeContribution(
+    LocalSpeciesMatrices &localMatrices) const
+{
+  localMatrices.remove(_neighborContribution, _denominatorContribution);
+}
+
+void CherryTree::getContributionIndices(unsigned int speciesNumber,
+      std::vector<unsigned long> &indices) const
+{
+  _neighborContribution.getIndices(speciesNumber, indices);
+  _denominatorContribution.getIndices(speciesNumber, indices);
+}
+
+void CherryTree::updateNeigborMatrix(SparseMatrix &neighborMatrixToUpdate,
+      SparseMatrix &denominatorMatrixToUpdate)
+{
+  SparseMatrix *neighborMatrix = &neighborMatrixToUpdate;
+  SparseMatrix *denominatorMatrix = &denominatorMatrixToUpdate;
   
   
   /*
@@ -310,7 +382,7 @@ void CherryTree::updateNeigborMatrix(MatrixDouble &neighborMatrixToUpdate,
       auto spid1 = _nodes[geneId].speciesId;
       auto spid2 = _nodes[neighborGeneId].speciesId;
       assert(spid1 == speciesId);
-      (*neighborMatrix)[spid1][spid2] += 1.0;
+      neighborMatrix->add(spid1, spid2, 1.0);
     }
     // Then fill denominatorMatrix with
     // the maximum possible number of neighbors
@@ -320,8 +392,8 @@ void CherryTree::updateNeigborMatrix(MatrixDouble &neighborMatrixToUpdate,
       const auto &geneIdSet2 = p2.second;
       double small = std::min(geneIdSet.size(),  geneIdSet2.size());
       double big = std::max(geneIdSet.size(),  geneIdSet2.size());
-      (*denominatorMatrix)[speciesId][spid2] += 
-        2.0  / (1.0 / big + 1.0 / small);
+      denominatorMatrix->add(speciesId, spid2,
+        2.0  / (1.0 / big + 1.0 / small));
         
       //std::min(geneIdSet.size(),  geneIdSet2.size());
     }
@@ -665,17 +737,247 @@ CherryTree::CherryTree(const std::string &treeString,
 }
 
 
-static void filterGeneTrees(std::vector<std::shared_ptr<CherryTree> > &geneTrees)
+static bool isInformative(CherryTree &geneTree)
+{
+  return geneTree.getLeavesNumber() >= 4 && geneTree.coveredSpeciesNumber() > 2;
+}
+
+/**
+ *  Remove the gene trees that do not hold information 
+ *  @return the number of remaining gene trees over all ranks
+ */
+static unsigned int filterGeneTrees(std::vector<std::shared_ptr<CherryTree> > &geneTrees)
 {
   auto geneTreesCopy = geneTrees;
   geneTrees.clear();
   for (auto geneTree: geneTreesCopy) {
-    if (geneTree->getLeavesNumber() >= 4 && geneTree->coveredSpeciesNumber() > 2 ) {
+    if (isInformative(*geneTree)) {
       geneTrees.push_back(geneTree);
     }
   }
+  unsigned int remainingTrees = geneTrees.size();
+  ParallelContext::sumUInt(remainingTrees);
   if (CHERRY_DBG) {
-    Logger::info << "Number of gene trees after filtering: " << geneTrees.size() << std::endl;;
+    Logger::info << "Number of gene trees after filtering: " << remainingTrees << std::endl;;
+  }
+  return remainingTrees;
+}
+
+using CherryTrees = std::vector<std::shared_ptr<CherryTree> >;
+
+/**
+ *  The informative gene trees of this rank, indexed by the 
+ *  species they cover, such that joining two species only visits
+ *  the gene trees that cover one of them.
+ *
+ *  When checking if a gene tree is informative, every species 
+ *  resulting from a join counts as covered by all the gene trees,
+ *  even the ones that do not cover it. These species are not
+ *  stored in the gene trees: they are counted here, and each gene
+ *  tree only stores the number of its species that do not result
+ *  from a join. The gene trees that do not cover the joined 
+ *  species are then only visited when they become uninformative.
+ */
+class CherryForest {
+public:
+  CherryForest(const CherryTrees &geneTrees, unsigned int speciesNumber);
+
+  /**
+   *  Join the second species into the first one in the gene trees,
+   *  update the local matrices and remove the gene trees that are
+   *  not informative anymore. Append the linear indices of the
+   *  entries of the local matrices that changed to changedIndices.
+   */
+  void joinSpecies(int speciesId1,
+      int speciesId2,
+      std::vector<double> &branchLengths,
+      LocalSpeciesMatrices &localMatrices,
+      std::vector<unsigned long> &changedIndices);
+
+  /**
+   *  Local indices of the gene trees covering a species
+   */
+  const std::set<unsigned int> &getTrees(int speciesId) const {
+    return _speciesToTrees[speciesId];
+  }
+  
+  CherryTree &getTree(unsigned int index) {return *_geneTrees[index];}
+
+  /**
+   *  @return the number of remaining gene trees over all ranks
+   */
+  unsigned int getRemainingTrees() const;
+
+  void printTrees(int maxTrees);
+private:
+  bool isInformative(unsigned int index) const;
+  void updateOwnSpeciesNumber(unsigned int index);
+  void remove(unsigned int index);
+  
+  CherryTrees _geneTrees;
+  unsigned int _speciesNumber;
+  std::vector<std::set<unsigned int> > _speciesToTrees;
+  std::vector<bool> _joinedSpecies;
+  unsigned int _joinedSpeciesNumber;
+  // for each gene tree, the number of its species that 
+  // do not result from a join
+  std::vector<unsigned int> _ownSpeciesNumbers;
+  // the gene trees with up to two own species, per number: the
+  // only ones that can become uninformative without being visited
+  std::vector<std::set<unsigned int> > _fewSpeciesTrees;
+  unsigned int _treesNumber;
+};
+
+CherryForest::CherryForest(const CherryTrees &geneTrees, 
+    unsigned int speciesNumber):
+  _geneTrees(geneTrees),
+  _speciesNumber(speciesNumber),
+  _speciesToTrees(speciesNumber),
+  _joinedSpecies(speciesNumber, false),
+  _joinedSpeciesNumber(0),
+  _ownSpeciesNumbers(geneTrees.size(), 0),
+  _fewSpeciesTrees(3),
+  _treesNumber(geneTrees.size())
+{
+  std::vector<int> species;
+  for (unsigned int i = 0; i < _geneTrees.size(); ++i) {
+    species.clear();
+    _geneTrees[i]->getCoveredSpecies(species);
+    for (auto speciesId: species) {
+      _speciesToTrees[speciesId].insert(i);
+    }
+    _ownSpeciesNumbers[i] = species.size();
+    if (_ownSpeciesNumbers[i] < _fewSpeciesTrees.size()) {
+      _fewSpeciesTrees[_ownSpeciesNumbers[i]].insert(i);
+    }
+  }
+}
+
+bool CherryForest::isInformative(unsigned int index) const
+{
+  return _geneTrees[index]->getLeavesNumber() >= 4 
+    && _ownSpeciesNumbers[index] + _joinedSpeciesNumber > 2;
+}
+
+void CherryForest::updateOwnSpeciesNumber(unsigned int index)
+{
+  auto &ownSpecies = _ownSpeciesNumbers[index];
+  if (ownSpecies < _fewSpeciesTrees.size()) {
+    _fewSpeciesTrees[ownSpecies].erase(index);
+  }
+  std::vector<int> species;
+  _geneTrees[index]->getCoveredSpecies(species);
+  ownSpecies = 0;
+  for (auto speciesId: species) {
+    if (!_joinedSpecies[speciesId]) {
+      ownSpecies++;
+    }
+  }
+  if (ownSpecies < _fewSpeciesTrees.size()) {
+    _fewSpeciesTrees[ownSpecies].insert(index);
+  }
+}
+
+void CherryForest::remove(unsigned int index)
+{
+  std::vector<int> species;
+  _geneTrees[index]->getCoveredSpecies(species);
+  for (auto speciesId: species) {
+    _speciesToTrees[speciesId].erase(index);
+  }
+  if (_ownSpeciesNumbers[index] < _fewSpeciesTrees.size()) {
+    _fewSpeciesTrees[_ownSpeciesNumbers[index]].erase(index);
+  }
+  _geneTrees[index] = nullptr;
+  _treesNumber--;
+}
+
+unsigned int CherryForest::getRemainingTrees() const
+{
+  unsigned int remainingTrees = _treesNumber;
+  ParallelContext::sumUInt(remainingTrees);
+  if (CHERRY_DBG) {
+    Logger::info << "Number of gene trees after filtering: " << remainingTrees << std::endl;
+  }
+  return remainingTrees;
+}
+
+void CherryForest::printTrees(int maxTrees)
+{
+  int displayed = 0;
+  for (auto &geneTree: _geneTrees) {
+    if (displayed == maxTrees) {
+      break;
+    }
+    if (geneTree) {
+      Logger::info << "Tree " << geneTree->_hackIndex << " " <<  geneTree->toString() << std::endl;
+      displayed++;
+    }
+  }
+}
+
+void CherryForest::joinSpecies(int speciesId1,
+    int speciesId2,
+    std::vector<double> &branchLengths,
+    LocalSpeciesMatrices &localMatrices,
+    std::vector<unsigned long> &changedIndices)
+{
+  // the gene trees covering the second species now cover the first one
+  auto trees = _speciesToTrees[speciesId1];
+  trees.insert(_speciesToTrees[speciesId2].begin(), 
+      _speciesToTrees[speciesId2].end());
+  _speciesToTrees[speciesId1] = trees;
+  _speciesToTrees[speciesId2].clear();
+  if (_joinedSpecies[speciesId2]) {
+    _joinedSpecies[speciesId2] = false;
+    _joinedSpeciesNumber--;
+  }
+  if (!_joinedSpecies[speciesId1]) {
+    _joinedSpecies[speciesId1] = true;
+    _joinedSpeciesNumber++;
+  }
+  for (auto index: trees) {
+    auto &geneTree = *_geneTrees[index];
+    // Only the gene trees covering the second species change (and
+    // the ones covering the first species for MiniNJ distances, that
+    // depend on the node heights): only their old contributions are
+    // removed and their new ones added
+    bool changed = MININJ || geneTree.coversSpecies(speciesId2);
+    if (changed) {
+      geneTree.getContributionIndices(_speciesNumber, changedIndices);
+      geneTree.removeContribution(localMatrices);
+    }
+    geneTree.mergeNodesWithSpeciesId(speciesId1,
+        speciesId2,
+        branchLengths[0],
+        branchLengths[1],
+        branchLengths[2],
+        branchLengths[3]);
+    geneTree.relabelNodesWithSpeciesId(speciesId2, speciesId1);
+    updateOwnSpeciesNumber(index);
+    if (!isInformative(index)) {
+      if (!changed) {
+        geneTree.getContributionIndices(_speciesNumber, changedIndices);
+        geneTree.removeContribution(localMatrices);
+      }
+      remove(index);
+    } else if (changed) {
+      geneTree.updateContribution();
+      geneTree.getContributionIndices(_speciesNumber, changedIndices);
+      geneTree.addContribution(localMatrices);
+    }
+  }
+  // the other gene trees only become uninformative if the
+  // number of joined species decreased
+  for (unsigned int ownSpecies = 0; ownSpecies < _fewSpeciesTrees.size() 
+      && ownSpecies + _joinedSpeciesNumber <= 2; ++ownSpecies) {
+    auto uninformativeTrees = _fewSpeciesTrees[ownSpecies];
+    for (auto index: uninformativeTrees) {
+      _geneTrees[index]->getContributionIndices(_speciesNumber, 
+          changedIndices);
+      _geneTrees[index]->removeContribution(localMatrices);
+      remove(index);
+    }
   }
 }
 
@@ -688,24 +990,36 @@ std::unique_ptr<PLLRootedTree> Cherry::geneTreeCherry(const Families &families)
   
   // fill the structure that map speciesStr <-> speciesId
   // and create gene trees mapped with the species IDs
-  for (auto &family: families) {
+  // All ranks assign the species IDs in the same order, but
+  // each rank only builds the gene trees of its families
+  auto familiesNumber = static_cast<unsigned int>(families.size());
+  auto begin = ParallelContext::getBegin(familiesNumber);
+  auto end = ParallelContext::getEnd(familiesNumber);
+  for (unsigned int i = 0; i < familiesNumber; ++i) {
+    auto &family = families[i];
     GeneSpeciesMapping mapping;
-    mapping.fill(family.mappingFile, family.startingGeneTree);
-    auto coveredSpecies = mapping.getCoveredSpecies();
+    Family::fillMapping(family, mapping);
     for (auto &species: mapping.getCoveredSpecies()) {
       if (speciesStrToId.find(species) == speciesStrToId.end()) {
         speciesStrToId.insert({species, speciesIdToStr.size()});
         speciesIdToStr.push_back(species);
       }
     }
-    std::ifstream reader(family.startingGeneTree);
+    if (i < begin || i >= end) {
+      continue;
+    }
+    std::string geneTreesContent;
+    Family::getStartingGeneTreeContent(family, geneTreesContent);
+    std::istringstream reader(geneTreesContent);
     std::string line;
     while (std::getline(reader, line)) {
       geneTrees.push_back(std::make_shared<CherryTree>( 
           line, mapping, speciesStrToId));
     }
   }
-  Logger::info << "Loaded " << geneTrees.size() << " gene trees" << std::endl;
+  unsigned int loadedTrees = geneTrees.size();
+  ParallelContext::sumUInt(loadedTrees);
+  Logger::info << "Loaded " << loadedTrees << " gene trees" << std::endl;
   unsigned int speciesNumber = speciesStrToId.size();
   std::unordered_set<int> remainingSpeciesIds;
   for (unsigned int i = 0; i < speciesNumber; ++i) {
@@ -715,10 +1029,28 @@ std::unique_ptr<PLLRootedTree> Cherry::geneTreeCherry(const Families &families)
   for (auto geneTree: geneTrees) {
     geneTree->mergeNodesWithSameSpeciesId();
   }
+  // filter out gene trees that do not hold information
+  auto remainingTrees = filterGeneTrees(geneTrees);
+  // The neighbor and denominator matrices are the sums of the
+  // contributions of the gene trees. They are computed once, and
+  // then only the contributions of the gene trees that change
+  // after each join are updated, and only the entries they 
+  // touch are reduced.
+  LocalSpeciesMatrices localMatrices(speciesNumber);
+  for (auto geneTree: geneTrees) {
+    geneTree->updateContribution();
+    geneTree->addContribution(localMatrices);
+  }
+  MatrixDouble neighborMatrix;
+  MatrixDouble denominatorMatrix;
+  SpeciesMatrices::reduceMatrices(localMatrices,
+      neighborMatrix, denominatorMatrix);
+  MatrixDouble frequencies = neighborMatrix;
+  divideMatrix(frequencies, denominatorMatrix);
+  MaxEntryQueue maxEntries(frequencies);
+  CherryForest forest(geneTrees, speciesNumber);
+  geneTrees.clear();
   // main loop of the algorithm
-  VectorDouble zeros(speciesNumber, 0.0);
-  MatrixDouble neighborMatrix(speciesNumber, zeros);
-  MatrixDouble denominatorMatrix(speciesNumber, zeros);
   for (unsigned int i = 0; i < speciesNumber - 2; ++i) {
     if (CHERRY_DBG) {
       Logger::info << std::endl;
@@ -729,24 +1061,8 @@ std::unique_ptr<PLLRootedTree> Cherry::geneTreeCherry(const Families &families)
         Logger::info << "  " << spid << "\t" << speciesIdToStr[spid] << std::endl;
       }
     }
-      // filter out gene trees that do not hold information
-    filterGeneTrees(geneTrees);
-    // merge identical tips in cherries
-    // compute the frequency matrix
     if (CHERRY_DBG) {
-      for (int i = 0; i < std::min(int(geneTrees.size()), TREES_TO_DISPLAY); ++i) {
-        Logger::info << "Tree " << geneTrees[i]->_hackIndex << " " <<  geneTrees[i]->toString() << std::endl;
-      }
-    }
-    
-    neighborMatrix = MatrixDouble(speciesNumber, zeros);
-    denominatorMatrix = MatrixDouble(speciesNumber, zeros);
-    for (auto geneTree: geneTrees) {
-      if (MININJ) {
-        geneTree->updateMiniNJMatrix(neighborMatrix, denominatorMatrix);
-      } else {
-        geneTree->updateNeigborMatrix(neighborMatrix, denominatorMatrix);
-      }
+      forest.printTrees(TREES_TO_DISPLAY);
     }
     /*
     if (CHERRY_DBG) {
@@ -756,28 +1072,25 @@ std::unique_ptr<PLLRootedTree> Cherry::geneTreeCherry(const Families &families)
       printMatrix(denominatorMatrix);
     }
     */
-    divideMatrix(neighborMatrix, denominatorMatrix);
     if (CHERRY_DBG) {
       Logger::info << "Frequencies: " << std::endl;
-      printMatrix(neighborMatrix);
+      printMatrix(frequencies);
     }
     if (WITHOUT_CHERRY_MERGING) {
       if (!MININJ) {
-        for (auto &c: neighborMatrix) {
-          for (auto &d: c) {
-            d = -d;
-          }
+        for (unsigned int k = 0; k < frequencies.entries(); ++k) {
+          frequencies.data()[k] = -frequencies.data()[k];
         }
       }
-      return MiniNJ::applyNJ(neighborMatrix, speciesIdToStr, speciesStrToId);
+      return MiniNJ::applyNJ(frequencies, speciesIdToStr, speciesStrToId);
     }
     // compute the two species to join, and join them
     std::pair<int, int> bestPairSpecies = MININJ ? 
-      getMinInMatrix(neighborMatrix) : getMaxInMatrix(neighborMatrix);
+      getMinInMatrix(frequencies) : maxEntries.getMax();
     Logger::info << bestPairSpecies.first << " " << bestPairSpecies.second << std::endl; 
     if (bestPairSpecies.first == bestPairSpecies.second) {
       // edge case when we filtered out all gene trees
-      assert(geneTrees.size() == 0);
+      assert(remainingTrees == 0);
       bestPairSpecies = {-1, -1};
       for (auto speciesId: remainingSpeciesIds) {
         if (bestPairSpecies.first == -1) {
@@ -795,26 +1108,28 @@ std::unique_ptr<PLLRootedTree> Cherry::geneTreeCherry(const Families &families)
     std::string speciesStr2 = speciesIdToStr[bestPairSpecies.second];
     if (CHERRY_DBG) {
       Logger::info << "Best pair " << bestPairSpecies.first
-        << " " << bestPairSpecies.second << " with distance " << neighborMatrix[bestPairSpecies.first][bestPairSpecies.second] << std::endl;
+        << " " << bestPairSpecies.second << " with distance " << frequencies[bestPairSpecies.first][bestPairSpecies.second] << std::endl;
       Logger::info << "Best pair " << speciesStr1 << " " << speciesStr2 << std::endl;
     }
-    double sumBL1 = 0.0;
-    double denBL1 = 0.0;
-    double sumBL2 = 0.0;
-    double denBL2 = 0.0;
-    for (auto geneTree: geneTrees) {
-      geneTree->mergeNodesWithSpeciesId(bestPairSpecies.first,
-          bestPairSpecies.second,
-          sumBL1,
-          denBL1,
-          sumBL2,
-          denBL2);
-      geneTree->relabelNodesWithSpeciesId(bestPairSpecies.second,
-        bestPairSpecies.first);
-      //geneTree->mergeNodesWithSpeciesId(bestPairSpecies.first);
-    }
-    double bl1 = sumBL1 / denBL1;
-    double bl2 = sumBL2 / denBL2;
+    // sumBL1, denBL1, sumBL2, denBL2
+    std::vector<double> branchLengths(4, 0.0);
+    // only reduce the entries that changed on one of the ranks
+    std::vector<unsigned long> changedIndices;
+    forest.joinSpecies(bestPairSpecies.first,
+        bestPairSpecies.second,
+        branchLengths,
+        localMatrices,
+        changedIndices);
+    remainingTrees = forest.getRemainingTrees();
+    auto indices = SpeciesMatrices::reduceEntries(localMatrices,
+        neighborMatrix, denominatorMatrix, changedIndices);
+    maxEntries.remove(frequencies, indices);
+    SpeciesMatrices::updateFrequencies(frequencies, neighborMatrix, 
+        denominatorMatrix, indices);
+    maxEntries.insert(frequencies, indices);
+    ParallelContext::sumDoubles(&branchLengths[0], branchLengths.size());
+    double bl1 = branchLengths[0] / branchLengths[1];
+    double bl2 = branchLengths[2] / branchLengths[3];
     speciesIdToStr[bestPairSpecies.first] = std::string("(") + 
       speciesStr1 + ":" + std::to_string(bl1) + "," + 
       speciesStr2 + ":" + std::to_string(bl2) + ")";
@@ -827,20 +1142,18 @@ std::unique_ptr<PLLRootedTree> Cherry::geneTreeCherry(const Families &families)
     lastSpeciesId.push_back(speciesId);
   }
   assert(lastSpecies.size() == 2);
-  double sumBL1 = 0.0;
-  double denBL1 = 0.0;
-  double sumBL2 = 0.0;
-  double denBL2 = 0.0;
-  for (auto geneTree: geneTrees) {
-    geneTree->mergeNodesWithSpeciesId(lastSpeciesId[0],
+  std::vector<double> branchLengths(4, 0.0);
+  for (auto index: forest.getTrees(lastSpeciesId[0])) {
+    forest.getTree(index).mergeNodesWithSpeciesId(lastSpeciesId[0],
         lastSpeciesId[1],
-        sumBL1,
-        denBL1,
-        sumBL2,
-        denBL2);
+        branchLengths[0],
+        branchLengths[1],
+        branchLengths[2],
+        branchLengths[3]);
   }
-  double bl1 = sumBL1 / denBL1;
-  double bl2 = sumBL2 / denBL2;
+  ParallelContext::sumDoubles(&branchLengths[0], branchLengths.size());
+  double bl1 = branchLengths[0] / branchLengths[1];
+  double bl2 = branchLengths[2] / branchLengths[3];
   std::string newick = "(" + lastSpecies[0] + ":" + std::to_string(bl1) +
                        "," + lastSpecies[1] + ":" + std::to_string(bl2) + ");";
   Logger::info << newick << std::endl;
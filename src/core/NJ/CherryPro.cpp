@@ -3,10 +3,13 @@
 #include <vector>
 #include <array>
 #include <memory>
+#include <sstream>
 #include <set>
 #include "MiniNJ.hpp"
+#include "SpeciesMatrices.hpp"
 #include <IO/Logger.hpp>
 #include <IO/GeneSpeciesMapping.hpp>
+#include <parallelization/ParallelContext.hpp>
 #include <trees/PLLUnrootedTree.hpp>
 #include <util/types.hpp>
 #include <unordered_map>
@@ -61,9 +64,39 @@ public:
   void relabelNodesWithSpeciesId(unsigned int speciesId, 
     unsigned int newSpeciesId);
 
-  void updateNeigborMatrix(MatrixDouble &neighborMatrix,
-      MatrixDouble &denominatorMatrix);
+  /**
+   *  Recompute the contribution of this tree to the neighbor and
+   *  denominator matrices. Must be called after the tree changed.
+   */
+  void updateContribution();
+  /**
+   *  Add the last computed contribution of this tree to the
+   *  local matrices
+   */
+  void addContribution(LocalSpeciesMatrices &localMatrices) const;
+  /**
+   *  Remove the last computed contribution of this tree from 
+   *  the local matrices
+   */
+  void removeContribution(LocalSpeciesMatrices &localMatrices) const;
+  /**
+   *  Append the linear indices of the entries of the last 
+   *  computed contribution of this tree
+   */
+  void getContributionIndices(unsigned int speciesNumber,
+      std::vector<unsigned long> &indices) const;
   int coveredSpeciesNumber();
+  bool coversSpecies(int speciesId) const {
+    return _speciesIdToGeneIds.find(speciesId) != _speciesIdToGeneIds.end();
+  }
+  /**
+   *  Append the IDs of the species covered by this tree
+   */
+  void getCoveredSpecies(std::vector<int> &species) const {
+    for (auto &p: _speciesIdToGeneIds) {
+      species.push_back(p.first);
+    }
+  }
   int getCladeSize(int speciesId)  {return _speciesIdToCladeSize[speciesId];}
   std::string toString();
   void printInternalState();
@@ -86,7 +119,7 @@ private:
   void getAllEdgesRec(std::vector<CherryProEdge> &edges, const CherryProEdge &parentEdge);
   void getAllEdges(std::vector<CherryProEdge> &edges);
   int tagFromEdge(const CherryProEdge &edge, bool keepRoot);
-  void updateDenominatorMatrixRec(int geneId, MatrixDouble &denominatorMatrix, Clade &clade);
+  void updateDenominatorMatrixRec(int geneId, SparseMatrix &denominatorMatrix, Clade &clade);
 
   int getAnyValidId();
   int getAnyValidLeafId();
@@ -96,6 +129,8 @@ private:
   SpeciesIdToGeneIds _speciesIdToGeneIds;
   std::unordered_map<int, int>  _speciesIdToCladeSize;
   unsigned int _leavesNumber;
+  SparseMatrix _neighborContribution;
+  SparseMatrix _denominatorContribution;
   static int hackCounter;
 };
 
@@ -333,11 +368,11 @@ void CherryProTree::printInternalState()
   Logger::info << "Covered species " << coveredSpeciesNumber() << std::endl;
 }
 
-static void printMatrix(const MatrixDouble m) 
+static void printMatrix(const MatrixDouble &m) 
 {
-  for (auto &v: m) {
-    for (auto e: v) {
-      Logger::info << e << " ";
+  for (unsigned int i = 0; i < m.rows(); ++i) {
+    for (unsigned int j = 0; j < m.columns(); ++j) {
+      Logger::info << m[i][j] << " ";
     }
     Logger::info << std::endl;
   }
@@ -347,7 +382,7 @@ static void printMatrix(const MatrixDouble m)
 static void divideMatrix(MatrixDouble &m, const MatrixDouble &denom)
 {
   assert(m.size() == denom.size());
-  assert(m[0].size() == denom[0].size());
+  assert(m.columns() == denom.columns());
   for (unsigned int i = 0; i < m.size(); ++i) {
     for (unsigned int j = 0; j < m.size(); ++j) {
       if (denom[i][j] != 0.0) {
@@ -357,6 +392,27 @@ static void divideMatrix(MatrixDouble &m, const MatrixDouble &denom)
   }
 }
 
+/**
+ *  Recompute the contributions of all the gene trees, and the
+ *  global matrices from scratch
+ */
+static void computeAllContributions(GeneTrees &geneTrees,
+    LocalSpeciesMatrices &localMatrices,
+    MatrixDouble &neighborMatrix,
+    MatrixDouble &denominatorMatrix,
+    MatrixDouble &frequencies)
+{
+  localMatrices.clear();
+  for (auto geneTree: geneTrees) {
+    geneTree->updateContribution();
+    geneTree->addContribution(localMatrices);
+  }
+  SpeciesMatrices::reduceMatrices(localMatrices,
+      neighborMatrix, denominatorMatrix);
+  frequencies = neighborMatrix;
+  divideMatrix(frequencies, denominatorMatrix);
+}
+
 static std::pair<int, int> getMaxInMatrix(MatrixDouble &m)
 {
   assert(m.size());
@@ -372,7 +428,7 @@ static std::pair<int, int> getMaxInMatrix(MatrixDouble &m)
 }
  
 
-static double getRatio(const MatrixDouble m, int i, int j, double bestScore)
+static double getRatio(const MatrixDouble &m, int i, int j, double bestScore)
 {
   return fabs(bestScore - m[i][j]) / (bestScore + m[i][j]);
 }
@@ -380,8 +436,8 @@ static double getRatio(const MatrixDouble m, int i, int j, double bestScore)
 static double lineSupport(const MatrixDouble &neighborMatrix,
     const std::pair<int, int> p)
 {
-  auto &line = neighborMatrix[p.first];
-  auto sum = std::accumulate(line.begin(), line.end(), 0.0);
+  auto line = neighborMatrix[p.first];
+  auto sum = std::accumulate(line, line + neighborMatrix.columns(), 0.0);
   return (100.0 * neighborMatrix[p.first][p.second]) / sum;
 }
 
@@ -442,7 +498,7 @@ void CherryProTree::relabelNodesWithSpeciesId(unsigned int speciesId,
   _speciesIdToGeneIds.erase(speciesId);
 }
 
-void CherryProTree::updateDenominatorMatrixRec(int geneId, MatrixDouble &denominatorMatrix, Clade &clade)
+void CherryProTree::updateDenominatorMatrixRec(int geneId, SparseMatrix &denominatorMatrix, Clade &clade)
 {
   auto &node = _nodes[geneId];
   if (node.isLeaf) {
@@ -458,8 +514,8 @@ void CherryProTree::updateDenominatorMatrixRec(int geneId, MatrixDouble &denomin
   if (node.speciation) {
     for (auto &spid1: leftClade) {
       for (auto &spid2: rightClade) {
-        denominatorMatrix[spid1][spid2]++;
-        denominatorMatrix[spid2][spid1]++;
+        denominatorMatrix.add(spid1, spid2, 1.0);
+        denominatorMatrix.add(spid2, spid1, 1.0);
       }
     }
   }
@@ -467,12 +523,31 @@ void CherryProTree::updateDenominatorMatrixRec(int geneId, MatrixDouble &denomin
   clade.insert(rightClade.begin(), rightClade.end());
 }
 
-void CherryProTree::updateNeigborMatrix(MatrixDouble &neighborMatrixToUpdate,
-      MatrixDouble &denominatorMatrixToUpdate)
+void CherryProTree::addContribution(
+    LocalSpeciesMatrices &localMatrices) const
 {
-  MatrixDouble *neighborMatrix = &neighborMatrixToUpdate;
-  MatrixDouble *denominatorMatrix = &denominatorMatrixToUpdate;
-  
+  localMatrices.add(_neighborContribution, _denominatorContribution);
+}
+
+void CherryProTree::removeContribution(
+    LocalSpeciesMatrices &localMatrices) const
+{
+  localMatrices.remove(_neighborContribution, _denominatorContribution);
+}
+
+void CherryProTree::getContributionIndices(unsigned int speciesNumber,
+      std::vector<unsigned long> &indices) const
+{
+  _neighborContribution.getIndices(speciesNumber, indices);
+  _denominatorContribution.getIndices(speciesNumber, indices);
+}
+
+void CherryProTree::updateContribution()
+{
+  SparseMatrix *neighborMatrix = &_neighborContribution;
+  SparseMatrix *denominatorMatrix = &_denominatorContribution;
+  neighborMatrix->clear();
+  denominatorMatrix->clear();
 
   // First fill neighborMatrix
   for (auto &p: _speciesIdToGeneIds) {
@@ -490,7 +565,7 @@ void CherryProTree::updateNeigborMatrix(MatrixDouble &neighborMatrixToUpdate,
       auto spid2 = gene2.speciesId;
       assert(spid1 == speciesId);
       double neighborFrequency = 1.0;
-      (*neighborMatrix)[spid1][spid2] += neighborFrequency;
+      neighborMatrix->add(spid1, spid2, neighborFrequency);
     }
   }
   // Then fill denominatorMatrix with
@@ -502,9 +577,7 @@ void CherryProTree::updateNeigborMatrix(MatrixDouble &neighborMatrixToUpdate,
     updateDenominatorMatrixRec(getRootId(), *denominatorMatrix, clade);
   } else if (USE_WEIGHTED_CHERRY_PRO_METRIC) {
     Clade clade;
-    int speciesNumber = denominatorMatrix->size();
-    VectorDouble zeros(speciesNumber, 0.0);
-    MatrixDouble maxNeighbors(speciesNumber, zeros);
+    SparseMatrix maxNeighbors;
     updateDenominatorMatrixRec(getRootId(), maxNeighbors, clade);
     for (auto &p: _speciesIdToGeneIds) {
       auto speciesId = p.first;
@@ -512,10 +585,10 @@ void CherryProTree::updateNeigborMatrix(MatrixDouble &neighborMatrixToUpdate,
       for (auto &p2: _speciesIdToGeneIds) {
         auto spid2 = p2.first; 
         const auto &geneIdSet2 = p2.second;
-        double small = maxNeighbors[speciesId][spid2] / 2.0;
+        double small = maxNeighbors.get(speciesId, spid2) / 2.0;
         double big = (geneIdSet.size() +  geneIdSet2.size()) / 2.0;
-        (*denominatorMatrix)[speciesId][spid2] += 
-          2.0  / (1.0 / big + 1.0 / small);
+        denominatorMatrix->add(speciesId, spid2, 
+          2.0  / (1.0 / big + 1.0 / small));
       }
     }
   } else {
@@ -527,8 +600,8 @@ void CherryProTree::updateNeigborMatrix(MatrixDouble &neighborMatrixToUpdate,
         const auto &geneIdSet2 = p2.second;
         double small = std::min(geneIdSet.size(),  geneIdSet2.size());
         double big = std::max(geneIdSet.size(),  geneIdSet2.size());
-        (*denominatorMatrix)[speciesId][spid2] += 
-          2.0  / (1.0 / big + 1.0 / small);
+        denominatorMatrix->add(speciesId, spid2, 
+          2.0  / (1.0 / big + 1.0 / small));
       }
     }
   }
@@ -722,18 +795,76 @@ CherryProTree::CherryProTree(const std::string &treeString,
 }
 
 
-static void filterGeneTrees(std::vector<std::shared_ptr<CherryProTree> > &geneTrees)
+static bool isInformative(CherryProTree &geneTree)
+{
+  return geneTree.getLeavesNumber() >= 3 && geneTree.coveredSpeciesNumber() >= 3;
+}
+
+/**
+ *  @return the number of gene trees over all ranks
+ */
+static unsigned int getRemainingTrees(unsigned int localTrees)
+{
+  unsigned int remainingTrees = localTrees;
+  ParallelContext::sumUInt(remainingTrees);
+  if (CHERRY_DBG) {
+    Logger::info << "Number of gene trees after filtering: " << remainingTrees << std::endl;
+  }
+  return remainingTrees;
+}
+
+/**
+ *  Remove the gene trees that do not hold information (and
+ *  the null gene trees, see removeGeneTree)
+ *  @return the number of remaining gene trees over all ranks
+ */
+static unsigned int filterGeneTrees(std::vector<std::shared_ptr<CherryProTree> > &geneTrees)
 {
   auto geneTreesCopy = geneTrees;
   geneTrees.clear();
   for (auto geneTree: geneTreesCopy) {
-    if (geneTree->getLeavesNumber() >= 3 && geneTree->coveredSpeciesNumber() >= 3 ) {
+    if (geneTree && isInformative(*geneTree)) {
       geneTrees.push_back(geneTree);
     }
   }
-  if (CHERRY_DBG) {
-    Logger::info << "Number of gene trees after filtering: " << geneTrees.size() << std::endl;;
+  return getRemainingTrees(geneTrees.size());
+}
+
+/**
+ *  Local indices of the gene trees covering each species
+ */
+using SpeciesToGeneTrees = std::vector<std::set<unsigned int> >;
+
+static SpeciesToGeneTrees indexGeneTrees(const GeneTrees &geneTrees,
+    unsigned int speciesNumber)
+{
+  SpeciesToGeneTrees speciesToTrees(speciesNumber);
+  std::vector<int> species;
+  for (unsigned int i = 0; i < geneTrees.size(); ++i) {
+    species.clear();
+    geneTrees[i]->getCoveredSpecies(species);
+    for (auto speciesId: species) {
+      speciesToTrees[speciesId].insert(i);
+    }
   }
+  return speciesToTrees;
+}
+
+/**
+ *  Remove a gene tree from the index, and replace it with a
+ *  null pointer, such that the indices of the other gene trees
+ *  do not change
+ */
+static void removeGeneTree(GeneTrees &geneTrees,
+    SpeciesToGeneTrees &speciesToTrees,
+    unsigned int index)
+{
+  std::vector<int> species;
+  geneTrees[index]->getCoveredSpecies(species);
+  for (auto speciesId: species) {
+    speciesToTrees[speciesId].erase(index);
+  }
+  geneTrees[index] = nullptr;
 }
 
 int CherryProTree::countTripletRec(int geneId, 
@@ -787,10 +918,14 @@ static int countFight(GeneTrees &geneTrees,
   int count = 0;
   TripletBool present;
   for (auto &geneTree: geneTrees) {
-    count += geneTree->countTripletRec(geneTree->getRootId(), 
-        clade, present);
+    if (geneTree) {
+      count += geneTree->countTripletRec(geneTree->getRootId(), 
+          clade, present);
+    }
   }
-  return count;
+  auto totalCount = static_cast<unsigned int>(count);
+  ParallelContext::sumUInt(totalCount);
+  return static_cast<int>(totalCount);
 } 
 
 /**
@@ -816,24 +951,36 @@ std::unique_ptr<PLLRootedTree> CherryPro::geneTreeCherryPro(const Families &fami
   
   // fill the structure that map speciesStr <-> speciesId
   // and create gene trees mapped with the species IDs
-  for (auto &family: families) {
+  // All ranks assign the species IDs in the same order, but
+  // each rank only builds the gene trees of its families
+  auto familiesNumber = static_cast<unsigned int>(families.size());
+  auto begin = ParallelContext::getBegin(familiesNumber);
+  auto end = ParallelContext::getEnd(familiesNumber);
+  for (unsigned int i = 0; i < familiesNumber; ++i) {
+    auto &family = families[i];
     GeneSpeciesMapping mapping;
-    mapping.fill(family.mappingFile, family.startingGeneTree);
-    auto coveredSpecies = mapping.getCoveredSpecies();
+    Family::fillMapping(family, mapping);
     for (auto &species: mapping.getCoveredSpecies()) {
       if (speciesStrToId.find(species) == speciesStrToId.end()) {
         speciesStrToId.insert({species, speciesIdToStr.size()});
         speciesIdToStr.push_back(species);
       }
     }
-    std::ifstream reader(family.startingGeneTree);
+    if (i < begin || i >= end) {
+      continue;
+    }
+    std::string geneTreesContent;
+    Family::getStartingGeneTreeContent(family, geneTreesContent);
+    std::istringstream reader(geneTreesContent);
     std::string line;
     while (std::getline(reader, line)) {
       geneTrees.push_back(std::make_shared<CherryProTree>( 
           line, mapping, speciesStrToId));
     }
   }
-  Logger::info << "Loaded " << geneTrees.size() << " gene trees" << std::endl;
+  unsigned int loadedTrees = geneTrees.size();
+  ParallelContext::sumUInt(loadedTrees);
+  Logger::info << "Loaded " << loadedTrees << " gene trees" << std::endl;
   unsigned int speciesNumber = speciesStrToId.size();
   std::unordered_set<int> remainingSpeciesIds;
   for (unsigned int i = 0; i < speciesNumber; ++i) {
@@ -843,10 +990,23 @@ std::unique_ptr<PLLRootedTree> CherryPro::geneTreeCherryPro(const Families &fami
   for (auto geneTree: geneTrees) {
     geneTree->mergeNodesWithSameSpeciesId();
   }
+  // filter out gene trees that do not hold information
+  auto remainingTrees = filterGeneTrees(geneTrees);
+  // The neighbor and denominator matrices are the sums of the
+  // contributions of the gene trees. They are computed once, and
+  // then only the contributions of the gene trees that change
+  // after each join are updated, and only the entries they 
+  // touch are reduced.
+  LocalSpeciesMatrices localMatrices(speciesNumber);
+  MatrixDouble neighborMatrix;
+  MatrixDouble denominatorMatrix;
+  MatrixDouble frequencies;
+  computeAllContributions(geneTrees, localMatrices,
+      neighborMatrix, denominatorMatrix, frequencies);
+  // a join only visits the gene trees covering the second species
+  auto speciesToTrees = indexGeneTrees(geneTrees, speciesNumber);
+  unsigned int localTrees = geneTrees.size();
   // main loop of the algorithm
-  VectorDouble zeros(speciesNumber, 0.0);
-  MatrixDouble neighborMatrix(speciesNumber, zeros);
-  MatrixDouble denominatorMatrix(speciesNumber, zeros);
   for (unsigned int i = 0; i < speciesNumber - 2; ++i) {
     if (CHERRY_DBG) {
       Logger::info << std::endl;
@@ -857,15 +1017,19 @@ std::unique_ptr<PLLRootedTree> CherryPro::geneTreeCherryPro(const Families &fami
         Logger::info << "  " << spid << "\t" << speciesIdToStr[spid] << std::endl;
       }
     }
-      // filter out gene trees that do not hold information
-    filterGeneTrees(geneTrees);
     if (ALWAYS_RETAG)
     {
       for (auto &tree: geneTrees) {
-        tree->findBestRootAndTag(true);
-        tree->mergeNodesWithSameSpeciesId();
+        if (tree) {
+          tree->findBestRootAndTag(true);
+          tree->mergeNodesWithSameSpeciesId();
+        }
       }
-      filterGeneTrees(geneTrees);
+      remainingTrees = filterGeneTrees(geneTrees);
+      computeAllContributions(geneTrees, localMatrices,
+          neighborMatrix, denominatorMatrix, frequencies);
+      speciesToTrees = indexGeneTrees(geneTrees, speciesNumber);
+      localTrees = geneTrees.size();
     }
     if (CHERRY_DBG) {
       //for (auto &tree: geneTrees) {
@@ -873,26 +1037,20 @@ std::unique_ptr<PLLRootedTree> CherryPro::geneTreeCherryPro(const Families &fami
       //}
     }
     
-    neighborMatrix = MatrixDouble(speciesNumber, zeros);
-    denominatorMatrix = MatrixDouble(speciesNumber, zeros);
-    for (auto geneTree: geneTrees) {
-      geneTree->updateNeigborMatrix(neighborMatrix, denominatorMatrix);
-    }
     if (CHERRY_DBG) {
       Logger::info << "Neighbors: " << std::endl;
       printMatrix(neighborMatrix);
       Logger::info << "Denominators: " << std::endl;
       printMatrix(denominatorMatrix);
     }
-    divideMatrix(neighborMatrix, denominatorMatrix);
     if (CHERRY_DBG) {
       Logger::info << "Frequencies: " << std::endl;
-      printMatrix(neighborMatrix);
+      printMatrix(frequencies);
     }
     // compute the two species to join, and join them
-    auto bestPairSpecies = getMaxInMatrix(neighborMatrix);
+    auto bestPairSpecies = getMaxInMatrix(frequencies);
     std::pair<int, int> bestCompetingPair;
-    bool doFight = shouldWeFight(neighborMatrix, bestPairSpecies, bestCompetingPair);
+    bool doFight = shouldWeFight(frequencies, bestPairSpecies, bestCompetingPair);
     if (doFight) {
       Logger::info << "Fight!!" << std::endl;
       if (!fight(geneTrees, bestPairSpecies, bestCompetingPair)) {
@@ -903,7 +1061,7 @@ std::unique_ptr<PLLRootedTree> CherryPro::geneTreeCherryPro(const Families &fami
     if (bestPairSpecies.first == bestPairSpecies.second) {
       // edge case when we filtered out all gene trees
       std::cout << "We filtered all gene trees, taking a random pair of species..." << std::endl;
-      assert(geneTrees.size() == 0);
+      assert(remainingTrees == 0);
       bestPairSpecies = {-1, -1};
       for (auto speciesId: remainingSpeciesIds) {
         if (bestPairSpecies.first == -1) {
@@ -917,22 +1075,45 @@ std::unique_ptr<PLLRootedTree> CherryPro::geneTreeCherryPro(const Families &fami
       }
       assert(bestPairSpecies.second != -1);
     }
-    auto support = computeSupport(neighborMatrix, bestPairSpecies);
+    auto support = computeSupport(frequencies, bestPairSpecies);
     std::string speciesStr1 = speciesIdToStr[bestPairSpecies.first];
     std::string speciesStr2 = speciesIdToStr[bestPairSpecies.second];
     if (CHERRY_DBG) {
-      Logger::info << "Remaining gene trees: " << geneTrees.size() << std::endl;
+      Logger::info << "Remaining gene trees: " << remainingTrees << std::endl;
       Logger::info << "Best pair " << bestPairSpecies.first
-        << " " << bestPairSpecies.second << " with distance " << neighborMatrix[bestPairSpecies.first][bestPairSpecies.second] << std::endl;
+        << " " << bestPairSpecies.second << " with distance " << frequencies[bestPairSpecies.first][bestPairSpecies.second] << std::endl;
       Logger::info << "Best pair " << speciesStr1 << " " << speciesStr2 << std::endl;
       Logger::info << speciesStr1 << std::endl << speciesStr2 << std::endl;
       Logger::info << "Support: " << support << std::endl;
     }
-    for (auto geneTree: geneTrees) {
+    // Only the gene trees covering the second species change:
+    // only remove their old contributions and add their new ones,
+    // and only reduce the entries they touch
+    std::vector<unsigned long> changedIndices;
+    std::set<unsigned int> changedTrees;
+    std::swap(changedTrees, speciesToTrees[bestPairSpecies.second]);
+    for (auto index: changedTrees) {
+      auto geneTree = geneTrees[index];
+      geneTree->getContributionIndices(speciesNumber, changedIndices);
+      geneTree->removeContribution(localMatrices);
       geneTree->relabelNodesWithSpeciesId(bestPairSpecies.second,
         bestPairSpecies.first);
       geneTree->mergeNodesWithSpeciesId(bestPairSpecies.first);
+      if (isInformative(*geneTree)) {
+        geneTree->updateContribution();
+        geneTree->getContributionIndices(speciesNumber, changedIndices);
+        geneTree->addContribution(localMatrices);
+        speciesToTrees[bestPairSpecies.first].insert(index);
+      } else {
+        removeGeneTree(geneTrees, speciesToTrees, index);
+        localTrees--;
+      }
     }
+    remainingTrees = getRemainingTrees(localTrees);
+    auto indices = SpeciesMatrices::reduceEntries(localMatrices,
+        neighborMatrix, denominatorMatrix, changedIndices);
+    SpeciesMatrices::updateFrequencies(frequencies, neighborMatrix, 
+        denominatorMatrix, indices);
     speciesIdToStr[bestPairSpecies.first] = std::string("(") + 
       speciesStr1 + "," + speciesStr2 + ")" + std::to_string(support);
     remainingSpeciesIds.erase(bestPairSpecies.second);
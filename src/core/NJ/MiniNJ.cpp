@@ -4,9 +4,12 @@
 #include <IO/Logger.hpp>
 #include <IO/GeneSpeciesMapping.hpp>
 #include <IO/Families.hpp>
+#include <IO/LibpllParsers.hpp>
 #include <trees/PLLUnrootedTree.hpp>
 #include <algorithm>
 #include <parallelization//ParallelContext.hpp>
+#include <parallelization/ThreadPool.hpp>
+#include <unordered_map>
 
 void fillDistancesRec(pll_unode_t *currentNode, 
     bool useBL,
@@ -36,104 +39,135 @@ void fillDistancesRec(pll_unode_t *currentNode,
 } 
 
 
+/**
+ *  Species distances and denominators, summed over gene trees.
+ *  They are stored in the same matrix (the distances in the first
+ *  speciesNumber rows and the denominators in the last ones), 
+ *  such that both are reduced at once.
+ */
+struct SpeciesDistances {
+  SpeciesDistances(unsigned int speciesNumber):
+    speciesNumber(speciesNumber),
+    sums(2 * speciesNumber, speciesNumber, 0.0)
+  {}
+  
+  double *distances(unsigned int i) {return sums[i];}
+  double *denominators(unsigned int i) {return sums[speciesNumber + i];}
+  void add(const SpeciesDistances &other) {sums += other.sums;}
+  
+  unsigned int speciesNumber;
+  MatrixDouble sums;
+};
+
+/**
+ *  Add the contribution of one gene tree to the species distances.
+ *  The gene tree contribution is first computed for the pairs of 
+ *  species covered by the gene tree only, and the leaf-to-leaf 
+ *  distances are computed one leaf at a time
+ */
 static void geneDistancesFromGeneTree(PLLUnrootedTree &geneTree,
-    GeneSpeciesMapping &mapping,
-    StringToUint &speciesStringToSpeciesId,
-    DistanceMatrix &distances,
-    DistanceMatrix &distancesDenominator,
+    const GeneSpeciesMapping &mapping,
+    const StringToUint &speciesStringToSpeciesId,
+    SpeciesDistances &speciesDistances,
     bool minMode,
     bool reweight,
     bool useBL,
     bool useBootstrap,
     bool ustar)
 {
-  unsigned int speciesNumber = distances.size();
-  if (speciesNumber < 3) {
-    Logger::error << "Found less than 3 species, please check that the genes cover at least 3 species or that the gene-species mappings are correct" << std::endl;
-    ParallelContext::abort(1);
-  }
-  std::vector<double>zeros(speciesNumber, 0.0);
-  DistanceMatrix distancesToAdd(speciesNumber, zeros);
-  DistanceMatrix distancesDenominatorToAdd(speciesNumber, zeros);
-
   auto leaves = geneTree.getLeaves();
-  // build geneId -> speciesId
-  std::vector<unsigned int> geneIdToSpeciesId(leaves.size());
+  // build geneId -> local species id, and local -> global species id
+  std::vector<unsigned int> geneIdToLocalId(leaves.size());
+  std::vector<unsigned int> localIdToSpeciesId;
+  std::unordered_map<unsigned int, unsigned int> speciesIdToLocalId;
   for (auto leafNode: leaves) {
     auto &species = mapping.getSpecies(leafNode->label);
-    auto speciesId = speciesStringToSpeciesId[species];
-    geneIdToSpeciesId[leafNode->node_index] = speciesId;
-  }
-  // build gene leaf distance matrix
-  std::vector<double>zerosLeaf(leaves.size(), 0.0);
-  std::vector<std::vector<double> > leafDistances(leaves.size(), zerosLeaf);
-  for (auto leafNode: leaves) {
-    fillDistancesRec(leafNode->back, useBL, useBootstrap, 0.0, leafDistances[leafNode->node_index]);
+    auto speciesId = speciesStringToSpeciesId.at(species);
+    auto it = speciesIdToLocalId.find(speciesId);
+    if (it == speciesIdToLocalId.end()) {
+      it = speciesIdToLocalId.insert({speciesId, 
+          static_cast<unsigned int>(localIdToSpeciesId.size())}).first;
+      localIdToSpeciesId.push_back(speciesId);
+    }
+    geneIdToLocalId[leafNode->node_index] = it->second;
   }
-
-  // fill species distance matrices
+  unsigned int localSpecies = localIdToSpeciesId.size();
+  MatrixDouble distancesToAdd(localSpecies, localSpecies, 0.0);
+  MatrixDouble denominatorsToAdd(localSpecies, localSpecies, 0.0);
+  std::vector<double> leafDistances(leaves.size(), 0.0);
   for (auto gene1: leaves) {
     auto gid1 = gene1->node_index;
-    auto spid1 = geneIdToSpeciesId[gid1];
+    fillDistancesRec(gene1->back, useBL, useBootstrap, 0.0, leafDistances);
+    leafDistances[gid1] = 0.0;
+    auto distancesRow = distancesToAdd[geneIdToLocalId[gid1]];
+    auto denominatorsRow = denominatorsToAdd[geneIdToLocalId[gid1]];
     for (auto gene2: leaves) {
       auto gid2 = gene2->node_index;
-      auto spid2 = geneIdToSpeciesId[gid2];
+      auto index = geneIdToLocalId[gid2];
       if (!minMode) {
-        distancesToAdd[spid1][spid2] += leafDistances[gid1][gid2];
-        distancesDenominatorToAdd[spid1][spid2]++;
+        distancesRow[index] += leafDistances[gid2];
+        denominatorsRow[index]++;
       } else {
-        if (distancesDenominatorToAdd[spid1][spid2]) {
-          distancesToAdd[spid1][spid2] =
-            std::min(distancesToAdd[spid1][spid2], 
-                   leafDistances[gid1][gid2]);
+        if (denominatorsRow[index]) {
+          distancesRow[index] = std::min(distancesRow[index], 
+              leafDistances[gid2]);
         } else {
-          distancesToAdd[spid1][spid2] = leafDistances[gid1][gid2];
-          distancesDenominatorToAdd[spid1][spid2] = 1;
+          distancesRow[index] = leafDistances[gid2];
+          denominatorsRow[index] = 1;
         }
       }
     }
   }
-  for (unsigned int i = 0; i < speciesNumber; ++i) {
-    for (unsigned int j = 0; j < speciesNumber; ++j) {
+  for (unsigned int i = 0; i < localSpecies; ++i) {
+    auto distancesRow = speciesDistances.distances(localIdToSpeciesId[i]);
+    auto denominatorsRow = 
+      speciesDistances.denominators(localIdToSpeciesId[i]);
+    for (unsigned int j = 0; j < localSpecies; ++j) {
+      auto &distance = distancesToAdd[i][j];
+      auto &denominator = denominatorsToAdd[i][j];
       if (reweight) {
         double factor = (double(leaves.size()));
-        distancesToAdd[i][j] *= factor;
-        distancesDenominatorToAdd[i][j] *= factor;
+        distance *= factor;
+        denominator *= factor;
       }
       if (ustar) {
-        if (distancesDenominatorToAdd[i][j] > 0.0) {
-          distancesToAdd[i][j] /= distancesDenominatorToAdd[i][j];
-          distancesDenominatorToAdd[i][j] = 1.0;
+        if (denominator > 0.0) {
+          distance /= denominator;
+          denominator = 1.0;
         }
       }
-      distances[i][j] += distancesToAdd[i][j];
-      distancesDenominator[i][j] += distancesDenominatorToAdd[i][j];
+      distancesRow[localIdToSpeciesId[j]] += distance;
+      denominatorsRow[localIdToSpeciesId[j]] += denominator;
     }
   }
 }
 
-std::unique_ptr<PLLRootedTree> MiniNJ::runNJst(const Families &families)
+std::unique_ptr<PLLRootedTree> MiniNJ::runNJst(const Families &families,
+    unsigned int threads)
 {
-  return geneTreeNJ(families, false);
+  return geneTreeNJ(families, false, false, false, threads);
 }
 
-std::unique_ptr<PLLRootedTree> MiniNJ::runWMinNJ(const Families &families)
+std::unique_ptr<PLLRootedTree> MiniNJ::runWMinNJ(const Families &families,
+    unsigned int threads)
 {
-  return geneTreeNJ(families, true, false, true);
+  return geneTreeNJ(families, true, false, true, threads);
 }
 
-std::unique_ptr<PLLRootedTree> MiniNJ::runUstar(const Families &families)
+std::unique_ptr<PLLRootedTree> MiniNJ::runUstar(const Families &families,
+    unsigned int threads)
 {
-  return geneTreeNJ(families, false, true, false);
+  return geneTreeNJ(families, false, true, false, threads);
 }
 
-std::unique_ptr<PLLRootedTree> MiniNJ::runMiniNJ(const Families &families)
+std::unique_ptr<PLLRootedTree> MiniNJ::runMiniNJ(const Families &families,
+    unsigned int threads)
 {
-  return geneTreeNJ(families, true);
+  return geneTreeNJ(families, true, false, false, threads);
 }
 
 
-std::unique_ptr<PLLRootedTree> MiniNJ::geneTreeNJ(const Families &families, bool minMode, bool ustar, bool reweight)
+std::unique_ptr<PLLRootedTree> MiniNJ::geneTreeNJ(const Families &families, bool minMode, bool ustar, bool reweight, unsigned int threads)
 {
   DistanceMatrix distanceMatrix;
   std::vector<std::string> speciesIdToSpeciesString;
@@ -148,8 +182,9 @@ std::unique_ptr<PLLRootedTree> MiniNJ::geneTreeNJ(const Families &families, bool
       ustar,
       distanceMatrix,
       speciesIdToSpeciesString,
-      speciesStringToSpeciesId);
-  auto res = NeighborJoining::applyNJ(distanceMatrix, 
+      speciesStringToSpeciesId,
+      threads);
+  auto res = NeighborJoining::applyNJ(std::move(distanceMatrix), 
       speciesIdToSpeciesString, 
       speciesStringToSpeciesId);
   /*
@@ -170,11 +205,18 @@ void MiniNJ::computeDistanceMatrix(const Families &families,
   bool ustar,
   DistanceMatrix &distanceMatrix,
   std::vector<std::string> &speciesIdToSpeciesString,
-  StringToUint &speciesStringToSpeciesId)
+  StringToUint &speciesStringToSpeciesId,
+  unsigned int threads)
 {
-  for (auto &family: families) {
+  // all ranks need the same species ids, but each rank only
+  // keeps the mappings of its own families
+  auto familiesBegin = ParallelContext::getBegin(families.size());
+  auto familiesEnd = ParallelContext::getEnd(families.size());
+  std::vector<GeneSpeciesMapping> localMappings;
+  for (unsigned int i = 0; i < families.size(); ++i) {
+    auto &family = families[i];
     GeneSpeciesMapping mappings;
-    mappings.fill(family.mappingFile, family.startingGeneTree);
+    Family::fillMapping(family, mappings);
     for (auto &pairMapping: mappings.getMap()) {
       auto &species = pairMapping.second;
       if (speciesStringToSpeciesId.find(species) == speciesStringToSpeciesId.end()) {
@@ -183,38 +225,72 @@ void MiniNJ::computeDistanceMatrix(const Families &families,
         
       }
     }
+    if (familiesBegin <= i && i < familiesEnd) {
+      localMappings.push_back(mappings);
+    }
   }
   unsigned int speciesNumber = speciesIdToSpeciesString.size(); 
-  std::vector<double> nullDistances(speciesNumber, 0.0);
-  distanceMatrix = DistanceMatrix(speciesNumber, nullDistances);  
-  DistanceMatrix distanceDenominator(speciesNumber, nullDistances);
-    
-  for (auto &family: families) {
-    GeneSpeciesMapping mappings;
-    mappings.fill(family.mappingFile, family.startingGeneTree);
-    std::ifstream reader(family.startingGeneTree);
-    std::string geneTreeStr;
-    while (std::getline(reader, geneTreeStr)) {
-      PLLUnrootedTree geneTree(geneTreeStr, false);
-      geneDistancesFromGeneTree(geneTree, 
-          mappings,
-          speciesStringToSpeciesId,
-          distanceMatrix,
-          distanceDenominator,
-          minMode,
-          reweight,
-          useBL,
-          useBootstrap,
-          ustar);
+  if (speciesNumber < 3) {
+    Logger::error << "Found less than 3 species, please check that the genes cover at least 3 species or that the gene-species mappings are correct" << std::endl;
+    ParallelContext::abort(1);
+  }
+  // The gene trees of a family are added to the family distances
+  // in file order, and the family distances to the rank distances
+  // in family order, such that the result does not depend on the
+  // number of threads. The families are processed by waves of 
+  // threads families, to keep one matrix per thread.
+  unsigned int localFamilies = familiesEnd - familiesBegin;
+  threads = std::max(1u, std::min(threads, localFamilies));
+  SpeciesDistances speciesDistances(speciesNumber);
+  std::vector<SpeciesDistances> familyDistances(threads, 
+      SpeciesDistances(speciesNumber));
+  ThreadPool threadPool(threads);
+  for (unsigned int wave = 0; wave < localFamilies; wave += threads) {
+    auto waveSize = std::min(threads, localFamilies - wave);
+    threadPool.parallelFor(waveSize, [&](unsigned int k) {
+      auto localIndex = wave + k;
+      auto &distances = familyDistances[k];
+      distances.sums.fill(0.0);
+      // the in-buffer newick parser is thread-safe
+      std::vector<pll_utree_t *> utrees;
+      Family::readStartingGeneTrees(families[familiesBegin + localIndex],
+          utrees);
+      std::vector<std::unique_ptr<PLLUnrootedTree> > geneTrees;
+      for (auto utree: utrees) {
+        geneTrees.push_back(std::make_unique<PLLUnrootedTree>(utree));
+      }
+      for (auto &geneTree: geneTrees) {
+        geneDistancesFromGeneTree(*geneTree, 
+            localMappings[localIndex],
+            speciesStringToSpeciesId,
+            distances,
+            minMode,
+            reweight,
+            useBL,
+            useBootstrap,
+            ustar);
+      }
+    });
+    for (unsigned int k = 0; k < waveSize; ++k) {
+      speciesDistances.add(familyDistances[k]);
     }
   }
+  // reduce the distances and the denominators at once. The sums 
+  // are exact (sums of integers) unless ustar, useBL or useBootstrap
+  // is set: in these modes, the order of the MPI reduction depends 
+  // on the number of ranks, and so do the last bits of the matrix
+  ParallelContext::sumMatrixDouble(speciesDistances.sums);
+  distanceMatrix = DistanceMatrix(speciesNumber, speciesNumber, 0.0);  
   for (unsigned int i = 0; i < speciesNumber; ++i) {
+    auto distances = speciesDistances.distances(i);
+    auto denominators = speciesDistances.denominators(i);
+    auto row = distanceMatrix[i];
     for (unsigned int j = 0; j < speciesNumber; ++j) {
-      if (i == j) {
-        distanceMatrix[i][j] = 0.0;
+      if (i != j) {
+        row[j] = distances[j];
       }
-      if (0.0 != distanceDenominator[i][j]) {
-        distanceMatrix[i][j] /= distanceDenominator[i][j];
+      if (0.0 != denominators[j]) {
+        row[j] /= denominators[j];
       }
     }
   }
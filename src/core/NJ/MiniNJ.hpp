@@ -25,21 +25,32 @@ public:
    * the distance matrix. The distance matrix is very similar to the one
    * built in NJst (another NJ took).
    */
-  static std::unique_ptr<PLLRootedTree> runMiniNJ(const Families &families);
+  static std::unique_ptr<PLLRootedTree> runMiniNJ(const Families &families,
+      unsigned int threads = 1);
   
   
   /**
    *  Run the original NJst algorithm
    */
-  static std::unique_ptr<PLLRootedTree> runNJst(const Families &families);
-  static std::unique_ptr<PLLRootedTree> runUstar(const Families &families);
-  static std::unique_ptr<PLLRootedTree> runWMinNJ(const Families &families);
+  static std::unique_ptr<PLLRootedTree> runNJst(const Families &families,
+      unsigned int threads = 1);
+  static std::unique_ptr<PLLRootedTree> runUstar(const Families &families,
+      unsigned int threads = 1);
+  static std::unique_ptr<PLLRootedTree> runWMinNJ(const Families &families,
+      unsigned int threads = 1);
   
   static std::unique_ptr<PLLRootedTree> applyNJ(DistanceMatrix &distanceMatrix,
     std::vector<std::string> &speciesIdToSpeciesString,
     StringToUint &speciesStringToSpeciesId);
 
 
+  /**
+   *  Compute the species distance matrix from the gene trees.
+   *  The families are split over the MPI ranks, and the families
+   *  of each rank over threads threads. Each thread holds two 
+   *  species x species matrices. The matrix does not depend on
+   *  the number of threads.
+   */
   static void computeDistanceMatrix(const Families &families,
       bool minMode, 
       bool reweight,
@@ -48,8 +59,9 @@ public:
       bool ustar,
       DistanceMatrix &distanceMatrix,
       std::vector<std::string> &speciesIdToSpeciesString,
-      StringToUint &speciesStringToSpeciesId);
+      StringToUint &speciesStringToSpeciesId,
+      unsigned int threads = 1);
 
 private:
-  static std::unique_ptr<PLLRootedTree> geneTreeNJ(const Families &families, bool minAlgo, bool ustarAlgo = false, bool reweight = false);
+  static std::unique_ptr<PLLRootedTree> geneTreeNJ(const Families &families, bool minAlgo, bool ustarAlgo = false, bool reweight = false, unsigned int threads = 1);
 };
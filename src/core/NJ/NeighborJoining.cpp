@@ -1,68 +1,235 @@
 #include "NeighborJoining.hpp"
 #include <IO/Logger.hpp>
+#include <algorithm>
+#include <numeric>
+#include <utility>
 
 using Cherry = std::pair<unsigned int, unsigned int>;
+using Position = std::pair<unsigned int, unsigned int>;
 static const double invalidDouble = std::numeric_limits<double>::infinity();
 
 static double getIfOk(double value) {
   return (value != invalidDouble) ? value : 0.0;
 }
 
-void printDistanceMatrix(const DistanceMatrix &d) {
-  for (auto &l: d) {
-    for (auto elem: l) {
-      Logger::info << elem << "\t";
+/**
+ *  Distance matrix, with the row sums
+ *  r(i) of the valid distances, such that the NJ criterion 
+ *  Q(i, j) = (n - 2) * d(i, j) - r(i) - r(j) can be computed
+ *  in constant time (n being the number of remaining entries)
+ */
+class NJMatrix {
+public:
+  NJMatrix(DistanceMatrix &&distanceMatrix):
+    _size(static_cast<unsigned int>(distanceMatrix.size())),
+    _distances(std::move(distanceMatrix)),
+    _rowSums(_size, 0.0)
+  {
+    for (unsigned int i = 0; i < _size; ++i) {
+      updateRowSum(i);
     }
-    Logger::info << std::endl;
   }
-  Logger::info << std::endl;
-}
 
-static DistanceMatrix getQ(DistanceMatrix &distanceMatrix, unsigned int dmSize)
-{
-  DistanceMatrix Q = distanceMatrix;
-  unsigned int n = dmSize;
-  for (unsigned int i = 0; i < distanceMatrix.size(); ++i) {
-    for (unsigned int j = 0; j < distanceMatrix.size(); ++j) {
-      double sum = 0.0;
-      if (distanceMatrix[i][j] == invalidDouble) {
-        sum = invalidDouble;
-      } else {
-        sum = (n - 2) * getIfOk(distanceMatrix[i][j]);
-        for (unsigned int k = 0; k < distanceMatrix.size(); ++k) {
-          sum -= getIfOk(distanceMatrix[i][k]) + getIfOk(distanceMatrix[j][k]); 
+  unsigned int size() const {return _size;}
+  
+  double get(unsigned int i, unsigned int j) const {
+    return _distances[i][j];
+  }
+  
+  double getRowSum(unsigned int i) const {return _rowSums[i];}
+
+  double getQ(unsigned int i, unsigned int j, unsigned int n) const {
+    auto d = get(i, j);
+    if (d == invalidDouble) {
+      return invalidDouble;
+    }
+    return double(n - 2) * d - _rowSums[i] - _rowSums[j];
+  }
+
+  /**
+   *  Merge the entries p1 and p2 into p1, and invalidate p2
+   */
+  void merge(unsigned int p1, unsigned int p2) {
+    // the matrix is symetric: we read rows p1 and p2 
+    // instead of the columns
+    double d12 = get(p1, p2);
+    const double *row1 = _distances[p1];
+    const double *row2 = _distances[p2];
+    std::vector<double> newDistances(_size);
+    for (unsigned int i = 0; i < _size; ++i) {
+      newDistances[i] = 0.5 * (row1[i] + row2[i] - d12);
+    }
+    for (unsigned int i = 0; i < _size; ++i) {
+      if (i == p1 || i == p2) {
+        continue;
+      }
+      _rowSums[i] += getIfOk(newDistances[i]) 
+        - getIfOk(get(p1, i)) - getIfOk(get(p2, i));
+    }
+    for (unsigned int i = 0; i < _size; ++i) {
+      set(p1, i, newDistances[i]);
+    }
+    for (unsigned int i = 0; i < _size; ++i) {
+      set(p2, i, invalidDouble);
+    }
+    updateRowSum(p1);
+    _rowSums[p2] = 0.0;
+  }
+
+private:
+  void set(unsigned int i, unsigned int j, double value) {
+    _distances[i][j] = value;
+    _distances[j][i] = value;
+  }
+
+  void updateRowSum(unsigned int i) {
+    _rowSums[i] = 0.0;
+    for (unsigned int k = 0; k < _size; ++k) {
+      _rowSums[i] += getIfOk(get(i, k));
+    }
+  }
+
+  unsigned int _size;
+  DistanceMatrix _distances;
+  std::vector<double> _rowSums;
+};
+
+/**
+ *  RapidNJ-like search of the pair minimizing Q
+ *
+ *  Each entry has a list of the other entries, sorted by
+ *  increasing distance, built when the entry is created and 
+ *  never updated: the entries that were removed or created
+ *  after the list was built are skipped (the pairs with a newer
+ *  entry are in the list of the newer entry). Since
+ *  Q(i, j) >= (n - 2) * d(i, j) - r(i) - max(r), the scan of a 
+ *  list stops as soon as this lower bound exceeds the best Q.
+ */
+class NJCandidates {
+public:
+  NJCandidates(const NJMatrix &matrix):
+    _matrix(matrix),
+    _alive(matrix.size()),
+    _isAlive(matrix.size(), true),
+    _creationStep(matrix.size(), 0),
+    _sortedEntries(matrix.size())
+  {
+    std::iota(_alive.begin(), _alive.end(), 0);
+    for (auto i: _alive) {
+      sortEntries(i);
+    }
+  }
+
+  /**
+   *  Return the pair (i < j) minimizing Q. In case of 
+   *  equality, return the smallest pair.
+   */
+  Position findMinPosition() const {
+    const Position invalidPosition = {-1, -1};
+    Position minPosition = invalidPosition;
+    unsigned int n = static_cast<unsigned int>(_alive.size());
+    if (n == 2) {
+      return Position(std::min(_alive[0], _alive[1]), 
+          std::max(_alive[0], _alive[1]));
+    }
+    double maxRowSum = -std::numeric_limits<double>::infinity();
+    for (auto i: _alive) {
+      maxRowSum = std::max(maxRowSum, _matrix.getRowSum(i));
+    }
+    double minQ = std::numeric_limits<double>::max();
+    for (auto i: _alive) {
+      auto rowSum = _matrix.getRowSum(i);
+      for (auto j: _sortedEntries[i]) {
+        if (!_isAlive[j] || _creationStep[j] > _creationStep[i]) {
+          continue;
+        }
+        double partialQ = double(n - 2) * _matrix.get(i, j) - rowSum;
+        if (partialQ - maxRowSum > minQ) {
+          break;
+        }
+        double q = partialQ - _matrix.getRowSum(j);
+        Position position(std::min(i, j), std::max(i, j));
+        if (q < minQ || (q == minQ && position < minPosition)) {
+          minQ = q;
+          minPosition = position;
         }
       }
-      Q[i][j] = sum;
     }
+    assert(minPosition != invalidPosition);
+    return minPosition;
   }
-  return Q;
-}
 
-using Position = std::pair<unsigned int, unsigned int>;
+  /**
+   *  To call after the merge of p1 and p2 into p1 in the matrix
+   */
+  void merge(unsigned int p1, unsigned int p2, unsigned int step) {
+    _isAlive[p2] = false;
+    _alive.erase(std::find(_alive.begin(), _alive.end(), p2));
+    std::vector<unsigned int>().swap(_sortedEntries[p2]);
+    _creationStep[p1] = step + 1;
+    sortEntries(p1);
+  }
 
-static Position findMinPosition(const DistanceMatrix &distanceMatrix)
-{
-  double minDistance = std::numeric_limits<double>::max();
-  const Position invalidPosition = {-1, -1};
-  Position minPosition = invalidPosition;
-  for (unsigned int i = 0; i < distanceMatrix.size(); ++i) {
-    for (unsigned int j = i + 1; j < distanceMatrix.size(); ++j) {
-      if (minDistance > distanceMatrix[i][j]) {
-        minPosition.first = i;
-        minPosition.second = j;
-        minDistance = distanceMatrix[i][j];
+private:
+  void sortEntries(unsigned int i) {
+    auto &entries = _sortedEntries[i];
+    entries.clear();
+    for (auto j: _alive) {
+      if (j != i) {
+        entries.push_back(j);
       }
     }
+    std::sort(entries.begin(), entries.end(), 
+        [this, i](unsigned int j1, unsigned int j2) {
+          auto d1 = _matrix.get(i, j1);
+          auto d2 = _matrix.get(i, j2);
+          return d1 < d2 || (d1 == d2 && j1 < j2);
+        });
   }
-  assert(minPosition != invalidPosition);
-  return minPosition;
+  
+  const NJMatrix &_matrix;
+  std::vector<unsigned int> _alive;
+  std::vector<bool> _isAlive;
+  std::vector<unsigned int> _creationStep;
+  std::vector<std::vector<unsigned int> > _sortedEntries;
+};
+
+/**
+ *  Node of the NJ tree, used to write the newick string
+ *  once all the entries have been merged
+ */
+struct NJNode {
+  NJNode(const std::string &label = std::string()):
+    label(label), left(-1), right(-1), leftLength(0.0), rightLength(0.0)
+  {}
+  std::string label;
+  int left;
+  int right;
+  double leftLength;
+  double rightLength;
+};
+
+static void appendNewick(const std::vector<NJNode> &nodes,
+    unsigned int nodeIndex,
+    std::string &newick)
+{
+  auto &node = nodes[nodeIndex];
+  if (node.left == -1) {
+    newick += node.label;
+    return;
+  }
+  newick += "(";
+  appendNewick(nodes, node.left, newick);
+  newick += ":" + std::to_string(node.leftLength) + ",";
+  appendNewick(nodes, node.right, newick);
+  newick += ":" + std::to_string(node.rightLength) + ")";
 }
 
 static Position findConstrainedMinPosition(
     const std::set<Cherry> &cherries,
     const std::vector<unsigned int> &constrainIndexToMatrixIndex,
-    const DistanceMatrix &distanceMatrix
+    const NJMatrix &matrix,
+    unsigned int n
     )
 {
   assert(cherries.size());
@@ -75,10 +242,11 @@ static Position findConstrainedMinPosition(
     if (i >=j) {
       std::swap(i, j);
     }
-    if (minDistance > distanceMatrix[i][j]) {
+    auto q = matrix.getQ(i, j, n);
+    if (minDistance > q) {
       minPosition.first = i;
       minPosition.second = j;
-      minDistance = distanceMatrix[i][j];
+      minDistance = q;
     }
   }
   assert(minPosition != invalidPosition);
@@ -185,58 +353,59 @@ std::unique_ptr<PLLRootedTree> NeighborJoining::applyNJ(
   }
 
   unsigned int speciesNumber = speciesIdToSpeciesString.size();
-  std::string subtree;
+  NJMatrix matrix(std::move(distanceMatrix));
+  std::unique_ptr<NJCandidates> candidates;
+  if (!constrainTree) {
+    candidates = std::make_unique<NJCandidates>(matrix);
+  }
+  std::vector<NJNode> nodes;
+  std::vector<unsigned int> entryToNode;
+  for (auto &label: speciesIdToSpeciesString) {
+    entryToNode.push_back(nodes.size());
+    nodes.push_back(NJNode(label));
+  }
   // Start Neighbor Joining iterations
   for (unsigned int step = 0; step < speciesNumber - 1; ++step) {
     unsigned int dmSize = speciesNumber - step;
-    auto Q = getQ(distanceMatrix, dmSize);    
     Position minPosition;
     if (constrainTree) {
       minPosition = findConstrainedMinPosition(constrainCherries,
           constrainIndexToMatrixIndex,
-          Q);
+          matrix,
+          dmSize);
     } else {
-      minPosition = findMinPosition(Q);
+      minPosition = candidates->findMinPosition();
     }
     auto p1 = minPosition.first;
     auto p2 = minPosition.second;
     auto speciesEntryToUpdate = p1;
     auto speciesEntryToRemove = p2;
-    // update new values:
-    DistanceMatrix copy = distanceMatrix;
-    for (unsigned int i = 0; i < speciesNumber; ++i) {
-      double newDistance = 0.5 * (copy[i][p1] + copy[i][p2] - copy[p1][p2]);
-      distanceMatrix[speciesEntryToUpdate][i] = newDistance;
-      distanceMatrix[i][speciesEntryToUpdate] = newDistance;
-    }
-    for (unsigned int i = 0; i < speciesNumber; ++i) {
-      distanceMatrix[speciesEntryToRemove][i] = invalidDouble;
-      distanceMatrix[i][speciesEntryToRemove] = invalidDouble;
-    }
     double bl1 = 0.0;
     for (unsigned int k = 0; k < speciesNumber; ++k) {
-      if (copy[p1][k] != invalidDouble) {
-        bl1 += copy[p1][k] - copy[p2][k];
+      if (matrix.get(p1, k) != invalidDouble) {
+        bl1 += matrix.get(p1, k) - matrix.get(p2, k);
       }
     }
     if (dmSize > 2) {
       bl1 /= double(dmSize - 2);
     }
-    bl1 += copy[p1][p2];
+    bl1 += matrix.get(p1, p2);
     bl1 *= 0.5;
-    double bl2 = copy[p1][p2] - bl1;
+    double bl2 = matrix.get(p1, p2) - bl1;
     bl1 = std::max(0.0, bl1);
     bl2 = std::max(0.0, bl2);
-    subtree = "(" + 
-      speciesIdToSpeciesString[minPosition.first] 
-      + ":" + std::to_string(bl1)
-      + ","
-      + speciesIdToSpeciesString[minPosition.second] 
-      + ":" + std::to_string(bl2)
-      + ")";
-    speciesIdToSpeciesString[speciesEntryToUpdate] = subtree;
-    speciesIdToSpeciesString[speciesEntryToRemove] = std::string("NULL");
-    speciesStringToSpeciesId[subtree] = speciesEntryToUpdate;
+    // update new values:
+    matrix.merge(speciesEntryToUpdate, speciesEntryToRemove);
+    if (candidates) {
+      candidates->merge(speciesEntryToUpdate, speciesEntryToRemove, step);
+    }
+    NJNode parent;
+    parent.left = static_cast<int>(entryToNode[p1]);
+    parent.right = static_cast<int>(entryToNode[p2]);
+    parent.leftLength = bl1;
+    parent.rightLength = bl2;
+    entryToNode[speciesEntryToUpdate] = nodes.size();
+    nodes.push_back(parent);
     
     if (constrainTree && step != speciesNumber - 2) {
       updateConstrainData(speciesEntryToUpdate,
@@ -250,7 +419,11 @@ std::unique_ptr<PLLRootedTree> NeighborJoining::applyNJ(
           *constrainTree);
     }
   }
-  std::string newick = subtree + ";";
+  std::string newick;
+  if (speciesNumber > 1) {
+    appendNewick(nodes, nodes.size() - 1, newick);
+  }
+  newick += ";";
   auto res = std::make_unique<PLLRootedTree>(newick, false); 
   
   return res;
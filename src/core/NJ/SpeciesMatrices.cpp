@@ -0,0 +1,181 @@
+#include "SpeciesMatrices.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <parallelization/ParallelContext.hpp>
+
+// 2^32: the contributions are rounded to about 1e-10, and the
+// sums of an entry over all the gene trees can reach 2^32
+static const double FIXED_POINT_SCALE = 4294967296.0;
+
+void SparseMatrix::getIndices(unsigned int width, 
+    std::vector<unsigned long> &indices) const
+{
+  for (auto &entry: _entries) {
+    indices.push_back(static_cast<unsigned long>(entry.first.first) * width 
+        + static_cast<unsigned long>(entry.first.second));
+  }
+}
+
+LocalSpeciesMatrices::LocalSpeciesMatrices(unsigned int speciesNumber):
+  _speciesNumber(speciesNumber),
+  _neighbors(static_cast<size_t>(speciesNumber) * speciesNumber, 0),
+  _denominators(static_cast<size_t>(speciesNumber) * speciesNumber, 0)
+{
+}
+
+void LocalSpeciesMatrices::add(const SparseMatrix &neighbors, 
+    const SparseMatrix &denominators)
+{
+  add(neighbors, _neighbors, false);
+  add(denominators, _denominators, false);
+}
+
+void LocalSpeciesMatrices::remove(const SparseMatrix &neighbors, 
+    const SparseMatrix &denominators)
+{
+  add(neighbors, _neighbors, true);
+  add(denominators, _denominators, true);
+}
+
+void LocalSpeciesMatrices::clear()
+{
+  std::fill(_neighbors.begin(), _neighbors.end(), 0);
+  std::fill(_denominators.begin(), _denominators.end(), 0);
+}
+
+double LocalSpeciesMatrices::toDouble(unsigned long value)
+{
+  return static_cast<double>(value) / FIXED_POINT_SCALE;
+}
+
+void LocalSpeciesMatrices::add(const SparseMatrix &contribution, 
+    std::vector<unsigned long> &sums,
+    bool subtract)
+{
+  const unsigned long width = _speciesNumber;
+  for (auto &entry: contribution.getEntries()) {
+    auto i = static_cast<unsigned long>(entry.first.first);
+    auto j = static_cast<unsigned long>(entry.first.second);
+    auto value = static_cast<unsigned long>(
+        std::llround(entry.second * FIXED_POINT_SCALE));
+    if (subtract) {
+      sums[i * width + j] -= value;
+    } else {
+      sums[i * width + j] += value;
+    }
+  }
+}
+
+void SpeciesMatrices::reduceMatrices(
+    const LocalSpeciesMatrices &localMatrices,
+    MatrixDouble &neighborMatrix,
+    MatrixDouble &denominatorMatrix)
+{
+  const unsigned int speciesNumber = localMatrices.getSpeciesNumber();
+  const unsigned long entries =
+    static_cast<unsigned long>(speciesNumber) * speciesNumber;
+  // the neighbors first, then the denominators
+  std::vector<unsigned long> sums(2 * entries);
+  for (unsigned long i = 0; i < entries; ++i) {
+    sums[i] = localMatrices.getNeighbors(i);
+    sums[entries + i] = localMatrices.getDenominators(i);
+  }
+  ParallelContext::sumULongs(sums.data(), sums.size());
+  neighborMatrix = MatrixDouble(speciesNumber, speciesNumber, 0.0);
+  denominatorMatrix = MatrixDouble(speciesNumber, speciesNumber, 0.0);
+  for (unsigned long i = 0; i < entries; ++i) {
+    neighborMatrix.data()[i] = LocalSpeciesMatrices::toDouble(sums[i]);
+    denominatorMatrix.data()[i] = 
+      LocalSpeciesMatrices::toDouble(sums[entries + i]);
+  }
+}
+
+std::vector<unsigned long> SpeciesMatrices::reduceEntries(
+    const LocalSpeciesMatrices &localMatrices,
+    MatrixDouble &neighborMatrix,
+    MatrixDouble &denominatorMatrix,
+    const std::vector<unsigned long> &localIndices)
+{
+  std::vector<unsigned long> indices;
+  ParallelContext::concatenateULongVectors(localIndices, indices);
+  std::sort(indices.begin(), indices.end());
+  indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+  std::vector<unsigned long> buffer;
+  buffer.reserve(indices.size() * 2);
+  for (auto index: indices) {
+    buffer.push_back(localMatrices.getNeighbors(index));
+  }
+  for (auto index: indices) {
+    buffer.push_back(localMatrices.getDenominators(index));
+  }
+  ParallelContext::sumULongs(buffer.data(), buffer.size());
+  auto it = buffer.begin();
+  for (auto index: indices) {
+    neighborMatrix.data()[index] = LocalSpeciesMatrices::toDouble(*it++);
+  }
+  for (auto index: indices) {
+    denominatorMatrix.data()[index] = LocalSpeciesMatrices::toDouble(*it++);
+  }
+  return indices;
+}
+
+void SpeciesMatrices::updateFrequencies(MatrixDouble &frequencies,
+    const MatrixDouble &neighborMatrix,
+    const MatrixDouble &denominatorMatrix,
+    const std::vector<unsigned long> &indices)
+{
+  const unsigned long width = frequencies.size();
+  for (auto index: indices) {
+    auto i = index / width;
+    auto j = index % width;
+    auto denom = denominatorMatrix[i][j];
+    frequencies[i][j] = denom != 0.0 ? 
+      neighborMatrix[i][j] / denom : neighborMatrix[i][j];
+  }
+}
+
+
+MaxEntryQueue::MaxEntryQueue(const MatrixDouble &m)
+{
+  for (unsigned int i = 0; i < m.size(); ++i) {
+    for (unsigned int j = 0; j < m.size(); ++j) {
+      insert(m, i, j);
+    }
+  }
+}
+
+std::pair<int, int> MaxEntryQueue::getMax() const
+{
+  if (_entries.empty()) {
+    return {0, 0};
+  }
+  return {_entries.begin()->i, _entries.begin()->j};
+}
+
+void MaxEntryQueue::remove(const MatrixDouble &m, 
+    const std::vector<unsigned long> &indices)
+{
+  for (auto index: indices) {
+    unsigned int i = index / m.size();
+    unsigned int j = index % m.size();
+    _entries.erase(Entry{m[i][j], i, j});
+  }
+}
+
+void MaxEntryQueue::insert(const MatrixDouble &m, 
+    const std::vector<unsigned long> &indices)
+{
+  for (auto index: indices) {
+    insert(m, index / m.size(), index % m.size());
+  }
+}
+
+void MaxEntryQueue::insert(const MatrixDouble &m, 
+    unsigned int i, 
+    unsigned int j)
+{
+  if (m[i][j] > 0.0) {
+    _entries.insert(Entry{m[i][j], i, j});
+  }
+}
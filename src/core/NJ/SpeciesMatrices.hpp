@@ -0,0 +1,177 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+#include <util/types.hpp>
+
+/**
+ *  Sparse species x species matrix, to store the contribution
+ *  of a single gene tree to the neighbor and denominator matrices
+ */
+class SparseMatrix {
+public:
+  using Entries = std::map<std::pair<int, int>, double>;
+  void add(int i, int j, double value) {_entries[{i, j}] += value;}
+  double get(int i, int j) const {
+    auto it = _entries.find({i, j});
+    return it == _entries.end() ? 0.0 : it->second;
+  }
+  void clear() {_entries.clear();}
+  const Entries &getEntries() const {return _entries;}
+  /**
+   *  Append the linear indices (i * width + j) of the stored
+   *  entries to indices
+   */
+  void getIndices(unsigned int width, 
+      std::vector<unsigned long> &indices) const;
+private:
+  Entries _entries;
+};
+
+/**
+ *  Neighbor and denominator matrices of the gene trees of one
+ *  rank: the sums of their contributions. The contributions are 
+ *  accumulated in fixed point, such that removing the contribution 
+ *  of a gene tree that changed and adding its new one is exact: 
+ *  the entries do not depend on the order of the updates, and 
+ *  are always the ones of a rebuild from scratch (the denominators 
+ *  are not integers, and would accumulate rounding errors in 
+ *  floating point).
+ */
+class LocalSpeciesMatrices {
+public:
+  LocalSpeciesMatrices(unsigned int speciesNumber);
+
+  /**
+   *  Add the contribution of a gene tree
+   */
+  void add(const SparseMatrix &neighbors, 
+      const SparseMatrix &denominators);
+  
+  /**
+   *  Remove a contribution previously added with add
+   */
+  void remove(const SparseMatrix &neighbors, 
+      const SparseMatrix &denominators);
+
+  /**
+   *  Remove all the contributions
+   */
+  void clear();
+
+  unsigned int getSpeciesNumber() const {return _speciesNumber;}
+  
+  /**
+   *  Fixed point values of the entries at linear index i
+   */
+  unsigned long getNeighbors(unsigned long i) const {return _neighbors[i];}
+  unsigned long getDenominators(unsigned long i) const {
+    return _denominators[i];
+  }
+  
+  /**
+   *  @return the value of a fixed point sum
+   */
+  static double toDouble(unsigned long value);
+private:
+  void add(const SparseMatrix &contribution, 
+      std::vector<unsigned long> &sums,
+      bool subtract);
+  unsigned int _speciesNumber;
+  // with unsigned integers, removing a contribution 
+  // wraps around but stays exact
+  std::vector<unsigned long> _neighbors;
+  std::vector<unsigned long> _denominators;
+};
+
+/**
+ *  Helpers to maintain the species matrices of the cherry
+ *  algorithms, when each rank holds the contributions of its
+ *  own gene trees
+ */
+class SpeciesMatrices {
+public:
+  SpeciesMatrices() = delete;
+
+  /**
+   *  Set the global matrices to the sums over all ranks of the 
+   *  local matrices. Both matrices are packed into one buffer 
+   *  and reduced with a single collective operation.
+   */
+  static void reduceMatrices(const LocalSpeciesMatrices &localMatrices,
+      MatrixDouble &neighborMatrix,
+      MatrixDouble &denominatorMatrix);
+
+  /**
+   *  Set the entries of the global matrices to the sum over all 
+   *  ranks of the entries of the local matrices, for the given
+   *  linear indices only. Each rank can pass different indices:
+   *  the union of all the indices is updated on all the ranks.
+   *  Both matrices are reduced with a single collective operation.
+   *  @return the sorted union of the indices
+   */
+  static std::vector<unsigned long> reduceEntries(
+      const LocalSpeciesMatrices &localMatrices,
+      MatrixDouble &neighborMatrix,
+      MatrixDouble &denominatorMatrix,
+      const std::vector<unsigned long> &localIndices);
+
+  /**
+   *  frequency = neighbor / denominator (or neighbor if the 
+   *  denominator is null), for the given linear indices only
+   */
+  static void updateFrequencies(MatrixDouble &frequencies,
+      const MatrixDouble &neighborMatrix,
+      const MatrixDouble &denominatorMatrix,
+      const std::vector<unsigned long> &indices);
+};
+
+/**
+ *  Non-null entries of a frequency matrix, sorted such that
+ *  the first one is the maximum value, and the smallest 
+ *  (row, column) among equal values (the entry found by a 
+ *  row-major scan with a strict comparison)
+ */
+class MaxEntryQueue {
+public:
+  MaxEntryQueue(const MatrixDouble &m);
+  
+  /**
+   *  @return the maximum entry, or (0, 0) if all the 
+   *  entries are null
+   */
+  std::pair<int, int> getMax() const;
+  
+  /**
+   *  Remove the entries at the given linear indices. Must be
+   *  called before updating them in m.
+   */
+  void remove(const MatrixDouble &m, 
+      const std::vector<unsigned long> &indices);
+  
+  /**
+   *  Insert the entries at the given linear indices, after 
+   *  they have been updated in m
+   */
+  void insert(const MatrixDouble &m, 
+      const std::vector<unsigned long> &indices);
+private:
+  struct Entry {
+    double value;
+    unsigned int i;
+    unsigned int j;
+    bool operator <(const Entry &other) const {
+      if (value != other.value) {
+        return value > other.value;
+      }
+      return std::make_pair(i, j) < std::make_pair(other.i, other.j);
+    }
+  };
+  
+  void insert(const MatrixDouble &m, unsigned int i, unsigned int j);
+
+  std::set<Entry> _entries;
+};
+
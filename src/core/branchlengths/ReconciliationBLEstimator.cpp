@@ -64,8 +64,8 @@ static void estimateBLRecursive(pll_unode_t *node,
     pll_rtree_t *speciesTree,
     const std::vector<std::vector<Scenario::Event> > &geneToEvents,
     double familyWeight,
-    std::vector<double> &speciesSumBL,
-    std::vector<double> &speciesWeightBL)
+    double *speciesSumBL,
+    double *speciesWeightBL)
 {
   auto &lastEvent = geneToEvents[node->node_index].back();
   bool isSpeciation = lastEvent.type == ReconciliationEventType::EVENT_S;
@@ -118,8 +118,8 @@ static void estimateBLRecursive(pll_unode_t *node,
 
 void estimateBLForFamily(const Scenario &scenario,
     double familyWeight, 
-    std::vector<double> &speciesSumBL,
-    std::vector<double> &speciesWeightBL)
+    double *speciesSumBL,
+    double *speciesWeightBL)
 {
   auto geneRoot = scenario.getGeneRoot();
   pll_unode_t virtualRoot;
@@ -145,6 +145,14 @@ double getFamilyWeight(const FamilyInfo &info)
   if (info.alignmentFile == "" || info.libpllModel == "" || info.libpllModel == "true") {
     return 1.0;
   }
+  if (info.alignmentTaxa) {
+    // precomputed in the family bundle
+    if (info.alignmentCharacters == 0) {
+      return 1.0;
+    }
+    return static_cast<double>(info.alignmentCharacters) 
+      / static_cast<double>(info.alignmentTaxa);
+  }
   try {
     Model model(info.libpllModel);
   } catch (...) {
@@ -161,10 +169,11 @@ double getFamilyWeight(const FamilyInfo &info)
 void ReconciliationBLEstimator::estimate(
       const std::string &speciesTreeFile,
       const Families &families, 
-      const ModelParameters &modelParameters)
+      const ModelParameters &modelParameters,
+      const FamilyCosts *familyCosts)
 {
     PLLRootedTree speciesTree(speciesTreeFile, true);
-    PerCoreGeneTrees geneTrees(families);
+    PerCoreGeneTrees geneTrees(families, false, familyCosts);
     const unsigned int samples = 0;
     const bool optimizeRates = false;
     std::vector<Scenario> scenarios;
@@ -176,9 +185,11 @@ void ReconciliationBLEstimator::estimate(
         samples,
         optimizeRates,
         scenarios);
-    double speciesNodesNumber = speciesTree.getNodesNumber();
-    std::vector<double> speciesSumBL(speciesNodesNumber, 0.0);
-    std::vector<double> speciesWeightBL(speciesNodesNumber, 0.0);
+    unsigned int speciesNodesNumber = speciesTree.getNodesNumber();
+    // both rows are reduced at once
+    MatrixDouble sums(2, speciesNodesNumber, 0.0);
+    auto speciesSumBL = sums[0];
+    auto speciesWeightBL = sums[1];
        
     Logger::timed << "[Species BL estimation] Infering branch lengths from gene trees" << std::endl;
     for (unsigned int i = 0; i < geneTrees.getTrees().size(); ++i) {
@@ -188,9 +199,8 @@ void ReconciliationBLEstimator::estimate(
         speciesSumBL,
         speciesWeightBL);
     }
-    ParallelContext::sumVectorDouble(speciesSumBL);
-    ParallelContext::sumVectorDouble(speciesWeightBL);
-    for (unsigned int i = 0; i < speciesSumBL.size(); ++i) {
+    ParallelContext::sumMatrixDouble(sums);
+    for (unsigned int i = 0; i < speciesNodesNumber; ++i) {
       auto length = 0.0;
       if (speciesWeightBL[i] != 0.0) {
         length = speciesSumBL[i] / speciesWeightBL[i];
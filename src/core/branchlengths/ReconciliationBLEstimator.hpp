@@ -8,9 +8,14 @@ class ReconciliationBLEstimator {
 public:
   ReconciliationBLEstimator() = delete;
 
+  /**
+   *  If set, familyCosts is used to distribute the families
+   *  (see PerCoreGeneTrees)
+   */
   static void estimate(const std::string &speciesTreeFile,
       const Families &families, 
-      const ModelParameters &parameters);
+      const ModelParameters &parameters,
+      const FamilyCosts *familyCosts = nullptr);
 
   
 
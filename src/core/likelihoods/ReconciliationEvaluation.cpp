@@ -5,6 +5,7 @@
 #include <likelihoods/reconciliation_models/UndatedDLModel.hpp>
 #include <likelihoods/reconciliation_models/UndatedDTLModel.hpp>
 #include <likelihoods/reconciliation_models/ParsimonyDModel.hpp>
+#include <chrono>
 #include <cmath>
 #include <IO/FileSystem.hpp>
 #include <likelihoods/reconciliation_models/AbstractReconciliationModel.hpp>
@@ -14,6 +15,13 @@ double log(ScaledValue v)
   return v.getLogValue();
 }
 
+/**
+ *  Below this log-likelihood, some of the CLV values that 
+ *  significantly contribute to the likelihood might underflow 
+ *  with double precision (DBL_MIN is around exp(-708))
+ */
+static const double MIN_DOUBLE_PRECISION_LL = -600.0;
+
 
 ReconciliationEvaluation::ReconciliationEvaluation(PLLRootedTree  &speciesTree,
   PLLUnrootedTree &initialGeneTree,
@@ -23,7 +31,10 @@ ReconciliationEvaluation::ReconciliationEvaluation(PLLRootedTree  &speciesTree,
     _initialGeneTree(initialGeneTree),
     _geneSpeciesMapping(geneSpeciesMapping),
     _recModelInfo(recModelInfo),
-    _infinitePrecision(true)
+    _infinitePrecision(false),
+    _likelihoodMode(PartialLikelihoodMode::PartialGenes),
+    _madRooting(false),
+    _evaluationTime(0.0)
 {
   _evaluators = buildRecModelObject(_recModelInfo.model, 
       _infinitePrecision);
@@ -43,6 +54,7 @@ void ReconciliationEvaluation::setRates(const Parameters &parameters)
   }
   assert(parameters.dimensions());
   assert(0 == parameters.dimensions() % freeParameters);
+  _parameters = parameters;
   _rates.resize(freeParameters);
   for (auto &r: _rates) {
     r.resize(_speciesTree.getNodesNumber());
@@ -68,11 +80,53 @@ void ReconciliationEvaluation::setRoot(pll_unode_t * root)
 
 double ReconciliationEvaluation::evaluate()
 {
-  return _evaluators->computeLogLikelihood();
+  auto start = std::chrono::steady_clock::now();
+  auto ll = _evaluators->computeLogLikelihood();
+  if (!_infinitePrecision && !_evaluators->isParsimony() 
+      && !(ll >= MIN_DOUBLE_PRECISION_LL)) {
+    // possible underflow: we keep infinite precision for this 
+    // family from now on
+    updatePrecision(true);
+    ll = _evaluators->computeLogLikelihood();
+  }
+  _evaluationTime += std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  return ll;
+}
+  
+double ReconciliationEvaluation::evaluateWithGradient(Parameters &gradient,
+    double epsilon)
+{
+  auto ll = evaluate();
+  gradient = Parameters(_parameters.dimensions());
+  if (!std::isfinite(ll) || !_parameters.dimensions()) {
+    return ll;
+  }
+  RatesVector ratesGradient;
+  if (_evaluators->computeLogLikelihoodGradient(ratesGradient)) {
+    // reverse the mapping of setRates
+    for (unsigned int d = 0; d < _rates.size(); ++d) {
+      for (unsigned int e = 0; e < _speciesTree.getNodesNumber(); ++e) {
+        gradient[(e * _rates.size() + d) % gradient.dimensions()] += 
+          ratesGradient[d][e];
+      }
+    }
+    return ll;
+  }
+  auto parameters = _parameters;
+  for (unsigned int i = 0; i < parameters.dimensions(); ++i) {
+    auto closeParameters = parameters;
+    closeParameters[i] += epsilon;
+    setRates(closeParameters);
+    gradient[i] = (evaluate() - ll) / epsilon;
+  }
+  setRates(parameters);
+  return ll;
 }
   
 void ReconciliationEvaluation::enableMADRooting(bool enable)
 {
+  _madRooting = enable;
   _evaluators->enableMADRooting(enable);
 }
 
@@ -129,12 +183,21 @@ ReconciliationModelInterface *ReconciliationEvaluation::buildRecModelObject(RecM
 void ReconciliationEvaluation::updatePrecision(bool infinitePrecision)
 {
   if (infinitePrecision != _infinitePrecision) {
+    auto root = _evaluators->getRoot();
     _infinitePrecision = infinitePrecision;
     delete _evaluators;
     _evaluators = buildRecModelObject(_recModelInfo.model, 
       _infinitePrecision);
-    _evaluators->setRates(_rates);
- }
+    if (_rates.size()) {
+      _evaluators->setRates(_rates);
+    }
+    _evaluators->setPartialLikelihoodMode(_likelihoodMode);
+    if (_madRooting) {
+      _evaluators->enableMADRooting(true);
+    }
+    // setRates resets the root, so we set it after
+    _evaluators->setRoot(root);
+  }
 }
 void ReconciliationEvaluation::inferMLScenario(Scenario &scenario, bool stochastic) {
   auto infinitePrecision = _infinitePrecision;
@@ -144,6 +207,18 @@ void ReconciliationEvaluation::inferMLScenario(Scenario &scenario, bool stochast
   _evaluators->inferMLScenario(scenario, stochastic);
   updatePrecision(infinitePrecision);
 }
+
+void ReconciliationEvaluation::sampleScenarios(std::vector<Scenario *> &scenarios,
+    unsigned int seed,
+    ThreadPool &threadPool)
+{
+  auto infinitePrecision = _infinitePrecision;
+  updatePrecision(true);
+  auto ll = evaluate();
+  assert(std::isfinite(ll) && ll <= 0.0);
+  _evaluators->sampleScenarios(scenarios, seed, threadPool);
+  updatePrecision(infinitePrecision);
+}
   
 pll_unode_t *ReconciliationEvaluation::computeMLRoot() 
 {
@@ -170,11 +245,17 @@ void ReconciliationEvaluation::onSpeciesTreeChange(const std::unordered_set<pll_
 
 void ReconciliationEvaluation::setPartialLikelihoodMode(PartialLikelihoodMode mode) 
 { 
+  _likelihoodMode = mode;
   _evaluators->setPartialLikelihoodMode(mode);
 }
   
-void ReconciliationEvaluation::rollbackToLastState() 
+void ReconciliationEvaluation::saveState()
+{
+  _evaluators->saveState();
+}
+  
+bool ReconciliationEvaluation::rollbackToLastState() 
 {
-  _evaluators->rollbackToLastState();
+  return _evaluators->rollbackToLastState();
 }
 
@@ -12,6 +12,7 @@
 
 class ReconciliationModelInterface;
 class Scenario;
+class ThreadPool;
 
 /**
  *  Wrapper around the reconciliation likelihood classes
@@ -53,10 +54,29 @@ public:
   void enableMADRooting(bool enable);
 
   /**
-   *  @param input geneTree
+   *  Compute the reconciliation log-likelihood of the current gene tree.
+   *  The family is first evaluated with double precision, and switches
+   *  (once and for all) to infinite precision if the likelihood underflows 
    */
   double evaluate();
 
+  /**
+   *  Compute the reconciliation log-likelihood of the current gene tree,
+   *  and its gradient with respect to the parameters of the last setRates
+   *  call. The gradient is computed analytically if the model supports 
+   *  it, and with forward finite differences (with step epsilon) else
+   */
+  double evaluateWithGradient(Parameters &gradient, double epsilon);
+
+  bool isInfinitePrecision() const {return _infinitePrecision;}
+
+  /**
+   *  Total time (in seconds) spent in evaluate since the 
+   *  construction of this object. This is the measured cost
+   *  used to balance the families (see PerCoreGeneTrees)
+   */
+  double getEvaluationTime() const {return _evaluationTime;}
+
   bool implementsTransfers() {return Enums::accountsForTransfers(_recModelInfo.model);} 
 
   /*
@@ -79,16 +99,45 @@ public:
   
   void inferMLScenario(Scenario &scenario, bool stochastic = false);
 
+  /**
+   *  Draw one stochastic scenario per element of scenarios,
+   *  concurrently with threadPool. The sample i is drawn from
+   *  the random stream seeded with seed + i.
+   */
+  void sampleScenarios(std::vector<Scenario *> &scenarios,
+      unsigned int seed,
+      ThreadPool &threadPool);
+
   RecModel getRecModel() const {return _recModelInfo.model;}
   
-  void rollbackToLastState();
+  /**
+   *  Save the current state before modifying the gene tree, such 
+   *  that rollbackToLastState restores the CLVs overwritten by
+   *  the following evaluations instead of recomputing them
+   */
+  void saveState();
+
+  /**
+   *  Restore the state of the last saveState call, once the gene 
+   *  tree has been restored.
+   *  Return false if the state cannot be restored (e.g. after a
+   *  rate or precision change): the caller must then invalidate
+   *  the CLVs of the modified nodes
+   */
+  bool rollbackToLastState();
 private:
   PLLRootedTree &_speciesTree;
   PLLUnrootedTree &_initialGeneTree;
   GeneSpeciesMapping _geneSpeciesMapping;
   RecModelInfo _recModelInfo; 
   bool _infinitePrecision;
+  Parameters _parameters;
   std::vector<std::vector<double> > _rates;
+  // state forwarded to _evaluators, that we keep to 
+  // restore it when we change the precision
+  PartialLikelihoodMode _likelihoodMode;
+  bool _madRooting;
+  double _evaluationTime;
   // we actually own this pointer, but we do not 
   // wrap it into a unique_ptr to allow forward definition
   ReconciliationModelInterface *_evaluators;
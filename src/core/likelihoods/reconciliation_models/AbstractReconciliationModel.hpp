@@ -10,6 +10,8 @@
 #include <maths/ScaledValue.hpp>
 #include <trees/PLLRootedTree.hpp>
 #include <maths/Random.hpp>
+#include <parallelization/ThreadPool.hpp>
+#include <algorithm>
 
 
 
@@ -45,10 +47,28 @@ public:
   virtual double computeLogLikelihood() = 0;
 
   /**
-   * If implemented, rollback to the state before the
-   * last "computeLogLikelihood(false)" call
+   * Compute the gradient of the log-likelihood returned by the last
+   * computeLogLikelihood call, with respect to the rates of the last
+   * setRates call (gradient has the same dimensions as these rates)
+   * Return false if the model does not implement it
    */
-  virtual void rollbackToLastState() = 0;
+  virtual bool computeLogLikelihoodGradient(RatesVector &gradient) = 0;
+
+  /**
+   * Save the current state, before modifying the gene tree: the 
+   * CLVs overwritten from now on are kept until the next call
+   */
+  virtual void saveState() = 0;
+
+  /**
+   * Restore the state of the last saveState call. The caller must 
+   * have restored the gene tree, and the pending CLV invalidations 
+   * are discarded.
+   * Return false if the state cannot be restored (the model does
+   * not implement it, or the species tree or the rates changed): 
+   * the CLVs of the modified nodes must then be invalidated
+   */
+  virtual bool rollbackToLastState() = 0;
 
   virtual bool isParsimony() const = 0;
 
@@ -60,6 +80,7 @@ public:
   
   /**
    * Compute and set the maximum likelihood root. Relevant in both rooted and unrooted gene tree modes
+   * Return nullptr if the likelihoods of all roots underflowed
    */
   virtual pll_unode_t *computeMLRoot() = 0;
 
@@ -79,6 +100,18 @@ public:
    **/
   virtual bool inferMLScenario(Scenario &scenario, bool stochastic = false) = 0;
 
+  /**
+   *  Fill each scenario with a set of events sampled proportionally
+   *  to their likelihood. The CLVs are computed once and only read
+   *  by the samples, which are drawn concurrently with threadPool.
+   *  The sample i uses the random stream seeded with seed + i, so
+   *  that the samples do not depend on the number of threads.
+   *  Changes the random state of the threads of threadPool.
+   **/
+  virtual bool sampleScenarios(std::vector<Scenario *> &scenarios,
+      unsigned int seed,
+      ThreadPool &threadPool) = 0;
+
   virtual void onSpeciesTreeChange(const std::unordered_set<pll_rnode_t *> *nodesToInvalidate) = 0;
 
   virtual void setFractionMissingGenes(const std::string &fractionMissingFile) = 0;
@@ -115,10 +148,14 @@ public:
   virtual void setRates(const RatesVector &rates) = 0;
   // overload from parent
   virtual double computeLogLikelihood();
+  // overload from parent
+  virtual bool computeLogLikelihoodGradient(RatesVector &) {return false;}
   // overload from parent 
   virtual bool isParsimony() const {return false;}
   // overload from parent 
-  virtual void rollbackToLastState() {assert(false);}
+  virtual void saveState();
+  // overload from parent 
+  virtual bool rollbackToLastState();
   // overload from parent
   virtual void setRoot(pll_unode_t * root) {_geneRoot = root;}
   // overload from parent
@@ -132,6 +169,10 @@ public:
   // overload from parent
   virtual bool inferMLScenario(Scenario &scenario, bool stochastic = false);
   // overload from parent
+  virtual bool sampleScenarios(std::vector<Scenario *> &scenarios,
+      unsigned int seed,
+      ThreadPool &threadPool);
+  // overload from parent
   virtual void setPartialLikelihoodMode(PartialLikelihoodMode mode) {_likelihoodMode = mode;};
   // overload from parents
   virtual void setFractionMissingGenes(const std::string &fractionMissingFile);
@@ -149,6 +190,13 @@ protected:
   virtual REAL getGeneRootLikelihood(pll_unode_t *root, pll_rnode_t *speciesRoot) = 0;
   virtual REAL getLikelihoodFactor() const = 0;
   virtual void recomputeSpeciesProbabilities() = 0;
+  /**
+   *  Models supporting rollbackToLastState copy the CLV of the gene 
+   *  node gid to (and back from) the given rollback slot
+   */
+  virtual bool supportsRollback() const {return false;}
+  virtual void saveCLV(unsigned int, unsigned int) {assert(false);}
+  virtual void restoreCLV(unsigned int, unsigned int) {assert(false);}
   // Called by inferMLScenario
   // fills scenario with the best likelihood set of events that 
   // would lead to the subtree of geneNode under speciesNode
@@ -210,14 +258,30 @@ protected:
   pll_rnode_t *getSpeciesRight(pll_rnode_t *node) {return _speciesRight[node->node_index];}
   pll_rnode_t *getSpeciesParent(pll_rnode_t *node) {return _speciesParent[node->node_index];}
   pll_rnode_t *getPrunedRoot() {return _prunedRoot;}
+  /**
+   *  Fill the gene roots summed in the likelihood, and the gene
+   *  nodes whose CLVs contribute to them, in postorder
+   */
+  void getGradientNodes(std::vector<pll_unode_t *> &roots,
+      std::vector<pll_unode_t *> &geneNodes);
+  REAL getRootLikelihoodsSum(const std::vector<pll_unode_t *> &roots);
+  double getRootWeight(pll_unode_t *root) const {
+    return _madRootingEnabled ? _madProbabilities[root->node_index] : 1.0;
+  }
 private:
   void mapGenesToSpecies();
   void computeMLRoot(pll_unode_t *&bestGeneRoot, pll_rnode_t *&bestSpeciesRoot);
+  // fill the CLVs and compute the roots of the scenarios
+  void prepareScenarios(pll_unode_t *&geneRoot, pll_rnode_t *&speciesRoot);
+  // only reads the CLVs: can be called concurrently
+  bool backtraceScenario(pll_unode_t *geneRoot, pll_rnode_t *speciesRoot,
+      Scenario &scenario, bool stochastic);
   virtual void computeLikelihoods();
   double getSumLikelihood();
   void updateCLVsRec(pll_unode_t *node);
   void markInvalidatedNodes();
   void markInvalidatedNodesRec(pll_unode_t *node);
+  void onCLVChange(unsigned int gid);
   bool fillPrunedNodesPostOrder(pll_rnode_t *node, 
     std::vector<pll_rnode_t *> &nodes, 
     std::unordered_set<pll_rnode_t *> *nodesToAdd = nullptr);  
@@ -236,6 +300,17 @@ private:
 
   // is the CLV up to date?
   std::vector<bool> _isCLVUpdated;
+
+  // state of the last saveState call. _touchedGeneIds are the 
+  // CLVs invalidated or recomputed since, and _savedGeneIds the
+  // ones that were up to date, saved in the rollback slots
+  bool _canRollback;
+  std::vector<bool> _isCLVTouched;
+  std::vector<unsigned int> _touchedGeneIds;
+  std::vector<unsigned int> _savedGeneIds;
+  std::vector<pll_rnode_t *> _savedLCAs;
+  pll_unode_t *_savedGeneRoot;
+
   std::vector<pll_unode_t *> _allNodes;
  
   // left, right and parent species vectors, 
@@ -263,6 +338,8 @@ AbstractReconciliationModel<REAL>::AbstractReconciliationModel(
   _speciesTree(speciesTree),
   _geneNameToSpeciesName(geneSpeciesMapping.getMap()),
   _allSpeciesNodesInvalid(true),
+  _canRollback(false),
+  _savedGeneRoot(nullptr),
   _pllUnrootedTree(nullptr),
   _madRootingEnabled(false)
 {
@@ -324,6 +401,7 @@ void AbstractReconciliationModel<REAL>::setInitialGeneTree(PLLUnrootedTree &tree
   mapGenesToSpecies();
   _maxGeneId = static_cast<unsigned int>(_allNodes.size() - 1);
   _geneToSpeciesLCA.resize(_maxGeneId + 1);
+  _isCLVTouched = std::vector<bool>(_maxGeneId + 1, false);
   invalidateAllCLVs();
 }
   
@@ -387,6 +465,7 @@ void AbstractReconciliationModel<REAL>::initSpeciesTree()
 template <class REAL>
 void AbstractReconciliationModel<REAL>::onSpeciesTreeChange(const std::unordered_set<pll_rnode_t *> *nodesToInvalidate)
 {
+  _canRollback = false;
   if (!nodesToInvalidate) {
     _allSpeciesNodesInvalid = true;
   } else {
@@ -494,12 +573,19 @@ double AbstractReconciliationModel<REAL>::computeLogLikelihood()
   updateCLVs();
   computeLikelihoods();
   if (_info.rootedGeneTree) {
-    setRoot(computeMLRoot());
-    while (root != getRoot()) {
+    auto mlRoot = computeMLRoot();
+    while (mlRoot && root != mlRoot) {
+      setRoot(mlRoot);
       updateCLVs(false);
       computeLikelihoods();
-      root = getRoot();
-      setRoot(computeMLRoot());
+      root = mlRoot;
+      mlRoot = computeMLRoot();
+    }
+    if (!mlRoot) {
+      // all the roots underflowed (only possible without 
+      // infinite precision)
+      afterComputeLogLikelihood();
+      return -std::numeric_limits<double>::infinity();
     }
   }
   
@@ -545,6 +631,7 @@ pll_unode_t *AbstractReconciliationModel<REAL>::getRightRepeats(pll_unode_t *nod
 template <class REAL>
 void AbstractReconciliationModel<REAL>::markInvalidatedNodesRec(pll_unode_t *node)
 {
+  onCLVChange(node->node_index);
   _isCLVUpdated[node->node_index] = false;
   if (node->back->next) {
     markInvalidatedNodesRec(node->back->next);
@@ -562,6 +649,64 @@ void AbstractReconciliationModel<REAL>::markInvalidatedNodes()
   _invalidatedNodes.clear();
 }
 
+template <class REAL>
+void AbstractReconciliationModel<REAL>::onCLVChange(unsigned int gid)
+{
+  if (!_canRollback || _isCLVTouched[gid]) {
+    return;
+  }
+  _isCLVTouched[gid] = true;
+  _touchedGeneIds.push_back(gid);
+  if (_isCLVUpdated[gid]) {
+    saveCLV(gid, static_cast<unsigned int>(_savedGeneIds.size()));
+    _savedGeneIds.push_back(gid);
+    _savedLCAs.push_back(_geneToSpeciesLCA[gid]);
+  }
+}
+
+template <class REAL>
+void AbstractReconciliationModel<REAL>::saveState()
+{
+  // apply the pending invalidations, that belong to the saved state
+  _canRollback = false;
+  markInvalidatedNodes();
+  for (auto gid: _touchedGeneIds) {
+    _isCLVTouched[gid] = false;
+  }
+  _touchedGeneIds.clear();
+  _savedGeneIds.clear();
+  _savedLCAs.clear();
+  _savedGeneRoot = _geneRoot;
+  _canRollback = supportsRollback();
+}
+
+template <class REAL>
+bool AbstractReconciliationModel<REAL>::rollbackToLastState()
+{
+  if (!_canRollback) {
+    return false;
+  }
+  // the CLVs recomputed since saveState were not up to date in the 
+  // saved state, except the saved ones
+  for (auto gid: _touchedGeneIds) {
+    _isCLVUpdated[gid] = false;
+    _isCLVTouched[gid] = false;
+  }
+  for (unsigned int slot = 0; slot < _savedGeneIds.size(); ++slot) {
+    auto gid = _savedGeneIds[slot];
+    restoreCLV(gid, slot);
+    _geneToSpeciesLCA[gid] = _savedLCAs[slot];
+    _isCLVUpdated[gid] = true;
+  }
+  _touchedGeneIds.clear();
+  _savedGeneIds.clear();
+  _savedLCAs.clear();
+  _invalidatedNodes.clear();
+  _geneRoot = _savedGeneRoot;
+  _canRollback = false;
+  return true;
+}
+
 template <class REAL>
 void AbstractReconciliationModel<REAL>::updateCLVsRec(pll_unode_t *node)
 {
@@ -591,6 +736,7 @@ void AbstractReconciliationModel<REAL>::updateCLVsRec(pll_unode_t *node)
     
     // update LCA
     auto gid = currentNode->node_index;
+    onCLVChange(gid);
     if (!currentNode->next) { // gene leaf
       _geneToSpeciesLCA[gid] = _speciesTree.getNode(_geneToSpecies[gid]);
     } else { // gene internal node
@@ -632,6 +778,46 @@ void AbstractReconciliationModel<REAL>::updateCLVs(bool invalidate)
   }
 }
 
+template <class REAL>
+void AbstractReconciliationModel<REAL>::getGradientNodes(std::vector<pll_unode_t *> &roots,
+    std::vector<pll_unode_t *> &geneNodes)
+{
+  getRoots(roots, _geneIds);
+  geneNodes.clear();
+  std::vector<bool> marked(_maxGeneId + 1, false);
+  std::stack<pll_unode_t *> nodes;
+  for (auto root: roots) {
+    nodes.push(root);
+    nodes.push(root->back);
+    while (!nodes.empty()) {
+      auto currentNode = nodes.top();
+      if (marked[currentNode->node_index]) {
+        nodes.pop();
+        continue;
+      }
+      if (currentNode->next) {
+        bool waitForChildren = false;
+        auto left = getLeft(currentNode, false);
+        auto right = getRight(currentNode, false);
+        if (!marked[left->node_index]) {
+          nodes.push(left);
+          waitForChildren = true;
+        }
+        if (!marked[right->node_index]) {
+          nodes.push(right);
+          waitForChildren = true;
+        }
+        if (waitForChildren) {
+          continue;
+        }
+      }
+      nodes.pop();
+      marked[currentNode->node_index] = true;
+      geneNodes.push_back(currentNode);
+    }
+  }
+}
+
 template <class REAL>
 void AbstractReconciliationModel<REAL>::invalidateCLV(unsigned int nodeIndex)
 {
@@ -656,6 +842,8 @@ void AbstractReconciliationModel<REAL>::setFractionMissingGenes(const std::strin
 template <class REAL>
 void AbstractReconciliationModel<REAL>::invalidateAllCLVs()
 {
+  // the saved CLVs might not be valid anymore (e.g. new rates)
+  _canRollback = false;
   _isCLVUpdated = std::vector<bool>(_maxGeneId + 1, false);
 }
  
@@ -723,10 +911,23 @@ pll_unode_t *AbstractReconciliationModel<REAL>::computeMLRoot()
       max = rootProba;
     }
   }
-  assert(bestRoot);
   return bestRoot;
 }
 
+template <class REAL>
+REAL AbstractReconciliationModel<REAL>::getRootLikelihoodsSum(const std::vector<pll_unode_t *> &roots)
+{
+  REAL total = REAL();
+  for (auto root: roots) {
+    auto ll = getGeneRootLikelihood(root);
+    if (_madRootingEnabled) {
+      ll *= _madProbabilities[root->node_index];
+    }
+    total += ll;
+  }
+  return total;
+}
+
 template <class REAL>
 double AbstractReconciliationModel<REAL>::getSumLikelihood()
 {
@@ -735,15 +936,7 @@ double AbstractReconciliationModel<REAL>::getSumLikelihood()
   getRoots(roots, _geneIds);
   //Logger::info << "HEY" << std::endl;
   if (!isParsimony()) {
-    for (auto root: roots) {
-      auto ll = getGeneRootLikelihood(root);
-      if (_madRootingEnabled) {
-        ll *= _madProbabilities[root->node_index];
-        //Logger::info << root->node_index << " " << _madProbabilities[root->node_index] << std::endl;
-      }
-
-      total += ll;
-    }
+    total = getRootLikelihoodsSum(roots);
   } else {
     total =  REAL(-std::numeric_limits<double>::infinity()); 
     for (auto root: roots) {
@@ -811,7 +1004,8 @@ static std::string geneTreeString(pll_unode_t *node, const std::vector<unsigned
 }
 
 template <class REAL>
-bool AbstractReconciliationModel<REAL>::inferMLScenario(Scenario &scenario, bool stochastic)
+void AbstractReconciliationModel<REAL>::prepareScenarios(pll_unode_t *&geneRoot, 
+    pll_rnode_t *&speciesRoot)
 {
   // make sure the CLVs are filled
   invalidateAllCLVs();
@@ -819,12 +1013,19 @@ bool AbstractReconciliationModel<REAL>::inferMLScenario(Scenario &scenario, bool
   computeLikelihoods(); 
   auto ll = getSumLikelihood();
   assert(ll == 0.0 || (std::isnormal(ll) && ll <= 0.0));
-
-  pll_unode_t *geneRoot = 0;
-  pll_rnode_t *speciesRoot = 0;
+  geneRoot = 0;
+  speciesRoot = 0;
   computeMLRoot(geneRoot, speciesRoot);
   assert(geneRoot);
   assert(speciesRoot);
+}
+
+template <class REAL>
+bool AbstractReconciliationModel<REAL>::backtraceScenario(pll_unode_t *geneRoot, 
+    pll_rnode_t *speciesRoot,
+    Scenario &scenario,
+    bool stochastic)
+{
   scenario.setGeneRoot(geneRoot);
   scenario.setSpeciesTree(_speciesTree.getRawPtr());
   pll_unode_t virtualRoot;
@@ -834,6 +1035,32 @@ bool AbstractReconciliationModel<REAL>::inferMLScenario(Scenario &scenario, bool
   scenario.initBlackList(_maxGeneId, _speciesTree.getNodesNumber());
   return  backtrace(&virtualRoot, speciesRoot, scenario, true, stochastic);
 }
+
+template <class REAL>
+bool AbstractReconciliationModel<REAL>::inferMLScenario(Scenario &scenario, bool stochastic)
+{
+  pll_unode_t *geneRoot = 0;
+  pll_rnode_t *speciesRoot = 0;
+  prepareScenarios(geneRoot, speciesRoot);
+  return backtraceScenario(geneRoot, speciesRoot, scenario, stochastic);
+}
+
+template <class REAL>
+bool AbstractReconciliationModel<REAL>::sampleScenarios(std::vector<Scenario *> &scenarios,
+    unsigned int seed,
+    ThreadPool &threadPool)
+{
+  pll_unode_t *geneRoot = 0;
+  pll_rnode_t *speciesRoot = 0;
+  prepareScenarios(geneRoot, speciesRoot);
+  std::vector<char> ok(scenarios.size(), 0);
+  threadPool.parallelFor(static_cast<unsigned int>(scenarios.size()), 
+      [&](unsigned int i) {
+    Random::setSeed(seed + i);
+    ok[i] = backtraceScenario(geneRoot, speciesRoot, *scenarios[i], true);
+  });
+  return std::all_of(ok.begin(), ok.end(), [](char v) {return v != 0;});
+}
   
 
 static pll_unode_t *getOther(pll_unode_t *ref, pll_unode_t *n1, pll_unode_t *n2)
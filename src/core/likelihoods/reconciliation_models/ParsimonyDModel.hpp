@@ -137,8 +137,7 @@ void ParsimonyDModel::computeProbability(pll_unode_t *geneNode,
   // D event
   auto leftLCA = this->_geneToSpeciesLCA[v];
   auto rightLCA = this->_geneToSpeciesLCA[w];
-  auto &parentsCache = this->_speciesTree.getParentsCache(rightLCA);
-  if (parentsCache[leftLCA->node_index]) {
+  if (this->_speciesTree.areParents(leftLCA, rightLCA)) {
     proba += _costD;
   }
   // else: SL or S event
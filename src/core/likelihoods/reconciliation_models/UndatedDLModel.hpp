@@ -37,6 +37,8 @@ public:
   
   // overloaded from parent
   virtual void setRates(const RatesVector &rates);
+  // overloaded from parent
+  virtual bool computeLogLikelihoodGradient(RatesVector &gradient);
 protected:
   // overload from parent
   virtual void setInitialGeneTree(PLLUnrootedTree &tree);
@@ -50,6 +52,14 @@ protected:
 
   // overload from parent
   virtual void recomputeSpeciesProbabilities();
+  // overload from parent
+  virtual bool supportsRollback() const {return true;}
+  // overload from parent
+  virtual void saveCLV(unsigned int gid, unsigned int slot);
+  // overload from parent
+  virtual void restoreCLV(unsigned int gid, unsigned int slot) {
+    std::swap(_dlclvs[gid], _savedCLVs[slot]);
+  }
   virtual REAL getLikelihoodFactor() const;
   // overload from parent
   virtual void computeGeneRootLikelihood(pll_unode_t *virtualRoot);
@@ -70,6 +80,33 @@ private:
   // to produce the subtree of this gene node
   typedef std::vector<REAL> DLCLV;
   std::vector<DLCLV> _dlclvs;
+  // CLVs saved for rollbackToLastState (the slots are reused)
+  std::vector<DLCLV> _savedCLVs;
+  
+  /**
+   *  Derivatives of the log-likelihood (adjoints) with respect to 
+   *  the intermediate values, accumulated in the backward pass of
+   *  computeLogLikelihoodGradient
+   */
+  struct DLAdjoints {
+    DLAdjoints(unsigned int clvsNumber, unsigned int speciesNumber):
+      uq(clvsNumber),
+      PD(speciesNumber, 0.0),
+      PL(speciesNumber, 0.0),
+      PS(speciesNumber, 0.0),
+      uE(speciesNumber, 0.0)
+    {}
+    // only allocated for the CLVs that contribute to the likelihood
+    std::vector<std::vector<double> > uq;
+    std::vector<double> PD;
+    std::vector<double> PL;
+    std::vector<double> PS;
+    std::vector<double> uE;
+  };
+  void backwardCLV(pll_unode_t *geneNode, 
+      unsigned int gid, 
+      bool isVirtualRoot,
+      DLAdjoints &adjoints);
  
 private:
   std::vector<pll_rnode_s *> &getSpeciesNodesToUpdate() {
@@ -153,6 +190,17 @@ void UndatedDLModel<REAL>::updateCLV(pll_unode_t *geneNode)
 }
 
 
+template <class REAL>
+void UndatedDLModel<REAL>::saveCLV(unsigned int gid, unsigned int slot)
+{
+  assert(slot <= _savedCLVs.size());
+  if (slot == _savedCLVs.size()) {
+    _savedCLVs.push_back(_dlclvs[gid]);
+  } else {
+    _savedCLVs[slot] = _dlclvs[gid];
+  }
+}
+
 template <class REAL>
 void UndatedDLModel<REAL>::computeProbability(pll_unode_t *geneNode, pll_rnode_t *speciesNode, 
       REAL &proba,
@@ -303,6 +351,163 @@ void UndatedDLModel<REAL>::computeGeneRootLikelihood(pll_unode_t *virtualRoot)
   }
 }
 
+template <class REAL>
+bool UndatedDLModel<REAL>::computeLogLikelihoodGradient(RatesVector &)
+{
+  // each CLV value of the infinite precision model has its own 
+  // scaler, and the adjoints of the smallest values would overflow
+  return false;
+}
+
+/**
+ *  Reverse-mode differentiation of the likelihood computation:
+ *  the adjoints are propagated from the virtual roots to the gene 
+ *  leaves, then through the extinction probabilities, and finally
+ *  through the normalization of the rates
+ */
+template <>
+inline bool UndatedDLModel<double>::computeLogLikelihoodGradient(RatesVector &gradient)
+{
+  auto speciesNumber = this->_allSpeciesNodesCount;
+  std::vector<pll_unode_t *> roots;
+  std::vector<pll_unode_t *> geneNodes;
+  this->getGradientNodes(roots, geneNodes);
+  auto total = this->getRootLikelihoodsSum(roots);
+  if (!(total > 0.0)) {
+    return false;
+  }
+  DLAdjoints adjoints(_dlclvs.size(), speciesNumber);
+  for (auto root: roots) {
+    pll_unode_t virtualRoot;
+    virtualRoot.next = root;
+    virtualRoot.node_index = root->node_index + this->_maxGeneId + 1;
+    adjoints.uq[virtualRoot.node_index] = std::vector<double>(speciesNumber, 
+        this->getRootWeight(root) / total);
+    backwardCLV(&virtualRoot, virtualRoot.node_index, true, adjoints);
+  }
+  for (auto it = geneNodes.rbegin(); it != geneNodes.rend(); ++it) {
+    auto gid = (*it)->node_index;
+    if (adjoints.uq[gid].size()) {
+      backwardCLV(*it, gid, false, adjoints);
+    }
+  }
+  // likelihood factor
+  double factor = 0.0;
+  for (auto speciesNode: this->_allSpeciesNodes) {
+    factor += 1.0 - _uE[speciesNode->node_index];
+  }
+  // extinction probabilities, solutions of uE = PD uE^2 + c
+  // with c = PL + PS uE(f) uE(g), in reverse postorder
+  for (auto it = this->_allSpeciesNodes.rbegin(); 
+      it != this->_allSpeciesNodes.rend(); ++it) {
+    auto speciesNode = *it;
+    auto e = speciesNode->node_index;
+    double cAdj = (adjoints.uE[e] + 1.0 / factor) 
+      / (1.0 - 2.0 * _PD[e] * _uE[e]);
+    adjoints.PD[e] += cAdj * _uE[e] * _uE[e];
+    adjoints.PL[e] += cAdj;
+    if (this->getSpeciesLeft(speciesNode)) {
+      auto f = this->getSpeciesLeft(speciesNode)->node_index;
+      auto g = this->getSpeciesRight(speciesNode)->node_index;
+      adjoints.PS[e] += cAdj * _uE[f] * _uE[g];
+      adjoints.uE[f] += cAdj * _PS[e] * _uE[g];
+      adjoints.uE[g] += cAdj * _PS[e] * _uE[f];
+    }
+  }
+  // normalization of the rates: P_x = x / (d + l + 1)
+  gradient = RatesVector(2, std::vector<double>(speciesNumber, 0.0));
+  for (auto speciesNode: this->_allSpeciesNodes) {
+    auto e = speciesNode->node_index;
+    double dot = adjoints.PD[e] * _PD[e] + adjoints.PL[e] * _PL[e] 
+      + adjoints.PS[e] * _PS[e];
+    gradient[0][e] = (adjoints.PD[e] - dot) * _PS[e];
+    gradient[1][e] = (adjoints.PL[e] - dot) * _PS[e];
+    if (!std::isfinite(gradient[0][e]) || !std::isfinite(gradient[1][e])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ *  Backward pass of the computeProbability calls filling the CLV 
+ *  gid: propagate its adjoints to the CLVs of the gene children 
+ *  and to the species probabilities (only used with REAL = double)
+ */
+template <class REAL>
+void UndatedDLModel<REAL>::backwardCLV(pll_unode_t *geneNode, 
+    unsigned int gid, 
+    bool isVirtualRoot,
+    DLAdjoints &adjoints)
+{
+  bool isGeneLeaf = !geneNode->next;
+  auto &clv = _dlclvs[gid];
+  auto &adj = adjoints.uq[gid];
+  std::vector<double> *leftAdj = nullptr;
+  std::vector<double> *rightAdj = nullptr;
+  unsigned int leftGid = 0;
+  unsigned int rightGid = 0;
+  if (!isGeneLeaf) {
+    leftGid = this->getLeft(geneNode, isVirtualRoot)->node_index;
+    rightGid = this->getRight(geneNode, isVirtualRoot)->node_index;
+    leftAdj = &adjoints.uq[leftGid];
+    rightAdj = &adjoints.uq[rightGid];
+    leftAdj->resize(this->_allSpeciesNodesCount, 0.0);
+    rightAdj->resize(this->_allSpeciesNodesCount, 0.0);
+  }
+  // reverse postorder: the adjoint of a species is complete
+  // before we propagate it to its children
+  for (auto it = this->_allSpeciesNodes.rbegin(); 
+      it != this->_allSpeciesNodes.rend(); ++it) {
+    auto speciesNode = *it;
+    auto e = speciesNode->node_index;
+    bool isSpeciesLeaf = !this->getSpeciesLeft(speciesNode);
+    if (isSpeciesLeaf && isGeneLeaf) {
+      if (e == this->_geneToSpecies[gid]) {
+        adjoints.PS[e] += adj[e];
+      }
+      continue;
+    }
+    if (adj[e] == 0.0) {
+      continue;
+    }
+    // DL event
+    auto a = adj[e] / (1.0 - 2.0 * _PD[e] * _uE[e]);
+    adjoints.PD[e] += a * clv[e] * 2.0 * _uE[e];
+    adjoints.uE[e] += a * clv[e] * 2.0 * _PD[e];
+    unsigned int f = 0;
+    unsigned int g = 0;
+    if (!isSpeciesLeaf) {
+      f = this->getSpeciesLeft(speciesNode)->node_index;
+      g = this->getSpeciesRight(speciesNode)->node_index;
+    }
+    if (!isGeneLeaf) {
+      auto &left = _dlclvs[leftGid];
+      auto &right = _dlclvs[rightGid];
+      if (!isSpeciesLeaf) {
+        // S event
+        (*leftAdj)[f] += a * right[g] * _PS[e];
+        (*rightAdj)[g] += a * left[f] * _PS[e];
+        (*leftAdj)[g] += a * right[f] * _PS[e];
+        (*rightAdj)[f] += a * left[g] * _PS[e];
+        adjoints.PS[e] += a * (left[f] * right[g] + left[g] * right[f]);
+      }
+      // D event
+      (*leftAdj)[e] += a * right[e] * _PD[e];
+      (*rightAdj)[e] += a * left[e] * _PD[e];
+      adjoints.PD[e] += a * left[e] * right[e];
+    }
+    if (!isSpeciesLeaf) {
+      // SL event
+      adj[f] += a * (_uE[g] * _PS[e]);
+      adj[g] += a * (_uE[f] * _PS[e]);
+      adjoints.uE[g] += a * clv[f] * _PS[e];
+      adjoints.uE[f] += a * clv[g] * _PS[e];
+      adjoints.PS[e] += a * (clv[f] * _uE[g] + clv[g] * _uE[f]);
+    }
+  }
+}
+
 template <class REAL>
 REAL UndatedDLModel<REAL>::getLikelihoodFactor() const
 {
@@ -0,0 +1,226 @@
+#include "UndatedDTLKernel.hpp"
+
+extern "C" {
+#include <pll.h>
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define JS_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+typedef UndatedDTLKernel::KernelSet KernelSet;
+
+static void computeDTCPU(size_t size,
+    const double *left,
+    const double *right,
+    const double *PD,
+    const double *PT,
+    double leftTransferSum,
+    double rightTransferSum,
+    double *res)
+{
+  for (size_t e = 0; e < size; ++e) {
+    double d = left[e] * right[e] * PD[e];
+    double t1 = (leftTransferSum * PT[e]) * right[e];
+    double t2 = (rightTransferSum * PT[e]) * left[e];
+    res[e] = d + t1 + t2;
+  }
+}
+
+static double getMaxCPU(size_t size, const double *values)
+{
+  double res = 0.0;
+  for (size_t e = 0; e < size; ++e) {
+    res = (values[e] > res) ? values[e] : res;
+  }
+  return res;
+}
+
+static void multiplyCPU(size_t size, double factor, double *values)
+{
+  for (size_t e = 0; e < size; ++e) {
+    values[e] *= factor;
+  }
+}
+
+#ifdef JS_X86_KERNELS
+
+__attribute__((target("sse2")))
+static void computeDTSSE(size_t size,
+    const double *left,
+    const double *right,
+    const double *PD,
+    const double *PT,
+    double leftTransferSum,
+    double rightTransferSum,
+    double *res)
+{
+  const size_t width = 2;
+  size_t vectorized = size - size % width;
+  __m128d lts = _mm_set1_pd(leftTransferSum);
+  __m128d rts = _mm_set1_pd(rightTransferSum);
+  for (size_t e = 0; e < vectorized; e += width) {
+    __m128d l = _mm_loadu_pd(left + e);
+    __m128d r = _mm_loadu_pd(right + e);
+    __m128d pt = _mm_loadu_pd(PT + e);
+    __m128d d = _mm_mul_pd(_mm_mul_pd(l, r), _mm_loadu_pd(PD + e));
+    __m128d t1 = _mm_mul_pd(_mm_mul_pd(lts, pt), r);
+    __m128d t2 = _mm_mul_pd(_mm_mul_pd(rts, pt), l);
+    _mm_storeu_pd(res + e, _mm_add_pd(_mm_add_pd(d, t1), t2));
+  }
+  computeDTCPU(size - vectorized, left + vectorized, right + vectorized,
+      PD + vectorized, PT + vectorized,
+      leftTransferSum, rightTransferSum, res + vectorized);
+}
+
+__attribute__((target("sse2")))
+static double getMaxSSE(size_t size, const double *values)
+{
+  const size_t width = 2;
+  size_t vectorized = size - size % width;
+  __m128d max = _mm_setzero_pd();
+  for (size_t e = 0; e < vectorized; e += width) {
+    max = _mm_max_pd(max, _mm_loadu_pd(values + e));
+  }
+  double buffer[width];
+  _mm_storeu_pd(buffer, max);
+  double res = getMaxCPU(width, buffer);
+  double tail = getMaxCPU(size - vectorized, values + vectorized);
+  return (tail > res) ? tail : res;
+}
+
+__attribute__((target("sse2")))
+static void multiplySSE(size_t size, double factor, double *values)
+{
+  const size_t width = 2;
+  size_t vectorized = size - size % width;
+  __m128d f = _mm_set1_pd(factor);
+  for (size_t e = 0; e < vectorized; e += width) {
+    _mm_storeu_pd(values + e, _mm_mul_pd(_mm_loadu_pd(values + e), f));
+  }
+  multiplyCPU(size - vectorized, factor, values + vectorized);
+}
+
+__attribute__((target("avx")))
+static void computeDTAVX(size_t size,
+    const double *left,
+    const double *right,
+    const double *PD,
+    const double *PT,
+    double leftTransferSum,
+    double rightTransferSum,
+    double *res)
+{
+  const size_t width = 4;
+  size_t vectorized = size - size % width;
+  __m256d lts = _mm256_set1_pd(leftTransferSum);
+  __m256d rts = _mm256_set1_pd(rightTransferSum);
+  for (size_t e = 0; e < vectorized; e += width) {
+    __m256d l = _mm256_loadu_pd(left + e);
+    __m256d r = _mm256_loadu_pd(right + e);
+    __m256d pt = _mm256_loadu_pd(PT + e);
+    __m256d d = _mm256_mul_pd(_mm256_mul_pd(l, r), _mm256_loadu_pd(PD + e));
+    __m256d t1 = _mm256_mul_pd(_mm256_mul_pd(lts, pt), r);
+    __m256d t2 = _mm256_mul_pd(_mm256_mul_pd(rts, pt), l);
+    _mm256_storeu_pd(res + e, _mm256_add_pd(_mm256_add_pd(d, t1), t2));
+  }
+  computeDTCPU(size - vectorized, left + vectorized, right + vectorized,
+      PD + vectorized, PT + vectorized,
+      leftTransferSum, rightTransferSum, res + vectorized);
+}
+
+__attribute__((target("avx")))
+static double getMaxAVX(size_t size, const double *values)
+{
+  const size_t width = 4;
+  size_t vectorized = size - size % width;
+  __m256d max = _mm256_setzero_pd();
+  for (size_t e = 0; e < vectorized; e += width) {
+    max = _mm256_max_pd(max, _mm256_loadu_pd(values + e));
+  }
+  double buffer[width];
+  _mm256_storeu_pd(buffer, max);
+  double res = getMaxCPU(width, buffer);
+  double tail = getMaxCPU(size - vectorized, values + vectorized);
+  return (tail > res) ? tail : res;
+}
+
+__attribute__((target("avx")))
+static void multiplyAVX(size_t size, double factor, double *values)
+{
+  const size_t width = 4;
+  size_t vectorized = size - size % width;
+  __m256d f = _mm256_set1_pd(factor);
+  for (size_t e = 0; e < vectorized; e += width) {
+    _mm256_storeu_pd(values + e, _mm256_mul_pd(_mm256_loadu_pd(values + e), f));
+  }
+  multiplyCPU(size - vectorized, factor, values + vectorized);
+}
+
+#endif
+
+/**
+ *  AVX2 only adds integer instructions to AVX for our purpose,
+ *  and we do not use FMA to keep the results independent from
+ *  the architecture: AVX2 CPUs use the AVX kernels.
+ */
+static const KernelSet cpuKernels = {"CPU", computeDTCPU, getMaxCPU, 
+  multiplyCPU};
+
+static KernelSet getBestKernels()
+{
+#ifdef JS_X86_KERNELS
+  KernelSet sse = {"SSE", computeDTSSE, getMaxSSE, multiplySSE};
+  KernelSet avx = {"AVX", computeDTAVX, getMaxAVX, multiplyAVX};
+  pll_hardware_probe();
+  if (pll_hardware.avx2_present) {
+    avx.name = "AVX2";
+    return avx;
+  } else if (pll_hardware.avx_present) {
+    return avx;
+  } else if (pll_hardware.sse_present) {
+    return sse;
+  }
+#endif
+  return cpuKernels;
+}
+
+const KernelSet &UndatedDTLKernel::getKernels()
+{
+  static const KernelSet kernels = getBestKernels();
+  return kernels;
+}
+
+const KernelSet &UndatedDTLKernel::getScalarKernels()
+{
+  return cpuKernels;
+}
+
+void UndatedDTLKernel::computeDuplicationsAndTransfers(size_t size,
+    const double *left,
+    const double *right,
+    const double *PD,
+    const double *PT,
+    double leftTransferSum,
+    double rightTransferSum,
+    double *res)
+{
+  getKernels().dt(size, left, right, PD, PT,
+      leftTransferSum, rightTransferSum, res);
+}
+
+double UndatedDTLKernel::getMax(size_t size, const double *values)
+{
+  return getKernels().max(size, values);
+}
+
+void UndatedDTLKernel::multiply(size_t size, double factor, double *values)
+{
+  getKernels().multiply(size, factor, values);
+}
+
+const char *UndatedDTLKernel::getArchName()
+{
+  return getKernels().name;
+}
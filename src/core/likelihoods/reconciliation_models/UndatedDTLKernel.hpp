@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ *  Vectorized kernels operating on the contiguous per-species
+ *  arrays of the UndatedDTLModel CLVs.
+ *
+ *  The best implementation (AVX2, AVX, SSE or scalar) is selected
+ *  at runtime. None of the kernels uses FMA or reorders a sum,
+ *  such that all implementations return bitwise identical results.
+ */
+class UndatedDTLKernel {
+public:
+  UndatedDTLKernel() = delete;
+
+  /**
+   *  Duplication and transfer terms of the undated DTL recursion,
+   *  for all species e in [0, size[
+   *  res[e] = left[e] * right[e] * PD[e]
+   *    + (leftTransferSum * PT[e]) * right[e]
+   *    + (rightTransferSum * PT[e]) * left[e]
+   */
+  static void computeDuplicationsAndTransfers(size_t size,
+      const double *left,
+      const double *right,
+      const double *PD,
+      const double *PT,
+      double leftTransferSum,
+      double rightTransferSum,
+      double *res);
+
+  /**
+   *  Return the maximum value of a non-negative array
+   */
+  static double getMax(size_t size, const double *values);
+
+  /**
+   *  values[e] *= factor for all e in [0, size[
+   */
+  static void multiply(size_t size, double factor, double *values);
+
+  /**
+   *  Name of the instruction set used by the kernels
+   */
+  static const char *getArchName();
+
+  /**
+   *  One implementation of all the kernels
+   */
+  struct KernelSet {
+    const char *name;
+    void (*dt)(size_t, const double *, const double *,
+        const double *, const double *, double, double, double *);
+    double (*max)(size_t, const double *);
+    void (*multiply)(size_t, double, double *);
+  };
+
+  /**
+   *  The implementation used by the functions above, selected
+   *  once at the first call
+   */
+  static const KernelSet &getKernels();
+
+  /**
+   *  The scalar implementation (to compare it with getKernels)
+   */
+  static const KernelSet &getScalarKernels();
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <likelihoods/reconciliation_models/AbstractReconciliationModel.hpp>
+#include <likelihoods/reconciliation_models/UndatedDTLKernel.hpp>
 #include <likelihoods/LibpllEvaluation.hpp>
 #include <IO/GeneSpeciesMapping.hpp>
 #include <IO/Logger.hpp>
@@ -31,8 +32,8 @@ public:
   
   // overloaded from parent
   virtual void setRates(const RatesVector &rates);
-  
-  virtual void rollbackToLastState();
+  // overloaded from parent
+  virtual bool computeLogLikelihoodGradient(RatesVector &gradient);
 protected:
   // overloaded from parent
   virtual void setInitialGeneTree(PLLUnrootedTree &tree);
@@ -40,12 +41,20 @@ protected:
   virtual void updateCLV(pll_unode_t *geneNode);
   // overload from parent
   virtual void recomputeSpeciesProbabilities();
+  // overload from parent
+  virtual bool supportsRollback() const {return true;}
+  // overload from parent
+  virtual void saveCLV(unsigned int gid, unsigned int slot);
+  // overload from parent
+  virtual void restoreCLV(unsigned int gid, unsigned int slot) {
+    std::swap(_dtlclvs[gid], _savedCLVs[slot]);
+  }
   // overloaded from parent
   virtual REAL getGeneRootLikelihood(pll_unode_t *root) const;
   // overload from parent
   virtual void computeGeneRootLikelihood(pll_unode_t *virtualRoot);
   virtual REAL getGeneRootLikelihood(pll_unode_t *root, pll_rnode_t *speciesRoot) {
-    return _dtlclvs[root->node_index + this->_maxGeneId + 1]._uq[speciesRoot->node_index];
+    return getUq(root->node_index + this->_maxGeneId + 1, speciesRoot->node_index);
   }
   virtual REAL getLikelihoodFactor() const;
   virtual void computeProbability(pll_unode_t *geneNode, pll_rnode_t *speciesNode, 
@@ -63,36 +72,115 @@ private:
   // SPECIES
   std::vector<double> _uE; // Probability for a gene to become extinct on each brance
   double _transferExtinctionSum;
+  // values of _uE and _transferExtinctionSum after each fixed-point
+  // iteration of recomputeSpeciesProbabilities (for the gradient)
+  std::vector<std::vector<double> > _uEIterations;
+  std::vector<double> _transferExtinctionSumIterations;
 
   
   /**
    *  All intermediate results needed to compute the reconciliation likelihood
    *  each gene node has one DTLCLV object
    *  Each DTLCLV gene  object is a function of the DTLCLVs of the direct children genes
+   *  
+   *  The values are stored as contiguous doubles indexed by species,
+   *  and all the values of a DTLCLV share the same scaler (the
+   *  scaler is always 0 when REAL is double)
    */
   struct DTLCLV {
     DTLCLV():
-      _survivingTransferSums(REAL())
+      _survivingTransferSums(0.0),
+      _scaler(0)
     {}
 
     DTLCLV(unsigned int speciesNumber):
-      _uq(speciesNumber, REAL()),
-      _survivingTransferSums(REAL())
+      _uq(speciesNumber, 0.0),
+      _survivingTransferSums(0.0),
+      _scaler(0)
     {
     }
     // probability of a gene node rooted at a species node
-    std::vector<REAL> _uq;
+    // (up to the scaling factor)
+    std::vector<double> _uq;
 
     // sum of transfer probabilities. Can be computed only once
     // for all species, to reduce computation complexity
-    REAL _survivingTransferSums;
+    double _survivingTransferSums;
+
+    // the actual probabilities are the values multiplied 
+    // by JS_SCALE_THRESHOLD^_scaler
+    int _scaler;
   };
 
   // Current DTLCLV values
   std::vector<DTLCLV> _dtlclvs;
+  // CLVs saved for rollbackToLastState (the slots are reused)
+  std::vector<DTLCLV> _savedCLVs;
+  
+  // left and right children node indices of the (pruned) species tree,
+  // indexed with the species node indices. Leaves have no children
+  // and are marked with NO_SPECIES
+  static const unsigned int NO_SPECIES = static_cast<unsigned int>(-1);
+  std::vector<unsigned int> _speciesLeftIds;
+  std::vector<unsigned int> _speciesRightIds;
+
+  /**
+   *  Derivatives of the log-likelihood (adjoints) with respect to 
+   *  the intermediate values, accumulated in the backward pass of
+   *  computeLogLikelihoodGradient. The CLV adjoints are relative 
+   *  to the scaled values stored in the DTLCLVs
+   */
+  struct DTLAdjoints {
+    DTLAdjoints(unsigned int clvsNumber, unsigned int speciesNumber):
+      uq(clvsNumber),
+      survivingTransferSums(clvsNumber, 0.0),
+      PD(speciesNumber, 0.0),
+      PL(speciesNumber, 0.0),
+      PT(speciesNumber, 0.0),
+      PS(speciesNumber, 0.0),
+      uE(speciesNumber, 0.0)
+    {}
+    // only allocated for the CLVs that contribute to the likelihood
+    std::vector<std::vector<double> > uq;
+    std::vector<double> survivingTransferSums;
+    std::vector<double> PD;
+    std::vector<double> PL;
+    std::vector<double> PT;
+    std::vector<double> PS;
+    std::vector<double> uE;
+  };
+private:
+  void updateSpeciesIds();
+  void updateCLVFromChildren(unsigned int gid,
+      unsigned int leftGid,
+      unsigned int rightGid,
+      pll_rnode_t *lca);
+  void updateLeafCLV(unsigned int gid);
+  void updateSpeciationLosses(DTLCLV &clv, 
+      const DTLCLV *leftCLV,
+      const DTLCLV *rightCLV,
+      pll_rnode_t *lca);
+  void rescaleCLV(DTLCLV &clv);
+  void backwardCLVFromChildren(unsigned int gid,
+      unsigned int leftGid,
+      unsigned int rightGid,
+      pll_rnode_t *lca,
+      DTLAdjoints &adjoints);
+  void backwardLeafCLV(unsigned int gid, DTLAdjoints &adjoints);
+  void backwardSpeciationLosses(unsigned int gid,
+      const DTLCLV *leftCLV,
+      const DTLCLV *rightCLV,
+      std::vector<double> *leftAdjoints,
+      std::vector<double> *rightAdjoints,
+      double scale,
+      pll_rnode_t *lca,
+      DTLAdjoints &adjoints);
+  void backwardSpeciesProbabilities(DTLAdjoints &adjoints);
+  REAL getUq(unsigned int gid, unsigned int speciesId) const {
+    auto &clv = _dtlclvs[gid];
+    return getScaledReal<REAL>(clv._uq[speciesId], clv._scaler);
+  }
 private:
-  void updateTransferSums(REAL &transferExtinctionSum,
-      const std::vector<REAL> &probabilities);
   void getBestTransfer(pll_unode_t *parentGeneNode, 
     pll_rnode_t *originSpeciesNode,
     bool isVirtualRoot,
@@ -114,7 +202,8 @@ private:
 
   REAL getCorrectedTransferSum(unsigned int geneId, unsigned int speciesId) const
   {
-    return _dtlclvs[geneId]._survivingTransferSums * _PT[speciesId];
+    auto &clv = _dtlclvs[geneId];
+    return getScaledReal<REAL>(clv._survivingTransferSums, clv._scaler) * _PT[speciesId];
   }
   std::vector<pll_rnode_s *> &getSpeciesNodesToUpdate() {
     return this->_speciesNodesToUpdate;
@@ -133,17 +222,6 @@ void UndatedDTLModel<REAL>::setInitialGeneTree(PLLUnrootedTree &tree)
   _dtlclvs = std::vector<DTLCLV>(2 * (this->_maxGeneId + 1), nullCLV);
 }
 
-template <class REAL>
-void UndatedDTLModel<REAL>::updateTransferSums(REAL &transferSum,
-    const std::vector<REAL> &probabilities)
-{
-  transferSum = REAL();
-  for (auto speciesNode: getSpeciesNodesToUpdateSafe()) {
-    transferSum += probabilities[speciesNode->node_index];
-  }
-  transferSum /= this->_allSpeciesNodes.size();
-}
-
 
 template <class REAL>
 void UndatedDTLModel<REAL>::setRates(const RatesVector &rates)
@@ -178,14 +256,31 @@ void UndatedDTLModel<REAL>::setRates(const RatesVector &rates)
 template <class REAL>
 UndatedDTLModel<REAL>::~UndatedDTLModel() { }
 
+template <class REAL>
+void UndatedDTLModel<REAL>::updateSpeciesIds()
+{
+  _speciesLeftIds.resize(this->_allSpeciesNodesCount);
+  _speciesRightIds.resize(this->_allSpeciesNodesCount);
+  for (auto speciesNode: getSpeciesNodesToUpdateSafe()) {
+    auto e = speciesNode->node_index;
+    auto left = this->getSpeciesLeft(speciesNode);
+    auto right = this->getSpeciesRight(speciesNode);
+    _speciesLeftIds[e] = left ? left->node_index : NO_SPECIES;
+    _speciesRightIds[e] = right ? right->node_index : NO_SPECIES;
+  }
+}
+
 template <class REAL>
 void UndatedDTLModel<REAL>::recomputeSpeciesProbabilities()
 {
+  updateSpeciesIds();
   _uE.resize(this->_allSpeciesNodesCount);
   for (auto speciesNode: getSpeciesNodesToUpdateSafe()) {
     _uE[speciesNode->node_index] = REAL(0.0);
   }
   _transferExtinctionSum = REAL();
+  _uEIterations.resize(getIterationsNumber());
+  _transferExtinctionSumIterations.resize(getIterationsNumber());
   for (unsigned int it = 0; it < getIterationsNumber(); ++it) {
     for (auto speciesNode: getSpeciesNodesToUpdateSafe()) {
       auto e = speciesNode->node_index;
@@ -210,6 +305,8 @@ void UndatedDTLModel<REAL>::recomputeSpeciesProbabilities()
       _transferExtinctionSum += _uE[speciesNode->node_index];
     }
     _transferExtinctionSum /= this->_allSpeciesNodes.size();
+    _uEIterations[it] = _uE;
+    _transferExtinctionSumIterations[it] = _transferExtinctionSum;
   }
 }
 
@@ -217,63 +314,132 @@ template <class REAL>
 void UndatedDTLModel<REAL>::updateCLV(pll_unode_t *geneNode)
 {
   auto gid = geneNode->node_index; 
-  auto lca = this->_geneToSpeciesLCA[gid];
-  auto &clv = _dtlclvs[gid];
-  auto &uq = clv._uq;
-  
-  auto &parentsCache = this->_speciesTree.getParentsCache(lca);
-  
-  /*
-  auto lcaRight = lca;
-  auto lcaLeft = lca;
-  if (geneNode->next) {
+  if (!geneNode->next) {
+    updateLeafCLV(gid);
+  } else {
     auto geneLeft = this->getLeft(geneNode, false);
     auto geneRight = this->getRight(geneNode, false);
-    lcaRight = this->_geneToSpeciesLCA[geneLeft->node_index];
-    lcaLeft = this->_geneToSpeciesLCA[geneRight->node_index];
+    updateCLVFromChildren(gid, 
+        geneLeft->node_index,
+        geneRight->node_index,
+        this->_geneToSpeciesLCA[gid]);
   }
-  auto &ancestorsLeft = this->_speciesTree.getAncestorssCache(lcaLeft);
-  auto &ancestorsRight = this->_speciesTree.getAncestorssCache(lcaRight);
-  */
+}
 
-  std::fill(uq.begin(), uq.end(), REAL());
-  REAL sum = REAL();
+template <class REAL>
+void UndatedDTLModel<REAL>::updateLeafCLV(unsigned int gid)
+{
+  auto &clv = _dtlclvs[gid];
+  auto &uq = clv._uq;
+  std::fill(uq.begin(), uq.end(), 0.0);
+  clv._scaler = 0;
+  // the only event that does not involve a loss
+  auto e = this->_geneToSpecies[gid];
+  if (_speciesLeftIds[e] == NO_SPECIES) {
+    uq[e] = _PS[e];
+  }
+  updateSpeciationLosses(clv, nullptr, nullptr, this->_geneToSpeciesLCA[gid]);
+}
+
+/**
+ *  Compute the CLV of gid from the CLVs of its children, 
+ *  for all the species at once. If lca is set, the species 
+ *  that are neither ancestors nor descendants of lca are
+ *  ignored (their probability is set to 0)
+ */
+template <class REAL>
+void UndatedDTLModel<REAL>::updateCLVFromChildren(unsigned int gid,
+    unsigned int leftGid,
+    unsigned int rightGid,
+    pll_rnode_t *lca)
+{
+  auto &clv = _dtlclvs[gid];
+  auto &leftCLV = _dtlclvs[leftGid];
+  auto &rightCLV = _dtlclvs[rightGid];
+  clv._scaler = leftCLV._scaler + rightCLV._scaler;
+  // D and T events
+  UndatedDTLKernel::computeDuplicationsAndTransfers(
+      this->_allSpeciesNodesCount,
+      leftCLV._uq.data(),
+      rightCLV._uq.data(),
+      _PD.data(),
+      _PT.data(),
+      leftCLV._survivingTransferSums,
+      rightCLV._survivingTransferSums,
+      clv._uq.data());
+  // S and SL events
+  updateSpeciationLosses(clv, &leftCLV, &rightCLV, lca);
+  if (isScaledReal<REAL>()) {
+    rescaleCLV(clv);
+  }
+}
+
+/**
+ *  Add the S (if the gene node is not a leaf) and SL 
+ *  contributions to clv, and update the transfer sums.
+ *  These events depend on the values of the species
+ *  children, so the species are processed in postorder.
+ */
+template <class REAL>
+void UndatedDTLModel<REAL>::updateSpeciationLosses(DTLCLV &clv, 
+    const DTLCLV *leftCLV,
+    const DTLCLV *rightCLV,
+    pll_rnode_t *lca)
+{
+  auto &uq = clv._uq;
+  double sum = 0.0;
   for (auto speciesNode: getSpeciesNodesToUpdateSafe()) { 
     auto e = speciesNode->node_index;
-    if (parentsCache[e]) {
-    //if (ancestorsLeft[e] || ancestorsRight[e]) {
-      computeProbability(geneNode, 
-        speciesNode, 
-        uq[e]);
-      sum += uq[e];
+    if (lca && !this->_speciesTree.areParents(lca, speciesNode)) {
+      uq[e] = 0.0;
+      continue;
+    }
+    auto f = _speciesLeftIds[e];
+    if (f != NO_SPECIES) {
+      auto g = _speciesRightIds[e];
+      if (leftCLV) {
+        // S event
+        auto &left = leftCLV->_uq;
+        auto &right = rightCLV->_uq;
+        uq[e] += left[f] * right[g] * _PS[e];
+        uq[e] += left[g] * right[f] * _PS[e];
+      }
+      // SL event
+      uq[e] += uq[f] * (_uE[g] * _PS[e]);
+      uq[e] += uq[g] * (_uE[f] * _PS[e]);
     }
-    //}
+    sum += uq[e];
   }
   sum /= this->_allSpeciesNodes.size();
   clv._survivingTransferSums = sum;
 }
 
+template <class REAL>
+void UndatedDTLModel<REAL>::rescaleCLV(DTLCLV &clv)
+{
+  auto &uq = clv._uq;
+  auto max = UndatedDTLKernel::getMax(uq.size(), uq.data());
+  if (max == 0.0) {
+    return;
+  }
+  while (max < JS_SCALE_THRESHOLD) {
+    UndatedDTLKernel::multiply(uq.size(), JS_SCALE_FACTOR, uq.data());
+    clv._survivingTransferSums *= JS_SCALE_FACTOR;
+    clv._scaler += 1;
+    max *= JS_SCALE_FACTOR;
+  }
+}
 
 template <class REAL>
 void UndatedDTLModel<REAL>::computeGeneRootLikelihood(pll_unode_t *virtualRoot)
 {
   auto u = virtualRoot->node_index;
-  _dtlclvs[u]._survivingTransferSums = REAL();
-  std::fill(_dtlclvs[u]._uq.begin(), _dtlclvs[u]._uq.end(), REAL());
-  /*
   auto geneLeft = this->getLeft(virtualRoot, true);
   auto geneRight = this->getRight(virtualRoot, true);
-  auto lcaRight = this->_geneToSpeciesLCA[geneLeft->node_index];
-  auto lcaLeft = this->_geneToSpeciesLCA[geneRight->node_index];
-  auto &ancestorsLeft = this->_speciesTree.getAncestorssCache(lcaLeft);
-  auto &ancestorsRight = this->_speciesTree.getAncestorssCache(lcaRight);
-  */
-  for (auto speciesNode: getSpeciesNodesToUpdateSafe()) {
-    unsigned int e = speciesNode->node_index;
-    //if (ancestorsLeft[e] || ancestorsRight[e]) {
-    computeProbability(virtualRoot, speciesNode, _dtlclvs[u]._uq[e], true);
-    //}
-  }
+  updateCLVFromChildren(u, 
+      geneLeft->node_index, 
+      geneRight->node_index, 
+      nullptr);
 }
 
 template <class REAL>
@@ -328,10 +494,10 @@ void UndatedDTLModel<REAL>::computeProbability(pll_unode_t *geneNode, pll_rnode_
     auto u_right = rightGeneNode->node_index;
     if (not isSpeciesLeaf) {
       //  speciation event
-      values[0] = _dtlclvs[u_left]._uq[f];
-      values[1] = _dtlclvs[u_left]._uq[g];
-      values[0] *= _dtlclvs[u_right]._uq[g];
-      values[1] *= _dtlclvs[u_right]._uq[f];
+      values[0] = getUq(u_left, f);
+      values[1] = getUq(u_left, g);
+      values[0] *= getUq(u_right, g);
+      values[1] *= getUq(u_right, f);
       values[0] *= _PS[e]; 
       values[1] *= _PS[e]; 
       scale(values[0]);
@@ -340,28 +506,28 @@ void UndatedDTLModel<REAL>::computeProbability(pll_unode_t *geneNode, pll_rnode_
       proba += values[1];
     }
     // D event
-    values[2] = _dtlclvs[u_left]._uq[e];
-    values[2] *= _dtlclvs[u_right]._uq[e];
+    values[2] = getUq(u_left, e);
+    values[2] *= getUq(u_right, e);
     values[2] *= _PD[e];
     scale(values[2]);
     proba += values[2];
     
     // T event
     values[5] = getCorrectedTransferSum(u_left, e);
-    values[5] *= _dtlclvs[u_right]._uq[e];
+    values[5] *= getUq(u_right, e);
     scale(values[5]);
     values[6] = getCorrectedTransferSum(u_right, e);
-    values[6] *= _dtlclvs[u_left]._uq[e];
+    values[6] *= getUq(u_left, e);
     scale(values[6]);
     proba += values[5];
     proba += values[6];
   }
   if (not isSpeciesLeaf) {
     // SL event
-    values[3] = _dtlclvs[gid]._uq[f];
+    values[3] = getUq(gid, f);
     values[3] *= (_uE[g] * _PS[e]);
     scale(values[3]);
-    values[4] = _dtlclvs[gid]._uq[g];
+    values[4] = getUq(gid, g);
     values[4]*= _uE[f] * _PS[e];
     scale(values[4]);
     proba += values[3];
@@ -432,13 +598,13 @@ void UndatedDTLModel<REAL>::computeProbability(pll_unode_t *geneNode, pll_rnode_
 template <class REAL>
 REAL UndatedDTLModel<REAL>::getGeneRootLikelihood(pll_unode_t *root) const
 {
-  REAL sum = REAL();
+  double sum = 0.0;
   auto u = root->node_index + this->_maxGeneId + 1;
   for (auto speciesNode: this->_allSpeciesNodes) {
     auto e = speciesNode->node_index;
     sum += _dtlclvs[u]._uq[e];
   }
-  return sum;
+  return getScaledReal<REAL>(sum, _dtlclvs[u]._scaler);
 }
 
 template <class REAL>
@@ -454,9 +620,285 @@ REAL UndatedDTLModel<REAL>::getLikelihoodFactor() const
 }
 
 
+/**
+ *  Reverse-mode differentiation of the likelihood computation:
+ *  the adjoints are propagated from the virtual roots to the gene 
+ *  leaves, then through the extinction probabilities fixed point, 
+ *  and finally through the normalization of the rates
+ */
 template <class REAL>
-void UndatedDTLModel<REAL>::rollbackToLastState()
+bool UndatedDTLModel<REAL>::computeLogLikelihoodGradient(RatesVector &gradient)
 {
+  auto speciesNumber = this->_allSpeciesNodesCount;
+  std::vector<pll_unode_t *> roots;
+  std::vector<pll_unode_t *> geneNodes;
+  this->getGradientNodes(roots, geneNodes);
+  auto total = this->getRootLikelihoodsSum(roots);
+  auto logTotal = log(total);
+  if (!std::isfinite(logTotal)) {
+    return false;
+  }
+  DTLAdjoints adjoints(_dtlclvs.size(), speciesNumber);
+  for (auto root: roots) {
+    auto u = root->node_index + this->_maxGeneId + 1;
+    auto rootLikelihood = getGeneRootLikelihood(root);
+    rootLikelihood *= this->getRootWeight(root);
+    if (!isSummed(rootLikelihood, total)) {
+      // this root does not contribute to the likelihood
+      continue;
+    }
+    auto scaledWeight = getScaledReal<REAL>(this->getRootWeight(root),
+        _dtlclvs[u]._scaler);
+    double rootAdjoint = exp(log(scaledWeight) - logTotal);
+    adjoints.uq[u] = std::vector<double>(speciesNumber, rootAdjoint);
+  }
+  for (auto root: roots) {
+    auto u = root->node_index + this->_maxGeneId + 1;
+    if (!adjoints.uq[u].size()) {
+      continue;
+    }
+    backwardCLVFromChildren(u,
+        root->node_index,
+        root->back->node_index,
+        nullptr,
+        adjoints);
+  }
+  for (auto it = geneNodes.rbegin(); it != geneNodes.rend(); ++it) {
+    auto geneNode = *it;
+    auto gid = geneNode->node_index;
+    if (!adjoints.uq[gid].size()) {
+      continue;
+    }
+    if (!geneNode->next) {
+      backwardLeafCLV(gid, adjoints);
+    } else {
+      backwardCLVFromChildren(gid,
+          this->getLeft(geneNode, false)->node_index,
+          this->getRight(geneNode, false)->node_index,
+          this->_geneToSpeciesLCA[gid],
+          adjoints);
+    }
+  }
+  // likelihood factor
+  double factor = 0.0;
+  for (auto speciesNode: this->_allSpeciesNodes) {
+    factor += 1.0 - _uE[speciesNode->node_index];
+  }
+  for (auto speciesNode: this->_allSpeciesNodes) {
+    adjoints.uE[speciesNode->node_index] += 1.0 / factor;
+  }
+  backwardSpeciesProbabilities(adjoints);
+  // normalization of the rates: P_x = x / (d + l + t + 1)
+  gradient = RatesVector(3, std::vector<double>(speciesNumber, 0.0));
+  for (auto speciesNode: this->_allSpeciesNodes) {
+    auto e = speciesNode->node_index;
+    double dot = adjoints.PD[e] * _PD[e] + adjoints.PL[e] * _PL[e] 
+      + adjoints.PT[e] * _PT[e] + adjoints.PS[e] * _PS[e];
+    if (!this->_info.noDup) {
+      gradient[0][e] = (adjoints.PD[e] - dot) * _PS[e];
+    }
+    gradient[1][e] = (adjoints.PL[e] - dot) * _PS[e];
+    gradient[2][e] = (adjoints.PT[e] - dot) * _PS[e];
+    for (auto &rateGradient: gradient) {
+      if (!std::isfinite(rateGradient[e])) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ *  Backward pass of updateCLVFromChildren: propagate the adjoints of
+ *  the CLV gid to the CLVs of its children and to the species 
+ *  probabilities
+ */
+template <class REAL>
+void UndatedDTLModel<REAL>::backwardCLVFromChildren(unsigned int gid,
+    unsigned int leftGid,
+    unsigned int rightGid,
+    pll_rnode_t *lca,
+    DTLAdjoints &adjoints)
+{
+  auto &clv = _dtlclvs[gid];
+  auto &leftCLV = _dtlclvs[leftGid];
+  auto &rightCLV = _dtlclvs[rightGid];
+  auto &adj = adjoints.uq[gid];
+  auto &leftAdj = adjoints.uq[leftGid];
+  auto &rightAdj = adjoints.uq[rightGid];
+  leftAdj.resize(this->_allSpeciesNodesCount, 0.0);
+  rightAdj.resize(this->_allSpeciesNodesCount, 0.0);
+  // the stored values are the computed values multiplied by scale
+  double scale = 1.0;
+  for (int i = leftCLV._scaler + rightCLV._scaler; i < clv._scaler; ++i) {
+    scale *= JS_SCALE_FACTOR;
+  }
+  // S and SL events
+  backwardSpeciationLosses(gid, &leftCLV, &rightCLV, &leftAdj, &rightAdj,
+      scale, lca, adjoints);
+  // D and T events
+  auto &left = leftCLV._uq;
+  auto &right = rightCLV._uq;
+  auto leftTransferSum = leftCLV._survivingTransferSums;
+  auto rightTransferSum = rightCLV._survivingTransferSums;
+  double leftTransferSumAdj = 0.0;
+  double rightTransferSumAdj = 0.0;
+  for (auto speciesNode: getSpeciesNodesToUpdateSafe()) {
+    auto e = speciesNode->node_index;
+    auto a = adj[e];
+    if (a == 0.0) {
+      continue;
+    }
+    leftAdj[e] += a * (right[e] * _PD[e] + rightTransferSum * _PT[e]) * scale;
+    rightAdj[e] += a * (left[e] * _PD[e] + leftTransferSum * _PT[e]) * scale;
+    leftTransferSumAdj += a * _PT[e] * right[e] * scale;
+    rightTransferSumAdj += a * _PT[e] * left[e] * scale;
+    adjoints.PD[e] += a * left[e] * right[e] * scale;
+    adjoints.PT[e] += a * (leftTransferSum * right[e] 
+        + rightTransferSum * left[e]) * scale;
+  }
+  adjoints.survivingTransferSums[leftGid] += leftTransferSumAdj;
+  adjoints.survivingTransferSums[rightGid] += rightTransferSumAdj;
+}
+
+/**
+ *  Backward pass of updateLeafCLV
+ */
+template <class REAL>
+void UndatedDTLModel<REAL>::backwardLeafCLV(unsigned int gid, 
+    DTLAdjoints &adjoints)
+{
+  backwardSpeciationLosses(gid, nullptr, nullptr, nullptr, nullptr,
+      1.0, this->_geneToSpeciesLCA[gid], adjoints);
+  auto e = this->_geneToSpecies[gid];
+  if (_speciesLeftIds[e] == NO_SPECIES) {
+    adjoints.PS[e] += adjoints.uq[gid][e];
+  }
+}
+
+/**
+ *  Backward pass of updateSpeciationLosses. On return, the adjoints
+ *  of the CLV gid are the adjoints of the values before the S and SL
+ *  contributions were added (and are null for the ignored species)
+ */
+template <class REAL>
+void UndatedDTLModel<REAL>::backwardSpeciationLosses(unsigned int gid,
+    const DTLCLV *leftCLV,
+    const DTLCLV *rightCLV,
+    std::vector<double> *leftAdjoints,
+    std::vector<double> *rightAdjoints,
+    double scale,
+    pll_rnode_t *lca,
+    DTLAdjoints &adjoints)
+{
+  auto &speciesNodes = getSpeciesNodesToUpdateSafe();
+  auto &uq = _dtlclvs[gid]._uq;
+  auto &adj = adjoints.uq[gid];
+  // transfer sums
+  double sumAdj = adjoints.survivingTransferSums[gid] 
+    / this->_allSpeciesNodes.size();
+  for (auto speciesNode: speciesNodes) {
+    adj[speciesNode->node_index] += sumAdj;
+  }
+  // reverse postorder: the adjoint of a species is complete
+  // before we propagate it to its children
+  for (auto it = speciesNodes.rbegin(); it != speciesNodes.rend(); ++it) {
+    auto speciesNode = *it;
+    auto e = speciesNode->node_index;
+    if (lca && !this->_speciesTree.areParents(lca, speciesNode)) {
+      adj[e] = 0.0;
+      continue;
+    }
+    auto f = _speciesLeftIds[e];
+    if (f == NO_SPECIES) {
+      continue;
+    }
+    auto g = _speciesRightIds[e];
+    auto a = adj[e];
+    if (a == 0.0) {
+      continue;
+    }
+    // SL event
+    adj[f] += a * (_uE[g] * _PS[e]);
+    adj[g] += a * (_uE[f] * _PS[e]);
+    adjoints.uE[g] += a * uq[f] * _PS[e];
+    adjoints.uE[f] += a * uq[g] * _PS[e];
+    adjoints.PS[e] += a * (uq[f] * _uE[g] + uq[g] * _uE[f]);
+    if (leftCLV) {
+      // S event
+      auto &left = leftCLV->_uq;
+      auto &right = rightCLV->_uq;
+      auto &leftAdj = *leftAdjoints;
+      auto &rightAdj = *rightAdjoints;
+      leftAdj[f] += a * right[g] * _PS[e] * scale;
+      rightAdj[g] += a * left[f] * _PS[e] * scale;
+      leftAdj[g] += a * right[f] * _PS[e] * scale;
+      rightAdj[f] += a * left[g] * _PS[e] * scale;
+      adjoints.PS[e] += a * (left[f] * right[g] + left[g] * right[f]) * scale;
+    }
+  }
+}
+
+/**
+ *  Backward pass of recomputeSpeciesProbabilities: propagate the 
+ *  adjoints of _uE to the species probabilities, through the 
+ *  fixed-point iterations
+ */
+template <class REAL>
+void UndatedDTLModel<REAL>::backwardSpeciesProbabilities(DTLAdjoints &adjoints)
+{
+  auto &speciesNodes = getSpeciesNodesToUpdateSafe();
+  auto iterations = getIterationsNumber();
+  std::vector<double> zeros(this->_allSpeciesNodesCount, 0.0);
+  // adjoints of _uE after and before the current iteration
+  std::vector<double> uEAdj = adjoints.uE;
+  std::vector<double> previousUEAdj(this->_allSpeciesNodesCount);
+  // adjoint of _transferExtinctionSum after the current iteration
+  double transferExtinctionSumAdj = 0.0;
+  for (unsigned int it = iterations; it-- > 0; ) {
+    auto &current = _uEIterations[it];
+    auto &previous = it ? _uEIterations[it - 1] : zeros;
+    double previousSum = it ? _transferExtinctionSumIterations[it - 1] : 0.0;
+    double previousSumAdj = 0.0;
+    std::fill(previousUEAdj.begin(), previousUEAdj.end(), 0.0);
+    for (auto speciesNode: speciesNodes) {
+      uEAdj[speciesNode->node_index] += transferExtinctionSumAdj 
+        / this->_allSpeciesNodes.size();
+    }
+    for (auto rit = speciesNodes.rbegin(); rit != speciesNodes.rend(); ++rit) {
+      auto e = (*rit)->node_index;
+      auto a = uEAdj[e];
+      auto f = _speciesLeftIds[e];
+      if (it + 1 == iterations && f == NO_SPECIES) {
+        previousUEAdj[e] += a * (1.0 - this->_fm[e]);
+        continue;
+      }
+      adjoints.PL[e] += a;
+      adjoints.PD[e] += a * previous[e] * previous[e];
+      adjoints.PT[e] += a * previousSum * previous[e];
+      previousSumAdj += a * _PT[e] * previous[e];
+      previousUEAdj[e] += a * (2.0 * previous[e] * _PD[e] + previousSum * _PT[e]);
+      if (f != NO_SPECIES) {
+        auto g = _speciesRightIds[e];
+        uEAdj[f] += a * current[g] * _PS[e];
+        uEAdj[g] += a * current[f] * _PS[e];
+        adjoints.PS[e] += a * current[f] * current[g];
+      }
+    }
+    std::swap(uEAdj, previousUEAdj);
+    transferExtinctionSumAdj = previousSumAdj;
+  }
+}
+
+template <class REAL>
+void UndatedDTLModel<REAL>::saveCLV(unsigned int gid, unsigned int slot)
+{
+  assert(slot <= _savedCLVs.size());
+  if (slot == _savedCLVs.size()) {
+    _savedCLVs.push_back(_dtlclvs[gid]);
+  } else {
+    _savedCLVs[slot] = _dtlclvs[gid];
+  }
 }
 
 template <class REAL>
@@ -481,10 +923,10 @@ void UndatedDTLModel<REAL>::getBestTransfer(pll_unode_t *parentGeneNode,
     if (h == e) {
       continue;
     }
-    transferProbas[h] = (_dtlclvs[u_left->node_index]._uq[h] 
-        * _dtlclvs[u_right->node_index]._uq[e]) * factor;
-    transferProbas[h + speciesNumber] = (_dtlclvs[u_right->node_index]._uq[h] 
-        * _dtlclvs[u_left->node_index]._uq[e]) * factor;
+    transferProbas[h] = (getUq(u_left->node_index, h) 
+        * getUq(u_right->node_index, e)) * factor;
+    transferProbas[h + speciesNumber] = (getUq(u_right->node_index, h) 
+        * getUq(u_left->node_index, e)) * factor;
   }
   if (stochastic) {
     // stochastic sample: proba will be set to the sum of probabilities
@@ -547,7 +989,7 @@ void UndatedDTLModel<REAL>::getBestTransferLoss(Scenario &scenario,
     if (h == e) {
       continue;
     }
-    transferProbas[h] = _dtlclvs[u]._uq[h] * factor;
+    transferProbas[h] = getUq(u, h) * factor;
   }
   if (!stochastic) {
     for (auto species: this->_allSpeciesNodes) {
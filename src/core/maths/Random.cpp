@@ -1,8 +1,8 @@
 #include "Random.hpp"
 
-std::mt19937_64 Random::_rng;
-std::uniform_int_distribution<int> Random::_unii(0);
-std::uniform_real_distribution<double> Random::_uniproba;
+thread_local std::mt19937_64 Random::_rng;
+thread_local std::uniform_int_distribution<int> Random::_unii(0);
+thread_local std::uniform_real_distribution<double> Random::_uniproba;
 
 void Random::setSeed(unsigned int seed)
 {
@@ -1,6 +1,11 @@
 #pragma once
 #include <random>
 
+/**
+ *  Random number generator. Each thread has its own generator,
+ *  so that threads can draw numbers concurrently from
+ *  independent (and reproducible) streams.
+ */
 class Random {
 public:
   Random() = delete;
@@ -9,7 +14,7 @@ public:
   static double getProba();
 
 private:
-  static std::mt19937_64 _rng;
-  static std::uniform_int_distribution<int> _unii;
-  static std::uniform_real_distribution<double> _uniproba;
+  static thread_local std::mt19937_64 _rng;
+  static thread_local std::uniform_int_distribution<int> _unii;
+  static thread_local std::uniform_real_distribution<double> _uniproba;
 };
@@ -232,3 +232,47 @@ inline void scale<ScaledValue>(ScaledValue &v) {
   v.scale();
 }
 
+
+/**
+ *  Return true if REAL values need to be scaled to avoid underflows
+ */
+template<class REAL>
+inline bool isScaledReal() {return false;}
+
+template<>
+inline bool isScaledReal<ScaledValue>() {return true;}
+
+/**
+ *  Build a REAL from a double value and a scaler, for
+ *  arrays of doubles sharing the same scaler
+ *  (the value is value * JS_SCALE_THRESHOLD^scaler)
+ */
+template<class REAL>
+inline REAL getScaledReal(double value, int) {return REAL(value);}
+
+template<>
+inline ScaledValue getScaledReal<ScaledValue>(double value, int scaler) {
+  if (value == 0.0) {
+    return ScaledValue();
+  }
+  ScaledValue res(value, scaler);
+  while (res.value < JS_SCALE_THRESHOLD) {
+    res.value *= JS_SCALE_FACTOR;
+    res.scaler += 1;
+  }
+  return res;
+}
+
+
+/**
+ *  Return true if term contributes to sum, sum being accumulated
+ *  with operator +=. ScaledValue sums only keep the terms with the
+ *  smallest scaler.
+ */
+template<class REAL>
+inline bool isSummed(const REAL &, const REAL &) {return true;}
+
+template<>
+inline bool isSummed<ScaledValue>(const ScaledValue &term, const ScaledValue &sum) {
+  return !term.isNull() && term.scaler == sum.scaler;
+}
@@ -28,6 +28,44 @@ static void updateLL(Parameters &rates, Evaluations &evaluations) {
   rates.setScore(ll);
 }
 
+/**
+ *  Evaluate the sum of the log-likelihoods at rates, and its gradient
+ *  projected on the domain of the rates (the components that would 
+ *  push a rate above 1.0 are set to 0)
+ */
+static void updateLLAndGradient(Parameters &rates, 
+    Evaluations &evaluations,
+    Parameters &gradient,
+    const OptimizationSettings &settings) 
+{
+  rates.ensurePositivity();
+  double ll = 0.0;
+  std::vector<double> gradientSum(rates.dimensions(), 0.0);
+  for (auto evaluation: evaluations) {
+    Parameters familyGradient;
+    evaluation->setRates(rates);
+    ll += evaluation->evaluateWithGradient(familyGradient, settings.epsilon);
+    for (unsigned int i = 0; i < rates.dimensions(); ++i) {
+      gradientSum[i] += familyGradient[i];
+    }
+  }
+  // reduce the likelihood together with the gradient
+  gradientSum.push_back(ll);
+  ParallelContext::sumVectorDouble(gradientSum);
+  ll = gradientSum.back();
+  gradientSum.pop_back();
+  if (!isValidLikelihood(ll)) {
+    ll = -std::numeric_limits<double>::infinity();
+  }
+  rates.setScore(ll);
+  gradient = Parameters(gradientSum);
+  for (unsigned int i = 0; i < rates.dimensions(); ++i) {
+    if (rates[i] >= 1.0 && gradient[i] > 0.0) {
+      gradient[i] = 0.0;
+    }
+  }
+}
+
 static bool lineSearchParameters(Evaluations &evaluations, 
     Parameters &currentRates, 
     const Parameters &gradient, 
@@ -70,21 +108,16 @@ Parameters DTLOptimizer::optimizeParameters(PerCoreEvaluations &evaluations,
   if (startingParameters.dimensions() == 0) {
     return Parameters();
   }
-  double epsilon = settings.epsilon;
   Parameters currentRates = startingParameters;
-  updateLL(currentRates, evaluations);
   unsigned int llComputationsGrad = 0;
   unsigned int llComputationsLine = 0;
   unsigned int dimensions = startingParameters.dimensions();
   Parameters gradient(dimensions);
   do {
-    std::vector<Parameters> closeRates(dimensions, currentRates);
-    for (unsigned int i = 0; i < dimensions; ++i) {
-      Parameters closeRates = currentRates;
-      closeRates[i] += epsilon;
-      updateLL(closeRates, evaluations);
-      llComputationsGrad++;
-      gradient[i] = (currentRates.getScore() - closeRates.getScore()) / (-epsilon);
+    updateLLAndGradient(currentRates, evaluations, gradient, settings);
+    llComputationsGrad++;
+    if (gradient.distance(Parameters(dimensions)) == 0.0) {
+      break;
     }
   } while (lineSearchParameters(evaluations, currentRates, gradient, llComputationsLine, settings));
   return currentRates;
@@ -18,9 +18,11 @@ SpeciesTreeOptimizer::SpeciesTreeOptimizer(const std::string speciesTreeFile,
     const Parameters &startingRates,
     bool userDTLRates,
     const std::string &outputDir,
-    const SpeciesTreeSearchParams &searchParams):
+    const SpeciesTreeSearchParams &searchParams,
+    FamilyCosts *familyCosts):
   _speciesTree(nullptr),
   _geneTrees(nullptr),
+  _threadPool(std::make_unique<ThreadPool>(searchParams.threads)),
   _initialFamilies(initialFamilies),
   _outputDir(outputDir),
   _lastRecLL(-std::numeric_limits<double>::infinity()),
@@ -32,7 +34,9 @@ SpeciesTreeOptimizer::SpeciesTreeOptimizer(const std::string speciesTreeFile,
   _okForClades(0),
   _koForClades(0),
   _hardToFindBetter(false),
-  _optimizationCriteria(ReconciliationLikelihood)
+  _optimizationCriteria(ReconciliationLikelihood),
+  _familyCosts(familyCosts),
+  _familiesRebalanced(false)
 {
 
   _modelRates.info.perFamilyRates = false; // we set it back a few
@@ -67,6 +71,7 @@ void SpeciesTreeOptimizer::optimize(SpeciesSearchStrategy strategy,
 {
   setOptimizationCriteria(criteria);
   _bestRecLL = computeRecLikelihood();
+  rebalanceFamilies();
   size_t hash1 = 0;
   size_t hash2 = 0;
   unsigned int index = 0;
@@ -119,6 +124,10 @@ void SpeciesTreeOptimizer::optimize(SpeciesSearchStrategy strategy,
     assert(false);
   }
   setOptimizationCriteria(ReconciliationLikelihood);
+  if (_familyCosts) {
+    Routines::measureFamilyCosts(_initialFamilies, *_geneTrees, 
+        _evaluations, *_familyCosts);
+  }
 }
 
 
@@ -309,6 +318,150 @@ bool SpeciesTreeOptimizer::testPruning(unsigned int prune,
   return false;
 }
 
+/**
+ *  Same as testPruning, for a move evaluated by startPrunings: its
+ *  likelihood with the current gene roots is already summed over
+ *  the ranks. It is exact with unrooted gene trees, and is the
+ *  approximated likelihood of testPruning with rooted gene trees.
+ */
+bool SpeciesTreeOptimizer::testEvaluatedMove(const EvaluatedMove &move)
+{
+  const bool geneRootOpt = _modelRates.info.rootedGeneTree; 
+  if (geneRootOpt && _averageGeneRootDiff.isSignificant()) {
+    // the average may have changed since finishPrunings
+    auto epsilon = 2.0 * _averageGeneRootDiff.getAverage();
+    if (move.ll + epsilon <= _bestRecLL) {
+      _koForClades++;
+      return false;
+    }
+  }
+  beforeTestCallback();
+  auto rollback = SpeciesTreeOperator::applySPRMove(*_speciesTree, 
+      move.prune, move.regraft);
+  _okForClades++;
+  optimizeGeneRoots();
+  if (geneRootOpt) {
+    _lastRecLL = computeRecLikelihood();
+    _averageGeneRootDiff.addValue(_lastRecLL - move.ll);
+  } else {
+    // no need to evaluate the move again
+    _lastRecLL = move.ll;
+  }
+  if (_lastRecLL > _bestRecLL) {
+    newBestTreeCallback();
+    return true;
+  }
+  SpeciesTreeOperator::reverseSPRMove(*_speciesTree, move.prune, rollback);
+  rollbackCallback();
+  return false;
+}
+
+/**
+ *  Compute the local likelihood of all the SPR moves (prune, regraft)
+ *  with the current gene roots, and start summing them over the 
+ *  ranks. The moves are applied and rollbacked one after each other,
+ *  and the per-rank likelihoods of all the moves are summed with a
+ *  single non-blocking reduction, which finishPrunings waits for.
+ *  batch must not be modified in between.
+ */
+void SpeciesTreeOptimizer::startPrunings(unsigned int prune,
+    const std::vector<unsigned int> &regrafts,
+    PruningBatch &batch)
+{
+  batch.prune = prune;
+  batch.regrafts = regrafts;
+  batch.lls.assign(regrafts.size(), 0.0);
+  for (unsigned int i = 0; i < regrafts.size(); ++i) {
+    beforeTestCallback();
+    auto rollback = SpeciesTreeOperator::applySPRMove(*_speciesTree, 
+        prune, regrafts[i]);
+    batch.lls[i] = computeLocalRecLikelihood();
+    SpeciesTreeOperator::reverseSPRMove(*_speciesTree, prune, rollback);
+    rollbackCallback();
+  }
+  batch.request = ParallelContext::ReductionRequest();
+  if (_optimizationCriteria == ReconciliationLikelihood) {
+    batch.request = ParallelContext::startSumVectorDouble(batch.lls);
+  }
+}
+
+/**
+ *  Wait for the likelihoods of a batch started with startPrunings,
+ *  and fill candidates with the moves that testEvaluatedMove should test,
+ *  sorted by decreasing likelihood.
+ */
+void SpeciesTreeOptimizer::finishPrunings(PruningBatch &batch,
+    std::vector<EvaluatedMove> &candidates)
+{
+  candidates.clear();
+  ParallelContext::waitReduction(batch.request);
+  auto &lls = batch.lls;
+  // same criteria as in testPruning
+  const bool geneRootOpt = _modelRates.info.rootedGeneTree; 
+  for (unsigned int i = 0; i < batch.regrafts.size(); ++i) {
+    bool canTestMove = true;
+    if (!geneRootOpt) {
+      // the likelihood is already exact
+      canTestMove = lls[i] > _bestRecLL;
+    } else if (_averageGeneRootDiff.isSignificant()) {
+      auto epsilon = 2.0 * _averageGeneRootDiff.getAverage();
+      canTestMove = lls[i] + epsilon > _bestRecLL;
+    }
+    if (canTestMove) {
+      EvaluatedMove move;
+      move.prune = batch.prune;
+      move.regraft = batch.regrafts[i];
+      move.ll = lls[i];
+      candidates.push_back(move);
+    } else {
+      _koForClades++;
+    }
+  }
+  // stable sort: ties are broken by the regraft order, which is
+  // the same on all ranks
+  std::stable_sort(candidates.begin(), candidates.end(), 
+      [](const EvaluatedMove &m1, const EvaluatedMove &m2) {
+        return m1.ll > m2.ll;
+      });
+}
+
+/**
+ *  Test the candidate moves of a batch started with startPrunings,
+ *  and apply the best move that improves the likelihood, if any.
+ *  @return true if a move was applied
+ */
+bool SpeciesTreeOptimizer::testBestPruning(PruningBatch &batch,
+    unsigned int &acceptedRegraft)
+{
+  std::vector<EvaluatedMove> candidates;
+  finishPrunings(batch, candidates);
+  for (auto &candidate: candidates) {
+    if (testEvaluatedMove(candidate)) {
+      acceptedRegraft = candidate.regraft;
+      return true;
+    }
+    if (!_modelRates.info.rootedGeneTree) {
+      // the next candidates are not better
+      break;
+    }
+  }
+  return false;
+}
+
+/**
+ *  Evaluate all the regrafts of prune as a batch, and apply the
+ *  best move that improves the likelihood, if any.
+ *  @return true if a move was applied
+ */
+bool SpeciesTreeOptimizer::testBestPruning(unsigned int prune,
+    const std::vector<unsigned int> &regrafts,
+    unsigned int &acceptedRegraft)
+{
+  PruningBatch batch;
+  startPrunings(prune, regrafts, batch);
+  return testBestPruning(batch, acceptedRegraft);
+}
+
 struct TransferMove {
   unsigned int prune;
   unsigned int regraft;
@@ -369,23 +522,14 @@ double SpeciesTreeOptimizer::transferRound(MovesBlackList &blacklist,
   _bestRecLL = computeRecLikelihood();
   auto hash1 = _speciesTree->getNodeIndexHash(); 
   TransferFrequencies frequencies;
-  auto  speciesTreeFile = 
-    Paths::getSpeciesTreeFile(_outputDir, "speciesTreeTemp.newick");
-  saveCurrentSpeciesTreePath(speciesTreeFile, true);
-  ParallelContext::barrier();
-  Routines::getTransfersFrequencies(speciesTreeFile,
-    _initialFamilies,
-    _modelRates,
-    reconciliationSamples,
-    frequencies);
   PerSpeciesEvents perSpeciesEvents;
-  const bool forceTransfers = true;
-  Routines::getPerSpeciesEvents(speciesTreeFile,
-    _initialFamilies,
+  Routines::getTransfersFrequenciesAndPerSpeciesEvents(
+    _speciesTree->getTree(),
+    *_geneTrees,
     _modelRates,
     reconciliationSamples,
-    perSpeciesEvents,
-    forceTransfers);
+    frequencies,
+    perSpeciesEvents);
   unsigned int speciesNumber = _speciesTree->getTree().getNodesNumber();
   std::vector<double> speciesFrequencies;
   for (unsigned int e = 0; e < speciesNumber; ++e) {
@@ -512,25 +656,48 @@ double SpeciesTreeOptimizer::fastSPRRound(unsigned int radius)
       prunes,
       supportValues,
       maxSupport);
-  for (auto prune: prunes) {
+  // The regrafts of the next prune node are evaluated locally 
+  // while the likelihoods of the current prune node are reduced
+  // over the ranks. They are evaluated again if the current prune
+  // node changed the species tree.
+  PruningBatch batches[2];
+  auto startBatch = [&](unsigned int p) {
     std::vector<unsigned int> regrafts;
-    SpeciesTreeOperator::getPossibleRegrafts(*_speciesTree, prune, radius, regrafts);
-    for (auto regraft: regrafts) {
-      if (testPruning(prune, regraft)) {
-        auto pruneNode = _speciesTree->getNode(prune);
-        Logger::timed << "\tbetter tree (LL=" 
-          << _bestRecLL << ", hash=" 
-          << _speciesTree->getHash() 
-          << " us=" 
-          << _unsupportedCladesNumber() 
-          << ") "
-          << pruneNode->label 
-          << " -> " 
-          << _speciesTree->getNode(regraft)->label
-          << std::endl;
-        hash1 = _speciesTree->getNodeIndexHash(); 
-        assert(ParallelContext::isIntEqual(hash1));
-        _bestRecLL = veryLocalSearch(prune);
+    SpeciesTreeOperator::getPossibleRegrafts(*_speciesTree, prunes[p], 
+        radius, regrafts);
+    startPrunings(prunes[p], regrafts, batches[p % 2]);
+  };
+  if (prunes.size()) {
+    startBatch(0);
+  }
+  for (unsigned int p = 0; p < prunes.size(); ++p) {
+    auto prune = prunes[p];
+    bool hasNext = p + 1 < prunes.size();
+    if (hasNext) {
+      startBatch(p + 1);
+    }
+    unsigned int regraft = 0;
+    if (testBestPruning(batches[p % 2], regraft)) {
+      if (hasNext) {
+        // the reduction must complete before the batch is reused
+        ParallelContext::waitReduction(batches[(p + 1) % 2].request);
+      }
+      auto pruneNode = _speciesTree->getNode(prune);
+      Logger::timed << "\tbetter tree (LL=" 
+        << _bestRecLL << ", hash=" 
+        << _speciesTree->getHash() 
+        << " us=" 
+        << _unsupportedCladesNumber() 
+        << ") "
+        << pruneNode->label 
+        << " -> " 
+        << _speciesTree->getNode(regraft)->label
+        << std::endl;
+      hash1 = _speciesTree->getNodeIndexHash(); 
+      assert(ParallelContext::isIntEqual(hash1));
+      _bestRecLL = veryLocalSearch(prune);
+      if (hasNext) {
+        startBatch(p + 1);
       }
     }
   }
@@ -540,26 +707,19 @@ double SpeciesTreeOptimizer::fastSPRRound(unsigned int radius)
 double SpeciesTreeOptimizer::veryLocalSearch(unsigned int spid)
 {
   const unsigned int radius = 2;
-  std::vector<unsigned int> prunes;
-  prunes.push_back(spid);
-  unsigned int trials = 0;
-  for (auto prune: prunes) {
-    std::vector<unsigned int> regrafts;
-    SpeciesTreeOperator::getPossibleRegrafts(*_speciesTree, 
-        prune, 
-        radius, 
-        regrafts);
-    for (auto regraft: regrafts) {
-      trials++;
-      if (testPruning(prune, regraft)) {
-        Logger::timed << "\tfound better* (LL=" 
-            << _bestRecLL << ", hash=" << 
-            _speciesTree->getHash() << " wrong_clades=" 
-            << _unsupportedCladesNumber() << ")"<< std::endl;
-        Logger::info << _speciesTree->getNode(prune)->label << " " << _speciesTree->getNode(regraft)->label << std::endl;
-        return veryLocalSearch(prune);
-      }
-    }
+  std::vector<unsigned int> regrafts;
+  SpeciesTreeOperator::getPossibleRegrafts(*_speciesTree, 
+      spid, 
+      radius, 
+      regrafts);
+  unsigned int regraft = 0;
+  if (testBestPruning(spid, regrafts, regraft)) {
+    Logger::timed << "\tfound better* (LL=" 
+        << _bestRecLL << ", hash=" << 
+        _speciesTree->getHash() << " wrong_clades=" 
+        << _unsupportedCladesNumber() << ")"<< std::endl;
+    Logger::info << _speciesTree->getNode(spid)->label << " " << _speciesTree->getNode(regraft)->label << std::endl;
+    return veryLocalSearch(spid);
   }
   return _bestRecLL;
 }
@@ -661,16 +821,38 @@ void SpeciesTreeOptimizer::saveCurrentSpeciesTreePath(const std::string &str, bo
 
 
 double SpeciesTreeOptimizer::computeRecLikelihood()
+{
+  double res = computeLocalRecLikelihood();
+  if (_optimizationCriteria == ReconciliationLikelihood) {
+    ParallelContext::sumDouble(res);
+  }
+  return res;
+}
+
+double SpeciesTreeOptimizer::computeLocalRecLikelihood()
 {
   double res = 0.0;
   switch (_optimizationCriteria) {
   case ReconciliationLikelihood: 
-    for (auto &evaluation: _evaluations) {
-      res += evaluation->evaluate();
+    {
+      if (_threadPool->getThreadsNumber() > 1) {
+        // the LCA cache is lazily built: build it before
+        // the threads start reading it
+        _speciesTree->getTree().ensureLCACache();
+      }
+      std::vector<double> familyLL(_evaluations.size(), 0.0);
+      _threadPool->parallelFor(_evaluations.size(), [&](unsigned int i) {
+        familyLL[i] = _evaluations[i]->evaluate();
+      });
+      // sum in the family order, such that the result does not
+      // depend on the number of threads
+      for (auto ll: familyLL) {
+        res += ll;
+      }
     }
-    ParallelContext::sumDouble(res);
     break;
   case SupportedClades:
+    // already the same on all ranks
     res = -static_cast<double>(_unsupportedCladesNumber());
     break;
   }
@@ -686,9 +868,30 @@ void SpeciesTreeOptimizer::newBestTreeCallback()
   
 void SpeciesTreeOptimizer::setGeneTreesFromFamilies(const Families &families)
 {
-  _geneTrees = std::make_unique<PerCoreGeneTrees>(families, true);
+  _geneTrees = std::make_unique<PerCoreGeneTrees>(families, true, 
+      _familyCosts);
   updateEvaluations();
 }
+
+void SpeciesTreeOptimizer::rebalanceFamilies()
+{
+  // Redistribute the families once, according to the cost of
+  // the full evaluations done so far. Per-family rates are 
+  // indexed with the local trees, so they cannot follow
+  // their families
+  if (!_familyCosts || _familiesRebalanced 
+      || _modelRates.info.perFamilyRates
+      || _optimizationCriteria != ReconciliationLikelihood) {
+    return;
+  }
+  _familiesRebalanced = true;
+  Routines::measureFamilyCosts(_initialFamilies, *_geneTrees, 
+      _evaluations, *_familyCosts);
+  setGeneTreesFromFamilies(_initialFamilies);
+  _modelRates = ModelParameters(_modelRates.rates, 
+      _geneTrees->getTrees().size(),
+      _modelRates.info);
+}
   
 void SpeciesTreeOptimizer::updateEvaluations()
 {
@@ -738,18 +941,8 @@ void SpeciesTreeOptimizer::onSpeciesTreeChange(const std::unordered_set<pll_rnod
   }
 }
 
-std::string getCladesSetPath(const std::string &outputDir,
-    int rank)
-{
-  std::string basePath = "clades_" + std::to_string(rank) + ".txt";
-  return FileSystem::joinPaths(outputDir, basePath);
-}
-
 void SpeciesTreeOptimizer::_computeAllGeneClades()
 {
-  //Logger::timed << "Computing gene clades..." << std::endl;
-  ParallelContext::barrier();
-  
   // Compute local clades
   auto speciesLabelToInt = _speciesTree->getTree().getLabelToIntMap();
   CladeSet allClades; 
@@ -759,26 +952,12 @@ void SpeciesTreeOptimizer::_computeAllGeneClades()
         speciesLabelToInt);
     allClades.insert(cladesSet.begin(), cladesSet.end());
   }
-  // Write local clades
-  std::ofstream os(
-      getCladesSetPath(_outputDir, ParallelContext::getRank()));
-  for (auto clade: allClades) {
-    os << clade << " ";
-  }
-  os.close();
-  ParallelContext::barrier();
-  // Load all clades
-  _geneClades.clear();
-  for (unsigned int rank = 0; rank < ParallelContext::getSize(); ++rank) {
-    std::ifstream is(getCladesSetPath(_outputDir, rank));
-    unsigned int clade = 0;
-    while (is >> clade) {
-      _geneClades.insert(clade);
-    }
-  }
-  assert(ParallelContext::isIntEqual(_geneClades.size()));
-  ParallelContext::barrier();
-  std::remove(getCladesSetPath(_outputDir, ParallelContext::getRank()).c_str());
+  // Gather the (locally deduplicated) clades of all ranks
+  std::vector<unsigned long> localClades(allClades.begin(), allClades.end());
+  std::vector<unsigned long> globalClades;
+  ParallelContext::concatenateULongVectors(localClades, globalClades);
+  _geneClades = CladeSet(globalClades.begin(), globalClades.end());
+  assert(ParallelContext::isIntEqual(static_cast<int>(_geneClades.size())));
   //Logger::timed << "Number number of supported bipartitions: " << _geneClades.size()  << std::endl;
 }
 
@@ -848,33 +1027,36 @@ void SpeciesTreeOptimizer::addPerFamilyLikelihoods(
     TreePerFamLLVec &treePerFamLLVec)
 {
   assert(_optimizationCriteria != SupportedClades);
-  ParallelContext::barrier();
-  auto localRank = ParallelContext::getRank();
-  std::string localTemp = Paths::getTempFile(_outputDir, localRank);
-  std::ofstream os(localTemp);
-  for (auto &evaluation: _evaluations) {
-    os << evaluation->evaluate() << " ";
+  std::vector<double> localLL;
+  std::vector<unsigned int> localFamilies;
+  for (unsigned int i = 0; i < _evaluations.size(); ++i) {
+    localLL.push_back(_evaluations[i]->evaluate());
+    localFamilies.push_back(_geneTrees->getTrees()[i].familyIndex);
   }
-  os.close();
-  unsigned int totalEvaluationsCount = _evaluations.size();
-  ParallelContext::sumUInt(totalEvaluationsCount);
-  ParallelContext::barrier();
+  std::vector<double> allLL;
+  std::vector<unsigned int> allFamilies;
+  ParallelContext::gatherDoubleVectors(localLL, allLL);
+  ParallelContext::gatherUIntVectors(localFamilies, allFamilies);
   treePerFamLLVec.push_back({newick, PerFamLL()});
   auto &perFamLL = treePerFamLLVec.back().second;
-  perFamLL.reserve(totalEvaluationsCount);
   if (ParallelContext::getRank() == 0) {
-    for (unsigned int r = 0; r < ParallelContext::getSize(); ++r) {
-      std::string currentTemp = Paths::getTempFile(_outputDir, r);
-      std::ifstream is(currentTemp);
-      double ll;
-      while (is >> ll) {
-        perFamLL.push_back(ll);
-      }
+    // sort the likelihoods by family index, such that the columns 
+    // do not depend on the assignment of the families to the ranks.
+    // A family can have several gene trees, all on the same rank
+    // and in the file order: the stable sort keeps this order
+    std::vector<unsigned int> order(allFamilies.size());
+    for (unsigned int i = 0; i < order.size(); ++i) {
+      order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), 
+        [&](unsigned int i1, unsigned int i2) {
+          return allFamilies[i1] < allFamilies[i2];
+        });
+    perFamLL.reserve(order.size());
+    for (auto i: order) {
+      perFamLL.push_back(allLL[i]);
     }
-    assert(perFamLL.size() == totalEvaluationsCount);
   }
-  ParallelContext::barrier();
-
 }
 
 void SpeciesTreeOptimizer::savePerFamilyLikelihoods(
@@ -2,6 +2,8 @@
 
 #include <trees/SpeciesTree.hpp>
 #include <parallelization/PerCoreGeneTrees.hpp>
+#include <parallelization/ParallelContext.hpp>
+#include <parallelization/ThreadPool.hpp>
 #include <string>
 #include <maths/Parameters.hpp>
 #include <maths/AverageStream.hpp>
@@ -20,6 +22,18 @@ struct EvaluatedMove {
   double ll;
 };
 
+/**
+ *  Likelihoods of the SPR moves of one prune node. Their
+ *  reduction over the ranks may still be in progress
+ *  (see SpeciesTreeOptimizer::startPrunings)
+ */
+struct PruningBatch {
+  unsigned int prune;
+  std::vector<unsigned int> regrafts;
+  std::vector<double> lls;
+  ParallelContext::ReductionRequest request;
+};
+
 struct DistanceInfo {
   DistanceMatrix distanceMatrix;
   std::vector<std::string> speciesIdToSpeciesString;
@@ -30,11 +44,14 @@ struct SpeciesTreeSearchParams {
   SpeciesTreeSearchParams():
     sprRadius(DEFAULT_SPECIES_SPR_RADIUS),
     rootSmallRadius(DEFAULT_SPECIES_SMALL_ROOT_RADIUS),
-    rootBigRadius(DEFAULT_SPECIES_BIG_ROOT_RADIUS)
+    rootBigRadius(DEFAULT_SPECIES_BIG_ROOT_RADIUS),
+    threads(1)
   {}
   unsigned int sprRadius;
   unsigned int rootSmallRadius;
   unsigned int rootBigRadius;
+  // number of threads evaluating the families of each rank
+  unsigned int threads;
 };
 
 struct MovesBlackList;
@@ -50,7 +67,8 @@ public:
       const Parameters &startingRates,
       bool userDTLRates,
       const std::string &outputDir,
-      const SpeciesTreeSearchParams &searchParams);
+      const SpeciesTreeSearchParams &searchParams,
+      FamilyCosts *familyCosts = nullptr);
   
   // forbid copy
   SpeciesTreeOptimizer(const SpeciesTreeOptimizer &) = delete;
@@ -94,6 +112,7 @@ private:
   std::unique_ptr<SpeciesTree> _speciesTree;
   std::unique_ptr<PerCoreGeneTrees> _geneTrees;
   PerCoreEvaluations _evaluations; 
+  std::unique_ptr<ThreadPool> _threadPool;
   std::vector<pll_unode_t*> _previousGeneRoots;
   Families _initialFamilies;
   std::string _outputDir;
@@ -109,11 +128,16 @@ private:
   AverageStream _averageGeneRootDiff;
   bool _hardToFindBetter;
   OptimizationCriteria _optimizationCriteria;
+  // if set, used to distribute the families, and replaced with
+  // the evaluation costs measured during the search
+  FamilyCosts *_familyCosts;
+  bool _familiesRebalanced;
 private:
   void _computeAllGeneClades();
   unsigned int _unsupportedCladesNumber();
   ModelParameters computeOptimizedRates(bool thorough); 
   void updateEvaluations();
+  void rebalanceFamilies();
   void rootSearchAux(SpeciesTree &speciesTree, 
       PerCoreGeneTrees &geneTrees, 
       RecModel model, 
@@ -126,6 +150,18 @@ private:
       bool outputConsel);
   bool testPruning(unsigned int prune,
     unsigned int regraft);
+  bool testEvaluatedMove(const EvaluatedMove &move);
+  void startPrunings(unsigned int prune,
+    const std::vector<unsigned int> &regrafts,
+    PruningBatch &batch);
+  void finishPrunings(PruningBatch &batch,
+    std::vector<EvaluatedMove> &candidates);
+  bool testBestPruning(PruningBatch &batch,
+    unsigned int &acceptedRegraft);
+  bool testBestPruning(unsigned int prune,
+    const std::vector<unsigned int> &regrafts,
+    unsigned int &acceptedRegraft);
+  double computeLocalRecLikelihood();
   void newBestTreeCallback();
   void beforeTestCallback();
   void rollbackCallback();
@@ -2,6 +2,7 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <limits>
 #include <IO/Logger.hpp>
 #include <maths/Random.hpp>
 
@@ -140,68 +141,130 @@ unsigned int ParallelContext::getEnd(unsigned int elems)
 }
   
 void ParallelContext::sumDouble(double &value)
+{
+  sumDoubles(&value, 1);
+}
+
+void ParallelContext::sumUInt(unsigned int &value)
+{
+  sumUInts(&value, 1);
+}
+
+void ParallelContext::sumULong(unsigned long &value)
 {
 #ifdef WITH_MPI
   if (!_mpiEnabled) {
     return;
   }
-  double sum = 0;
-  barrier();
-  MPI_Allreduce(&value, &sum, 1, MPI_DOUBLE, MPI_SUM, getComm());
-  value = sum;
+  MPI_Allreduce(MPI_IN_PLACE, &value, 1, MPI_UNSIGNED_LONG, MPI_SUM, getComm());
 #endif
 }
 
-void ParallelContext::sumUInt(unsigned int &value)
+void ParallelContext::sumVectorDouble(std::vector<double> &value)
+{
+  sumDoubles(value.data(), value.size());
+}
+
+void ParallelContext::sumVectorUInt(std::vector<unsigned int> &value)
+{
+  sumUInts(value.data(), value.size());
+}
+
+#ifdef WITH_MPI
+// the allreduce is already a synchronization point: no barrier needed
+static void allReduceSum(void *values, size_t size, MPI_Datatype type)
+{
+  if (size == 0) {
+    return;
+  }
+  MPI_Allreduce(MPI_IN_PLACE, values, static_cast<int>(size), type, 
+      MPI_SUM, ParallelContext::getComm());
+}
+#endif
+
+void ParallelContext::sumDoubles(double *values, size_t size)
 {
 #ifdef WITH_MPI
   if (!_mpiEnabled) {
     return;
   }
-  unsigned int sum = 0;
-  barrier();
-  MPI_Allreduce(&value, &sum, 1, MPI_UNSIGNED, MPI_SUM, getComm());
-  value = sum;
+  allReduceSum(values, size, MPI_DOUBLE);
 #endif
 }
 
-void ParallelContext::sumULong(unsigned long &value)
+void ParallelContext::sumUInts(unsigned int *values, size_t size)
 {
 #ifdef WITH_MPI
   if (!_mpiEnabled) {
     return;
   }
-  unsigned long sum = 0;
-  barrier();
-  MPI_Allreduce(&value, &sum, 1, MPI_UNSIGNED_LONG, MPI_SUM, getComm());
-  value = sum;
+  allReduceSum(values, size, MPI_UNSIGNED);
 #endif
 }
 
-void ParallelContext::sumVectorDouble(std::vector<double> &value)
+void ParallelContext::sumULongs(unsigned long *values, size_t size)
 {
 #ifdef WITH_MPI
   if (!_mpiEnabled) {
     return;
   }
-  std::vector<double> sum(value.size());
-  barrier();
-  MPI_Allreduce(&(value[0]), &(sum[0]), static_cast<int>(value.size()), MPI_DOUBLE, MPI_SUM, getComm());
-  value = sum;
+  allReduceSum(values, size, MPI_UNSIGNED_LONG);
 #endif
 }
 
-void ParallelContext::sumVectorUInt(std::vector<unsigned int> &value)
+template <typename T>
+static void sumMatrix(std::vector<std::vector<T> > &matrix,
+    void (*sum)(T *, size_t))
+{
+  std::vector<T> buffer;
+  for (const auto &row: matrix) {
+    buffer.insert(buffer.end(), row.begin(), row.end());
+  }
+  sum(buffer.data(), buffer.size());
+  auto it = buffer.begin();
+  for (auto &row: matrix) {
+    std::copy(it, it + static_cast<long>(row.size()), row.begin());
+    it += static_cast<long>(row.size());
+  }
+}
+
+void ParallelContext::sumMatrixDouble(MatrixDouble &matrix)
+{
+  // the matrix is already contiguous
+  sumDoubles(matrix.data(), matrix.entries());
+}
+
+void ParallelContext::sumMatrixUInt(std::vector<std::vector<unsigned int> > &matrix)
 {
-#ifdef WITH_MPI
   if (!_mpiEnabled) {
     return;
   }
-  std::vector<unsigned int> sum(value.size(), 0u);
-  barrier();
-  MPI_Allreduce(&(value[0]), &(sum[0]), static_cast<int>(value.size()), MPI_UNSIGNED, MPI_SUM, getComm());
-  value = sum;
+  sumMatrix<unsigned int>(matrix, &ParallelContext::sumUInts);
+}
+
+ParallelContext::ReductionRequest ParallelContext::startSumVectorDouble(
+    std::vector<double> &value)
+{
+  ReductionRequest request;
+#ifdef WITH_MPI
+  if (_mpiEnabled && value.size()) {
+    MPI_Iallreduce(MPI_IN_PLACE, value.data(), static_cast<int>(value.size()),
+        MPI_DOUBLE, MPI_SUM, getComm(), &request.request);
+    request.pending = true;
+  }
+#endif
+  return request;
+}
+
+void ParallelContext::waitReduction(ReductionRequest &request)
+{
+  if (!request.pending) {
+    return;
+  }
+#ifdef WITH_MPI
+  MPI_Wait(&request.request, MPI_STATUS_IGNORE);
 #endif
+  request.pending = false;
 }
 
 void ParallelContext::parallelAnd(bool &value)
@@ -307,6 +370,140 @@ void ParallelContext::concatenateUIntVectors(const std::vector<unsigned int> &lo
 #endif
 }
   
+void ParallelContext::concatenateULongVectors(const std::vector<unsigned long> &localVector, 
+  std::vector<unsigned long> &globalVector)
+{
+  if (!_mpiEnabled) {
+    globalVector = localVector;
+    return;
+  }
+#ifdef WITH_MPI
+  std::vector<int> sizes;
+  allGatherInt(static_cast<int>(localVector.size()), sizes);
+  std::vector<int> offsets(sizes.size(), 0);
+  for (unsigned int i = 1; i < sizes.size(); ++i) {
+    offsets[i] = offsets[i - 1] + sizes[i - 1];
+  }
+  globalVector.resize(static_cast<size_t>(offsets.back() + sizes.back()));
+  MPI_Allgatherv(
+    localVector.data(),
+    static_cast<int>(localVector.size()),
+    MPI_UNSIGNED_LONG,
+    globalVector.data(),
+    sizes.data(),
+    offsets.data(),
+    MPI_UNSIGNED_LONG,
+    getComm());
+#else
+  assert(false);
+#endif
+}
+  
+#ifdef WITH_MPI
+template <typename T>
+static void gatherVectors(const std::vector<T> &localVector, 
+  std::vector<T> &globalVector,
+  MPI_Datatype type)
+{
+  const int master = 0;
+  auto isMaster = ParallelContext::getRank() == master;
+  // MPI_Gatherv counts and displacements are ints
+  const size_t maxSize = static_cast<size_t>(std::numeric_limits<int>::max());
+  if (localVector.size() > maxSize) {
+    Logger::error << "Error: cannot gather more than " << maxSize
+      << " elements" << std::endl;
+    ParallelContext::abort(1);
+  }
+  int localSize = static_cast<int>(localVector.size());
+  std::vector<int> sizes(isMaster ? ParallelContext::getSize() : 0);
+  MPI_Gather(&localSize, 1, MPI_INT, sizes.data(), 1, MPI_INT, 
+      master, ParallelContext::getComm());
+  std::vector<int> offsets(sizes.size(), 0);
+  globalVector.clear();
+  if (isMaster) {
+    size_t globalSize = 0;
+    for (unsigned int i = 0; i < sizes.size(); ++i) {
+      if (globalSize > maxSize) {
+        Logger::error << "Error: cannot gather more than " << maxSize
+          << " elements" << std::endl;
+        ParallelContext::abort(1);
+      }
+      offsets[i] = static_cast<int>(globalSize);
+      globalSize += static_cast<size_t>(sizes[i]);
+    }
+    globalVector.resize(globalSize);
+  }
+  MPI_Gatherv(
+    localVector.data(),
+    localSize,
+    type,
+    globalVector.data(),
+    sizes.data(),
+    offsets.data(),
+    type,
+    master,
+    ParallelContext::getComm());
+}
+#endif
+
+void ParallelContext::gatherDoubleVectors(const std::vector<double> &localVector, 
+  std::vector<double> &globalVector)
+{
+  if (!_mpiEnabled) {
+    globalVector = localVector;
+    return;
+  }
+#ifdef WITH_MPI
+  gatherVectors(localVector, globalVector, MPI_DOUBLE);
+#else
+  assert(false);
+#endif
+}
+
+void ParallelContext::gatherUIntVectors(const std::vector<unsigned int> &localVector, 
+  std::vector<unsigned int> &globalVector)
+{
+  if (!_mpiEnabled) {
+    globalVector = localVector;
+    return;
+  }
+#ifdef WITH_MPI
+  gatherVectors(localVector, globalVector, MPI_UNSIGNED);
+#else
+  assert(false);
+#endif
+}
+  
+void ParallelContext::gatherStrings(const std::vector<std::string> &localStrings, 
+  std::vector<std::string> &globalStrings)
+{
+  if (!_mpiEnabled) {
+    globalStrings = localStrings;
+    return;
+  }
+#ifdef WITH_MPI
+  // gather the string sizes and the concatenated characters
+  std::vector<unsigned int> localSizes;
+  std::vector<char> localChars;
+  for (auto &str: localStrings) {
+    localSizes.push_back(static_cast<unsigned int>(str.size()));
+    localChars.insert(localChars.end(), str.begin(), str.end());
+  }
+  std::vector<unsigned int> sizes;
+  std::vector<char> chars;
+  gatherVectors(localSizes, sizes, MPI_UNSIGNED);
+  gatherVectors(localChars, chars, MPI_CHAR);
+  globalStrings.clear();
+  auto it = chars.begin();
+  for (auto size: sizes) {
+    globalStrings.push_back(std::string(it, it + size));
+    it += size;
+  }
+#else
+  assert(false);
+#endif
+}
+
 void ParallelContext::broadcastInt(unsigned int fromRank, int &value)
 {
   if (!_mpiEnabled) {
@@ -358,10 +555,7 @@ void ParallelContext::maxUInt(unsigned int &value)
   if (!_mpiEnabled) {
     return;
   }
-  unsigned int sum = 0;
-  barrier();
-  MPI_Allreduce(&value, &sum, 1, MPI_UNSIGNED, MPI_MAX, getComm());
-  value = sum;
+  MPI_Allreduce(MPI_IN_PLACE, &value, 1, MPI_UNSIGNED, MPI_MAX, getComm());
 #endif
 }
 
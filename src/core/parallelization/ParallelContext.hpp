@@ -3,10 +3,12 @@
 #include <fstream>
 #include <vector>
 #include <stack>
+#include <util/types.hpp>
 #ifdef WITH_MPI
   #include <mpi.h>
 #else
   typedef int MPI_Comm;
+  typedef int MPI_Request;
 #endif
 
 
@@ -53,11 +55,68 @@ public:
   static void concatenateIntVectors(const std::vector<int> &localVector, std::vector<int> &globalVector);
   static void concatenateUIntVectors(const std::vector<unsigned int> &localVector, 
     std::vector<unsigned int> &globalVector);
+  /**
+   *  Concatenate the vectors of all the ranks, in the rank order.
+   *  Unlike concatenateUIntVectors, the local vectors can have 
+   *  different sizes.
+   */
+  static void concatenateULongVectors(const std::vector<unsigned long> &localVector, 
+    std::vector<unsigned long> &globalVector);
+  /**
+   *  Concatenate the vectors of all the ranks, in the rank order,
+   *  on the master rank only (globalVector is cleared on the other
+   *  ranks). The local vectors can have different sizes.
+   */
+  static void gatherDoubleVectors(const std::vector<double> &localVector, 
+    std::vector<double> &globalVector);
+  static void gatherUIntVectors(const std::vector<unsigned int> &localVector, 
+    std::vector<unsigned int> &globalVector);
+  static void gatherStrings(const std::vector<std::string> &localStrings, 
+    std::vector<std::string> &globalStrings);
 
   static void sumDouble(double &value);
   static void sumUInt(unsigned int &value);
   static void sumVectorDouble(std::vector<double> &value);
   static void sumVectorUInt(std::vector<unsigned int> &value);
+
+  /**
+   *  Sum, in place, the size contiguous values starting at
+   *  values over all the ranks, with a single collective operation
+   */
+  static void sumDoubles(double *values, size_t size);
+  static void sumUInts(unsigned int *values, size_t size);
+  static void sumULongs(unsigned long *values, size_t size);
+
+  /**
+   *  Sum the matrices of all the ranks, with a single collective
+   *  operation (the rows of sumMatrixUInt are packed into one 
+   *  buffer). All the ranks must have matrices with the same 
+   *  dimensions.
+   */
+  static void sumMatrixDouble(MatrixDouble &matrix);
+  static void sumMatrixUInt(std::vector<std::vector<unsigned int> > &matrix);
+
+  /**
+   *  Handle on a non-blocking reduction
+   */
+  struct ReductionRequest {
+    ReductionRequest(): pending(false) {}
+    MPI_Request request;
+    bool pending;
+  };
+
+  /**
+   *  Non-blocking version of sumVectorDouble: start the reduction
+   *  and return immediately. value must not be accessed (nor 
+   *  resized) until waitReduction is called on the returned request.
+   */
+  static ReductionRequest startSumVectorDouble(std::vector<double> &value);
+
+  /**
+   *  Wait until a reduction started with startSumVectorDouble completes
+   */
+  static void waitReduction(ReductionRequest &request);
+
   static void maxUInt(unsigned int &value);
   static void sumULong(unsigned long &value); 
   static void parallelAnd(bool &value);
@@ -1,83 +1,122 @@
 #include "PerCoreGeneTrees.hpp"
 #include <parallelization/ParallelContext.hpp>
 #include <IO/Logger.hpp>
-#include <IO/FileSystem.hpp>
 #include <IO/LibpllParsers.hpp>
 #include <algorithm>
+#include <cassert>
+#include <functional>
 #include <numeric>
+#include <queue>
 #include <iostream>
-#include <sstream>
 
 template <typename T>
 std::vector<size_t> sort_indexes_descending(const std::vector<T> &v) {
   std::vector<size_t> idx(v.size());
   iota(idx.begin(), idx.end(), 0);
-  sort(idx.begin(), idx.end(),
+  stable_sort(idx.begin(), idx.end(),
        [&v](size_t i1, size_t i2) {return v[i1] > v[i2];});
   return idx;
 }
 
 
-static std::vector<size_t> getMyIndices(const std::vector<unsigned int> &treeSizes) 
+/**
+ *  Longest processing time first: the families are sorted by
+ *  decreasing cost, and each family goes to the least loaded rank.
+ *  All ranks compute the same allocation.
+ */
+static std::vector<size_t> getMyIndices(const std::vector<double> &costs) 
 {
-  std::vector<size_t> sortedIndices = sort_indexes_descending<unsigned int>(treeSizes);
+  std::vector<size_t> sortedIndices = sort_indexes_descending<double>(costs);
   std::vector<size_t> myIndices;
-  std::vector<unsigned int> perRankLoad(ParallelContext::getSize(), 0);
-  unsigned int averageLoad = 0;
-  for (auto load: treeSizes) {
-    averageLoad += load;
+  using RankLoad = std::pair<double, unsigned int>;
+  std::priority_queue<RankLoad, std::vector<RankLoad>, std::greater<RankLoad> > loads;
+  for (unsigned int rank = 0; rank < ParallelContext::getSize(); ++rank) {
+    loads.push(RankLoad(0.0, rank));
   }
-  averageLoad /= ParallelContext::getSize();
-  unsigned int currentRank = 0;
   for (auto index: sortedIndices) {
-    perRankLoad[currentRank] += treeSizes[index];
-    if (currentRank == ParallelContext::getRank()) {
+    auto load = loads.top();
+    loads.pop();
+    if (load.second == ParallelContext::getRank()) {
       myIndices.push_back(index);
     }
-    currentRank = (currentRank + 1) % ParallelContext::getSize();
-    for (; perRankLoad[currentRank] > averageLoad;(currentRank = (currentRank + 1) % ParallelContext::getSize())) {}
+    load.first += costs[index];
+    loads.push(load);
   }
+  // keep the family order
+  std::sort(myIndices.begin(), myIndices.end());
   return myIndices;
 }
 
-static void splitLines(const std::string &input, 
-    std::vector<std::string> &output)
+/**
+ *  The cost of each family: its number of taxa, or its measured
+ *  cost expressed in number of taxa
+ */
+static std::vector<double> getCosts(const Families &families,
+    const FamilyCosts *measuredCosts)
 {
-  std::stringstream ss(input);
-  std::string to;
-  while(std::getline(ss,to,'\n')){
-    if (to.size() > 2) {
-      output.push_back(to);
+  auto treeSizes = LibpllParsers::parallelGetTreeSizes(families);
+  std::vector<double> costs(treeSizes.begin(), treeSizes.end());
+  if (!measuredCosts || measuredCosts->empty()) {
+    return costs;
+  }
+  std::vector<bool> measured(families.size(), false);
+  double measuredTotal = 0.0;
+  double measuredSizes = 0.0;
+  for (unsigned int i = 0; i < families.size(); ++i) {
+    auto it = measuredCosts->find(families[i].name);
+    if (it != measuredCosts->end()) {
+      measured[i] = true;
+      measuredTotal += it->second;
+      measuredSizes += costs[i];
+    }
+  }
+  if (measuredTotal <= 0.0) {
+    return costs;
+  }
+  for (unsigned int i = 0; i < families.size(); ++i) {
+    if (measured[i]) {
+      costs[i] = measuredCosts->at(families[i].name) 
+        * measuredSizes / measuredTotal;
     }
   }
+  return costs;
 }
 
 PerCoreGeneTrees::PerCoreGeneTrees(const Families &families,
-    bool acceptMultipleTrees)
+    bool acceptMultipleTrees,
+    const FamilyCosts *measuredCosts)
 {
-  auto treeSizes = LibpllParsers::parallelGetTreeSizes(families);
-  auto myIndices = getMyIndices(treeSizes);
+  auto myIndices = getMyIndices(getCosts(families, measuredCosts));
 
-  _geneTrees.resize(myIndices.size());
+  // parse all the trees before filling _geneTrees, because
+  // its elements must not be reallocated once they own a tree
+  std::vector<std::vector<pll_utree_t *> > utrees(myIndices.size());
+  size_t treesNumber = 0;
+  for (unsigned int k = 0; k < myIndices.size(); ++k) {
+    Family::readStartingGeneTrees(families[myIndices[k]],
+        utrees[k],
+        acceptMultipleTrees ? 0 : 1);
+    treesNumber += utrees[k].size();
+  }
+  _geneTrees.resize(treesNumber);
   unsigned int index = 0;
-  for (auto i: myIndices) {
-    std::string geneTreeStr;
-    FileSystem::getFileContent(families[i].startingGeneTree, geneTreeStr);
-    std::vector<std::string> geneTreeStrVector;
-    splitLines(geneTreeStr, geneTreeStrVector);
-    if (acceptMultipleTrees) {
-      if (index == 0) {
-        _geneTrees.resize(myIndices.size() * geneTreeStrVector.size());
-      }
-    } else {
-      geneTreeStrVector.resize(1);
+  for (unsigned int k = 0; k < myIndices.size(); ++k) {
+    auto i = myIndices[k];
+    GeneSpeciesMapping mapping;
+    if (families[i].mappingFile.size()) {
+      Family::fillMapping(families[i], mapping);
     }
-    for (auto &currentGeneTreeStr: geneTreeStrVector) {
+    for (auto utree: utrees[k]) {
       _geneTrees[index].name = families[i].name;
       _geneTrees[index].familyIndex = i; 
-      _geneTrees[index].mapping.fill(families[i].mappingFile, currentGeneTreeStr);
-      _geneTrees[index].geneTree = new PLLUnrootedTree(currentGeneTreeStr, false);
+      _geneTrees[index].geneTree = new PLLUnrootedTree(utree);
       _geneTrees[index].ownTree = true;
+      if (families[i].mappingFile.size()) {
+        _geneTrees[index].mapping = mapping;
+      } else {
+        _geneTrees[index].mapping.fillFromGeneLabels(
+            _geneTrees[index].geneTree->getLabels());
+      }
       index++;
     }
   }
@@ -112,4 +151,3 @@ bool PerCoreGeneTrees::checkMappings(const std::string &speciesTreeFile)
   return ok;
 }
 
-
@@ -31,10 +31,20 @@ public:
   /**
    *  Parse and allocate to the current core the gene trees 
    *  from the description of the gene families.
+   *  The families are allocated with a longest processing
+   *  time first heuristic. The cost of a family is its number
+   *  of taxa, unless measuredCosts is set and has a cost for
+   *  this family. The measured costs are rescaled to be 
+   *  comparable with the numbers of taxa. They must be the
+   *  same on all cores.
    *  @param families families description
+   *  @param acceptMultipleTrees read all the trees of the
+   *    starting gene tree files
+   *  @param measuredCosts optional measured family costs
    */
   PerCoreGeneTrees(const Families &families, 
-      bool acceptMultipleTrees = false);
+      bool acceptMultipleTrees = false,
+      const FamilyCosts *measuredCosts = nullptr);
   /**
    * Create an instance with a unique gene tree, without 
    * accouting for parallelization.
@@ -65,6 +75,4 @@ public:
   bool checkMappings(const std::string &speciesTreeFile);
 private:
   std::vector<GeneTree> _geneTrees;
-  std::vector<unsigned int> _treeSizes;
-
 };
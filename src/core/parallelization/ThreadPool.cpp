@@ -0,0 +1,98 @@
+#include "ThreadPool.hpp"
+
+ThreadPool::ThreadPool(unsigned int threadsNumber):
+  _task(nullptr),
+  _elements(0),
+  _nextElement(0),
+  _generation(0),
+  _runningWorkers(0),
+  _stop(false)
+{
+  for (unsigned int i = 1; i < threadsNumber; ++i) {
+    _workers.emplace_back(&ThreadPool::workerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _startCondition.notify_all();
+  for (auto &worker: _workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::parallelFor(unsigned int elements,
+    const std::function<void(unsigned int)> &f)
+{
+  if (!elements) {
+    return;
+  }
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _task = &f;
+    _elements = elements;
+    _nextElement = 0;
+    _exception = nullptr;
+    _runningWorkers = static_cast<unsigned int>(_workers.size());
+    _generation++;
+  }
+  _startCondition.notify_all();
+  runTasks();
+  std::exception_ptr exception;
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _endCondition.wait(lock, [this] {return _runningWorkers == 0;});
+    _task = nullptr;
+    exception = _exception;
+    _exception = nullptr;
+  }
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+}
+
+void ThreadPool::workerLoop()
+{
+  unsigned int lastGeneration = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _startCondition.wait(lock, [this, lastGeneration] {
+          return _stop || _generation != lastGeneration;
+      });
+      if (_stop) {
+        return;
+      }
+      lastGeneration = _generation;
+    }
+    runTasks();
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _runningWorkers--;
+    }
+    _endCondition.notify_one();
+  }
+}
+
+void ThreadPool::runTasks()
+{
+  while (true) {
+    unsigned int i = _nextElement++;
+    if (i >= _elements) {
+      return;
+    }
+    try {
+      (*_task)(i);
+    } catch (...) {
+      std::unique_lock<std::mutex> lock(_mutex);
+      if (!_exception) {
+        _exception = std::current_exception();
+      }
+    }
+  }
+}
+
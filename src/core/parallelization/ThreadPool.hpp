@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ *  Fixed-size pool of threads, used to run independant
+ *  tasks inside a MPI rank (for instance, to evaluate the
+ *  gene families of a rank concurrently)
+ *
+ *  The caller thread also participates to the work, so
+ *  a pool of n threads only spawns n - 1 worker threads.
+ */
+class ThreadPool {
+public:
+  /**
+   *  @param threadsNumber total number of threads, including
+   *         the caller thread (0 is interpreted as 1)
+   */
+  ThreadPool(unsigned int threadsNumber);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool & operator = (const ThreadPool &) = delete;
+  ThreadPool(ThreadPool &&) = delete;
+  ThreadPool & operator = (ThreadPool &&) = delete;
+
+  /**
+   *  Call f(i) for all i in [0, elements[, and return
+   *  when all the calls returned. The indices are dynamically
+   *  distributed over the threads: f must only write to
+   *  data that belongs to index i, and the caller is
+   *  responsible for reducing the results in index order
+   *  if it needs reproducible results.
+   *  If some calls throw, the first exception is rethrown
+   *  in the caller thread.
+   */
+  void parallelFor(unsigned int elements,
+      const std::function<void(unsigned int)> &f);
+
+  /**
+   *  @return the total number of threads (including the
+   *  caller thread)
+   */
+  unsigned int getThreadsNumber() const {
+    return static_cast<unsigned int>(_workers.size()) + 1;
+  }
+
+private:
+  void workerLoop();
+  void runTasks();
+
+  std::vector<std::thread> _workers;
+  std::mutex _mutex;
+  std::condition_variable _startCondition;
+  std::condition_variable _endCondition;
+  const std::function<void(unsigned int)> *_task;
+  unsigned int _elements;
+  std::atomic<unsigned int> _nextElement;
+  unsigned int _generation;
+  unsigned int _runningWorkers;
+  bool _stop;
+  std::exception_ptr _exception;
+};
+
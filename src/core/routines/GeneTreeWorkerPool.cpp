@@ -0,0 +1,268 @@
+#include "GeneTreeWorkerPool.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <IO/FileSystem.hpp>
+#include <IO/LibpllParsers.hpp>
+#include <IO/Logger.hpp>
+#include <maths/Parameters.hpp>
+#include <maths/Random.hpp>
+#include <parallelization/ParallelContext.hpp>
+#include <search/SPRSearch.hpp>
+#include <trees/JointTree.hpp>
+
+// do not migrate families when the most loaded rank is
+// within this fraction of the average load
+static const double REBALANCE_TOLERANCE = 0.05;
+
+static std::string readNewick(const FamilyInfo &family)
+{
+  auto &geneTreeFile = family.startingGeneTree;
+  if (geneTreeFile == "__random__" || geneTreeFile.size() == 0) {
+    return "__random__";
+  }
+  std::string content;
+  Family::getStartingGeneTreeContent(family, content);
+  std::istringstream is(content);
+  std::string newick;
+  while (std::getline(is, newick) && newick.empty()) {}
+  assert(newick.size());
+  return newick;
+}
+
+GeneTreeWorkerPool::GeneTreeWorkerPool(const std::string &speciesTreePath,
+    const RecModelInfo &recModelInfo,
+    RecOpt recOpt,
+    bool madRooting,
+    double supportThreshold,
+    double recWeight):
+  _speciesTreePath(speciesTreePath),
+  _recModelInfo(recModelInfo),
+  _recOpt(recOpt),
+  _madRooting(madRooting),
+  _supportThreshold(supportThreshold),
+  _recWeight(recWeight)
+{
+}
+
+GeneTreeWorkerPool::~GeneTreeWorkerPool()
+{
+}
+
+void GeneTreeWorkerPool::optimizeGeneTrees(Families &families,
+    const Parameters &rates,
+    const std::string &output,
+    const std::string &resultName,
+    bool enableRec,
+    bool enableLibpll,
+    unsigned int sprRadius,
+    long &elapsed)
+{
+  assert(ParallelContext::isRandConsistent());
+  auto start = Logger::getElapsedSec();
+  auto consistentSeed = Random::getInt();
+  if (_familyToRank.empty()) {
+    _assignFamilies(families);
+  } else {
+    assert(_familyToRank.size() == families.size());
+    _rebalance();
+  }
+  auto rank = ParallelContext::getRank();
+  std::vector<double> costs(families.size(), 0.0);
+  _libpllLL.assign(families.size(), 0.0);
+  _recLL.assign(families.size(), 0.0);
+  std::string resultsDir = FileSystem::joinPaths(output, resultName);
+  // every rank is rank 0 of its sequential context
+  Logger::mute();
+  ParallelContext::pushSequentialContext();
+  for (unsigned int i = 0; i < families.size(); ++i) {
+    auto &family = families[i];
+    std::string familyOutput = FileSystem::joinPaths(resultsDir, family.name);
+    std::string geneTreePath = FileSystem::joinPaths(familyOutput, "geneTree.newick");
+    std::string outputStats = FileSystem::joinPaths(familyOutput, "stats.txt");
+    if (_familyToRank[i] == rank) {
+      auto begin = std::chrono::steady_clock::now();
+      _optimizeFamily(i, family, rates, enableRec, enableLibpll,
+          sprRadius, geneTreePath, outputStats);
+      std::chrono::duration<double> familyElapsed =
+        std::chrono::steady_clock::now() - begin;
+      costs[i] = familyElapsed.count();
+    } else {
+      // the family migrated to another rank
+      _jointTrees[i].reset();
+    }
+    family.startingGeneTree = geneTreePath;
+    family.statsFile = outputStats;
+  }
+  ParallelContext::popContext();
+  Logger::unmute();
+  ParallelContext::sumVectorDouble(costs);
+  _costs = costs;
+  if (_recModelInfo.perFamilyRates) {
+    _shareFamilyRates(rates.dimensions());
+  }
+  // seed accross ranks might not be consistent anymore
+  Random::setSeed(consistentSeed);
+  ParallelContext::barrier();
+  elapsed = (Logger::getElapsedSec() - start);
+}
+
+void GeneTreeWorkerPool::gatherLikelihoods(double &totalLibpllLL,
+    double &totalRecLL) const
+{
+  std::vector<double> totalLL(2, 0.0);
+  for (unsigned int i = 0; i < _libpllLL.size(); ++i) {
+    totalLL[0] += _libpllLL[i];
+    totalLL[1] += _recLL[i];
+  }
+  ParallelContext::sumVectorDouble(totalLL);
+  totalLibpllLL = totalLL[0];
+  totalRecLL = totalLL[1];
+}
+
+void GeneTreeWorkerPool::_shareFamilyRates(unsigned int dimensions)
+{
+  auto rank = ParallelContext::getRank();
+  std::vector<double> allRates(_familyToRank.size() * dimensions, 0.0);
+  for (unsigned int i = 0; i < _familyToRank.size(); ++i) {
+    if (_familyToRank[i] == rank) {
+      auto &familyRates = _jointTrees[i]->getRatesVector();
+      assert(familyRates.dimensions() == dimensions);
+      for (unsigned int d = 0; d < dimensions; ++d) {
+        allRates[i * dimensions + d] = familyRates[d];
+      }
+    }
+  }
+  // only the owner of a family contributes to its rates
+  ParallelContext::sumVectorDouble(allRates);
+  _familyRates.resize(_familyToRank.size());
+  for (unsigned int i = 0; i < _familyToRank.size(); ++i) {
+    _familyRates[i] = Parameters(std::vector<double>(
+          allRates.begin() + i * dimensions,
+          allRates.begin() + (i + 1) * dimensions));
+  }
+}
+
+void GeneTreeWorkerPool::_assignFamilies(const Families &families)
+{
+  auto treeSizes = LibpllParsers::parallelGetTreeSizes(families);
+  _costs = std::vector<double>(treeSizes.begin(), treeSizes.end());
+  _familyToRank = std::vector<unsigned int>(families.size(), 0);
+  _jointTrees.resize(families.size());
+  // longest processing time first: this is deterministic,
+  // so all ranks compute the same assignment
+  std::vector<unsigned int> order(families.size());
+  for (unsigned int i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(),
+      [this](unsigned int a, unsigned int b) {
+        return _costs[a] > _costs[b];
+      });
+  std::vector<double> loads(ParallelContext::getSize(), 0.0);
+  for (auto famid: order) {
+    auto rank = static_cast<unsigned int>(
+        std::min_element(loads.begin(), loads.end()) - loads.begin());
+    _familyToRank[famid] = rank;
+    loads[rank] += _costs[famid];
+  }
+}
+
+void GeneTreeWorkerPool::_rebalance()
+{
+  std::vector<double> loads(ParallelContext::getSize(), 0.0);
+  double totalLoad = 0.0;
+  for (unsigned int i = 0; i < _familyToRank.size(); ++i) {
+    loads[_familyToRank[i]] += _costs[i];
+    totalLoad += _costs[i];
+  }
+  double averageLoad = totalLoad / static_cast<double>(loads.size());
+  // greedily move families from the most loaded rank to the
+  // least loaded rank. Each move strictly decreases the sum of
+  // the squared loads, and migrates as few families as possible
+  for (unsigned int move = 0; move < _familyToRank.size(); ++move) {
+    auto maxRank = static_cast<unsigned int>(
+        std::max_element(loads.begin(), loads.end()) - loads.begin());
+    auto minRank = static_cast<unsigned int>(
+        std::min_element(loads.begin(), loads.end()) - loads.begin());
+    if (loads[maxRank] <= (1.0 + REBALANCE_TOLERANCE) * averageLoad) {
+      break;
+    }
+    double halfGap = (loads[maxRank] - loads[minRank]) / 2.0;
+    // moving a family of cost c only helps if 0 < c < 2 * halfGap,
+    // and the best family is the closest to halfGap
+    double bestDistance = halfGap;
+    unsigned int bestFamily = static_cast<unsigned int>(_familyToRank.size());
+    for (unsigned int i = 0; i < _familyToRank.size(); ++i) {
+      auto distance = fabs(_costs[i] - halfGap);
+      if (_familyToRank[i] == maxRank && distance < bestDistance) {
+        bestDistance = distance;
+        bestFamily = i;
+      }
+    }
+    if (bestFamily == _familyToRank.size()) {
+      break;
+    }
+    _familyToRank[bestFamily] = minRank;
+    loads[maxRank] -= _costs[bestFamily];
+    loads[minRank] += _costs[bestFamily];
+  }
+}
+
+void GeneTreeWorkerPool::_optimizeFamily(unsigned int famid,
+    const FamilyInfo &family,
+    const Parameters &rates,
+    bool enableRec,
+    bool enableLibpll,
+    unsigned int sprRadius,
+    const std::string &outputGeneTree,
+    const std::string &outputStats)
+{
+  // the per-family rates do not depend on the rank that
+  // optimized the family during the previous calls
+  bool hasFamilyRates = _recModelInfo.perFamilyRates
+    && famid < _familyRates.size();
+  const Parameters &familyRates = hasFamilyRates ?
+    _familyRates[famid] : rates;
+  auto &jointTree = _jointTrees[famid];
+  if (!jointTree) {
+    jointTree = std::make_unique<JointTree>(readNewick(family),
+        family.alignmentFile,
+        _speciesTreePath,
+        family.mappingFile,
+        family.libpllModel,
+        _recModelInfo,
+        _recOpt,
+        _madRooting,
+        _supportThreshold,
+        _recWeight,
+        false, //check
+        _recModelInfo.perFamilyRates,
+        familyRates);
+  }
+  jointTree->enableReconciliation(enableRec);
+  jointTree->enableLibpll(enableLibpll);
+  jointTree->setRates(familyRates);
+  jointTree->optimizeParameters(true, enableRec);
+  double bestLoglk = jointTree->computeJointLoglk();
+  if (sprRadius > 0) {
+    while(SPRSearch::applySPRRound(*jointTree, static_cast<int>(sprRadius),
+          bestLoglk, true)) {}
+  }
+  jointTree->save(outputGeneTree, false);
+  std::ofstream stats(outputStats);
+  double libpllLL = jointTree->computeLibpllLoglk();
+  double recLL = jointTree->computeReconciliationLoglk();
+  _libpllLL[famid] = libpllLL;
+  _recLL[famid] = recLL;
+  stats << libpllLL << " " << recLL << std::endl;
+  stats << "Reconciliation rates = ";
+  for (auto rate: jointTree->getRatesVector().getVector()) {
+    stats << rate << " ";
+  }
+}
+
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <IO/Families.hpp>
+#include <maths/Parameters.hpp>
+#include <util/RecModelInfo.hpp>
+
+class JointTree;
+
+/**
+ *  In-process alternative to GeneRaxMaster::optimizeGeneTrees:
+ *  instead of scheduling one job per family (which rebuilds the
+ *  JointTree from the files at each call), each rank keeps the
+ *  JointTree objects of its families alive across calls.
+ *
+ *  The families are first assigned to the ranks according to their
+ *  number of taxa, and rebalanced between two calls according to
+ *  the measured optimization times. A family that migrates to another
+ *  rank is rebuilt from its last saved gene tree. With per-family
+ *  rates, the rates of each family are shared with all the ranks
+ *  after each call, such that they follow the family.
+ *
+ *  The gene trees and the stats files are still written at each call,
+ *  because the rates optimization reads them. The likelihoods of the
+ *  families are also kept in memory, see gatherLikelihoods.
+ */
+class GeneTreeWorkerPool {
+public:
+  GeneTreeWorkerPool(const std::string &speciesTreePath,
+      const RecModelInfo &recModelInfo,
+      RecOpt recOpt,
+      bool madRooting,
+      double supportThreshold,
+      double recWeight);
+  ~GeneTreeWorkerPool();
+  GeneTreeWorkerPool(const GeneTreeWorkerPool &) = delete;
+  GeneTreeWorkerPool & operator = (const GeneTreeWorkerPool &) = delete;
+  GeneTreeWorkerPool(GeneTreeWorkerPool &&) = delete;
+  GeneTreeWorkerPool & operator = (GeneTreeWorkerPool &&) = delete;
+
+  /**
+   *  Same semantics as GeneRaxMaster::optimizeGeneTrees.
+   *  Must be called by all ranks, always with the same families.
+   *  With global rates, the resident trees are updated with rates.
+   *  With per-family rates, each family starts from its previously
+   *  optimized rates, whatever rank it is assigned to.
+   */
+  void optimizeGeneTrees(Families &families,
+      const Parameters &rates,
+      const std::string &output,
+      const std::string &resultName,
+      bool enableRec,
+      bool enableLibpll,
+      unsigned int sprRadius,
+      long &elapsed);
+
+  /**
+   *  Same semantics as Routines::gatherLikelihoods after the last
+   *  optimizeGeneTrees call, without reading the stats files.
+   *  Must be called by all ranks.
+   */
+  void gatherLikelihoods(double &totalLibpllLL, double &totalRecLL) const;
+
+private:
+  std::string _speciesTreePath;
+  RecModelInfo _recModelInfo;
+  RecOpt _recOpt;
+  bool _madRooting;
+  double _supportThreshold;
+  double _recWeight;
+  // _familyToRank[famid] is the rank in charge of famid
+  std::vector<unsigned int> _familyToRank;
+  // estimated optimization cost of each family
+  std::vector<double> _costs;
+  // last optimized rates of each family (all the families,
+  // only with per-family rates)
+  std::vector<Parameters> _familyRates;
+  // only the families assigned to this rank have a tree
+  std::vector<std::unique_ptr<JointTree> > _jointTrees;
+  // likelihoods of the families of this rank (0 for the others)
+  std::vector<double> _libpllLL;
+  std::vector<double> _recLL;
+
+  void _assignFamilies(const Families &families);
+  void _rebalance();
+  void _shareFamilyRates(unsigned int dimensions);
+  void _optimizeFamily(unsigned int famid,
+      const FamilyInfo &family,
+      const Parameters &rates,
+      bool enableRec,
+      bool enableLibpll,
+      unsigned int sprRadius,
+      const std::string &outputGeneTree,
+      const std::string &outputStats);
+};
+
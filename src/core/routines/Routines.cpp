@@ -9,12 +9,15 @@
 #include <optimizers/SpeciesTreeOptimizer.hpp>
 #include <parallelization/PerCoreGeneTrees.hpp>
 #include <IO/FileSystem.hpp>
+#include <IO/FileArchive.hpp>
+#include <IO/ParallelOfstream.hpp>
 #include <likelihoods/LibpllEvaluation.hpp>
 #include <trees/PLLRootedTree.hpp>
 #include <maths/ModelParameters.hpp>
 #include <routines/scheduled_routines/RaxmlMaster.hpp>
 #include <routines/scheduled_routines/GeneRaxMaster.hpp>
 #include <maths/Random.hpp>
+#include <parallelization/ThreadPool.hpp>
 #include <trees/PLLRootedTree.hpp>
 #include <NJ/MiniNJ.hpp>
 #include <NJ/Cherry.hpp>
@@ -23,19 +26,20 @@
 std::unique_ptr<PLLRootedTree> 
 Routines::computeInitialSpeciesTree(Families &families,
     const std::string globalOutputDir,
-    SpeciesTreeAlgorithm algo)
+    SpeciesTreeAlgorithm algo,
+    unsigned int threads)
 {
   std::string cladeOutput = FileSystem::joinPaths(
       globalOutputDir, "cladesSpeciesTree");
   switch (algo) {
   case SpeciesTreeAlgorithm::MiniNJ:
-    return MiniNJ::runMiniNJ(families); 
+    return MiniNJ::runMiniNJ(families, threads); 
   case SpeciesTreeAlgorithm::NJst:
-    return MiniNJ::runNJst(families); 
+    return MiniNJ::runNJst(families, threads); 
   case SpeciesTreeAlgorithm::WMinNJ:
-    return MiniNJ::runWMinNJ(families); 
+    return MiniNJ::runWMinNJ(families, threads); 
   case SpeciesTreeAlgorithm::Ustar:
-    return MiniNJ::runUstar(families); 
+    return MiniNJ::runUstar(families, threads); 
   case SpeciesTreeAlgorithm::Cherry:
     return Cherry::geneTreeCherry(families); 
   case SpeciesTreeAlgorithm::CherryPro:
@@ -140,13 +144,14 @@ void Routines::optimizeRates(bool userDTLRates,
     Families &families,
     bool perSpeciesRates, 
     Parameters &rates,
-    long &sumElapsed) 
+    long &sumElapsed,
+    FamilyCosts *familyCosts) 
 {
   if (userDTLRates) {
     return;
   }
   auto start = Logger::getElapsedSec();
-  PerCoreGeneTrees geneTrees(families);
+  PerCoreGeneTrees geneTrees(families, false, familyCosts);
   PLLRootedTree speciesTree(speciesTreeFile);
   PerCoreEvaluations evaluations;
   buildEvaluations(geneTrees, speciesTree, recModelInfo, evaluations);
@@ -155,6 +160,9 @@ void Routines::optimizeRates(bool userDTLRates,
   } else {
     rates = DTLOptimizer::optimizeParametersGlobalDTL(evaluations);
   }
+  if (familyCosts) {
+    measureFamilyCosts(families, geneTrees, evaluations, *familyCosts);
+  }
   ParallelContext::barrier(); 
   auto elapsed = (Logger::getElapsedSec() - start);
   sumElapsed += elapsed;
@@ -177,13 +185,22 @@ static std::string getTransfersFile(const std::string &outputDir, const std::str
   res += std::string("_transfers.txt");
   return res;
 }
+std::string Routines::getReconciliationArchive(const std::string &outputDir,
+    unsigned int rank)
+{
+  return FileSystem::joinPaths(outputDir, 
+      FileSystem::joinPaths("reconciliations", 
+        "reconciliations_" + std::to_string(rank) + ".grxa"));
+}
+
 void Routines::inferAndGetReconciliationScenarios(
     PLLRootedTree &speciesTree,
     const PerCoreGeneTrees &geneTrees,
     const ModelParameters &initialModelRates,
     unsigned int reconciliationSamples,
     bool optimizeRates,
-    std::vector<Scenario> &scenarios)
+    std::vector<Scenario> &scenarios,
+    unsigned int threads)
 {
   // initialization
   auto consistentSeed = Random::getInt();
@@ -213,14 +230,25 @@ void Routines::inferAndGetReconciliationScenarios(
   }
   ParallelContext::barrier();
   // infer the scenarios!
+  std::unique_ptr<ThreadPool> threadPool;
+  if (reconciliationSamples > 0) {
+    threadPool = std::make_unique<ThreadPool>(threads);
+  }
   for (unsigned int i = 0; i  < geneTrees.getTrees().size(); ++i) {
     if (reconciliationSamples < 1) {
       evaluations[i]->inferMLScenario(scenarios[i]);
     } else {
+      std::vector<Scenario *> samples;
       for (unsigned int sample = 0; sample < reconciliationSamples; ++sample) {
         auto index = sample * geneTrees.getTrees().size() + i;
-        evaluations[i]->inferMLScenario(scenarios[index], true);
+        samples.push_back(&scenarios[index]);
       }
+      // one random stream per (family, sample) pair, independent
+      // of the number of ranks and threads
+      auto familyIndex = geneTrees.getTrees()[i].familyIndex;
+      auto seed = static_cast<unsigned int>(consistentSeed) 
+        + familyIndex * reconciliationSamples;
+      evaluations[i]->sampleScenarios(samples, seed, *threadPool);
     }
   }
   // restore the seed to a consistent state
@@ -237,12 +265,22 @@ void Routines::inferReconciliation(
     const std::string &outputDir,
     bool bestReconciliation,
     unsigned int reconciliationSamples,
-    bool optimizeRates
+    bool optimizeRates,
+    bool archiveOutput,
+    unsigned int threads,
+    const FamilyCosts *familyCosts
     )
 {
-  PerCoreGeneTrees geneTrees(families);
+  PerCoreGeneTrees geneTrees(families, false, familyCosts);
   std::string reconciliationsDir = FileSystem::joinPaths(outputDir, "reconciliations");
   FileSystem::mkdir(reconciliationsDir, true);
+  ParallelContext::barrier();
+  std::unique_ptr<FileArchiveWriter> archive;
+  if (archiveOutput) {
+    archive = std::make_unique<FileArchiveWriter>(
+        getReconciliationArchive(outputDir, ParallelContext::getRank()));
+    ParallelOfstream::startArchiving(*archive, reconciliationsDir);
+  }
   PLLRootedTree speciesTree(speciesTreeFile);
   if (bestReconciliation) {
     std::vector<Scenario> scenarios;
@@ -275,7 +313,6 @@ void Routines::inferReconciliation(
       scenario.saveAllOrthoGroups(allOrthoGroupFile, false);
       scenario.saveReconciliation(treeWithEventsFileNewickEvents, 
           ReconciliationFormat::NewickEvents, false);
-      scenario.saveReconciliation(treeWithEventsFileNHX, ReconciliationFormat::NHX, false);
       scenario.saveTransfers(transfersFile, false);
     }
   }
@@ -286,7 +323,8 @@ void Routines::inferReconciliation(
         initialModelRates, 
         reconciliationSamples, 
         optimizeRates, 
-        scenarios);
+        scenarios,
+        threads);
     assert(scenarios.size() == geneTrees.getTrees().size() * reconciliationSamples);
     for (unsigned int i = 0; i  < geneTrees.getTrees().size(); ++i) {
       auto &tree = geneTrees.getTrees()[i];
@@ -303,6 +341,10 @@ void Routines::inferReconciliation(
       }
     }
   }
+  if (archive) {
+    ParallelOfstream::stopArchiving();
+    archive.reset();
+  }
   ParallelContext::barrier();
   {
     bool forceTransfers = false;
@@ -376,7 +418,7 @@ void Routines::computeSuperMatrixFromOrthoGroups(
         sequences,
         weights);
       GeneSpeciesMapping mapping;
-      mapping.fill(family.mappingFile, family.startingGeneTree);
+      Family::fillMapping(family, mapping);
       for (auto &sequence: sequences) {
         std::string geneLabel(sequence->label);
         if (orthoGroup->find(geneLabel) != orthoGroup->end()) {
@@ -445,8 +487,10 @@ void Routines::gatherLikelihoods(Families &families,
     totalRecLL += recLL;
     totalLibpllLL += libpllLL;
   }
-  ParallelContext::sumDouble(totalRecLL);
-  ParallelContext::sumDouble(totalLibpllLL);
+  std::vector<double> totalLL({totalRecLL, totalLibpllLL});
+  ParallelContext::sumVectorDouble(totalLL);
+  totalRecLL = totalLL[0];
+  totalLibpllLL = totalLL[1];
 }
   
 
@@ -462,25 +506,20 @@ void Routines::getLabelsFromTransferKey(const std::string &key, std::string &lab
 
 
 
-void Routines::getPerSpeciesEvents(const std::string &speciesTreeFile,
-  Families &families,
-  const ModelParameters &modelParameters,
-  unsigned int reconciliationSamples,
-  PerSpeciesEvents &events,
-  bool forceTransfers)
+/**
+ *  Return the model parameters used to infer the transfers:
+ *  if the current model does not account for transfers (and 
+ *  if forceTransfers is set), we use a model that does
+ */
+static ModelParameters getTransfersModelParameters(
+    const ModelParameters &modelParameters,
+    bool forceTransfers)
 {
-  PLLRootedTree speciesTree(speciesTreeFile);
-  events = PerSpeciesEvents(speciesTree.getNodesNumber());
-  std::vector<Scenario> scenarios;
-  bool optimizeRates = false;
-  PerCoreGeneTrees geneTrees(families);
   ModelParameters transfersModelParameter;
   if (Enums::accountsForTransfers(modelParameters.info.model)
       || !forceTransfers) {
     transfersModelParameter = modelParameters;
   } else {
-    // the current model does not account for transfers
-    // to infer transfers, we use a model that does
     Parameters transfersParameters(0.2, 0.2, 0.2);
     RecModelInfo recModelInfo = modelParameters.info;
     recModelInfo.model = RecModel::UndatedDTL;
@@ -490,55 +529,29 @@ void Routines::getPerSpeciesEvents(const std::string &speciesTreeFile,
         recModelInfo);
   }
   transfersModelParameter.info.rootedGeneTree = false;
-  inferAndGetReconciliationScenarios(
-    speciesTree,
-    geneTrees,
-    transfersModelParameter,
-    reconciliationSamples,
-    optimizeRates,
-    scenarios);
+  return transfersModelParameter;
+}
+
+static void fillPerSpeciesEvents(PLLRootedTree &speciesTree,
+    const std::vector<Scenario> &scenarios,
+    PerSpeciesEvents &events)
+{
+  events = PerSpeciesEvents(speciesTree.getNodesNumber());
   for (auto &scenario: scenarios) {
     scenario.gatherReconciliationStatistics(events);
   }
   ParallelContext::barrier();
   events.parallelSum();
 }
-  
 
-void Routines::getTransfersFrequencies(const std::string &speciesTreeFile,
-    Families &families,
-    const ModelParameters &modelParameters,
+static void fillTransferFrequencies(PLLRootedTree &speciesTree,
+    const PerCoreGeneTrees &geneTrees,
     unsigned int reconciliationSamples,
+    std::vector<Scenario> &scenarios,
     TransferFrequencies &transferFrequencies)
 {
-  const bool optimizeRates = false;
-  ModelParameters transfersModelParameter;
-  if (Enums::accountsForTransfers(modelParameters.info.model)) {
-    transfersModelParameter = modelParameters;
-  } else {
-    // the current model does not account for transfers
-    // to infer transfers, we use a model that does
-    Parameters transfersParameters(0.2, 0.2, 0.2);
-    RecModelInfo recModelInfo = modelParameters.info;
-    recModelInfo.model = RecModel::UndatedDTL;
-    recModelInfo.perFamilyRates = false;
-    transfersModelParameter = ModelParameters(transfersParameters,
-        1,
-        recModelInfo);
-  }
-  transfersModelParameter.info.rootedGeneTree = false;
-  SpeciesTree speciesTree(speciesTreeFile);
-  PerCoreGeneTrees geneTrees(families);
-  std::vector<Scenario> scenarios;
-  inferAndGetReconciliationScenarios(speciesTree.getTree(), 
-      geneTrees, 
-      transfersModelParameter,
-      reconciliationSamples,
-      optimizeRates, 
-      scenarios);
-  
-  const auto labelToId = speciesTree.getTree().getDeterministicLabelToId();
-  const auto idToLabel = speciesTree.getTree().getDeterministicIdToLabel();
+  const auto labelToId = speciesTree.getDeterministicLabelToId();
+  const auto idToLabel = speciesTree.getDeterministicIdToLabel();
   const unsigned int labelsNumber = idToLabel.size();
   const VectorUint zeros(labelsNumber, 0);
   transferFrequencies.count = MatrixUint(labelsNumber, zeros);
@@ -552,13 +565,82 @@ void Routines::getTransfersFrequencies(const std::string &speciesTreeFile,
           transferFrequencies.count);
     }
   }
-  for (unsigned int i = 0; i < labelsNumber; ++i) {
-    ParallelContext::sumVectorUInt(transferFrequencies.count[i]); 
-  }
+  ParallelContext::sumMatrixUInt(transferFrequencies.count); 
   ParallelContext::barrier();
   assert(ParallelContext::isRandConsistent());
 }
 
+void Routines::getPerSpeciesEvents(const std::string &speciesTreeFile,
+  Families &families,
+  const ModelParameters &modelParameters,
+  unsigned int reconciliationSamples,
+  PerSpeciesEvents &events,
+  bool forceTransfers)
+{
+  PLLRootedTree speciesTree(speciesTreeFile);
+  std::vector<Scenario> scenarios;
+  const bool optimizeRates = false;
+  PerCoreGeneTrees geneTrees(families);
+  inferAndGetReconciliationScenarios(
+    speciesTree,
+    geneTrees,
+    getTransfersModelParameters(modelParameters, forceTransfers),
+    reconciliationSamples,
+    optimizeRates,
+    scenarios);
+  fillPerSpeciesEvents(speciesTree, scenarios, events);
+}
+  
+
+void Routines::getTransfersFrequencies(const std::string &speciesTreeFile,
+    Families &families,
+    const ModelParameters &modelParameters,
+    unsigned int reconciliationSamples,
+    TransferFrequencies &transferFrequencies)
+{
+  const bool optimizeRates = false;
+  const bool forceTransfers = true;
+  SpeciesTree speciesTree(speciesTreeFile);
+  PerCoreGeneTrees geneTrees(families);
+  std::vector<Scenario> scenarios;
+  inferAndGetReconciliationScenarios(speciesTree.getTree(), 
+      geneTrees, 
+      getTransfersModelParameters(modelParameters, forceTransfers),
+      reconciliationSamples,
+      optimizeRates, 
+      scenarios);
+  fillTransferFrequencies(speciesTree.getTree(), 
+      geneTrees, 
+      reconciliationSamples, 
+      scenarios, 
+      transferFrequencies);
+}
+
+void Routines::getTransfersFrequenciesAndPerSpeciesEvents(
+    PLLRootedTree &speciesTree,
+    const PerCoreGeneTrees &geneTrees,
+    const ModelParameters &modelParameters,
+    unsigned int reconciliationSamples,
+    TransferFrequencies &transferFrequencies,
+    PerSpeciesEvents &events)
+{
+  const bool optimizeRates = false;
+  const bool forceTransfers = true;
+  std::vector<Scenario> scenarios;
+  inferAndGetReconciliationScenarios(speciesTree, 
+      geneTrees, 
+      getTransfersModelParameters(modelParameters, forceTransfers),
+      reconciliationSamples,
+      optimizeRates, 
+      scenarios);
+  fillTransferFrequencies(speciesTree, 
+      geneTrees, 
+      reconciliationSamples, 
+      scenarios, 
+      transferFrequencies);
+  fillPerSpeciesEvents(speciesTree, scenarios, events);
+}
+
 
 void Routines::buildEvaluations(PerCoreGeneTrees &geneTrees, 
     PLLRootedTree &speciesTree, 
@@ -576,6 +658,27 @@ void Routines::buildEvaluations(PerCoreGeneTrees &geneTrees,
   }
 }
 
+void Routines::measureFamilyCosts(const Families &families,
+    const PerCoreGeneTrees &geneTrees,
+    const Evaluations &evaluations,
+    FamilyCosts &costs)
+{
+  auto &trees = geneTrees.getTrees();
+  assert(trees.size() == evaluations.size());
+  std::vector<double> times(families.size(), 0.0);
+  for (unsigned int i = 0; i < trees.size(); ++i) {
+    times[trees[i].familyIndex] += evaluations[i]->getEvaluationTime();
+  }
+  // each family is evaluated by one rank only
+  ParallelContext::sumVectorDouble(times);
+  costs.clear();
+  for (unsigned int i = 0; i < families.size(); ++i) {
+    if (times[i] > 0.0) {
+      costs[families[i].name] = times[i];
+    }
+  }
+}
+
 
 void Routines::parseOrthoGroups(const std::string &familyName,
       OrthoGroups &orthoGroups)
@@ -25,10 +25,15 @@ public:
   Routines() = delete;
 
 
+  /**
+   *  @param threads number of threads per rank (only used by
+   *    the distance-based algorithms)
+   */
   static std::unique_ptr<PLLRootedTree> computeInitialSpeciesTree(
       Families &family,
       const std::string globalOutputDir,
-      SpeciesTreeAlgorithm algo);
+      SpeciesTreeAlgorithm algo,
+      unsigned int threads = 1);
 
   static std::unique_ptr<PLLRootedTree> computeSupportedCladeTree(
       Families &family,
@@ -75,7 +80,10 @@ public:
     bool inPlace = false); 
   /**
    * Optimize the DTL rates for the families families. 
-   * The result is stored into rates
+   * The result is stored into rates.
+   * If set, familyCosts is used to distribute the families 
+   * (see PerCoreGeneTrees), and is then replaced with the 
+   * evaluation costs measured during the optimization
    */
   static void optimizeRates(bool userDTLRates, 
     const std::string &speciesTreeFile,
@@ -83,7 +91,8 @@ public:
     Families &families,
     bool perSpeciesRates, 
     Parameters &rates,
-    long &sumElapsed);
+    long &sumElapsed,
+    FamilyCosts *familyCosts = nullptr);
 
   static void getPerSpeciesEvents(const std::string &speciesTreeFile,
     Families &families,
@@ -97,6 +106,20 @@ public:
     const ModelParameters &modelRates,
     unsigned int reconciliationSamples,
     TransferFrequencies &frequencies);
+
+  /**
+   *  Same as getTransfersFrequencies and getPerSpeciesEvents 
+   *  (with forceTransfers set), but from the already loaded 
+   *  species tree and gene trees, and with only one scenario 
+   *  inference per gene tree for both outputs
+   */
+  static void getTransfersFrequenciesAndPerSpeciesEvents(
+    PLLRootedTree &speciesTree,
+    const PerCoreGeneTrees &geneTrees,
+    const ModelParameters &modelRates,
+    unsigned int reconciliationSamples,
+    TransferFrequencies &frequencies,
+    PerSpeciesEvents &events);
   
   static void getLabelsFromTransferKey(const std::string &key, 
       std::string &label1, 
@@ -112,6 +135,9 @@ public:
    * Infer the reconciliation between the families gene trees and the 
    * species tree, and output them in different files.
    * In addition, perform a stochastich sample of the reconciliations
+   * If archiveOutput is set, the per-family files are written into 
+   * one archive per rank (see IO/FileArchive.hpp)
+   * If set, familyCosts is used to distribute the families
    */
   static void inferReconciliation(
     const std::string &speciesTreeFile,
@@ -120,12 +146,22 @@ public:
     const std::string &outputDir,
     bool bestReconciliation,
     unsigned int reconciliationSamples,
-    bool optimizeRates
+    bool optimizeRates,
+    bool archiveOutput = false,
+    unsigned int threads = 1,
+    const FamilyCosts *familyCosts = nullptr
     );
 
+  /**
+   * Path of the reconciliation archive of a rank
+   */
+  static std::string getReconciliationArchive(const std::string &outputDir,
+      unsigned int rank);
+
   /**
    * Infer the reconciliation scenarios between the families gene trees 
-   * and the species tree. 
+   * and the species tree. The samples of a family are drawn with 
+   * threads threads, and do not depend on the number of threads.
    */
   static void inferAndGetReconciliationScenarios(
     PLLRootedTree &speciesTree,
@@ -133,7 +169,8 @@ public:
     const ModelParameters &initialModelRates,
     unsigned int reconciliationSamples, // 0 for ML
     bool optimizeRates,
-    std::vector<Scenario> &scenarios);
+    std::vector<Scenario> &scenarios,
+    unsigned int threads = 1);
  
   /**
    *  todobenoit
@@ -167,6 +204,17 @@ public:
     const RecModelInfo &recModelInfo,
     Evaluations &evaluations);
 
+  /**
+   * Replace costs with the time spent evaluating each family 
+   * (summed over the trees of the family and over all ranks).
+   * evaluations[i] must be the evaluation of geneTrees.getTrees()[i].
+   * Must be called by all ranks.
+   */
+  static void measureFamilyCosts(const Families &families,
+    const PerCoreGeneTrees &geneTrees,
+    const Evaluations &evaluations,
+    FamilyCosts &costs);
+
 
 private:
   static void parseOrthoGroups(const std::string &familyName,
@@ -8,19 +8,23 @@ void SavedBranch::restore() {
 
 void SPRRollback::applyRollback() {
   assert(PLL_SUCCESS == pllmod_tree_rollback(&rollback_));
+  // restore the reconciliation CLVs of the tree before the move 
+  // instead of recomputing them, when the model supports it
+  bool reconciliation = 
+    !tree_.getReconciliationEvaluation().rollbackToLastState();
   for (auto &b: branches_) {
     b.restore();
-    tree_.invalidateCLV(b.getNode());
-    tree_.invalidateCLV(b.getNode()->back);
+    tree_.invalidateCLV(b.getNode(), reconciliation);
+    tree_.invalidateCLV(b.getNode()->back, reconciliation);
   }
   auto prune = static_cast<pll_unode_s *>(rollback_.SPR.prune_edge);
   auto regraft = static_cast<pll_unode_s*>(rollback_.SPR.regraft_edge);
-  tree_.invalidateCLV(prune->next->back);
-  tree_.invalidateCLV(prune->next->next);
-  tree_.invalidateCLV(prune->next);
-  tree_.invalidateCLV(prune->next->next->back);
-  tree_.invalidateCLV(regraft);
-  tree_.invalidateCLV(regraft->back);
+  tree_.invalidateCLV(prune->next->back, reconciliation);
+  tree_.invalidateCLV(prune->next->next, reconciliation);
+  tree_.invalidateCLV(prune->next, reconciliation);
+  tree_.invalidateCLV(prune->next->next->back, reconciliation);
+  tree_.invalidateCLV(regraft, reconciliation);
+  tree_.invalidateCLV(regraft->back, reconciliation);
   tree_.setRoot(root_);
 }
 
@@ -62,13 +62,12 @@ void ICCalculator::_readTrees()
   for (auto speciesLabel: _referenceTree.getLabels()) {
     auto spid = static_cast<SPID>(speciesLabelToSpid.size());
     speciesLabelToSpid[speciesLabel] = spid;
-    _allSPID.insert(spid);
     _spidToString.push_back(speciesLabel);
   }
   for (auto &leaf: _referenceTree.getLeaves()) {
     leaf->clv_index = speciesLabelToSpid[std::string(leaf->label)]; 
   }
-  _taxaNumber = _allSPID.size();
+  _taxaNumber = speciesLabelToSpid.size();
   for (auto &geneTreeDesc: _perCoreGeneTrees.getTrees()) {
     auto &mappings = geneTreeDesc.mapping;
     auto evaluationTree = geneTreeDesc.geneTree;
@@ -81,30 +80,37 @@ void ICCalculator::_readTrees()
   }
 }
 
-void fillWithChildren(pll_unode_t *node, TaxaSet &set)
-{
-  if (!node->next) {
-    set.insert(node->clv_index);
-  } else {
-    fillWithChildren(node->next->back, set);
-    fillWithChildren(node->next->next->back, set);
-  }
-}
-
-static unsigned int intersectionSize(const TaxaSet &s1, const TaxaSet &s2)
+/**
+ *  Fill clades with the species under each directed node
+ *  of tree, computed in postorder from the children clades
+ */
+static void computeClades(PLLUnrootedTree &tree,
+    unsigned int taxaNumber,
+    std::vector<TaxaSet> &clades)
 {
-  if (s1.size() > s2.size()) {
-    return intersectionSize(s2, s1);
-  }
-  unsigned int res = 0;
-  for (auto element: s1) {
-    if (s2.find(element) != s2.end()) {
-      res++;
+  clades.assign(tree.getDirectedNodesNumber(), TaxaSet(taxaNumber));
+  for (auto node: tree.getPostOrderNodes()) {
+    auto &clade = clades[node->node_index];
+    if (!node->next) {
+      clade.insert(node->clv_index);
+    } else {
+      clade.unionWith(clades[node->next->back->node_index]);
+      clade.unionWith(clades[node->next->next->back->node_index]);
     }
   }
-  return res;
 }
 
+/**
+ *  Directed species node, with the indices of its children
+ */
+struct SpeciesCladeNode {
+  unsigned int spid;
+  unsigned int left;
+  unsigned int right;
+  bool isLeaf;
+  SPID taxon;
+};
+
 void ICCalculator::_computeIntersections()
 {
   auto speciesNodeCount = _referenceTree.getDirectedNodesNumber();
@@ -119,13 +125,31 @@ void ICCalculator::_computeIntersections()
       geneCounts = speciesZeros;
     }
   }
-  std::vector<TaxaSet> speciesSets(speciesNodeCount);
-  _speciesSubtreeSizes.resize(_referenceTree.getDirectedNodesNumber());
+  // The clade of an internal species node is the disjoint union
+  // of the clades of its children: in postorder, the intersection
+  // size of a gene clade with a species clade is the sum of its 
+  // intersection sizes with the children clades (see Astral III)
+  std::vector<SpeciesCladeNode> speciesNodes;
+  _speciesSubtreeSizes.resize(speciesNodeCount);
   for (auto speciesNode: _referenceTree.getPostOrderNodes()) {
-    auto spid = speciesNode->node_index;
-    fillWithChildren(speciesNode, speciesSets[spid]);
-    _speciesSubtreeSizes[spid] = speciesSets[spid].size();
+    SpeciesCladeNode node;
+    node.spid = speciesNode->node_index;
+    node.isLeaf = !speciesNode->next;
+    if (node.isLeaf) {
+      node.left = node.right = 0;
+      node.taxon = speciesNode->clv_index;
+      _speciesSubtreeSizes[node.spid] = 1;
+    } else {
+      node.left = speciesNode->next->back->node_index;
+      node.right = speciesNode->next->next->back->node_index;
+      node.taxon = 0;
+      _speciesSubtreeSizes[node.spid] = _speciesSubtreeSizes[node.left] 
+        + _speciesSubtreeSizes[node.right];
+    }
+    speciesNodes.push_back(node);
   }
+  std::vector<TaxaSet> geneClades;
+  TaxaSet upTraversalSet(_taxaNumber);
   for (unsigned int famid = 0; famid < _evaluationTrees.size(); ++famid) {
     auto &geneTree = _evaluationTrees[famid];
     
@@ -133,21 +157,25 @@ void ICCalculator::_computeIntersections()
     if (_paralogy) {
       tagger = std::make_unique<DSTagger>(*geneTree);
     }
+    computeClades(*geneTree, _taxaNumber, geneClades);
     for (auto geneNode: geneTree->getPostOrderNodes()) {
       auto geneid = geneNode->node_index;
       if (_paralogy && tagger->isDuplication(geneid))  {
         continue;
       }
-      // TODO: this could be more efficient (see Astral III paper)
-      TaxaSet geneSet;
+      const TaxaSet *geneSet = &geneClades[geneNode->back->node_index];
       if (_paralogy && tagger->goesUp(geneNode)) {
-        tagger->fillUpTraversal(geneNode, geneSet);
-      } else {
-        fillWithChildren(geneNode->back, geneSet);
+        upTraversalSet.clear();
+        tagger->fillUpTraversal(geneNode, upTraversalSet);
+        geneSet = &upTraversalSet;
       }
-      for (unsigned int spid = 0; spid < speciesNodeCount; ++spid) { 
-        auto interSize = intersectionSize(speciesSets[spid], geneSet);
-        _interCounts[famid][geneid][spid] = interSize;
+      auto &counts = _interCounts[famid][geneid];
+      for (auto &node: speciesNodes) {
+        if (node.isLeaf) {
+          counts[node.spid] = geneSet->contains(node.taxon) ? 1 : 0;
+        } else {
+          counts[node.spid] = counts[node.left] + counts[node.right];
+        }
       }
     }
   }
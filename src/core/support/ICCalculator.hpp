@@ -59,7 +59,6 @@ private:
   PLLUnrootedTree _referenceTree;
   pll_unode_t *_referenceRoot;
   PerCoreGeneTrees _perCoreGeneTrees;
-  TaxaSet _allSPID;
   std::vector<unsigned int> _speciesSubtreeSizes;
   unsigned int _taxaNumber;
   std::vector<unsigned int> _refNodeIndexToBranchIndex;
@@ -206,6 +206,7 @@ pll_unode_t *JointTree::getNode(unsigned int index) {
 
 
 void JointTree::applyMove(Move &move) {
+  reconciliationEvaluation_->saveState();
   _rollbacks.push(std::move(move.applyMove(*this)));
 }
 
@@ -243,9 +244,11 @@ pllmod_treeinfo_t * JointTree::getTreeInfo() {
 }
 
 
-void JointTree::invalidateCLV(pll_unode_s *node)
+void JointTree::invalidateCLV(pll_unode_s *node, bool reconciliation)
 {
-  reconciliationEvaluation_->invalidateCLV(node->node_index);
+  if (reconciliation) {
+    reconciliationEvaluation_->invalidateCLV(node->node_index);
+  }
   _libpllEvaluation.invalidateCLV(node->node_index);
 }
 
@@ -47,7 +47,11 @@ public:
     void applyMove(Move &move);
     void optimizeMove(Move &move);
   
-    void invalidateCLV(pll_unode_s *node);
+    /**
+     *  Invalidate the libpll and (if reconciliation is set) the
+     *  reconciliation CLVs of node
+     */
+    void invalidateCLV(pll_unode_s *node, bool reconciliation = true);
     void printAllNodes(std::ostream &os);
     void printInfo();
     void rollbackLastMove();
@@ -4,6 +4,7 @@
 #include <IO/Logger.hpp>
 #include <set>
 #include <cstring>
+#include <algorithm>
 #include <maths/Random.hpp>
 
 
@@ -264,124 +265,160 @@ std::vector<pll_rnode_t*> PLLRootedTree::getPostOrderNodes() const
   return nodes;
 }
   
-void PLLRootedTree::onSpeciesTreeChange(const std::unordered_set<pll_rnode_t *> *)
-{
-  if (_lcaCache) {
-    buildLCACache();
-  }
-}
-  
-pll_rnode_t *PLLRootedTree::getLCA(pll_rnode_t *n1, pll_rnode_t *n2)
+void PLLRootedTree::onSpeciesTreeChange(const std::unordered_set<pll_rnode_t *> *nodesToInvalidate)
 {
   if (!_lcaCache) {
+    return;
+  }
+  if (!nodesToInvalidate || !updateLCACache(*nodesToInvalidate)) {
     buildLCACache();
   }
-  return _lcaCache->lcas[n1->node_index][n2->node_index];
 }
-  
-bool PLLRootedTree::areParents(pll_rnode_t *n1, pll_rnode_t *n2)
+
+static unsigned int getSubtreeSize(pll_rnode_t *node)
 {
-  if (!_lcaCache) {
-    buildLCACache();
+  if (!node->left) {
+    return 1;
   }
-  return _lcaCache->parents[n1->node_index][n2->node_index];
+  return 1 + getSubtreeSize(node->left) + getSubtreeSize(node->right);
 }
 
-std::vector<bool> &PLLRootedTree::getParentsCache(pll_rnode_t *n1)
+/**
+ *  The nodes whose children changed (the nodes to invalidate)
+ *  all belong to the subtree of their LCA in the new tree, 
+ *  and the set of nodes under this LCA did not change.
+ *  Thus, its interval in the Euler tour keeps the same 
+ *  position and size, and only this interval needs to 
+ *  be recomputed.
+ */
+bool PLLRootedTree::updateLCACache(const std::unordered_set<pll_rnode_t *> &nodesToInvalidate)
 {
-  if (!_lcaCache) {
-    buildLCACache();
+  auto &cache = *_lcaCache;
+  if (nodesToInvalidate.empty() || 
+      cache.eulerTour[0] != getRoot()->node_index) {
+    // the root changed: all depths might have changed
+    return false;
+  }
+  // compute the lca of the invalidated nodes in the new tree
+  pll_rnode_t *lca = nullptr;
+  std::vector<bool> isLCAAncestor(getNodesNumber(), false);
+  for (auto node: nodesToInvalidate) {
+    if (!lca) {
+      lca = node;
+    } else {
+      std::fill(isLCAAncestor.begin(), isLCAAncestor.end(), false);
+      for (auto it = lca; it; it = it->parent) {
+        isLCAAncestor[it->node_index] = true;
+      }
+      while (!isLCAAncestor[node->node_index]) {
+        node = node->parent;
+      }
+      lca = node;
+    }
   }
-  return _lcaCache->parents[n1->node_index];
+  auto e = lca->node_index;
+  auto begin = cache.first[e];
+  auto end = cache.last[e] + 1;
+  if (end - begin != 2 * getSubtreeSize(lca) - 1) {
+    return false;
+  }
+  auto position = begin;
+  fillEulerTour(lca, cache.depths[e], position);
+  assert(position == end);
+  fillSparseTable(begin, end);
+  return true;
 }
-
-std::vector<bool> &PLLRootedTree::getAncestorssCache(pll_rnode_t *n1)
+  
+pll_rnode_t *PLLRootedTree::getLCA(pll_rnode_t *n1, pll_rnode_t *n2)
 {
   if (!_lcaCache) {
     buildLCACache();
   }
-  return _lcaCache->ancestors[n1->node_index];
+  auto &cache = *_lcaCache;
+  auto begin = cache.first[n1->node_index];
+  auto end = cache.first[n2->node_index];
+  if (begin > end) {
+    std::swap(begin, end);
+  }
+  // the two (possibly overlapping) intervals of size 2^k 
+  // cover [begin, end]
+  auto k = cache.logs[end - begin + 1];
+  auto candidate1 = cache.sparseTable[k][begin];
+  auto candidate2 = cache.sparseTable[k][end + 1 - (1u << k)];
+  if (cache.depths[candidate1] <= cache.depths[candidate2]) {
+    return getNode(candidate1);
+  } else {
+    return getNode(candidate2);
+  }
 }
   
-static void fillWithChildren(pll_rnode_t *n1,
-    pll_rnode_t *n2,
-    std::vector<pll_rnode_t *> &n1lcas)
-{
-  if (!n2) {
-    return;
+void PLLRootedTree::fillEulerTour(pll_rnode_t *node, 
+    unsigned int depth, 
+    unsigned int &position)
+{
+  auto &cache = *_lcaCache;
+  auto e = node->node_index;
+  cache.depths[e] = depth;
+  cache.first[e] = position;
+  cache.eulerTour[position++] = e;
+  if (node->left) {
+    fillEulerTour(node->left, depth + 1, position);
+    cache.eulerTour[position++] = e;
+    fillEulerTour(node->right, depth + 1, position);
+    cache.eulerTour[position++] = e;
   }
-  n1lcas[n2->node_index] = n1;
-  fillWithChildren(n1, n2->left, n1lcas);
-  fillWithChildren(n1, n2->right, n1lcas);
+  cache.last[e] = position - 1;
 }
 
 /**
- * Recursion that starts with n2 == root and lca == root
- * traverse all nodes from the root to the leaves with n2
- * to fill n1 LCAs
+ *  Recompute all the entries of the sparse table
+ *  that depend on the Euler tour interval [begin, end[
  */
-static void findn1LCAs(pll_rnode_t *n1,
-    pll_rnode_t *n2,
-    pll_rnode_t *lca,
-    const std::unordered_set<pll_rnode_t*> &n1Ancestors,
-    std::vector<pll_rnode_t *> &n1lcas)
-{
-  if (!n2) {
-    // end of the recursion
-    return;
-  }
-  if (n1 == n2) {
-    // edge case: from now, the lca of n1 and all children of n2
-    // is n1.
-    fillWithChildren(n1, n2, n1lcas);
-  } else {
-    if (n1Ancestors.find(n2) != n1Ancestors.end()) {
-      // n2 is an ancestor of n1, and thus the new lca
-      // in the recursion
-      lca = n2;
+void PLLRootedTree::fillSparseTable(unsigned int begin, unsigned int end)
+{
+  auto &cache = *_lcaCache;
+  auto &table = cache.sparseTable;
+  std::copy(cache.eulerTour.begin() + begin, 
+      cache.eulerTour.begin() + end, 
+      table[0].begin() + begin);
+  for (unsigned int k = 1; k < table.size(); ++k) {
+    unsigned int width = 1u << k;
+    unsigned int half = width / 2;
+    auto &previous = table[k - 1];
+    auto &current = table[k];
+    // intervals [i, i + width[ that intersect [begin, end[
+    unsigned int from = (begin + 1 > width) ? begin + 1 - width : 0;
+    unsigned int to = std::min(end, static_cast<unsigned int>(current.size()));
+    for (unsigned int i = from; i < to; ++i) {
+      auto n1 = previous[i];
+      auto n2 = previous[i + half];
+      current[i] = (cache.depths[n1] <= cache.depths[n2]) ? n1 : n2;
     }
-    n1lcas[n2->node_index] = lca;
-    findn1LCAs(n1, n2->left, lca, n1Ancestors, n1lcas);
-    findn1LCAs(n1, n2->right, lca, n1Ancestors, n1lcas);
-  }
-}
-
-
-static void findLCAs(pll_rnode_t *n1, std::vector<pll_rnode_t *> &n1lcas)
-{
-  std::unordered_set<pll_rnode_t *> n1Ancestors;
-  auto it = n1;
-  auto root = n1;
-  while (it) {
-    n1Ancestors.insert(it);
-    root = it;
-    it = it->parent;
   }
-  findn1LCAs(n1, root, root, n1Ancestors, n1lcas);
 }
 
 void PLLRootedTree::buildLCACache()
 {
   auto N = getNodesNumber();
+  auto tourSize = 2 * N - 1;
   _lcaCache = std::make_unique<LCACache>();
-  std::vector<pll_rnode_t *> nulls(N, nullptr);
-  _lcaCache->lcas = std::vector<std::vector<pll_rnode_t *> >(N, nulls);
-  std::vector<bool> falses(N, false);
-  _lcaCache->parents = std::vector<std::vector<bool > >(N, falses);
-  _lcaCache->ancestors = std::vector<std::vector<bool > >(N, falses);
-  for (auto n: getNodes()) {
-    findLCAs(n, _lcaCache->lcas[n->node_index]);
+  auto &cache = *_lcaCache;
+  cache.eulerTour.resize(tourSize);
+  cache.depths.resize(N);
+  cache.first.resize(N);
+  cache.last.resize(N);
+  cache.logs = std::vector<unsigned int>(tourSize + 1, 0);
+  for (unsigned int i = 2; i <= tourSize; ++i) {
+    cache.logs[i] = cache.logs[i / 2] + 1;
   }
-  for (auto n1: getNodes()) {
-    auto n2 = n1;
-    while (n2) {
-      _lcaCache->parents[n1->node_index][n2->node_index] = true;
-      _lcaCache->parents[n2->node_index][n1->node_index] = true;
-      _lcaCache->ancestors[n1->node_index][n2->node_index] = true;
-      n2 = n2->parent;
-    }
+  for (unsigned int k = 0; (1u << k) <= tourSize; ++k) {
+    cache.sparseTable.push_back(
+        std::vector<unsigned int>(tourSize + 1 - (1u << k)));
   }
-
+  unsigned int position = 0;
+  fillEulerTour(getRoot(), 0, position);
+  assert(position == tourSize);
+  fillSparseTable(0, tourSize);
 }
 
 StringToUint PLLRootedTree::getDeterministicLabelToId() const
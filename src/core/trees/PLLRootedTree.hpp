@@ -113,24 +113,56 @@ public:
 
   /**
    * Get lowest common ancestor
-   * First call is O(n^2), and all next calls O(1)
+   * First call is O(nlog(n)), and all next calls O(1)
    */
   pll_rnode_t *getLCA(pll_rnode_t *n1, pll_rnode_t *n2);
 
+  /**
+   * Return true if ancestor is an ancestor of node
+   * (or node itself)
+   * First call is O(nlog(n)), and all next calls O(1)
+   */
+  bool isAncestor(pll_rnode_t *node, pll_rnode_t *ancestor)
+  {
+    if (!_lcaCache) {
+      buildLCACache();
+    }
+    auto n = node->node_index;
+    auto a = ancestor->node_index;
+    return _lcaCache->first[a] <= _lcaCache->first[n] 
+      && _lcaCache->last[n] <= _lcaCache->last[a];
+  }
+
   /**
    * Return true if either one of n1 or n2 is parent of another
-   * First call is O(n^2), and all next calls O(1)
+   * First call is O(nlog(n)), and all next calls O(1)
    */
-  bool areParents(pll_rnode_t *n1, pll_rnode_t *n2);
+  bool areParents(pll_rnode_t *n1, pll_rnode_t *n2)
+  {
+    return isAncestor(n1, n2) || isAncestor(n2, n1);
+  }
 
+  /**
+   *  Update the LCA cache after a topological change.
+   *  nodesToInvalidate should contain all the nodes whose
+   *  children changed. If it is null, or if the root 
+   *  changed, the cache is rebuilt from scratch.
+   */
   void onSpeciesTreeChange(const std::unordered_set<pll_rnode_t *> *nodesToInvalidate);
   
-  
-  std::vector<bool> &getParentsCache(pll_rnode_t *n1);
-  std::vector<bool> &getAncestorssCache(pll_rnode_t *n1);
-  
   void buildLCACache();
 
+  /**
+   *  Build the LCA cache if it does not exist yet. Must be
+   *  called before querying LCAs from several threads
+   */
+  void ensureLCACache()
+  {
+    if (!_lcaCache) {
+      buildLCACache();
+    }
+  }
+
   /**
    *  Compute and return a mapping between labels and 
    *  unique IDs, such that the mapping does
@@ -150,17 +182,32 @@ public:
 private:
   std::unique_ptr<pll_rtree_t, void(*)(pll_rtree_t*)> _tree;
   
+  /**
+   *  LCA queries are answered with a range minimum query
+   *  over the Euler tour of the tree, using a sparse table
+   */
   struct LCACache {
-    // vectors are indexed with rnodes indices
-    // lcas[n1][n2] == lca(n1, n2) in the tree
-    // parents[n1][n2] is true if n2 is an ancestor
-    //   of n1 or n1 an ancestor of n2
-    // ancestors[n1][n2] is true if n2 is ancestor of n1
-    std::vector<std::vector<pll_rnode_t *> > lcas;
-    std::vector<std::vector<bool> > parents;
-    std::vector<std::vector<bool> > ancestors;
+    // node indices in the order of the Euler tour 
+    std::vector<unsigned int> eulerTour;
+    // the following vectors are indexed with rnodes indices
+    // depths[n] is the distance (in nodes) from the root to n
+    std::vector<unsigned int> depths;
+    // first[n] and last[n] are the positions of the first and
+    // last occurences of n in the Euler tour. n2 is an ancestor
+    // of n1 if [first[n1], last[n1]] is included in 
+    // [first[n2], last[n2]]
+    std::vector<unsigned int> first;
+    std::vector<unsigned int> last;
+    // sparseTable[k][i] is the node with the smallest depth
+    // in the Euler tour interval [i, i + 2^k[
+    std::vector<std::vector<unsigned int> > sparseTable;
+    // logs[i] is floor(log2(i))
+    std::vector<unsigned int> logs;
   };
   std::unique_ptr<LCACache> _lcaCache;
+  void fillEulerTour(pll_rnode_t *node, unsigned int depth, unsigned int &position);
+  void fillSparseTable(unsigned int begin, unsigned int end);
+  bool updateLCACache(const std::unordered_set<pll_rnode_t *> &nodesToInvalidate);
   
   
   static pll_rtree_t *buildRandomTree(const std::unordered_set<std::string> &leafLabels);
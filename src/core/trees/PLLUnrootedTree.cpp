@@ -3,6 +3,7 @@
 #include <IO/LibpllParsers.hpp>
 #include <IO/Logger.hpp>
 #include <trees/PLLRootedTree.hpp>  
+#include <algorithm>
 #include <stack>
 #include <functional>
 #include <sstream>
@@ -50,6 +51,11 @@ PLLUnrootedTree::PLLUnrootedTree(PLLRootedTree &rootedTree):
   pll_utree_reset_template_indices(root, _tree->tip_count);
 }
   
+PLLUnrootedTree::PLLUnrootedTree(pll_utree_t *utree):
+  _tree(utree, utreeDestroy)
+{
+}
+
 std::unique_ptr<PLLUnrootedTree> PLLUnrootedTree::buildFromStrOrFile(const std::string &strOrFile)
 {
   std::unique_ptr<PLLUnrootedTree> res;
@@ -224,7 +230,7 @@ std::vector<pll_unode_t*> PLLUnrootedTree::getPostOrderNodes(bool innerOnly)
 
 static void computePairwiseDistancesRec(pll_unode_t *currentNode, 
     double currentDistance,
-    VectorDouble &distancesVector)
+    double *distancesVector)
 {
   currentDistance += currentNode->length;
   if (!currentNode->next) {
@@ -246,11 +252,10 @@ void PLLUnrootedTree::computePairwiseDistances(MatrixDouble &distances,
   auto M = leavesOnly ? getLeavesNumber() : getDirectedNodesNumber(); 
   auto N = getLeavesNumber();
   auto MIter = leavesOnly ? getLeavesNumber() : getNodesNumber();
-  VectorDouble zeros(N, 0.0);
-  distances = MatrixDouble(M, zeros);
+  distances = MatrixDouble(M, N, 0.0);
   for (unsigned int i = 0; i < MIter; ++i) {
     auto node = getNode(i);
-    auto &distancesVector = distances[node->node_index];
+    auto distancesVector = distances[node->node_index];
     computePairwiseDistancesRec(node->back, 0.0, distancesVector);
     if (node->next) {
       // compute distances to leaves in all three directions
@@ -261,8 +266,10 @@ void PLLUnrootedTree::computePairwiseDistances(MatrixDouble &distances,
           0.0, 
           distancesVector);
       // also update the two other directed nodes
-      distances[node->next->node_index] = distancesVector;
-      distances[node->next->next->node_index] = distancesVector;
+      std::copy(distancesVector, distancesVector + N, 
+          distances[node->next->node_index]);
+      std::copy(distancesVector, distancesVector + N, 
+          distances[node->next->next->node_index]);
     }
   }
 }
@@ -363,38 +370,64 @@ void PLLUnrootedTree::orientTowardEachOther(pll_unode_t **pu,
 
 
 
+/**
+ *  Append the distances from the node to the leaves under
+ *  the directed node
+ */
+static void fillLeafDistances(pll_unode_t *node, 
+    double currentDistance,
+    std::vector<double> &leafDistances)
+{
+  if (!node->next) {
+    leafDistances.push_back(currentDistance);
+    return;
+  }
+  fillLeafDistances(node->next->back, 
+      currentDistance + node->next->length, 
+      leafDistances);
+  fillLeafDistances(node->next->next->back, 
+      currentDistance + node->next->next->length, 
+      leafDistances);
+}
+
 std::vector<double> PLLUnrootedTree::getMADRelativeDeviations()
 {
-  MatrixDouble distances;
-  computePairwiseDistances(distances, false);
   auto nodes = getPostOrderNodes();  
   std::vector<double> deviations(nodes.size());
-  for (auto node: getPostOrderNodes()) {
-    // we reuse notations from the MAD paper (I, J, i, j, rho, b, c)
-    // I and J are the set of leaves of each side of the branch node
-    // rho is the relative position of the rooting that minimizes 
-    // the squared relative deviation
-    auto I = getClade(node); 
-    auto J = getClade(node->back);
+  // we reuse notations from the MAD paper (I, J, i, j, rho, b, c)
+  // I and J are the set of leaves of each side of the branch node
+  // rho is the relative position of the rooting that minimizes 
+  // the squared relative deviation
+  // The distance between b and c is the sum of the distances 
+  // b-i, i-j and j-c: we only store the distances from i to
+  // the leaves of I and from j to the leaves of J, instead of
+  // the distances between all the nodes and all the leaves.
+  std::vector<double> distancesI;
+  std::vector<double> distancesJ;
+  for (auto node: nodes) {
+    distancesI.clear();
+    distancesJ.clear();
+    fillLeafDistances(node, 0.0, distancesI);
+    fillLeafDistances(node->back, 0.0, distancesJ);
     auto rho = 0.0;
     auto rhoDen = 0.0;
-    auto i = node->node_index;
     auto Dij = node->length;
-    for (auto b: I) {
-      for (auto c: J) {
-        auto invPowBC = pow(distances[b][c], -2.0);
-        rho += (distances[b][c] - 2.0 * distances[i][b]) * invPowBC;
+    for (auto Dib: distancesI) {
+      for (auto Djc: distancesJ) {
+        auto Dbc = Dib + Dij + Djc;
+        auto invPowBC = 1.0 / (Dbc * Dbc);
+        rho += (Dbc - 2.0 * Dib) * invPowBC;
         rhoDen += invPowBC;
       }
     }
     rho = rho / (2.0 * Dij * rhoDen);
     rho = std::max(std::min(rho, 1.0), 0.0);
     auto deviation = 0.0;
-    for (auto b: I) {
-      for (auto c: J) {
-        auto v = (2.0 * (distances[i][b] + rho * Dij) / distances[b][c]);
-        v -= 1.0;
-        deviation += pow(v, 2.0);
+    for (auto Dib: distancesI) {
+      for (auto Djc: distancesJ) {
+        auto Dbc = Dib + Dij + Djc;
+        auto v = (2.0 * (Dib + rho * Dij) / Dbc) - 1.0;
+        deviation += v * v;
       }
     }
     deviations[node->node_index] = deviation;
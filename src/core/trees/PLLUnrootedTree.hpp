@@ -44,6 +44,11 @@ public:
 
   PLLUnrootedTree(PLLRootedTree &rootedTree);
 
+  /**
+   *  Take ownership of an already parsed libpll tree
+   */
+  explicit PLLUnrootedTree(pll_utree_t *utree);
+
   static std::unique_ptr<PLLUnrootedTree> buildFromStrOrFile(const std::string &strOrFile);
 
   /**
@@ -172,7 +177,14 @@ public:
    */
    pll_unode_t *getVirtualRoot(PLLRootedTree &referenceTree);
 
-  // TODO: DOCUMENT
+  /**
+   *  Compute, for each directed node, the sum of the squared
+   *  relative deviations of the MAD (minimal ancestor deviation)
+   *  rooting on its branch, indexed by node_index.
+   *  Runs in O(sum over the branches of |I| * |J|) time, where I
+   *  and J are the leaf sets on each side of the branch, and in
+   *  O(leaves) memory.
+   */
   std::vector<double> getMADRelativeDeviations();
 
   /**
@@ -328,9 +328,7 @@ std::unordered_set<std::string> SpeciesTree::getLabelsFromFamilies(const Familie
 {
   GeneSpeciesMapping mappings;
   for (const auto &family: families) {
-    std::string geneTreeStr;
-    FileSystem::getFileContent(family.startingGeneTree, geneTreeStr);
-    mappings.fill(family.mappingFile, geneTreeStr);
+    Family::fillMapping(family, mappings);
   }
   std::unordered_set<std::string> leaves;
   for (auto &mapping: mappings.getMap()) {
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+/**
+ *  Dense rows x columns matrix, stored in one contiguous
+ *  row-major buffer.
+ *
+ *  m[i] returns a pointer to the row i, such that m[i][j] reads
+ *  like with a vector of rows, but a copy only costs one
+ *  allocation, rows can be processed with plain (vectorizable)
+ *  loops, and the whole matrix can be sent to MPI at once with
+ *  data() and entries().
+ */
+template <typename T>
+class Matrix {
+public:
+  Matrix(): _rows(0), _columns(0) {}
+
+  Matrix(size_t rows, size_t columns, T value = T()):
+    _rows(rows),
+    _columns(columns),
+    _data(rows * columns, value)
+  {}
+
+  /**
+   *  Number of rows, as for a vector of rows
+   */
+  size_t size() const {return _rows;}
+  size_t rows() const {return _rows;}
+  size_t columns() const {return _columns;}
+
+  /**
+   *  Total number of entries (rows * columns)
+   */
+  size_t entries() const {return _data.size();}
+
+  T *operator[](size_t row) {return _data.data() + row * _columns;}
+  const T *operator[](size_t row) const {
+    return _data.data() + row * _columns;
+  }
+
+  T *data() {return _data.data();}
+  const T *data() const {return _data.data();}
+
+  void fill(T value) {
+    std::fill(_data.begin(), _data.end(), value);
+  }
+
+  /**
+   *  Entry-wise sum with a matrix of the same dimensions
+   */
+  Matrix &operator+=(const Matrix &other) {
+    assert(_rows == other._rows && _columns == other._columns);
+    T *dest = _data.data();
+    const T *source = other._data.data();
+    for (size_t i = 0; i < _data.size(); ++i) {
+      dest[i] += source[i];
+    }
+    return *this;
+  }
+
+  /**
+   *  Free the memory
+   */
+  void clear() {
+    _rows = _columns = 0;
+    std::vector<T>().swap(_data);
+  }
+
+private:
+  size_t _rows;
+  size_t _columns;
+  std::vector<T> _data;
+};
+
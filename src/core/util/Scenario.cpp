@@ -12,14 +12,29 @@ const char *Scenario::eventNames[]  = {"S", "SL", "D", "T", "TL", "L", "Leaf", "
   
 void PerSpeciesEvents::parallelSum() 
 {
+  // pack all the counts to sum them at once
+  const unsigned int countsNumber = 6;
+  std::vector<unsigned int> counts;
+  counts.reserve(events.size() * countsNumber);
   for (auto &speciesEvents: events) 
   {
-    ParallelContext::sumUInt(speciesEvents.LeafCount);
-    ParallelContext::sumUInt(speciesEvents.DCount);
-    ParallelContext::sumUInt(speciesEvents.SCount);
-    ParallelContext::sumUInt(speciesEvents.SLCount);
-    ParallelContext::sumUInt(speciesEvents.TCount);
-    ParallelContext::sumUInt(speciesEvents.TLCount);
+    counts.push_back(speciesEvents.LeafCount);
+    counts.push_back(speciesEvents.DCount);
+    counts.push_back(speciesEvents.SCount);
+    counts.push_back(speciesEvents.SLCount);
+    counts.push_back(speciesEvents.TCount);
+    counts.push_back(speciesEvents.TLCount);
+  }
+  ParallelContext::sumVectorUInt(counts);
+  auto it = counts.begin();
+  for (auto &speciesEvents: events) 
+  {
+    speciesEvents.LeafCount = *it++;
+    speciesEvents.DCount = *it++;
+    speciesEvents.SCount = *it++;
+    speciesEvents.SLCount = *it++;
+    speciesEvents.TCount = *it++;
+    speciesEvents.TLCount = *it++;
   }
 }
 
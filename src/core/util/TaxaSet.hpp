@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+using SPID = unsigned int;
+
+/**
+ *  Dense set of species ids (SPID), stored as a bitset.
+ *  The ids must be smaller than the maximum number of taxa
+ *  given to the constructor.
+ */
+class TaxaSet {
+public:
+  TaxaSet() {}
+
+  explicit TaxaSet(unsigned int maxTaxa):
+    _words((maxTaxa + WORD_BITS - 1) / WORD_BITS, 0)
+  {}
+
+  void insert(SPID spid) {
+    _words[spid / WORD_BITS] |= (Word(1) << (spid % WORD_BITS));
+  }
+
+  bool contains(SPID spid) const {
+    return (_words[spid / WORD_BITS] >> (spid % WORD_BITS)) & Word(1);
+  }
+
+  /**
+   *  Number of taxa in the set
+   */
+  unsigned int size() const {
+    unsigned int res = 0;
+    for (auto word: _words) {
+      res += __builtin_popcountll(word);
+    }
+    return res;
+  }
+
+  /**
+   *  Add the taxa of other (with the same maximum number
+   *  of taxa) to this set
+   */
+  void unionWith(const TaxaSet &other) {
+    for (unsigned int i = 0; i < _words.size(); ++i) {
+      _words[i] |= other._words[i];
+    }
+  }
+
+  /**
+   *  Number of taxa present in both sets
+   */
+  unsigned int intersectionSize(const TaxaSet &other) const {
+    unsigned int res = 0;
+    for (unsigned int i = 0; i < _words.size(); ++i) {
+      res += __builtin_popcountll(_words[i] & other._words[i]);
+    }
+    return res;
+  }
+
+  void clear() {
+    std::fill(_words.begin(), _words.end(), 0);
+  }
+
+  bool operator ==(const TaxaSet &other) const {
+    return _words == other._words;
+  }
+
+private:
+  using Word = uint64_t;
+  static const unsigned int WORD_BITS = 64;
+  std::vector<Word> _words;
+};
+
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <likelihoods/ReconciliationEvaluation.hpp>
+#include <maths/Random.hpp>
+#include <memory>
+#include <string>
+#include <unordered_set>
+
+/**
+ *  Random species tree with the labels S<k>, and random gene tree
+ *  with the labels S<k>_<i>, where S<k> is the species of the gene i,
+ *  drawn uniformly. Shared by the reconciliation tests.
+ */
+class RandomReconciliation {
+public:
+  RandomReconciliation(unsigned int speciesNumber,
+      unsigned int genesNumber):
+    speciesTree(getSpeciesLabels(speciesNumber)),
+    geneLabels(getGeneLabels(speciesNumber, genesNumber)),
+    rootedGeneTree(geneLabels),
+    geneTree(rootedGeneTree)
+  {
+    mapping.fillFromGeneLabels(geneLabels);
+  }
+  RandomReconciliation(const RandomReconciliation &) = delete;
+  RandomReconciliation & operator = (const RandomReconciliation &) = delete;
+
+  /**
+   *  Create an evaluation of the gene tree under the given model.
+   *  The evaluation references the trees of this object.
+   */
+  std::unique_ptr<ReconciliationEvaluation> createEvaluation(
+      RecModel model,
+      bool rootedGeneTree = true)
+  {
+    RecModelInfo info;
+    info.model = model;
+    info.rootedGeneTree = rootedGeneTree;
+    return std::unique_ptr<ReconciliationEvaluation>(
+        new ReconciliationEvaluation(speciesTree, geneTree, mapping, info));
+  }
+
+  PLLRootedTree speciesTree;
+  std::unordered_set<std::string> geneLabels;
+  PLLRootedTree rootedGeneTree;
+  PLLUnrootedTree geneTree;
+  GeneSpeciesMapping mapping;
+
+private:
+  static std::unordered_set<std::string> getSpeciesLabels(
+      unsigned int speciesNumber)
+  {
+    std::unordered_set<std::string> speciesLabels;
+    for (unsigned int i = 0; i < speciesNumber; ++i) {
+      speciesLabels.insert("S" + std::to_string(i));
+    }
+    return speciesLabels;
+  }
+
+  static std::unordered_set<std::string> getGeneLabels(
+      unsigned int speciesNumber,
+      unsigned int genesNumber)
+  {
+    std::unordered_set<std::string> labels;
+    for (unsigned int i = 0; i < genesNumber; ++i) {
+      auto species = Random::getInt() % speciesNumber;
+      labels.insert("S" + std::to_string(species) + "_" + std::to_string(i));
+    }
+    return labels;
+  }
+};
+
@@ -0,0 +1,180 @@
+#include <IO/FamilyBundle.hpp>
+#include <IO/FamiliesFileParser.hpp>
+#include <IO/FileSystem.hpp>
+#include <IO/GeneSpeciesMapping.hpp>
+#include <IO/LibpllParsers.hpp>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+// the files that the tests may create in their directory
+static const std::vector<std::string> testFiles({
+    "tree1.newick", "mapping1.txt", "ali1.fasta",
+    "tree2.newick", "mapping2.txt", "tree3.newick",
+    "species.newick", "families.bundle"});
+
+/**
+ *  Create a new empty directory in the temporary directory
+ */
+static std::string createTemporaryDirectory()
+{
+  auto tmpDir = std::getenv("TMPDIR");
+  auto path = FileSystem::joinPaths(tmpDir ? tmpDir : "/tmp",
+      "family_bundle_tests_XXXXXX");
+  auto res = mkdtemp(&path[0]);
+  assert(res);
+  return path;
+}
+
+/**
+ *  Remove the test files and the directory created with
+ *  createTemporaryDirectory
+ */
+static void removeTemporaryDirectory(const std::string &dir)
+{
+  for (auto &file: testFiles) {
+    std::remove(FileSystem::joinPaths(dir, file).c_str());
+  }
+  auto res = rmdir(dir.c_str());
+  assert(res == 0);
+}
+
+static void writeFile(const std::string &path, const std::string &content)
+{
+  std::ofstream os(path);
+  os << content;
+}
+
+/**
+ *  Write the family files in dir
+ */
+static Families getFamilies(const std::string &dir)
+{
+  auto path = [&dir](const std::string &file) {
+    return FileSystem::joinPaths(dir, file);
+  };
+  writeFile(path("tree1.newick"), "((a1,b1),(c1,d1));\n");
+  writeFile(path("mapping1.txt"), "a1 s1\nb1 s1\nc1 s2\nd1 s3\n");
+  writeFile(path("ali1.fasta"), ">a1\nACGTA\n>b1\nAC-TA\n>c1\nACGTA\n>d1\nACGTA\n");
+  writeFile(path("tree2.newick"), "((a2,b2),(c2,d2),e2);\n");
+  writeFile(path("mapping2.txt"), "s1:a2;b2\ns2:c2;d2;e2\n");
+  writeFile(path("tree3.newick"), "((a3,b3,c3),d3);\n");
+  Families families;
+  FamilyInfo family;
+  family.name = "family1";
+  family.startingGeneTree = path("tree1.newick");
+  family.mappingFile = path("mapping1.txt");
+  family.alignmentFile = path("ali1.fasta");
+  families.push_back(family);
+  family.alignmentFile = "";
+  family.name = "family2";
+  family.startingGeneTree = path("tree2.newick");
+  family.mappingFile = path("mapping2.txt");
+  family.libpllModel = "LG+G";
+  families.push_back(family);
+  // invalid: the gene tree has a polytomy
+  family.name = "family3";
+  family.startingGeneTree = path("tree3.newick");
+  family.mappingFile = "";
+  families.push_back(family);
+  return families;
+}
+
+void test_round_trip()
+{
+  auto dir = createTemporaryDirectory();
+  auto bundlePath = FileSystem::joinPaths(dir, "families.bundle");
+  FamilyBundle::write(getFamilies(dir), bundlePath);
+  assert(FamilyBundle::isBundle(bundlePath));
+  assert(!FamilyBundle::isBundle(FileSystem::joinPaths(dir, "mapping1.txt")));
+  auto families = FamiliesFileParser::parseFamiliesFile(bundlePath);
+  assert(families.size() == 2);
+  auto &family1 = families[0];
+  assert(family1.name == "family1");
+  assert(family1.startingGeneTree == FileSystem::joinPaths(dir, "tree1.newick"));
+  assert(family1.mappingFile == FileSystem::joinPaths(dir, "mapping1.txt"));
+  assert(family1.alignmentFile == FileSystem::joinPaths(dir, "ali1.fasta"));
+  assert(family1.libpllModel == "GTR");
+  assert(family1.geneNumber == 4);
+  assert(family1.alignmentSites == 5);
+  assert(family1.alignmentTaxa == 4);
+  assert(family1.alignmentCharacters == 19);
+  assert(family1.validated);
+  assert(family1.alignmentValidated);
+  assert(family1.coveredSpecies == std::vector<std::string>({"s1", "s2", "s3"}));
+  auto &family2 = families[1];
+  assert(family2.name == "family2");
+  assert(family2.libpllModel == "LG+G");
+  assert(family2.geneNumber == 5);
+  assert(family2.validated);
+  assert(family2.alignmentTaxa == 0);
+  assert(family2.coveredSpecies == std::vector<std::string>({"s1", "s2"}));
+  auto treeSizes = LibpllParsers::parallelGetTreeSizes(families);
+  assert(treeSizes == std::vector<unsigned int>({4, 5}));
+  removeTemporaryDirectory(dir);
+  std::cout << "Test round trip ok!" << std::endl;
+}
+
+void test_packed_files()
+{
+  auto dir = createTemporaryDirectory();
+  auto bundlePath = FileSystem::joinPaths(dir, "families.bundle");
+  FamilyBundle::write(getFamilies(dir), bundlePath);
+  auto families = FamiliesFileParser::parseFamiliesFile(bundlePath);
+  assert(families.size() == 2);
+  for (auto &family: families) {
+    assert(family.packedGeneTree.packs(family.startingGeneTree));
+    assert(family.packedMapping.packs(family.mappingFile));
+  }
+  // the packed files are parsed from the bundle
+  std::remove(families[0].startingGeneTree.c_str());
+  std::remove(families[0].mappingFile.c_str());
+  std::vector<pll_utree_t *> trees;
+  Family::readStartingGeneTrees(families[0], trees);
+  assert(trees.size() == 1);
+  assert(trees[0]->tip_count == 4);
+  pll_utree_destroy(trees[0], nullptr);
+  GeneSpeciesMapping mapping;
+  Family::fillMapping(families[0], mapping);
+  assert(mapping.getMap().size() == 4);
+  assert(mapping.getSpecies("d1") == "s3");
+  // a family that references another file does not use its packed file
+  families[0].startingGeneTree = families[1].startingGeneTree;
+  trees.clear();
+  Family::readStartingGeneTrees(families[0], trees);
+  assert(trees.size() == 1);
+  assert(trees[0]->tip_count == 5);
+  pll_utree_destroy(trees[0], nullptr);
+  removeTemporaryDirectory(dir);
+  std::cout << "Test packed files ok!" << std::endl;
+}
+
+void test_species_filter()
+{
+  auto dir = createTemporaryDirectory();
+  auto bundlePath = FileSystem::joinPaths(dir, "families.bundle");
+  FamilyBundle::write(getFamilies(dir), bundlePath);
+  auto families = FamiliesFileParser::parseFamiliesFile(bundlePath);
+  // s3 is missing: family1 should be filtered out without
+  // reading its files
+  auto speciesTreePath = FileSystem::joinPaths(dir, "species.newick");
+  writeFile(speciesTreePath, "(s1,s2);\n");
+  Family::filterFamilies(families, speciesTreePath, false, true);
+  assert(families.size() == 1);
+  assert(families[0].name == "family2");
+  removeTemporaryDirectory(dir);
+  std::cout << "Test species filter ok!" << std::endl;
+}
+
+int main(int, char**)
+{
+  test_round_trip();
+  test_packed_files();
+  test_species_filter();
+  return 0;
+}
+
@@ -0,0 +1,80 @@
+#include <IO/FileArchive.hpp>
+#include <IO/FileSystem.hpp>
+#include <IO/ParallelOfstream.hpp>
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+static std::string readContent(const std::string &path)
+{
+  std::string content;
+  FileSystem::getFileContent(path, content);
+  return content;
+}
+
+void test_archive()
+{
+  std::string archivePath = "test.grxa";
+  std::string binary("a\nGRXA 3 4\n\0b", 14);
+  {
+    FileArchiveWriter archive(archivePath);
+    archive.addFile("first.txt", "first content\n");
+    archive.addFile("binary.txt", binary);
+    archive.addFile("empty.txt", "");
+    archive.addFile("first.txt", "overriden content\n");
+  }
+  auto names = FileArchive::list(archivePath);
+  assert(names == std::vector<std::string>({"first.txt", "binary.txt", "empty.txt"}));
+  std::string content;
+  assert(FileArchive::readFile(archivePath, "binary.txt", content));
+  assert(content == binary);
+  assert(FileArchive::readFile(archivePath, "first.txt", content));
+  assert(content == "overriden content\n");
+  assert(!FileArchive::readFile(archivePath, "missing.txt", content));
+  // without the index
+  std::remove((archivePath + ".index").c_str());
+  assert(FileArchive::readFile(archivePath, "first.txt", content));
+  assert(content == "overriden content\n");
+  assert(FileArchive::readFile(archivePath, "empty.txt", content));
+  assert(content.empty());
+  FileSystem::mkdir("extracted", false);
+  assert(FileArchive::extract(archivePath, "extracted") == 4);
+  assert(readContent("extracted/binary.txt") == binary);
+  assert(readContent("extracted/first.txt") == "overriden content\n");
+  std::cout << "Test archive ok!" << std::endl;
+}
+
+void test_parallel_ofstream()
+{
+  std::string archivePath = "test_ofstream.grxa";
+  FileSystem::mkdir("archived", false);
+  std::remove("archived/archived.txt");
+  {
+    FileArchiveWriter archive(archivePath);
+    ParallelOfstream::startArchiving(archive, "archived");
+    {
+      ParallelOfstream os("archived/archived.txt", false);
+      os << "hello " << 42 << std::endl;
+    }
+    {
+      ParallelOfstream os("not_archived.txt", false);
+      os << "world" << std::endl;
+    }
+    ParallelOfstream::stopArchiving();
+  }
+  assert(!FileSystem::exists("archived/archived.txt"));
+  assert(readContent("not_archived.txt") == "world\n");
+  std::string content;
+  assert(FileArchive::readFile(archivePath, "archived.txt", content));
+  assert(content == "hello 42\n");
+  std::cout << "Test parallel ofstream ok!" << std::endl;
+}
+
+int main(int, char**)
+{
+  test_archive();
+  test_parallel_ofstream();
+  return 0;
+}
+
@@ -1,7 +1,11 @@
 #include <trees/PLLRootedTree.hpp>
+#include <IO/FileSystem.hpp>
 #include <cassert>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
+#include <unistd.h>
 
 const std::string tree1("((A,B),(C,D));");
 const std::string tree2("(E, ((A,B),(C,D)));");
@@ -26,28 +30,74 @@ pll_rnode_t * getLCA(pll_rnode_t *n1,
   assert(false);
 }
 
-void testTree(const std::string &treeStr)
+bool isAncestor(pll_rnode_t *node,
+    pll_rnode_t *ancestor)
 {
-  std::ofstream os("temp.txt");
-  os << treeStr << std::endl;
-  os.close();
-  PLLRootedTree treeFromFile("temp.txt", true);
-  PLLRootedTree tree(treeStr, false);
-  assert(tree.getNodesNumber() == treeFromFile.getNodesNumber());
+  while (node) {
+    if (node == ancestor) {
+      return true;
+    }
+    node = node->parent;
+  }
+  return false;
+}
 
+void checkLCAs(PLLRootedTree &tree)
+{
   for (auto n1: tree.getNodes()) {
     for (auto n2: tree.getNodes()) {
       assert(tree.getLCA(n1, n2) == getLCA(n1, n2));
+      assert(tree.isAncestor(n1, n2) == isAncestor(n1, n2));
+      assert(tree.areParents(n1, n2) == 
+          (isAncestor(n1, n2) || isAncestor(n2, n1)));
     }
   }
 }
 
 
+/**
+ *  Create a new empty file in the temporary directory
+ */
+std::string createTemporaryFile()
+{
+  auto tmpDir = std::getenv("TMPDIR");
+  auto path = FileSystem::joinPaths(tmpDir ? tmpDir : "/tmp",
+      "pllrooted_tree_tests_XXXXXX");
+  auto fd = mkstemp(&path[0]);
+  assert(fd != -1);
+  close(fd);
+  return path;
+}
+
+void testTree(const std::string &treeStr)
+{
+  auto treePath = createTemporaryFile();
+  std::ofstream os(treePath);
+  os << treeStr << std::endl;
+  os.close();
+  PLLRootedTree treeFromFile(treePath, true);
+  std::remove(treePath.c_str());
+  PLLRootedTree tree(treeStr, false);
+  assert(tree.getNodesNumber() == treeFromFile.getNodesNumber());
+  checkLCAs(tree);
+}
+
+void testRandomTree(unsigned int taxa)
+{
+  std::unordered_set<std::string> labels;
+  for (unsigned int i = 0; i < taxa; ++i) {
+    labels.insert(std::string("S" + std::to_string(i)));
+  }
+  PLLRootedTree tree(labels);
+  checkLCAs(tree);
+}
+
 int main(int, char**)
 {
   testTree(tree1); 
   testTree(tree2); 
   testTree(tree3); 
+  testRandomTree(100);
   std::cout << "Test PLLRootedTree ok!" << std::endl;
   return 0;
 }
@@ -0,0 +1,67 @@
+#include "RandomReconciliation.hpp"
+#include <maths/Random.hpp>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+
+/**
+ *  Compare the gradient returned by evaluateWithGradient with
+ *  central finite differences of evaluate
+ */
+static void checkGradient(ReconciliationEvaluation &evaluation,
+    const Parameters &parameters)
+{
+  Parameters gradient;
+  evaluation.setRates(parameters);
+  double ll = evaluation.evaluateWithGradient(gradient, 0.0000001);
+  assert(std::isfinite(ll));
+  assert(gradient.dimensions() == parameters.dimensions());
+  const double epsilon = 0.000001;
+  for (unsigned int i = 0; i < parameters.dimensions(); ++i) {
+    auto plus = parameters;
+    plus[i] += epsilon;
+    evaluation.setRates(plus);
+    double llPlus = evaluation.evaluate();
+    auto minus = parameters;
+    minus[i] -= epsilon;
+    evaluation.setRates(minus);
+    double llMinus = evaluation.evaluate();
+    double finiteDifference = (llPlus - llMinus) / (2.0 * epsilon);
+    double error = fabs(finiteDifference - gradient[i])
+      / std::max(1.0, fabs(finiteDifference));
+    assert(error < 0.0001);
+  }
+}
+
+static void testGradients(RecModel model,
+    unsigned int speciesNumber,
+    unsigned int genesNumber)
+{
+  RandomReconciliation problem(speciesNumber, genesNumber);
+  // in rooted mode, the ML root may change between two
+  // close rates, and the likelihood is not differentiable
+  auto evaluation = problem.createEvaluation(model, false);
+  auto freeParameters = Enums::freeParameters(model);
+  for (auto perSpecies: {false, true}) {
+    unsigned int dimensions = freeParameters *
+      (perSpecies ? problem.speciesTree.getNodesNumber() : 1);
+    Parameters parameters(dimensions);
+    for (unsigned int i = 0; i < dimensions; ++i) {
+      parameters[i] = 0.05 + 0.3 * Random::getProba();
+    }
+    checkGradient(*evaluation, parameters);
+  }
+}
+
+int main(int, char**)
+{
+  Random::setSeed(42);
+  for (auto model: {RecModel::UndatedDL, RecModel::UndatedDTL}) {
+    testGradients(model, 6, 10);
+    testGradients(model, 20, 50);
+    // large enough to switch to infinite precision
+    testGradients(model, 10, 800);
+  }
+  std::cout << "Test reconciliation gradients ok!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,119 @@
+#include "RandomReconciliation.hpp"
+#include <maths/Random.hpp>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+static bool close(double ll1, double ll2)
+{
+  return fabs(ll1 - ll2) < 0.0000001 * std::max(1.0, fabs(ll1));
+}
+
+/**
+ *  Swap the subtrees node->next->back and node->back->next->back
+ *  (NNI move around the branch of node). Applying the same move
+ *  twice restores the tree.
+ */
+static void applyNNI(pll_unode_t *node)
+{
+  auto left = node->next;
+  auto right = node->back->next;
+  auto leftSubtree = left->back;
+  auto rightSubtree = right->back;
+  left->back = rightSubtree;
+  rightSubtree->back = left;
+  right->back = leftSubtree;
+  leftSubtree->back = right;
+}
+
+static pll_unode_t *getInternalBranch(PLLUnrootedTree &geneTree)
+{
+  std::vector<pll_unode_t *> branches;
+  for (auto node: geneTree.getPostOrderNodes()) {
+    if (node->next && node->back->next) {
+      branches.push_back(node);
+    }
+  }
+  return branches[Random::getInt() % branches.size()];
+}
+
+static void invalidateNNI(ReconciliationEvaluation &evaluation,
+    pll_unode_t *node)
+{
+  evaluation.invalidateCLV(node->node_index);
+  evaluation.invalidateCLV(node->back->node_index);
+}
+
+/**
+ *  Recompute all the CLVs of reference, starting the ML root search
+ *  (in rooted gene tree mode) from the current root of evaluation
+ */
+static double evaluateReference(ReconciliationEvaluation &reference,
+    ReconciliationEvaluation &evaluation)
+{
+  reference.invalidateAllCLVs();
+  reference.setRoot(evaluation.getRoot());
+  return reference.evaluate();
+}
+
+static void testRollback(RecModel model,
+    bool rooted,
+    unsigned int speciesNumber,
+    unsigned int genesNumber)
+{
+  RandomReconciliation problem(speciesNumber, genesNumber);
+  auto evaluation = problem.createEvaluation(model, rooted);
+  // recomputes all the CLVs at each evaluation
+  auto reference = problem.createEvaluation(model, rooted);
+  Parameters parameters(Enums::freeParameters(model));
+  for (unsigned int i = 0; i < parameters.dimensions(); ++i) {
+    parameters[i] = 0.1 + 0.2 * Random::getProba();
+  }
+  evaluation->setRates(parameters);
+  reference->setRates(parameters);
+  double ll = evaluation->evaluate();
+  assert(close(ll, reference->evaluate()));
+  for (unsigned int i = 0; i < 30; ++i) {
+    auto node = getInternalBranch(problem.geneTree);
+    evaluation->saveState();
+    applyNNI(node);
+    invalidateNNI(*evaluation, node);
+    double newLL = evaluation->evaluate();
+    assert(close(newLL, evaluateReference(*reference, *evaluation)));
+    if (i % 3 == 0) {
+      // keep the move
+      ll = newLL;
+      continue;
+    }
+    applyNNI(node);
+    assert(evaluation->rollbackToLastState());
+    assert(close(ll, evaluation->evaluate()));
+    assert(close(ll, evaluateReference(*reference, *evaluation)));
+  }
+  // the rates changed: the state cannot be restored
+  auto node = getInternalBranch(problem.geneTree);
+  evaluation->saveState();
+  applyNNI(node);
+  invalidateNNI(*evaluation, node);
+  evaluation->evaluate();
+  evaluation->setRates(parameters);
+  applyNNI(node);
+  assert(!evaluation->rollbackToLastState());
+  invalidateNNI(*evaluation, node);
+  ll = evaluation->evaluate();
+  assert(close(ll, evaluateReference(*reference, *evaluation)));
+}
+
+int main(int, char**)
+{
+  Random::setSeed(42);
+  for (auto model: {RecModel::UndatedDL, RecModel::UndatedDTL}) {
+    for (auto rooted: {false, true}) {
+      testRollback(model, rooted, 8, 20);
+      testRollback(model, rooted, 15, 30);
+    }
+  }
+  std::cout << "Test reconciliation rollback ok!" << std::endl;
+  return 0;
+}
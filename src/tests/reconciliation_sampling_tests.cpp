@@ -0,0 +1,89 @@
+#include "RandomReconciliation.hpp"
+#include <maths/Random.hpp>
+#include <parallelization/ThreadPool.hpp>
+#include <util/Scenario.hpp>
+#include <cassert>
+#include <iostream>
+#include <memory>
+
+static bool sameEvents(const Scenario &s1, const Scenario &s2)
+{
+  auto &events1 = s1.getGeneIdToEvents();
+  auto &events2 = s2.getGeneIdToEvents();
+  if (events1.size() != events2.size()) {
+    return false;
+  }
+  for (unsigned int i = 0; i < events1.size(); ++i) {
+    if (events1[i].size() != events2[i].size()) {
+      return false;
+    }
+    for (unsigned int j = 0; j < events1[i].size(); ++j) {
+      auto &e1 = events1[i][j];
+      auto &e2 = events2[i][j];
+      if (e1.type != e2.type || e1.geneNode != e2.geneNode
+          || e1.speciesNode != e2.speciesNode
+          || e1.destSpeciesNode != e2.destSpeciesNode
+          || e1.transferedGeneNode != e2.transferedGeneNode) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static void sample(ReconciliationEvaluation &evaluation,
+    unsigned int threads,
+    unsigned int seed,
+    std::vector<Scenario> &scenarios)
+{
+  std::vector<Scenario *> samples;
+  for (auto &scenario: scenarios) {
+    samples.push_back(&scenario);
+  }
+  ThreadPool threadPool(threads);
+  evaluation.sampleScenarios(samples, seed, threadPool);
+}
+
+static void testSampling(RecModel model,
+    unsigned int speciesNumber,
+    unsigned int genesNumber)
+{
+  RandomReconciliation problem(speciesNumber, genesNumber);
+  auto evaluation = problem.createEvaluation(model);
+  Parameters parameters(Enums::freeParameters(model));
+  for (unsigned int i = 0; i < parameters.dimensions(); ++i) {
+    parameters[i] = 0.2;
+  }
+  evaluation->setRates(parameters);
+  const unsigned int samples = 30;
+  std::vector<Scenario> sequential(samples);
+  sample(*evaluation, 1, 42, sequential);
+  std::vector<Scenario> parallel(samples);
+  sample(*evaluation, 4, 42, parallel);
+  bool allIdentical = true;
+  for (unsigned int i = 0; i < samples; ++i) {
+    // the samples do not depend on the number of threads
+    assert(sameEvents(sequential[i], parallel[i]));
+    if (i > 0) {
+      allIdentical &= sameEvents(sequential[0], sequential[i]);
+    }
+  }
+  // ... but they are not all the same
+  assert(!allIdentical);
+  // the sample i only depends on seed + i
+  std::vector<Scenario> shifted(samples - 1);
+  sample(*evaluation, 3, 43, shifted);
+  for (unsigned int i = 0; i + 1 < samples; ++i) {
+    assert(sameEvents(sequential[i + 1], shifted[i]));
+  }
+}
+
+int main(int, char**)
+{
+  Random::setSeed(42);
+  for (auto model: {RecModel::UndatedDL, RecModel::UndatedDTL}) {
+    testSampling(model, 10, 40);
+  }
+  std::cout << "Test reconciliation sampling ok!" << std::endl;
+  return 0;
+}
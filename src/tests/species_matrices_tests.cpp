@@ -0,0 +1,179 @@
+#include <NJ/SpeciesMatrices.hpp>
+#include <maths/Random.hpp>
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+/**
+ *  Stands for a cherry gene tree: holds a contribution to the
+ *  neighbor and denominator matrices similar to the ones of
+ *  CherryTree (integer neighbor counts, and harmonic means of
+ *  gene counts as denominators)
+ */
+class TestTree {
+public:
+  TestTree(unsigned int speciesNumber) {
+    std::vector<unsigned int> geneCounts;
+    std::vector<int> species;
+    for (unsigned int s = 0; s < speciesNumber; ++s) {
+      if (Random::getInt() % 3 == 0) {
+        species.push_back(s);
+        geneCounts.push_back(1 + Random::getInt() % 5);
+      }
+    }
+    for (unsigned int i = 0; i < species.size(); ++i) {
+      auto neighbor = species[Random::getInt() % species.size()];
+      _neighbors.add(species[i], neighbor, 1.0);
+      for (unsigned int j = 0; j < species.size(); ++j) {
+        double small = std::min(geneCounts[i], geneCounts[j]);
+        double big = std::max(geneCounts[i], geneCounts[j]);
+        _denominators.add(species[i], species[j],
+            2.0 / (1.0 / big + 1.0 / small));
+      }
+    }
+  }
+
+  void addContribution(LocalSpeciesMatrices &localMatrices) const {
+    localMatrices.add(_neighbors, _denominators);
+  }
+
+  void removeContribution(LocalSpeciesMatrices &localMatrices) const {
+    localMatrices.remove(_neighbors, _denominators);
+  }
+
+  void getContributionIndices(unsigned int speciesNumber,
+      std::vector<unsigned long> &indices) const {
+    _neighbors.getIndices(speciesNumber, indices);
+    _denominators.getIndices(speciesNumber, indices);
+  }
+private:
+  SparseMatrix _neighbors;
+  SparseMatrix _denominators;
+};
+
+using TestTrees = std::vector<std::shared_ptr<TestTree> >;
+
+/**
+ *  Add the contributions of the trees in reverse order, to
+ *  check that the order of the updates does not matter
+ */
+static void computeFromScratch(const TestTrees &trees,
+    unsigned int speciesNumber,
+    MatrixDouble &neighbors,
+    MatrixDouble &denominators,
+    MatrixDouble &frequencies)
+{
+  LocalSpeciesMatrices localMatrices(speciesNumber);
+  for (auto it = trees.rbegin(); it != trees.rend(); ++it) {
+    (*it)->addContribution(localMatrices);
+  }
+  SpeciesMatrices::reduceMatrices(localMatrices, neighbors, denominators);
+  frequencies = neighbors;
+  std::vector<unsigned long> indices;
+  for (unsigned long i = 0; i < frequencies.entries(); ++i) {
+    indices.push_back(i);
+  }
+  SpeciesMatrices::updateFrequencies(frequencies, neighbors,
+      denominators, indices);
+}
+
+/**
+ *  Maximum entry found by a row-major scan (the entry
+ *  expected from MaxEntryQueue)
+ */
+static std::pair<int, int> getMaxInMatrix(const MatrixDouble &m)
+{
+  std::pair<int, int> maxPair = {0, 0};
+  for (unsigned int i = 0; i < m.size(); ++i) {
+    for (unsigned int j = 0; j < m.size(); ++j) {
+      if (m[maxPair.first][maxPair.second] < m[i][j]) {
+        maxPair = {i, j};
+      }
+    }
+  }
+  return maxPair;
+}
+
+static bool equal(const MatrixDouble &m1, const MatrixDouble &m2)
+{
+  return std::equal(m1.data(), m1.data() + m1.entries(), m2.data());
+}
+
+/**
+ *  Replace or remove a few trees at each step, and check that
+ *  the incrementally updated matrices and the chosen pairs are
+ *  exactly the ones of a full rebuild
+ */
+static void testIncrementalUpdates(unsigned int speciesNumber,
+    unsigned int treesNumber,
+    unsigned int steps)
+{
+  TestTrees trees;
+  for (unsigned int i = 0; i < treesNumber; ++i) {
+    trees.push_back(std::make_shared<TestTree>(speciesNumber));
+  }
+  LocalSpeciesMatrices localMatrices(speciesNumber);
+  for (auto &tree: trees) {
+    tree->addContribution(localMatrices);
+  }
+  MatrixDouble neighborMatrix;
+  MatrixDouble denominatorMatrix;
+  SpeciesMatrices::reduceMatrices(localMatrices, neighborMatrix,
+      denominatorMatrix);
+  MatrixDouble frequencies = neighborMatrix;
+  std::vector<unsigned long> allIndices;
+  for (unsigned long i = 0; i < frequencies.entries(); ++i) {
+    allIndices.push_back(i);
+  }
+  SpeciesMatrices::updateFrequencies(frequencies, neighborMatrix,
+      denominatorMatrix, allIndices);
+  MaxEntryQueue maxEntries(frequencies);
+  MatrixDouble neighbors(speciesNumber, speciesNumber, 0.0);
+  MatrixDouble denominators(speciesNumber, speciesNumber, 0.0);
+  MatrixDouble referenceFrequencies(speciesNumber, speciesNumber, 0.0);
+  for (unsigned int step = 0; step < steps && trees.size(); ++step) {
+    std::vector<unsigned long> changedIndices;
+    for (unsigned int k = 0; k < 3 && trees.size(); ++k) {
+      auto index = Random::getInt() % trees.size();
+      trees[index]->getContributionIndices(speciesNumber, changedIndices);
+      trees[index]->removeContribution(localMatrices);
+      if (Random::getInt() % 4 == 0) {
+        trees.erase(trees.begin() + index);
+      } else {
+        trees[index] = std::make_shared<TestTree>(speciesNumber);
+        trees[index]->getContributionIndices(speciesNumber,
+            changedIndices);
+        trees[index]->addContribution(localMatrices);
+      }
+    }
+    auto indices = SpeciesMatrices::reduceEntries(localMatrices,
+        neighborMatrix, denominatorMatrix, changedIndices);
+    maxEntries.remove(frequencies, indices);
+    SpeciesMatrices::updateFrequencies(frequencies, neighborMatrix,
+        denominatorMatrix, indices);
+    maxEntries.insert(frequencies, indices);
+    computeFromScratch(trees, speciesNumber, neighbors, denominators,
+        referenceFrequencies);
+    assert(equal(neighborMatrix, neighbors));
+    assert(equal(denominatorMatrix, denominators));
+    assert(equal(frequencies, referenceFrequencies));
+    auto best = getMaxInMatrix(referenceFrequencies);
+    if (referenceFrequencies[best.first][best.second] > 0.0) {
+      assert(maxEntries.getMax() == best);
+    } else {
+      assert(maxEntries.getMax() == std::make_pair(0, 0));
+    }
+  }
+}
+
+int main(int, char**)
+{
+  Random::setSeed(42);
+  testIncrementalUpdates(5, 10, 20);
+  testIncrementalUpdates(20, 100, 200);
+  testIncrementalUpdates(50, 300, 300);
+  std::cout << "Test species matrices ok!" << std::endl;
+  return 0;
+}
@@ -1,6 +1,33 @@
 #include <trees/SpeciesTree.hpp>
 #include <cassert>
 
+static pll_rnode_t *getNaiveLCA(pll_rnode_t *n1, pll_rnode_t *n2)
+{
+  std::unordered_set<pll_rnode_t *> n1Ancestors;
+  for (; n1; n1 = n1->parent) {
+    n1Ancestors.insert(n1);
+  }
+  for (; n2; n2 = n2->parent) {
+    if (n1Ancestors.find(n2) != n1Ancestors.end()) {
+      return n2;
+    }
+  }
+  assert(false);
+  return nullptr;
+}
+
+static void checkLCAs(SpeciesTree &speciesTree)
+{
+  auto &tree = speciesTree.getTree();
+  for (auto n1: tree.getNodes()) {
+    for (auto n2: tree.getNodes()) {
+      auto lca = getNaiveLCA(n1, n2);
+      assert(tree.getLCA(n1, n2) == lca);
+      assert(tree.areParents(n1, n2) == (lca == n1 || lca == n2));
+    }
+  }
+}
+
 static void checkRootMove(SpeciesTree &speciesTree, unsigned int direction) 
 {
   std::string initialStr = speciesTree.toString();
@@ -8,9 +35,11 @@ static void checkRootMove(SpeciesTree &speciesTree, unsigned int direction)
   
   SpeciesTreeOperator::changeRoot(speciesTree, direction);
   assert(initialTaxa == speciesTree.getTree().getLeavesNumber());
+  checkLCAs(speciesTree);
   SpeciesTreeOperator::revertChangeRoot(speciesTree, direction);
   assert(initialTaxa == speciesTree.getTree().getLeavesNumber());
   assert(initialStr == speciesTree.toString());
+  checkLCAs(speciesTree);
 }
 
 static void checkSPRMove(SpeciesTree &speciesTree, unsigned int prune, unsigned int regraft) 
@@ -19,9 +48,11 @@ static void checkSPRMove(SpeciesTree &speciesTree, unsigned int prune, unsigned
   auto initialTaxa = speciesTree.getTree().getLeavesNumber();
   unsigned int rollback = SpeciesTreeOperator::applySPRMove(speciesTree, prune, regraft);
   assert(initialTaxa == speciesTree.getTree().getLeavesNumber());
+  checkLCAs(speciesTree);
   SpeciesTreeOperator::reverseSPRMove(speciesTree, prune, rollback);
   assert(initialTaxa == speciesTree.getTree().getLeavesNumber());
   assert(initialStr == speciesTree.toString());
+  checkLCAs(speciesTree);
 }
 
 static void testRootMoves() 
@@ -0,0 +1,52 @@
+#include <util/TaxaSet.hpp>
+#include <cassert>
+#include <iostream>
+#include <set>
+
+static void testTaxaSet(unsigned int maxTaxa)
+{
+  TaxaSet s1(maxTaxa);
+  TaxaSet s2(maxTaxa);
+  std::set<SPID> ref1;
+  std::set<SPID> ref2;
+  for (SPID spid = 0; spid < maxTaxa; ++spid) {
+    if (spid % 3 == 0) {
+      s1.insert(spid);
+      ref1.insert(spid);
+    }
+    if (spid % 5 == 0 || spid + 1 == maxTaxa) {
+      s2.insert(spid);
+      ref2.insert(spid);
+    }
+  }
+  // inserting twice does not change the set
+  s1.insert(0);
+  assert(s1.size() == ref1.size());
+  assert(s2.size() == ref2.size());
+  unsigned int intersection = 0;
+  for (SPID spid = 0; spid < maxTaxa; ++spid) {
+    assert(s1.contains(spid) == (ref1.count(spid) == 1));
+    assert(s2.contains(spid) == (ref2.count(spid) == 1));
+    if (ref1.count(spid) && ref2.count(spid)) {
+      intersection++;
+    }
+  }
+  assert(s1.intersectionSize(s2) == intersection);
+  assert(s2.intersectionSize(s1) == intersection);
+  auto unionSet = s1;
+  unionSet.unionWith(s2);
+  assert(unionSet.size() == ref1.size() + ref2.size() - intersection);
+  assert(unionSet.intersectionSize(s1) == s1.size());
+  unionSet.clear();
+  assert(unionSet.size() == 0);
+  assert(unionSet == TaxaSet(maxTaxa));
+}
+
+int main(int, char**)
+{
+  for (unsigned int maxTaxa: {1u, 63u, 64u, 65u, 1000u}) {
+    testTaxaSet(maxTaxa);
+  }
+  std::cout << "Test TaxaSet ok!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,73 @@
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include <parallelization/ThreadPool.hpp>
+
+/**
+ *  Sum the elements in index order after a parallel 
+ *  computation, and check that the result is the same
+ *  as with a sequential computation
+ */
+void testReproducibleSum(unsigned int threads, unsigned int elements)
+{
+  ThreadPool pool(threads);
+  assert(pool.getThreadsNumber() == std::max(threads, 1u));
+  double sequentialSum = 0.0;
+  for (unsigned int i = 0; i < elements; ++i) {
+    sequentialSum += std::log(1.0 + i);
+  }
+  for (unsigned int repeat = 0; repeat < 10; ++repeat) {
+    std::vector<double> values(elements, 0.0);
+    pool.parallelFor(elements, [&](unsigned int i) {
+      values[i] = std::log(1.0 + i);
+    });
+    double sum = 0.0;
+    for (auto value: values) {
+      sum += value;
+    }
+    assert(sum == sequentialSum);
+  }
+}
+
+void testException(unsigned int threads)
+{
+  ThreadPool pool(threads);
+  std::vector<unsigned int> visited(100, 0);
+  bool thrown = false;
+  try {
+    pool.parallelFor(visited.size(), [&](unsigned int i) {
+      visited[i]++;
+      if (i == 42) {
+        throw std::runtime_error("error");
+      }
+    });
+  } catch (const std::runtime_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+  for (auto v: visited) {
+    assert(v == 1);
+  }
+  // the pool can still be used
+  pool.parallelFor(visited.size(), [&](unsigned int i) {
+    visited[i]++;
+  });
+  for (auto v: visited) {
+    assert(v == 2);
+  }
+}
+
+int main(int, char**)
+{
+  for (unsigned int threads: {0u, 1u, 2u, 4u, 7u}) {
+    testReproducibleSum(threads, 0);
+    testReproducibleSum(threads, 1);
+    testReproducibleSum(threads, 1000);
+    testException(threads);
+  }
+  std::cout << "Test ThreadPool ok!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,112 @@
+#include <likelihoods/reconciliation_models/UndatedDTLKernel.hpp>
+#include <maths/Random.hpp>
+#include <maths/ScaledValue.hpp>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+static std::vector<double> getRandomValues(size_t size, double scale)
+{
+  std::vector<double> values(size);
+  for (auto &value: values) {
+    value = Random::getProba() * scale;
+  }
+  return values;
+}
+
+/**
+ *  Compare the vectorized kernels with the scalar kernels on
+ *  arrays of the given size, with CLV values of the given
+ *  magnitude. The results must be bitwise identical.
+ */
+static void testKernels(size_t size, double scale)
+{
+  auto &scalar = UndatedDTLKernel::getScalarKernels();
+  auto &best = UndatedDTLKernel::getKernels();
+  auto left = getRandomValues(size, scale);
+  auto right = getRandomValues(size, scale);
+  auto PD = getRandomValues(size, 1.0);
+  auto PT = getRandomValues(size, 1.0);
+  double leftTransferSum = Random::getProba() * scale;
+  double rightTransferSum = Random::getProba() * scale;
+  std::vector<double> scalarRes(size);
+  std::vector<double> vectorRes(size);
+  scalar.dt(size, left.data(), right.data(), PD.data(), PT.data(),
+      leftTransferSum, rightTransferSum, scalarRes.data());
+  best.dt(size, left.data(), right.data(), PD.data(), PT.data(),
+      leftTransferSum, rightTransferSum, vectorRes.data());
+  assert(scalarRes == vectorRes);
+  double scalarMax = scalar.max(size, scalarRes.data());
+  double vectorMax = best.max(size, vectorRes.data());
+  assert(scalarMax == vectorMax);
+  for (size_t e = 0; e < size; ++e) {
+    assert(scalarRes[e] <= scalarMax);
+  }
+  scalar.multiply(size, JS_SCALE_FACTOR, scalarRes.data());
+  best.multiply(size, JS_SCALE_FACTOR, vectorRes.data());
+  assert(scalarRes == vectorRes);
+}
+
+/**
+ *  Same loop as UndatedDTLModel::rescaleCLV, which only runs
+ *  with ScaledValue CLVs
+ *  @return the number of rescalings
+ */
+static unsigned int rescale(const UndatedDTLKernel::KernelSet &kernels,
+    std::vector<double> &values)
+{
+  unsigned int scaler = 0;
+  auto max = kernels.max(values.size(), values.data());
+  if (max == 0.0) {
+    return scaler;
+  }
+  while (max < JS_SCALE_THRESHOLD) {
+    kernels.multiply(values.size(), JS_SCALE_FACTOR, values.data());
+    scaler++;
+    max *= JS_SCALE_FACTOR;
+  }
+  return scaler;
+}
+
+/**
+ *  Compare the rescaling of underflowing CLVs (ScaledValue
+ *  path) with the vectorized and the scalar kernels
+ */
+static void testRescaling(size_t size)
+{
+  auto scalarValues = getRandomValues(size, JS_SCALE_THRESHOLD
+      * JS_SCALE_THRESHOLD);
+  auto vectorValues = scalarValues;
+  auto scalarScaler = rescale(UndatedDTLKernel::getScalarKernels(),
+      scalarValues);
+  auto vectorScaler = rescale(UndatedDTLKernel::getKernels(),
+      vectorValues);
+  assert(scalarScaler == vectorScaler);
+  assert(size == 0 || scalarScaler > 0);
+  assert(scalarValues == vectorValues);
+}
+
+int main(int, char**)
+{
+  Random::setSeed(42);
+  // the vector widths are 2 (SSE) and 4 (AVX): test all the
+  // tails, and the odd species node numbers of real trees
+  std::vector<size_t> sizes;
+  for (size_t size = 0; size < 20; ++size) {
+    sizes.push_back(size);
+  }
+  for (size_t size: {59, 199, 1001}) {
+    sizes.push_back(size);
+  }
+  for (auto size: sizes) {
+    // double CLVs
+    testKernels(size, 1.0);
+    // ScaledValue CLVs, before rescaling
+    testKernels(size, JS_SCALE_THRESHOLD);
+    testRescaling(size);
+  }
+  std::cout << "Test undated DTL kernels ok ("
+    << UndatedDTLKernel::getArchName() << ")!" << std::endl;
+  return 0;
+}
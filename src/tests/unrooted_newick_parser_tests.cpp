@@ -0,0 +1,290 @@
+#include <IO/UnrootedNewickParser.hpp>
+#include <string>
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <cassert>
+#include <cstdlib>
+#include <set>
+#include <fstream>
+#include <map>
+
+using Clade = std::set<std::string>;
+
+static void fillLabels(pll_unode_t *node, Clade &clade)
+{
+  if (!node->next) {
+    clade.insert(std::string(node->label));
+    return;
+  }
+  fillLabels(node->next->back, clade);
+  fillLabels(node->next->next->back, clade);
+}
+
+/**
+ *  Each directed node of the tree induces the clade of the
+ *  labels below it. Two unrooted trees are equal if they
+ *  induce the same set of clades
+ */
+static std::set<Clade> getClades(pll_utree_t *tree)
+{
+  std::set<Clade> clades;
+  auto nodesNumber = tree->tip_count + tree->inner_count;
+  for (unsigned int i = 0; i < nodesNumber; ++i) {
+    auto node = tree->nodes[i];
+    std::vector<pll_unode_t *> directed = {node};
+    if (node->next) {
+      directed.push_back(node->next);
+      directed.push_back(node->next->next);
+    }
+    for (auto d: directed) {
+      Clade clade;
+      fillLabels(d, clade);
+      clades.insert(clade);
+    }
+  }
+  return clades;
+}
+
+/**
+ *  Check that the indices follow the libpll conventions
+ */
+static void checkIndices(pll_utree_t *tree)
+{
+  auto tips = tree->tip_count;
+  auto nodesNumber = tips + tree->inner_count;
+  assert(tree->inner_count == tips - 2);
+  assert(tree->edge_count == 2 * tips - 3);
+  std::set<unsigned int> nodeIndices;
+  std::set<unsigned int> pmatrixIndices;
+  for (unsigned int i = 0; i < nodesNumber; ++i) {
+    auto node = tree->nodes[i];
+    assert((i < tips) == (node->next == nullptr));
+    if (i < tips) {
+      assert(node->node_index == i);
+      assert(node->clv_index == i);
+      assert(node->label);
+    } else {
+      assert(node->next->next->next == node);
+      assert(node->clv_index == i);
+      assert(node->next->clv_index == i);
+      assert(node->next->next->clv_index == i);
+    }
+    auto current = node;
+    do {
+      assert(current->back->back == current);
+      assert(current->pmatrix_index == current->back->pmatrix_index);
+      assert(current->length == current->back->length);
+      assert(current->pmatrix_index < tree->edge_count);
+      nodeIndices.insert(current->node_index);
+      pmatrixIndices.insert(current->pmatrix_index);
+      current = current->next;
+    } while (current && current != node);
+  }
+  assert(nodeIndices.size() == tips + 3 * tree->inner_count);
+  assert(pmatrixIndices.size() == tree->edge_count);
+}
+
+void test_aux(const std::string &newickString, bool as_file)
+{
+  ParsingError error;
+  std::string input = newickString;
+  if (as_file) {
+    input = "temp.txt";
+    std::ofstream os(input);
+    os << newickString;
+    os.close();
+  }
+  auto pllTree = pll_utree_parse_newick_string_unroot(newickString.c_str());
+  assert(pllTree);
+  auto customTree = custom_utree_parse_newick(input.c_str(),
+      as_file,
+      &error);
+  if (error.type != PET_NOERROR) {
+    std::cout << get_parsing_error_name(error.type) << " "
+      << error.offset << std::endl;
+  }
+  assert(error.type == PET_NOERROR);
+  assert(customTree);
+  assert(pllTree->tip_count == customTree->tip_count);
+  assert(pllTree->inner_count == customTree->inner_count);
+  assert(pllTree->edge_count == customTree->edge_count);
+  assert(getClades(pllTree) == getClades(customTree));
+  checkIndices(customTree);
+  pll_utree_destroy(pllTree, nullptr);
+  pll_utree_destroy(customTree, nullptr);
+}
+
+void test(const std::string &newickString)
+{
+  test_aux(newickString, true);
+  test_aux(newickString, false);
+}
+
+void test_bad_trees_aux(const std::string &name,
+    const std::string &tree,
+    ParsingErrorType expectedError)
+{
+  std::cout << "[Test bad tree] " << name << ": " << tree << std::endl;;
+  ParsingError error;
+  auto customTree = custom_utree_parse_newick(tree.c_str(),
+      false,
+      &error);
+  if(error.type != expectedError) {
+    std::cerr << get_parsing_error_name(error.type) << std::endl;
+  }
+  assert(!customTree && error.type == expectedError);
+  std::cout << "[Test bad tree]   OK!" << std::endl;
+}
+
+void test_good_trees()
+{
+  std::map<std::string, std::string> newicks;
+  newicks.insert({"Rooted", "((a,b)ab,(c,d)cd)root;"});
+  newicks.insert({"Rooted with a leaf", "(((a,b),c),d);"});
+  newicks.insert({"Unrooted", "((a,b),(c,d),(e,f));"});
+  newicks.insert({"Unrooted with leaves", "(a,b,(c,d));"});
+  newicks.insert({"Three leaves", "(a,b,c);"});
+  newicks.insert({"Branch lengths", "((a:30.5,b:0.03):48.0,(c:0,d:3)cd:2,e:1);"});
+  newicks.insert({"Root branch length", "((a:1,b:2):0.5,(c:1,d:2):0.5):0.0;"});
+  newicks.insert({"Scientific notation", "((a:1e-10,b:0.03)ab,(c:0,d:3E-5)cd)root;"});
+  newicks.insert({"Spaces","( (a : 30.5 , b : 0.03 ) ab , (c :0,d : 3 ) cd , e)root;"});
+  newicks.insert({"Tabs","(\t(a\t:\t30.5\t,\tb\t:\t0.03\t)\tab\t,\t(c\t:0,d\t:\t3\t)\tcd\t)root\t;"});
+  newicks.insert({"Windows newlines", "((a,b)ab\r\n,(c,d\r\n)cd)root;\r\n"});
+  newicks.insert({"Weird characters", "((!a+7=5,b^o&)ab,($$£*c,d/\\?!_-|)cd)ro#~ot;"});
+  for (auto &entry: newicks) {
+    std::cout << "[Test good tree] " << entry.first <<
+      ": " << entry.second << std::endl;
+    test(entry.second);
+    std::cout << "[Test good tree]   OK" << std::endl;
+  }
+}
+
+void test_bad_trees()
+{
+  test_bad_trees_aux("Polytomy",
+      "((a,b),(c,(d, e, f));",
+      PET_POLYTOMY);
+  test_bad_trees_aux("Root polytomy",
+      "((a,b),c,d,e);",
+      PET_POLYTOMY);
+  test_bad_trees_aux("No semicolon",
+      "((a,b),(c,(d, e)))",
+      PET_NOSEMICOLON);
+  test_bad_trees_aux("Early semicolon",
+      "((a,b);,(c,(d, e)))",
+      PET_INVALID_PARENTHESES);
+  test_bad_trees_aux("Comments",
+      "((a[comment],b),(c,(d, e):0.5));",
+      PET_INVALID_LABEL);
+  test_bad_trees_aux("Token after the newick string",
+      "((a,b),(c,(d, e)));wtf",
+      PET_TOKEN_AFTER_SEMICOLON);
+  test_bad_trees_aux("Too many left parenthesis",
+      "((a,b),(c,(d, e:0.1));",
+      PET_INVALID_PARENTHESES);
+  test_bad_trees_aux("Too many right parenthesis",
+      "(a,b),(c,(d, e:0.1)));",
+      PET_INVALID_PARENTHESES);
+  test_bad_trees_aux("Space in label",
+      "((a,b),(c,(d, e)hello world);",
+      PET_INVALID_LABEL);
+  test_bad_trees_aux("0 children in non-terminal",
+      "((a,b),(c,(d, ())));",
+      PET_EMPTY_NODE);
+  test_bad_trees_aux("only 1 child",
+      "((a,b),(c,(d, (e))));",
+      PET_ONLY_ONE_CHILD);
+  test_bad_trees_aux("Invalid BL",
+      "((a,b),(c,(d, e):0.a5));",
+      PET_INVALID_BRANCH_LENGTH);
+  test_bad_trees_aux("Double branch length",
+      "((a,b),(c,(d, e:0.0:0.1)));",
+      PET_DOUBLE_BRANCH_LENGTH);
+  test_bad_trees_aux("Two leaves",
+      "(a,b);",
+      PET_TOO_FEW_TAXA);
+}
+
+void test_multiple_trees()
+{
+  std::cout << "[Test multiple trees]" << std::endl;
+  std::string file = "temp_multiple.txt";
+  std::ofstream os(file);
+  os << "((a,b),(c,d));\n\n(a,(b,c),d);\r\n((a,c),b,d);\n";
+  os.close();
+  std::vector<pll_utree_t *> trees;
+  ParsingError error;
+  assert(custom_utree_parse_newick_file(file.c_str(), 0, trees, &error));
+  assert(trees.size() == 3);
+  for (auto tree: trees) {
+    checkIndices(tree);
+    pll_utree_destroy(tree, nullptr);
+  }
+  trees.clear();
+  assert(custom_utree_parse_newick_file(file.c_str(), 2, trees, &error));
+  assert(trees.size() == 2);
+  for (auto tree: trees) {
+    pll_utree_destroy(tree, nullptr);
+  }
+  trees.clear();
+  std::ofstream bad(file);
+  bad << "((a,b),(c,d));\n((a,b),(c,d);\n";
+  bad.close();
+  assert(!custom_utree_parse_newick_file(file.c_str(), 0, trees, &error));
+  assert(trees.empty());
+  assert(error.type == PET_INVALID_PARENTHESES);
+  std::cout << "[Test multiple trees]   OK" << std::endl;
+}
+
+static std::string getCaterpillarNewick(unsigned int taxa)
+{
+  std::string newick = "t0";
+  for (unsigned int i = 1; i < taxa; ++i) {
+    newick = "(" + newick + ":0.1,t" + std::to_string(i) + ":0.2)";
+  }
+  return newick + ";";
+}
+
+void benchmark()
+{
+  std::cerr << "[benchmark] generating newick strings..." << std::endl;
+  std::vector<std::string> newickStrings;
+  for (unsigned int i = 0; i < 100; ++i) {
+    newickStrings.push_back(getCaterpillarNewick(1000 + 10 * i));
+  }
+  unsigned int iterations = 10;
+  auto startCustom = std::chrono::high_resolution_clock::now();
+  for (unsigned int i = 0; i < iterations; ++i) {
+    for (auto &newick: newickStrings) {
+      ParsingError error;
+      auto tree = custom_utree_parse_newick(newick.c_str(), false, &error);
+      pll_utree_destroy(tree, nullptr);
+    }
+  }
+  auto elapsedCustom = std::chrono::high_resolution_clock::now() - startCustom;
+  auto startPLL = std::chrono::high_resolution_clock::now();
+  for (unsigned int i = 0; i < iterations; ++i) {
+    for (auto &newick: newickStrings) {
+      auto tree = pll_utree_parse_newick_string_unroot(newick.c_str());
+      pll_utree_destroy(tree, nullptr);
+    }
+  }
+  auto elapsedPLL = std::chrono::high_resolution_clock::now() - startPLL;
+  auto timePLL = std::chrono::duration_cast<std::chrono::milliseconds>(
+      elapsedPLL).count();
+  auto timeCustom = std::chrono::duration_cast<std::chrono::milliseconds>(
+      elapsedCustom).count();
+  std::cerr << "PLL parser: " << timePLL << "ms" << std::endl;
+  std::cerr << "Custom parser: " << timeCustom << "ms" << std::endl;
+}
+
+int main(int, char**)
+{
+  //benchmark();
+  test_good_trees();
+  test_bad_trees();
+  test_multiple_trees();
+  return 0;
+}
+